@@ -0,0 +1,396 @@
+//! The MIDI path of midimon, stage by stage and as a whole:
+//!
+//! ingress callback → `HostedMidiReceiver` ring → `MidiReceiverController::update`
+//! → `ScriptLoader::handle_midi` → `ScriptEvent::Midi` → `MidiMessageHistory` rows.
+//!
+//! The rates of the sustained runs are set with `AUD_BENCH_MIDI_RATES`, in
+//! messages per second separated by commas, and their duration in seconds
+//! with `AUD_BENCH_MIDI_SECONDS`.
+
+use aud::{
+    clock,
+    controllers::audio_midi::AudioMidiController,
+    lua::{imported, HostEvent, LuaRuntime, ScriptEvent, ScriptLoader},
+    midi::*,
+};
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+use messages::MidiMessageHistory;
+use std::{
+    cell::Cell,
+    path::PathBuf,
+    rc::Rc,
+    time::{Duration, Instant},
+};
+
+#[allow(dead_code)]
+#[path = "../src/ui/widgets/midi.rs"]
+mod messages;
+
+const DEVICE: &str = "synthetic";
+/// midimon drains the controller once per frame.
+const FRAME: Duration = Duration::from_micros(16_667);
+/// Number of rows midimon formats on a tall terminal.
+const NUM_ROWS: usize = 64;
+
+/// Scripts of increasing cost, each displaying every message.
+const SCRIPTS: [(&str, &str); 3] = [
+    ("forward", "function on_midi(_, bytes) return true end"),
+    (
+        "filter",
+        r#"
+        local notes = {}
+        function on_midi(device, bytes)
+            local status = bytes[1] & 0xF0
+            if status == 0x90 then
+                notes[bytes[2]] = bytes[3]
+            elseif status == 0x80 then
+                notes[bytes[2]] = nil
+            end
+            return device ~= nil
+        end
+        "#,
+    ),
+    (
+        "heavy",
+        r#"
+        function on_midi(_, bytes)
+            local sum = 0
+            for i = 1, 200 do
+                sum = sum + (bytes[2] * i) % 127
+            end
+            return sum >= 0
+        end
+        "#,
+    ),
+];
+
+fn note(i: u64, timestamp: u64) -> MidiData {
+    MidiData {
+        timestamp,
+        port: 0,
+        bytes: [0x90, (i % 128) as u8, 100].into(),
+    }
+}
+
+enum Pace {
+    /// Messages per second, stamped when they are due.
+    Rate(u64),
+    /// Messages produced at once on every call.
+    Burst(usize),
+}
+
+/// A device producing notes at a configurable pace.
+struct SyntheticMidiSource {
+    pace: Pace,
+    port: Option<MidiPortId>,
+    is_running: bool,
+    start: u64,
+    /// Shared with the bench, which cannot reach the source once boxed.
+    num_produced: Rc<Cell<u64>>,
+}
+
+impl SyntheticMidiSource {
+    fn new(pace: Pace) -> Self {
+        Self {
+            pace,
+            port: None,
+            is_running: true,
+            start: 0,
+            num_produced: Rc::default(),
+        }
+    }
+}
+
+impl MidiReceiving for SyntheticMidiSource {
+    fn is_midi_stream_active(&self) -> bool {
+        self.is_running
+    }
+
+    fn set_midi_stream_active(&mut self, should_be_active: bool) {
+        self.is_running = should_be_active;
+    }
+
+    fn list_midi_devices(&self) -> anyhow::Result<Vec<String>> {
+        Ok(vec![DEVICE.to_owned()])
+    }
+
+    fn connect_to_midi_device(&mut self, _: &str, port: MidiPortId) -> anyhow::Result<()> {
+        self.port = Some(port);
+        self.start = clock::now();
+        self.num_produced.set(0);
+        Ok(())
+    }
+
+    fn disconnect_from_midi_device(&mut self, _: &str) -> anyhow::Result<()> {
+        self.port = None;
+        Ok(())
+    }
+
+    fn produce_midi_messages(&mut self) -> Vec<MidiData> {
+        let Some(port) = self.port.filter(|_| self.is_running) else {
+            return vec![];
+        };
+
+        let messages: Vec<_> = match self.pace {
+            Pace::Rate(rate) => {
+                let num_due = (clock::now() - self.start) * rate / 1_000_000;
+                (self.num_produced.get()..num_due)
+                    .map(|i| note(i, self.start + i * 1_000_000 / rate))
+                    .collect()
+            }
+            Pace::Burst(len) => {
+                let now = clock::now();
+                (0..len as u64).map(|i| note(i, now)).collect()
+            }
+        };
+
+        self.num_produced
+            .set(self.num_produced.get() + messages.len() as u64);
+        messages
+            .into_iter()
+            .map(|midi| MidiData { port, ..midi })
+            .collect()
+    }
+}
+
+/// midimon running a script on the synthetic device, along
+/// with the number of messages produced by the device.
+fn start_midimon(pace: Pace, script: &str) -> (AudioMidiController, Rc<Cell<u64>>) {
+    let path: PathBuf = std::env::temp_dir().join(format!("aud_bench_{}.lua", std::process::id()));
+    std::fs::write(&path, script).unwrap();
+
+    let source = SyntheticMidiSource::new(pace);
+    let num_produced = source.num_produced.clone();
+    let mut app = AudioMidiController::with_midi(Box::new(source), imported::midimon::API);
+    app.load_script_sync(&path, Duration::from_secs(5)).unwrap();
+    app.midi_mut().connect_to_input(DEVICE).unwrap();
+    let _ = std::fs::remove_file(path);
+    (app, num_produced)
+}
+
+/// Messages received from the script, along with the time they took from
+/// the device, pushed to the history and formatted like a frame of midimon.
+fn drain_midimon(
+    app: &mut AudioMidiController,
+    history: &mut MidiMessageHistory,
+    latencies: &mut Vec<u64>,
+) {
+    app.process_script_events().unwrap();
+    let messages = app.midi_mut().take_messages();
+    let now = clock::now();
+    latencies.extend(
+        messages
+            .iter()
+            .map(|midi| now.saturating_sub(midi.timestamp)),
+    );
+
+    history.extend(messages);
+    for row in history.latest_rows(NUM_ROWS) {
+        black_box(row);
+    }
+}
+
+fn bench_ingress(c: &mut Criterion) {
+    let mut group = c.benchmark_group("MIDI Pipeline");
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("Ingress callback to ring", |b| {
+        let (mut callback, mut consumer, _) = test_make_midi_input_callback(0, 4096);
+        b.iter(|| {
+            callback(black_box(&[0x90, 60, 100]));
+            consumer.pop()
+        });
+    });
+    group.finish();
+}
+
+fn bench_handle_midi(c: &mut Criterion) {
+    let mut group = c.benchmark_group("MIDI Pipeline");
+    group.throughput(Throughput::Elements(1));
+
+    for (name, script) in SCRIPTS {
+        let (script_tx, script_rx) = crossbeam::channel::unbounded();
+        let (_host_tx, host_rx) = crossbeam::channel::unbounded();
+        let mut loader = ScriptLoader::new(script_tx, host_rx, imported::midimon::API);
+        let mut lua = LuaRuntime::default();
+
+        let load = HostEvent::LoadScript {
+            name: name.to_owned(),
+            chunk: script.to_owned(),
+        };
+        loader.handle_event(&mut lua, load).unwrap();
+        let connect = HostEvent::ConnectMidi(0, DEVICE.to_owned());
+        loader.handle_event(&mut lua, connect).unwrap();
+
+        group.bench_function(format!("Script {name} handling a message"), |b| {
+            let mut i = 0;
+            b.iter(|| {
+                i += 1;
+                let midi = HostEvent::Midi(note(i, i));
+                loader.handle_event(&mut lua, midi).unwrap();
+                script_rx
+                    .try_iter()
+                    .filter(|event| matches!(event, ScriptEvent::Midi(_)))
+                    .count()
+            });
+        });
+    }
+
+    group.finish();
+}
+
+fn bench_format(c: &mut Criterion) {
+    let mut group = c.benchmark_group("MIDI Pipeline");
+    group.throughput(Throughput::Elements(NUM_ROWS as u64));
+    group.bench_function(format!("Formatting {NUM_ROWS} new rows"), |b| {
+        let mut history = MidiMessageHistory::default();
+        let mut i = 0;
+        b.iter(|| {
+            history.extend((i..i + NUM_ROWS as u64).map(|i| note(i, i)));
+            i += NUM_ROWS as u64;
+            for row in history.latest_rows(NUM_ROWS) {
+                black_box(row);
+            }
+        });
+    });
+    group.finish();
+}
+
+/// A frame of messages through the controller, the engine
+/// thread running the script, and back to the formatting.
+fn bench_frame(c: &mut Criterion) {
+    const FRAME_LEN: usize = 256;
+    /// A script dropping messages would otherwise never fill the frame.
+    const FRAME_TIMEOUT: Duration = Duration::from_secs(1);
+
+    let mut group = c.benchmark_group("MIDI Pipeline");
+    group.throughput(Throughput::Elements(FRAME_LEN as u64));
+
+    for (name, script) in SCRIPTS {
+        let (mut app, _) = start_midimon(Pace::Burst(FRAME_LEN), script);
+        let mut history = MidiMessageHistory::default();
+        let mut latencies = Vec::with_capacity(FRAME_LEN);
+
+        group.bench_function(format!("Frame of {FRAME_LEN} through {name}"), |b| {
+            b.iter(|| {
+                latencies.clear();
+                app.midi_mut().update();
+                let deadline = Instant::now() + FRAME_TIMEOUT;
+                while latencies.len() < FRAME_LEN && Instant::now() < deadline {
+                    drain_midimon(&mut app, &mut history, &mut latencies);
+                }
+            });
+        });
+    }
+
+    group.finish();
+}
+
+struct SustainedRun {
+    num_produced: u64,
+    num_received: u64,
+    latencies: Vec<u64>,
+}
+
+impl SustainedRun {
+    /// No message was lost and the app kept up, the
+    /// latency staying within a few frames.
+    fn is_sustained(&self) -> bool {
+        let max_latency = self.latencies.iter().max().copied().unwrap_or(0);
+        self.num_received == self.num_produced && max_latency < 4 * FRAME.as_micros() as u64
+    }
+
+    fn percentile(&mut self, percentile: usize) -> u64 {
+        if self.latencies.is_empty() {
+            return 0;
+        }
+
+        self.latencies.sort_unstable();
+        let index = (self.latencies.len() * percentile / 100).min(self.latencies.len() - 1);
+        self.latencies[index]
+    }
+}
+
+/// Run midimon frame by frame on the synthetic device at `rate`.
+fn run_sustained(rate: u64, script: &str, duration: Duration) -> SustainedRun {
+    let (mut app, num_produced) = start_midimon(Pace::Rate(rate), script);
+    let mut history = MidiMessageHistory::default();
+    let mut latencies = Vec::with_capacity((rate * duration.as_secs().max(1)) as usize);
+
+    let start = Instant::now();
+    let mut next_frame = start;
+    while start.elapsed() < duration {
+        next_frame += FRAME;
+        std::thread::sleep(next_frame.saturating_duration_since(Instant::now()));
+        app.midi_mut().update();
+        drain_midimon(&mut app, &mut history, &mut latencies);
+    }
+
+    app.midi_mut().set_running(false);
+    let drain_start = Instant::now();
+    while drain_start.elapsed() < 10 * FRAME {
+        std::thread::sleep(FRAME);
+        drain_midimon(&mut app, &mut history, &mut latencies);
+    }
+
+    SustainedRun {
+        num_produced: num_produced.get(),
+        num_received: latencies.len() as u64,
+        latencies,
+    }
+}
+
+/// The latency of messages from the device to the display at increasing
+/// rates, up to the first one a script does not sustain, and the highest
+/// rate it sustains.
+fn bench_sustained_rate(_: &mut Criterion) {
+    let mut rates: Vec<u64> = std::env::var("AUD_BENCH_MIDI_RATES")
+        .unwrap_or_else(|_| "1000,10000,50000,100000".to_owned())
+        .split(',')
+        .filter_map(|rate| rate.trim().parse().ok())
+        .collect();
+    rates.sort_unstable();
+
+    let duration = std::env::var("AUD_BENCH_MIDI_SECONDS")
+        .ok()
+        .and_then(|seconds| seconds.parse().ok())
+        .map_or(Duration::from_secs(2), Duration::from_secs_f64);
+
+    println!("MIDI Pipeline/Sustained rate");
+    println!("  script     msg/s   received   lost   p50 µs   p99 µs   max µs");
+
+    for (name, script) in SCRIPTS {
+        let mut max_sustained = None;
+
+        for &rate in &rates {
+            let mut run = run_sustained(rate, script, duration);
+            println!(
+                "  {name:<8} {rate:>7} {:>10} {:>6} {:>8} {:>8} {:>8}",
+                run.num_received,
+                run.num_produced.saturating_sub(run.num_received),
+                run.percentile(50),
+                run.percentile(99),
+                run.percentile(100),
+            );
+
+            if !run.is_sustained() {
+                break;
+            }
+            max_sustained = Some(rate);
+        }
+
+        match max_sustained {
+            Some(rate) => println!("  {name} sustains {rate} msg/s"),
+            None => println!("  {name} sustains none of the rates"),
+        }
+    }
+}
+
+criterion_group!(
+    midi_pipeline,
+    bench_ingress,
+    bench_handle_midi,
+    bench_format,
+    bench_frame,
+    bench_sustained_rate
+);
+criterion_main!(midi_pipeline);
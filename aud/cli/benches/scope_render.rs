@@ -0,0 +1,60 @@
+//! Rendering of the auscope scope into the buffer of a frame, on
+//! terminals of increasing width, with every channel of the history.
+
+use aud::audio::{AudioBuffer, AudioHistory};
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+use ratatui::{buffer::Buffer, layout::Rect, widgets::Widget};
+
+#[allow(dead_code)]
+#[path = "../src/ui/widgets/scope.rs"]
+mod scope;
+
+const SAMPLE_RATE: u32 = 48_000;
+const NUM_CHANNELS: usize = 2;
+/// Rows of the scope on a tall terminal.
+const HEIGHT: u16 = 48;
+
+fn history() -> AudioHistory {
+    let num_frames = SAMPLE_RATE as usize;
+    let mut history = AudioHistory::new(NUM_CHANNELS, num_frames);
+    history.push(&AudioBuffer {
+        data: (0..num_frames * NUM_CHANNELS)
+            .map(|i| {
+                let frame = (i / NUM_CHANNELS) as f32;
+                (frame * 440. * std::f32::consts::TAU / SAMPLE_RATE as f32).sin()
+            })
+            .collect(),
+        num_channels: NUM_CHANNELS as u32,
+        timestamp: 0,
+    });
+    history
+}
+
+fn bench_render(c: &mut Criterion) {
+    let audio = history();
+
+    let mut group = c.benchmark_group("Scope");
+    for width in [80, 200, 400, 800] {
+        let area = Rect::new(0, 0, width, HEIGHT);
+        let mut buf = Buffer::empty(area);
+        group.throughput(Throughput::Elements(area.area() as u64));
+
+        for downsample in [1, 16] {
+            group.bench_function(
+                format!("Render {width} columns at zoom {downsample}"),
+                |b| {
+                    b.iter(|| {
+                        buf.reset();
+                        scope::Scope::new(black_box(&audio))
+                            .downsample(downsample)
+                            .render(area, &mut buf);
+                    })
+                },
+            );
+        }
+    }
+    group.finish();
+}
+
+criterion_group!(scope_render, bench_render);
+criterion_main!(scope_render);
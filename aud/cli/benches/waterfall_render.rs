@@ -0,0 +1,59 @@
+//! Frames of the auscope spectrogram drawn at 60 fps, each after the
+//! frames of audio received since the previous one, and the frame after
+//! a stall of a second. A frame has to stay well below 16.7 ms to keep up.
+
+use aud::audio::{AudioBuffer, AudioHistory};
+use criterion::{black_box, criterion_group, criterion_main, Criterion};
+use ratatui::{backend::TestBackend, Terminal};
+use std::time::Duration;
+
+#[allow(dead_code)]
+#[path = "../src/ui/widgets/waterfall.rs"]
+mod waterfall;
+
+const SAMPLE_RATE: u32 = 48_000;
+const FPS: u32 = 60;
+/// Rows of the spectrogram on a tall terminal.
+const HEIGHT: u16 = 48;
+
+/// A sine sweeping the spectrum, to color every row over time.
+fn audio(duration: Duration) -> AudioBuffer {
+    let num_frames = (SAMPLE_RATE as f64 * duration.as_secs_f64()) as usize;
+    AudioBuffer {
+        data: (0..num_frames)
+            .map(|i| {
+                let t = i as f32 / SAMPLE_RATE as f32;
+                (t * (100. + 10_000. * t) * std::f32::consts::TAU).sin()
+            })
+            .collect(),
+        num_channels: 1,
+        timestamp: 0,
+    }
+}
+
+fn bench_render(c: &mut Criterion) {
+    let frame = audio(Duration::from_secs(1) / FPS);
+    let stall = audio(Duration::from_secs(1));
+
+    let mut group = c.benchmark_group("Waterfall");
+    for width in [80, 200, 400] {
+        let mut terminal = Terminal::new(TestBackend::new(width, HEIGHT)).unwrap();
+        let mut history = AudioHistory::with_duration(1, SAMPLE_RATE, Duration::from_secs(2));
+        let mut waterfall = waterfall::Waterfall::default();
+
+        for (name, audio) in [("frame at 60 fps", &frame), ("frame after a stall", &stall)] {
+            group.bench_function(format!("Draw {width} columns, {name}"), |b| {
+                b.iter(|| {
+                    history.push(black_box(audio));
+                    terminal
+                        .draw(|f| waterfall.render(f, f.size(), "", &history, SAMPLE_RATE))
+                        .unwrap();
+                })
+            });
+        }
+    }
+    group.finish();
+}
+
+criterion_group!(waterfall_render, bench_render);
+criterion_main!(waterfall_render);
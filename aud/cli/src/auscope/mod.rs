@@ -1,5 +1,6 @@
 mod ui;
 
+use crate::ui::widgets::waterfall::ColorMap;
 use aud::{
     audio::*,
     comms::Sockets,
@@ -11,20 +12,31 @@ use aud::{
     lua::imported,
 };
 use ratatui::prelude::*;
-use std::net::UdpSocket;
+use std::{
+    net::UdpSocket,
+    time::{Duration, Instant},
+};
 
 struct TerminalApp {
     app: AudioMidiController,
     ui: ui::Ui,
-    fps: f32,
+    /// Whether audio or script events were received since the last frame.
+    is_dirty: bool,
+    pipeline: crate::frame_stats::Pipeline,
 }
 
 impl TerminalApp {
-    fn new(audio_provider: Box<dyn AudioProvider>, fps: f32) -> Self {
-        let app = AudioMidiController::with_audio(audio_provider, imported::auscope::API);
+    fn new(audio_provider: Box<dyn AudioProvider>, history: Duration) -> Self {
+        let mut app = AudioMidiController::with_audio(audio_provider, imported::auscope::API);
+        app.audio_mut().set_history_duration(history);
         let mut ui = ui::Ui::default();
         ui.update_device_names(app.audio().devices());
-        Self { app, ui, fps }
+        Self {
+            app,
+            ui,
+            is_dirty: true,
+            pipeline: Default::default(),
+        }
     }
 
     fn try_connect_to_audio_input(&mut self, index: usize) -> anyhow::Result<()> {
@@ -42,15 +54,35 @@ impl TerminalApp {
 
 impl crate::app::Base for TerminalApp {
     fn update(&mut self) -> anyhow::Result<crate::app::Flow> {
-        self.app.audio_mut().update()?;
-        self.app.process_engine_events()?;
+        let started = Instant::now();
+        let position = self.app.audio().history().position();
+        self.is_dirty |= self.app.audio_mut().update()?;
+        self.pipeline = crate::frame_stats::Pipeline {
+            prep: started.elapsed(),
+            received: self
+                .app
+                .audio()
+                .history()
+                .position()
+                .saturating_sub(position) as usize,
+        };
 
-        if self.app.process_script_events()? == AppEvent::Stopping {
-            return Ok(crate::app::Flow::Exit);
+        self.is_dirty |= self.app.process_engine_events()? != AppEvent::Continue;
+
+        match self.app.process_script_events()? {
+            AppEvent::Stopping => return Ok(crate::app::Flow::Exit),
+            AppEvent::ScriptLoaded => self.is_dirty = true,
+            _ => (),
         }
 
         if self.app.process_file_events()? == AppEvent::ScriptLoaded {
             self.ui.clear_script_cache();
+            self.is_dirty = true;
+        }
+
+        if let Some(alert) = self.app.take_alert() {
+            self.ui.show_alert_message(&alert);
+            self.is_dirty = true;
         }
 
         Ok(crate::app::Flow::Continue)
@@ -77,14 +109,17 @@ impl crate::app::Base for TerminalApp {
         }
     }
 
-    fn render(&mut self, f: &mut Frame) {
-        if let Some(alert) = self.app.take_alert() {
-            self.ui.show_alert_message(&alert);
-        }
+    fn is_dirty(&self) -> bool {
+        self.is_dirty || self.ui.shows_live_data()
+    }
 
+    fn pipeline(&self) -> crate::frame_stats::Pipeline {
+        self.pipeline
+    }
+
+    fn render(&mut self, f: &mut Frame) {
         self.ui.render(f, &self.app);
-        self.ui
-            .remove_offscreen_samples(&mut self.app, f.size().width as usize, self.fps);
+        self.is_dirty = false;
     }
 }
 
@@ -99,6 +134,22 @@ pub struct Options {
     #[arg(long, default_value_t = 30.)]
     fps: f32,
 
+    /// Seconds of audio kept for display, which bounds the zoom
+    #[arg(long, default_value_t = 10.)]
+    history: f32,
+
+    /// Colors of the spectrogram
+    #[arg(long, value_enum, default_value_t = ColorMap::Heat)]
+    colormap: ColorMap,
+
+    /// Level shown in the lowest color of the spectrogram, in dB
+    #[arg(long, default_value_t = -90., allow_negative_numbers = true)]
+    min_db: f32,
+
+    /// Level shown in the highest color of the spectrogram, in dB
+    #[arg(long, default_value_t = 0., allow_negative_numbers = true)]
+    max_db: f32,
+
     /// Path to scripts to view or default script to run
     #[arg(long)]
     script: Option<std::path::PathBuf>,
@@ -117,7 +168,10 @@ pub struct Options {
     ports: String,
 }
 
-fn create_remote_audio_provider(address: String, ports: String) -> Box<dyn AudioProvider> {
+pub(crate) fn create_remote_audio_provider(
+    address: String,
+    ports: String,
+) -> Box<dyn AudioProvider> {
     let (in_port, out_port) = ports.split_at(
         ports
             .find(|c| c == ',')
@@ -141,13 +195,27 @@ pub fn run(
         crate::logger::start("auscope", log_file, common_opts.verbose)?;
     }
 
+    if opts.min_db >= opts.max_db {
+        anyhow::bail!(
+            "Invalid spectrogram range, {} dB is not below {} dB",
+            opts.min_db,
+            opts.max_db
+        );
+    }
+
     let audio_provider = if opts.remote {
         create_remote_audio_provider(opts.address, opts.ports)
     } else {
         Box::<HostAudioInput>::default()
     };
 
-    let mut app = TerminalApp::new(audio_provider, opts.fps);
+    let mut app = TerminalApp::new(
+        audio_provider,
+        Duration::from_secs_f32(opts.history.max(0.)),
+    );
+
+    app.ui
+        .configure_waterfall(opts.colormap, opts.min_db..opts.max_db);
 
     let scripts = opts
         .script
@@ -8,6 +8,9 @@ const USAGE: &str = r#"
          a : display API
          s : display script
          d : display docs
+         t : display telemetry
+         w : display spectrogram
+         c : cycle spectrogram colors
          K : increase gain
          J : decrease gain
          H : zoom out
@@ -18,6 +21,8 @@ const USAGE: &str = r#"
 <RIGHT>, l : cycle panes right
      Enter : confirm selection
   <ESC>, q : quit or hide help
+        F2 : display frame times
+        F3 : log frame times
      <C-c> : force quit
 "#;
 
@@ -52,6 +57,9 @@ pub struct Ui {
     cached_script: Option<String>,
     downsample: usize,
     gain: f32,
+    show_telemetry: bool,
+    waterfall: widgets::waterfall::Waterfall,
+    show_waterfall: bool,
 }
 
 impl Default for Ui {
@@ -71,13 +79,14 @@ impl Default for Ui {
             cached_script: None,
             downsample: 16,
             gain: 1.,
+            show_telemetry: false,
+            waterfall: widgets::waterfall::Waterfall::default(),
+            show_waterfall: false,
         }
     }
 }
 
 impl Ui {
-    const SAMPLE_RATE: usize = 48000;
-
     pub fn scripts(&self) -> &[String] {
         self.script_names.as_slice()
     }
@@ -100,6 +109,21 @@ impl Ui {
         Ok(())
     }
 
+    /// Whether a pane showing data that changes without events is visible.
+    pub fn shows_live_data(&self) -> bool {
+        self.show_telemetry
+    }
+
+    /// Colors of the spectrogram, and the levels in dB they span.
+    pub fn configure_waterfall(
+        &mut self,
+        color_map: widgets::waterfall::ColorMap,
+        db_range: std::ops::Range<f32>,
+    ) {
+        self.waterfall.set_color_map(color_map);
+        self.waterfall.set_db_range(db_range);
+    }
+
     pub fn update_device_names(&mut self, names: &[AudioDevice]) {
         if let Some(devices) = self.selectors.get_mut(Selector::Device) {
             *devices = components::Selector::with_len(names.len());
@@ -120,6 +144,11 @@ impl Ui {
             KeyCode::Char('a') => self.popups.toggle_visible(Popup::Api),
             KeyCode::Char('s') => self.popups.toggle_visible(Popup::Script),
             KeyCode::Char('d') => self.popups.toggle_visible(Popup::Docs),
+            KeyCode::Char('t') => self.show_telemetry = !self.show_telemetry,
+            KeyCode::Char('w') => self.show_waterfall = !self.show_waterfall,
+            KeyCode::Char('c') => self
+                .waterfall
+                .set_color_map(self.waterfall.color_map().next()),
             KeyCode::Char('q') | KeyCode::Esc => {
                 if !self.popups.any_visible() {
                     return UiEvent::Exit;
@@ -218,11 +247,55 @@ impl Ui {
             crate::title!("gain : {:.2}", self.gain),
         );
 
+        let scope_section = if self.show_telemetry {
+            let right_sections = Layout::default()
+                .direction(Direction::Vertical)
+                .constraints([Constraint::Percentage(70), Constraint::Percentage(30)])
+                .split(sections[1]);
+
+            widgets::telemetry::render(
+                f,
+                right_sections[1],
+                crate::title!("telemetry"),
+                &app.telemetry(),
+            );
+
+            right_sections[0]
+        } else {
+            sections[1]
+        };
+
+        let scope_section = if self.show_waterfall {
+            let scope_sections = Layout::default()
+                .direction(Direction::Vertical)
+                .constraints([Constraint::Percentage(50), Constraint::Percentage(50)])
+                .split(scope_section);
+
+            let db_range = self.waterfall.db_range();
+            let waterfall_title = format!(
+                "{}───{}",
+                crate::title!("spectrogram : {}", self.waterfall.color_map().name()),
+                crate::title!("{} dB to {} dB", db_range.start, db_range.end),
+            );
+
+            self.waterfall.render(
+                f,
+                scope_sections[1],
+                &waterfall_title,
+                app.audio().history(),
+                app.audio().sample_rate(),
+            );
+
+            scope_sections[0]
+        } else {
+            scope_section
+        };
+
         widgets::scope::render(
             f,
-            sections[1],
+            scope_section,
             &scope_tile,
-            app.audio().buffer(),
+            app.audio().history(),
             self.downsample,
             self.gain,
         );
@@ -276,23 +349,4 @@ impl Ui {
             self.cached_script.as_ref().unwrap(),
         );
     }
-
-    pub fn remove_offscreen_samples(
-        &mut self,
-        app: &mut AudioMidiController,
-        screen_width: usize,
-        fps: f32,
-    ) {
-        let audio = app.audio_mut().buffer_mut();
-        let num_renderable_samples = screen_width * self.downsample;
-        let num_samples_to_purge =
-            ((Self::SAMPLE_RATE as f32 / fps) * audio.num_channels as f32) as usize;
-
-        if audio.data.len() > num_renderable_samples {
-            let num_samples_to_purge =
-                num_samples_to_purge.max(audio.data.len() - num_renderable_samples);
-
-            let _ = audio.data.drain(0..num_samples_to_purge);
-        }
-    }
 }
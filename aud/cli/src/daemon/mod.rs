@@ -0,0 +1,539 @@
+use aud::{
+    audio::{AudioChannelSelection, AudioHistory, HostAudioInput},
+    clock,
+    controllers::{
+        audio::AudioProvider,
+        audio_midi::AudioMidiController,
+        worker::{AudioMidiEvent, AudioMidiWorker},
+    },
+    lua::{imported, DaemonConfig},
+    midi::{
+        HostedMidiReceiver, MidiMessageKind, MidiReceiving, MidiStatsSnapshot, PlaybackSpeed,
+        SmfPlayer,
+    },
+};
+use crossbeam::channel::Receiver;
+use std::{
+    net::{SocketAddr, UdpSocket},
+    path::{Path, PathBuf},
+    time::{Duration, Instant},
+};
+
+#[derive(Debug, clap::Parser)]
+pub struct Options {
+    /// Lua file returning the configuration of the pipeline
+    config: PathBuf,
+
+    /// Path to log file to write to. Defaults
+    /// to system log file at ~/.aud/log/daemon.log
+    #[arg(long)]
+    log: Option<PathBuf>,
+}
+
+const USAGE: &str = "status | metrics | load <script> | connect <input> | disconnect <input> \
+    | record [file] | stop-recording | pause | resume | stop";
+
+/// Commands run on the worker are answered within this time.
+const REPLY_TIMEOUT: Duration = Duration::from_secs(5);
+
+/// An audio input missing from the devices is looked for again this often.
+const RETRY_INTERVAL: Duration = Duration::from_secs(1);
+
+/// Largest command received on the control socket.
+const MAX_REQUEST_LEN: usize = 1024;
+
+/// Longest wait after failing to receive a command, the
+/// wait doubles with every failure until a command is received.
+const MAX_RECEIVE_BACKOFF: Duration = Duration::from_secs(1);
+
+struct Daemon {
+    worker: AudioMidiWorker,
+    config: DaemonConfig,
+    /// Directory of the configuration, which scripts can also be loaded from.
+    config_dir: PathBuf,
+    audio_device: Option<String>,
+    /// Stats of each port when the metrics were last logged.
+    logged_stats: Vec<(String, MidiStatsSnapshot)>,
+    /// Stats of each port when the metrics were last queried.
+    queried_stats: Vec<(String, MidiStatsSnapshot)>,
+    started: Instant,
+}
+
+impl Daemon {
+    fn start(config: DaemonConfig, config_dir: PathBuf) -> anyhow::Result<Self> {
+        let worker = AudioMidiWorker::spawn(config.interval, {
+            let config = config.clone();
+            move || build_controller(config)
+        })?;
+
+        let mut daemon = Self {
+            worker,
+            config,
+            config_dir,
+            audio_device: None,
+            logged_stats: vec![],
+            queried_stats: vec![],
+            started: Instant::now(),
+        };
+
+        daemon.try_connect_to_audio_input()?;
+        if let (None, Some(device)) = (&daemon.audio_device, &daemon.config.audio) {
+            log::warn!("[ DAEMON ] : waiting for the audio input {device}");
+        }
+
+        Ok(daemon)
+    }
+
+    /// Run a query on the controller, on the worker, and wait for its result.
+    /// Errors are returned to the caller rather than stopping the worker.
+    fn query<R: Send + 'static>(
+        &self,
+        query: impl FnOnce(&mut AudioMidiController) -> anyhow::Result<R> + Send + 'static,
+    ) -> anyhow::Result<R> {
+        let (reply_tx, reply_rx) = crossbeam::channel::bounded(1);
+        self.worker.send(move |app| {
+            let _ = reply_tx.send(query(app));
+            Ok(())
+        })?;
+
+        reply_rx
+            .recv_timeout(REPLY_TIMEOUT)
+            .map_err(|_| anyhow::anyhow!("the worker did not reply in time"))?
+    }
+
+    fn try_connect_to_audio_input(&mut self) -> anyhow::Result<()> {
+        let Some(name) = self.config.audio.clone() else {
+            return Ok(());
+        };
+
+        let channels = match self.config.channels.as_slice() {
+            [] => AudioChannelSelection::Mono(0),
+            [channel] => AudioChannelSelection::Mono(*channel),
+            channels => AudioChannelSelection::Multi(channels.to_vec()),
+        };
+
+        let is_connected = self.query({
+            let name = name.clone();
+            move |app| {
+                let Some(device) = app.audio().devices().iter().find(|d| d.name == name) else {
+                    return Ok(false);
+                };
+                let device = device.clone();
+                app.audio_mut().connect_to_input(&device, channels)?;
+                Ok(true)
+            }
+        })?;
+
+        if is_connected {
+            log::info!("[ DAEMON ] : connected to the audio input {name}");
+            self.audio_device = Some(name);
+        }
+        Ok(())
+    }
+
+    fn run(
+        &mut self,
+        socket: &UdpSocket,
+        requests: &Receiver<(String, SocketAddr)>,
+    ) -> anyhow::Result<()> {
+        let events = self.worker.events().clone();
+        let mut next_metrics = self
+            .config
+            .metrics
+            .map(|interval| Instant::now() + interval);
+        let mut next_retry = Instant::now() + RETRY_INTERVAL;
+
+        loop {
+            let now = Instant::now();
+            let is_waiting_for_audio = self.config.audio.is_some() && self.audio_device.is_none();
+            if is_waiting_for_audio && now >= next_retry {
+                self.try_connect_to_audio_input()?;
+                next_retry = now + RETRY_INTERVAL;
+            }
+
+            if let (Some(next), Some(interval)) = (next_metrics, self.config.metrics) {
+                if now >= next {
+                    self.metrics(true)?
+                        .lines()
+                        .for_each(|line| log::info!("[ METRICS ] : {line}"));
+                    next_metrics = Some(now + interval);
+                }
+            }
+
+            let deadline = [next_metrics, is_waiting_for_audio.then_some(next_retry)]
+                .into_iter()
+                .flatten()
+                .min()
+                .unwrap_or(now + REPLY_TIMEOUT);
+
+            crossbeam::select! {
+                recv(events) -> event => match event? {
+                    AudioMidiEvent::Midi(_) => (),
+                    AudioMidiEvent::Alert(alert) => log::warn!("[ DAEMON ] : {alert}"),
+                    AudioMidiEvent::ScriptLoaded => log::info!("[ DAEMON ] : script loaded"),
+                    AudioMidiEvent::ScriptCrash => log::error!("[ DAEMON ] : the script crashed"),
+                    AudioMidiEvent::Stopping => return Ok(()),
+                    AudioMidiEvent::Failed(e) => anyhow::bail!(e),
+                },
+                recv(requests) -> request => {
+                    let (request, from) = request?;
+                    let request = request.trim();
+                    let reply = match self.handle_request(request) {
+                        Ok(reply) => reply,
+                        Err(e) => format!("error : {e}"),
+                    };
+                    if let Err(e) = socket.send_to(reply.as_bytes(), from) {
+                        log::error!("[ DAEMON ] : failed to reply to {from} : {e}");
+                    }
+
+                    if request == "stop" {
+                        log::info!("[ DAEMON ] : stopped by {from}");
+                        return Ok(());
+                    }
+                },
+                default(deadline.saturating_duration_since(Instant::now())) => (),
+            }
+        }
+    }
+
+    fn handle_request(&mut self, request: &str) -> anyhow::Result<String> {
+        let (command, argument) = match request.split_once(' ') {
+            Some((command, argument)) => (command, Some(argument.trim().to_owned())),
+            None => (request, None),
+        };
+        let argument = || {
+            argument
+                .clone()
+                .ok_or_else(|| anyhow::anyhow!("usage : {USAGE}"))
+        };
+
+        match command {
+            "status" => Ok(self.status()),
+            "metrics" => self.metrics(false),
+            "load" => {
+                let script = self.script_path(&argument()?)?;
+                self.query(move |app| app.load_script(script).map(|_| ()))?;
+                Ok("loading".to_owned())
+            }
+            "connect" => {
+                let input = argument()?;
+                self.query(move |app| app.midi_mut().connect_to_input(&input))?;
+                Ok("connected".to_owned())
+            }
+            "disconnect" => {
+                let input = argument()?;
+                self.query(move |app| app.midi_mut().disconnect_from_input(&input))?;
+                Ok("disconnected".to_owned())
+            }
+            "record" => {
+                let path = recording_path(argument().ok().as_deref())?;
+                let reply = format!("recording to {}", path.display());
+                self.query(move |app| app.midi_mut().start_recording(path))?;
+                Ok(reply)
+            }
+            "stop-recording" => {
+                self.query(|app| app.midi_mut().stop_recording())?;
+                Ok("stopped recording".to_owned())
+            }
+            "pause" | "resume" => {
+                let run = command == "resume";
+                self.query(move |app| {
+                    app.midi_mut().set_running(run);
+                    Ok(())
+                })?;
+                Ok(command.to_owned())
+            }
+            "stop" => Ok("stopping".to_owned()),
+            _ => anyhow::bail!("unknown command {command}, usage : {USAGE}"),
+        }
+    }
+
+    /// Any local user can send commands, so scripts, which can run
+    /// anything, are only loaded from the directory of the configuration
+    /// and from the Lua directory of aud.
+    fn script_path(&self, script: &str) -> anyhow::Result<PathBuf> {
+        let dirs = [Some(self.config_dir.clone()), crate::locations::lua()];
+        for dir in dirs.iter().flatten() {
+            if let Ok(path) = path_within(dir, script) {
+                return Ok(path);
+            }
+        }
+
+        anyhow::bail!(
+            "no script {script} in {}",
+            dirs.iter()
+                .flatten()
+                .map(|dir| dir.display().to_string())
+                .collect::<Vec<_>>()
+                .join(" or ")
+        )
+    }
+
+    fn status(&mut self) -> String {
+        self.worker.update_snapshot();
+        let snapshot = self.worker.snapshot();
+        let uptime = Duration::from_secs(self.started.elapsed().as_secs());
+
+        let mut status = vec![
+            format!("uptime    : {}", humantime::format_duration(uptime)),
+            format!(
+                "script    : {}",
+                snapshot.selected_script.as_deref().unwrap_or("none")
+            ),
+            format!("running   : {}", snapshot.is_running),
+            format!("inputs    : {}", snapshot.connected_ports.join(", ")),
+            format!(
+                "audio     : {}",
+                self.audio_device.as_deref().unwrap_or("none")
+            ),
+            format!("dropped   : {}", snapshot.dropped_messages),
+        ];
+
+        if let Some(num_recorded) = snapshot.num_recorded {
+            status.push(format!("recorded  : {num_recorded}"));
+        }
+
+        status.join("\n")
+    }
+
+    /// The traffic of each port since the metrics were last logged if `log`,
+    /// or since they were last queried otherwise, or since the start, and
+    /// the level of the audio in the history.
+    fn metrics(&mut self, log: bool) -> anyhow::Result<String> {
+        let now = clock::now();
+        let mut metrics = vec![];
+        let since_start = MidiStatsSnapshot::default();
+        let baselines = match log {
+            true => &mut self.logged_stats,
+            false => &mut self.queried_stats,
+        };
+
+        for port in self.worker.midi_stats().ports() {
+            let latest = port.snapshot(now);
+            let baseline = baselines
+                .iter_mut()
+                .find(|(name, _)| *name == port.device_name);
+
+            let since = baseline.as_deref().map_or(&since_start, |(_, since)| since);
+            let rate: f64 = MidiMessageKind::ALL
+                .into_iter()
+                .map(|kind| latest.rate_since(since, kind, None))
+                .sum();
+
+            metrics.push(format!(
+                "{} : {} messages, {rate:.1}/s, sysex {} B",
+                port.device_name, latest.num_messages, latest.sysex_bytes
+            ));
+
+            match baseline {
+                Some((_, since)) => *since = latest,
+                None => baselines.push((port.device_name.clone(), latest)),
+            }
+        }
+
+        if let Some(device) = &self.audio_device {
+            let levels = self.query(|app| Ok(audio_levels(app.audio().history())))?;
+            for (channel, (peak, rms)) in levels.into_iter().enumerate() {
+                metrics.push(format!(
+                    "{device} ch {} : peak {:.1} dBFS, rms {:.1} dBFS",
+                    channel + 1,
+                    decibels(peak),
+                    decibels(rms)
+                ));
+            }
+        }
+
+        self.worker.update_snapshot();
+        let snapshot = self.worker.snapshot();
+        metrics.push(format!("dropped : {}", snapshot.dropped_messages));
+        if let Some(num_recorded) = snapshot.num_recorded {
+            metrics.push(format!("recorded : {num_recorded}"));
+        }
+
+        Ok(metrics.join("\n"))
+    }
+}
+
+fn build_controller(config: DaemonConfig) -> anyhow::Result<AudioMidiController> {
+    let audio_in: Box<dyn AudioProvider> = match config.remote {
+        Some(remote) => crate::auscope::create_remote_audio_provider(remote.address, remote.ports),
+        None => Box::<HostAudioInput>::default(),
+    };
+
+    let midi_in: Box<dyn MidiReceiving> = match config.play {
+        Some(ref file) => Box::new(SmfPlayer::open(file, PlaybackSpeed::Realtime)?),
+        None => Box::<HostedMidiReceiver>::default(),
+    };
+
+    let has_midi = config.play.is_some() || !config.midi.is_empty();
+    let api = match has_midi {
+        true => imported::midimon::API,
+        false => imported::auscope::API,
+    };
+
+    let mut app = AudioMidiController::new(audio_in, midi_in, api);
+    app.midi_mut().set_max_sysex_len(config.max_sysex);
+    if !config.routes.is_empty() {
+        app.midi_mut().set_routes(config.routes)?;
+    }
+
+    let inputs = match config.play {
+        Some(_) => app.midi().port_names().to_vec(),
+        None => config.midi,
+    };
+
+    for input in inputs {
+        app.midi_mut().connect_to_input(&input)?;
+        log::info!("[ DAEMON ] : connected to the MIDI input {input}");
+    }
+
+    if let Some(path) = config.record {
+        log::info!("[ DAEMON ] : recording to {}", path.display());
+        app.midi_mut().start_recording(path)?;
+    }
+
+    if let Some(script) = config.script {
+        log::info!("[ DAEMON ] : loading {}", script.display());
+        app.load_script(script)?;
+    }
+
+    Ok(app)
+}
+
+/// Peak and RMS of each channel of the history.
+fn audio_levels(history: &AudioHistory) -> Vec<(f32, f32)> {
+    (0..history.num_channels())
+        .map(|channel| {
+            let (older, newer) = history.latest(channel, history.num_frames());
+            let (peak, sum) = older
+                .iter()
+                .chain(newer)
+                .fold((0f32, 0f64), |(peak, sum), sample| {
+                    (peak.max(sample.abs()), sum + (*sample as f64).powi(2))
+                });
+
+            let rms = match history.num_frames() {
+                0 => 0.,
+                num_frames => (sum / num_frames as f64).sqrt() as f32,
+            };
+            (peak, rms)
+        })
+        .collect()
+}
+
+fn decibels(amplitude: f32) -> f32 {
+    20. * amplitude.max(1e-6).log10()
+}
+
+/// `path` from `dir`, which it has to be in once its links are resolved.
+fn path_within(dir: &Path, path: impl AsRef<Path>) -> anyhow::Result<PathBuf> {
+    let dir = dir.canonicalize()?;
+    let path = dir.join(path).canonicalize()?;
+    if !path.starts_with(&dir) {
+        anyhow::bail!("{} is not in {}", path.display(), dir.display());
+    }
+    Ok(path)
+}
+
+/// A new file of the recordings directory, named `name` or after the
+/// time. Any local user can send commands, so no other file is written.
+fn recording_path(name: Option<&str>) -> anyhow::Result<PathBuf> {
+    let Some(dir) = crate::locations::recordings() else {
+        anyhow::bail!("no directory to record to");
+    };
+    std::fs::create_dir_all(&dir)?;
+
+    let name = match name {
+        Some(name) => name.to_owned(),
+        None => {
+            let now = std::time::SystemTime::now().duration_since(std::time::UNIX_EPOCH)?;
+            format!("daemon-{}.mid", now.as_secs())
+        }
+    };
+
+    let path = dir.join(&name);
+    let (Some(parent), Some(file_name)) = (path.parent(), path.file_name()) else {
+        anyhow::bail!("invalid recording {name}");
+    };
+
+    let path = path_within(&dir, parent)?.join(file_name);
+    if path.symlink_metadata().is_ok() {
+        anyhow::bail!("{} already exists", path.display());
+    }
+    Ok(path)
+}
+
+/// Receive the commands sent to the control socket, one per datagram.
+fn receive_requests(socket: UdpSocket) -> anyhow::Result<Receiver<(String, SocketAddr)>> {
+    let (request_tx, request_rx) = crossbeam::channel::unbounded();
+
+    std::thread::Builder::new()
+        .name("aud-control".to_owned())
+        .spawn(move || {
+            let mut buffer = [0; MAX_REQUEST_LEN];
+            let mut backoff = Duration::ZERO;
+            loop {
+                let (len, from) = match socket.recv_from(&mut buffer) {
+                    Ok(received) => received,
+                    Err(e) => {
+                        log::error!("[ DAEMON ] : failed to receive a command : {e}");
+                        backoff =
+                            (backoff * 2).clamp(Duration::from_millis(1), MAX_RECEIVE_BACKOFF);
+                        std::thread::sleep(backoff);
+                        continue;
+                    }
+                };
+                backoff = Duration::ZERO;
+
+                let request = String::from_utf8_lossy(&buffer[..len]).into_owned();
+                if request_tx.send((request, from)).is_err() {
+                    return;
+                }
+            }
+        })?;
+
+    Ok(request_rx)
+}
+
+pub fn run(opts: Options, common_opts: crate::CommonOptions) -> anyhow::Result<()> {
+    if let Some(log_file) = opts.log.or_else(|| crate::locations::log_file("daemon")) {
+        crate::logger::start("daemon", log_file, common_opts.verbose)?;
+    }
+
+    let config = aud::lua::load_daemon_config(&opts.config)?;
+    let config_dir = match opts.config.canonicalize()?.parent() {
+        Some(dir) => dir.to_owned(),
+        None => anyhow::bail!("no directory for {}", opts.config.display()),
+    };
+
+    let socket = UdpSocket::bind(&config.control)?;
+    log::info!("[ DAEMON ] : controlled on {}", socket.local_addr()?);
+
+    let requests = receive_requests(socket.try_clone()?)?;
+    Daemon::start(config, config_dir)?.run(&socket, &requests)
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn only_resolves_paths_within_the_directory() {
+        let dir = std::env::temp_dir().join(format!("aud_daemon_{}", std::process::id()));
+        let scripts = dir.join("scripts");
+        std::fs::create_dir_all(&scripts).unwrap();
+        std::fs::write(scripts.join("monitor.lua"), "").unwrap();
+        std::fs::write(dir.join("other.lua"), "").unwrap();
+
+        let monitor = scripts.canonicalize().unwrap().join("monitor.lua");
+        assert_eq!(path_within(&scripts, "monitor.lua").unwrap(), monitor);
+        assert_eq!(path_within(&scripts, &monitor).unwrap(), monitor);
+        assert!(path_within(&scripts, "../scripts/monitor.lua").is_ok());
+
+        assert!(path_within(&scripts, "../other.lua").is_err());
+        assert!(path_within(&scripts, dir.join("other.lua")).is_err());
+        assert!(path_within(&scripts, "missing.lua").is_err());
+
+        let _ = std::fs::remove_dir_all(dir);
+    }
+}
@@ -1,18 +1,48 @@
 mod ui;
 
-use aud::controllers::ableton_link::AbletonLink;
+use aud::{
+    controllers::ableton_link::AbletonLink,
+    midi::{HostedMidiSender, MidiClockGenerator},
+};
 use crossterm::event::KeyCode;
 use ratatui::prelude::*;
+use std::time::Instant;
 
 #[derive(Default)]
 struct TerminalApp {
     ui: ui::Ui,
     app: AbletonLink,
+    midi_clock: Option<MidiClockGenerator>,
+    pipeline: crate::frame_stats::Pipeline,
+}
+
+impl TerminalApp {
+    fn with_midi_clock(device: String) -> anyhow::Result<Self> {
+        let mut app = Self::default();
+        app.app.capture_session_state();
+        let timeline = app.app.midi_clock_timeline();
+        app.ui.midi_clock_device = Some(device.clone());
+        app.midi_clock = Some(MidiClockGenerator::start(
+            Box::<HostedMidiSender>::default(),
+            device,
+            timeline,
+        )?);
+        Ok(app)
+    }
 }
 
 impl crate::app::Base for TerminalApp {
     fn update(&mut self) -> anyhow::Result<crate::app::Flow> {
+        let started = Instant::now();
         self.app.capture_session_state();
+
+        if let Some(ref mut midi_clock) = self.midi_clock {
+            midi_clock.update(self.app.midi_clock_timeline());
+            self.ui.midi_clock_stats = Some(midi_clock.stats());
+        }
+
+        self.pipeline.prep = started.elapsed();
+
         Ok(crate::app::Flow::Continue)
     }
 
@@ -51,6 +81,10 @@ impl crate::app::Base for TerminalApp {
         Ok(crate::app::Flow::Continue)
     }
 
+    fn pipeline(&self) -> crate::frame_stats::Pipeline {
+        self.pipeline
+    }
+
     fn render(&mut self, f: &mut Frame) {
         self.ui.render(f, &mut self.app)
     }
@@ -66,6 +100,10 @@ pub struct Options {
     /// Frames per second
     #[arg(long, default_value_t = 30.)]
     fps: f32,
+
+    /// MIDI output device to send the clock of the session to
+    #[arg(long)]
+    midi_clock: Option<String>,
 }
 
 pub fn run(
@@ -77,6 +115,9 @@ pub fn run(
         crate::logger::start("derlink", log_file, common_opts.verbose)?;
     }
 
-    let mut app = TerminalApp::default();
+    let mut app = match opts.midi_clock {
+        Some(device) => TerminalApp::with_midi_clock(device)?,
+        None => TerminalApp::default(),
+    };
     crate::app::run(terminal, &mut app, opts.fps.max(1.))
 }
@@ -1,5 +1,5 @@
 use crate::ui::widgets;
-use aud::controllers::ableton_link::AbletonLink;
+use aud::{controllers::ableton_link::AbletonLink, midi::MidiClockStats};
 use ratatui::{
     prelude::*,
     widgets::{Block, Borders, Gauge, Paragraph},
@@ -13,12 +13,16 @@ const USAGE: &str = r#"
     k / j : + / - tempo
     l / h : + / - quantum
  <ESC>, q : quit or hide help
+       F2 : display frame times
+       F3 : log frame times
     <C-c> : force quit
 "#;
 
 #[derive(Default)]
 pub struct Ui {
     pub show_usage: bool,
+    pub midi_clock_device: Option<String>,
+    pub midi_clock_stats: Option<MidiClockStats>,
 }
 
 impl Ui {
@@ -45,7 +49,7 @@ impl Ui {
                 ))
         };
 
-        let status_text = vec![
+        let mut status_text = vec![
             Line::from(format!("peers   : {}", app.num_peers())),
             Line::from(format!("sync    : {}", app.is_start_stop_sync_enabled())),
             Line::from(format!("state   : {}", app.is_playing())),
@@ -53,6 +57,18 @@ impl Ui {
             Line::from(format!("beats   : {:<8.2}", app.beats())),
             Line::from(format!("quantum : {}", app.quantum())),
         ];
+
+        if let Some(ref device) = self.midi_clock_device {
+            let stats = self.midi_clock_stats.unwrap_or_default();
+            status_text.push(Line::from(format!("clock   : {device}")));
+            status_text.push(Line::from(format!(
+                "late    : {} µs (max {} µs)",
+                stats.last_lateness, stats.max_lateness
+            )));
+            if stats.num_dropped != 0 {
+                status_text.push(Line::from(format!("dropped : {} ticks", stats.num_dropped)));
+            }
+        }
         let status = Paragraph::new(status_text)
             .style(Style::default().fg(beat_color))
             .block(create_block("˧ status ꜔"))
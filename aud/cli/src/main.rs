@@ -1,6 +1,9 @@
 mod auscope;
+mod daemon;
 mod derlink;
 mod midimon;
+mod runner;
+mod sysexio;
 mod ui;
 mod utils;
 pub use utils::*;
@@ -34,6 +37,12 @@ enum Commands {
     Derlink(derlink::Options),
     /// Audio oscilloscope
     Auscope(auscope::Options),
+    /// Run scripts offline against recorded MIDI and audio files
+    RunScript(runner::Options),
+    /// Send SysEx commands built by a script and parse the responses
+    Sysexio(sysexio::Options),
+    /// Run a pipeline without rendering, configured by a file and controlled over a socket
+    Daemon(daemon::Options),
     /// `aud completions --generate=zsh > aud.zsh`
     Completions(Completions),
 }
@@ -65,16 +74,21 @@ impl Completions {
 fn main() -> anyhow::Result<()> {
     let args = Cli::parse();
 
-    if let Commands::Completions(ref c) = args.command {
-        return c.generate();
-    }
-
-    let app_result = with_terminal(move |term| match args.command {
-        Commands::Midimon(opts) => midimon::run(term, opts, args.opts),
-        Commands::Derlink(opts) => derlink::run(term, opts, args.opts),
-        Commands::Auscope(opts) => auscope::run(term, opts, args.opts),
-        Commands::Completions(_) => Ok(()),
-    });
+    let app_result = match args.command {
+        Commands::Completions(ref c) => return c.generate(),
+        Commands::RunScript(opts) => runner::run(opts, args.opts),
+        Commands::Sysexio(opts) => sysexio::run(opts, args.opts),
+        Commands::Daemon(opts) => daemon::run(opts, args.opts),
+        command => with_terminal(move |term| match command {
+            Commands::Midimon(opts) => midimon::run(term, opts, args.opts),
+            Commands::Derlink(opts) => derlink::run(term, opts, args.opts),
+            Commands::Auscope(opts) => auscope::run(term, opts, args.opts),
+            Commands::Completions(_)
+            | Commands::RunScript(_)
+            | Commands::Sysexio(_)
+            | Commands::Daemon(_) => Ok(()),
+        }),
+    };
 
     if let Err(e) = app_result {
         if logger::is_active() {
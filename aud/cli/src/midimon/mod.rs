@@ -1,51 +1,84 @@
 mod ui;
 
-use crate::ui::widgets::midi::MidiMessageString;
 use aud::{
-    controllers::audio_midi::{AppEvent, AudioMidiController},
+    controllers::{
+        audio_midi::AudioMidiController,
+        worker::{AudioMidiEvent, AudioMidiWorker, DEFAULT_WORKER_INTERVAL},
+    },
     lua::imported,
-    midi::HostedMidiReceiver,
+    midi::{HostedMidiReceiver, MidiReceiving, PlaybackSpeed, SmfPlayer},
 };
 use ratatui::prelude::*;
+use std::{path::PathBuf, time::Instant};
 
 struct TerminalApp {
     ui: ui::Ui,
-    app: AudioMidiController,
+    worker: AudioMidiWorker,
+    record_path: Option<PathBuf>,
+    /// Whether events or a snapshot were received since the last frame.
+    is_dirty: bool,
+    pipeline: crate::frame_stats::Pipeline,
 }
 
-impl Default for TerminalApp {
-    fn default() -> Self {
-        let midi_in = Box::<HostedMidiReceiver>::default();
-        let app = AudioMidiController::with_midi(midi_in, imported::midimon::API);
+impl TerminalApp {
+    fn new(worker: AudioMidiWorker, record_path: Option<PathBuf>) -> Self {
         let mut ui = ui::Ui::default();
-        ui.update_port_names(app.midi().port_names());
-        Self { ui, app }
+        ui.update_port_names(worker.snapshot().port_names.as_slice());
+        Self {
+            ui,
+            worker,
+            record_path,
+            is_dirty: true,
+            pipeline: Default::default(),
+        }
     }
-}
-
-impl crate::app::Base for TerminalApp {
-    fn update(&mut self) -> anyhow::Result<crate::app::Flow> {
-        self.app.midi_mut().update();
-        self.app.process_engine_events()?;
 
-        if self.app.process_script_events()? == AppEvent::Stopping {
-            return Ok(crate::app::Flow::Exit);
+    fn toggle_recording(&mut self) -> anyhow::Result<()> {
+        if self.worker.snapshot().num_recorded.is_some() {
+            return self.worker.send(|app| app.midi_mut().stop_recording());
         }
 
-        let mut messages: Vec<_> = self
-            .app
-            .midi_mut()
-            .take_messages()
-            .iter()
-            .filter_map(|midi| MidiMessageString::new(midi.timestamp, &midi.bytes))
-            .collect();
+        let path = match self.record_path {
+            Some(ref path) => path.clone(),
+            None => {
+                let Some(dir) = crate::locations::recordings() else {
+                    anyhow::bail!("no directory to record to, use --record");
+                };
+                std::fs::create_dir_all(&dir)?;
+                let now = std::time::SystemTime::now().duration_since(std::time::UNIX_EPOCH)?;
+                dir.join(format!("midimon-{}.mid", now.as_secs()))
+            }
+        };
 
-        self.ui.append_messages(&mut messages);
+        log::info!("recording to {}", path.display());
+        self.worker
+            .send(move |app| app.midi_mut().start_recording(path))
+    }
+}
 
-        if self.app.process_file_events()? == AppEvent::ScriptLoaded {
-            self.ui.clear_script_cache();
+impl crate::app::Base for TerminalApp {
+    fn update(&mut self) -> anyhow::Result<crate::app::Flow> {
+        let started = Instant::now();
+        let mut received = 0;
+
+        for event in self.worker.events().try_iter() {
+            self.is_dirty = true;
+            received += 1;
+            match event {
+                AudioMidiEvent::Midi(messages) => self.ui.append_messages(messages),
+                AudioMidiEvent::Alert(alert) => self.ui.show_alert_message(&alert),
+                AudioMidiEvent::ScriptLoaded => self.ui.clear_script_cache(),
+                AudioMidiEvent::ScriptCrash => (),
+                AudioMidiEvent::Stopping => return Ok(crate::app::Flow::Exit),
+                AudioMidiEvent::Failed(e) => anyhow::bail!(e),
+            }
         }
 
+        self.is_dirty |= self.worker.update_snapshot();
+        self.pipeline = crate::frame_stats::Pipeline {
+            prep: started.elapsed(),
+            received,
+        };
         Ok(crate::app::Flow::Continue)
     }
 
@@ -53,18 +86,27 @@ impl crate::app::Base for TerminalApp {
         match self.ui.handle_keypress(key)? {
             ui::UiEvent::Continue => (),
             ui::UiEvent::Exit => return Ok(crate::app::Flow::Exit),
-            ui::UiEvent::ToggleRunningState => {
-                let run = !self.app.midi().is_running();
-                self.app.midi_mut().set_running(run)
-            }
-            ui::UiEvent::ClearMessages => self.app.midi_mut().clear_messages(),
-            ui::UiEvent::Connect(port_index) => {
-                self.app.midi_mut().connect_to_input_by_index(port_index)?;
+            ui::UiEvent::ToggleRunningState => self.worker.send(|app| {
+                let run = !app.midi().is_running();
+                app.midi_mut().set_running(run);
+                Ok(())
+            })?,
+            ui::UiEvent::ClearMessages => {
+                self.worker.send(|app| {
+                    app.midi_mut().clear_messages();
+                    Ok(())
+                })?;
+                self.ui.clear_messages();
             }
+            ui::UiEvent::ToggleRecording => self.toggle_recording()?,
+            ui::UiEvent::Connect(port_index) => self
+                .worker
+                .send(move |app| app.midi_mut().toggle_input_by_index(port_index))?,
             ui::UiEvent::LoadScript(script_index) => {
                 if let Some(script_name) = &self.ui.scripts().get(script_index) {
                     let script = self.ui.script_dir().unwrap().join(script_name);
-                    self.app.load_script(script)?;
+                    self.worker
+                        .send(move |app| app.load_script(script).map(|_| ()))?;
                 };
             }
         }
@@ -72,12 +114,17 @@ impl crate::app::Base for TerminalApp {
         Ok(crate::app::Flow::Continue)
     }
 
-    fn render(&mut self, f: &mut Frame) {
-        if let Some(alert) = self.app.take_alert() {
-            self.ui.show_alert_message(&alert);
-        }
+    fn is_dirty(&self) -> bool {
+        self.is_dirty || self.ui.shows_live_data()
+    }
+
+    fn pipeline(&self) -> crate::frame_stats::Pipeline {
+        self.pipeline
+    }
 
-        self.ui.render(f, &self.app);
+    fn render(&mut self, f: &mut Frame) {
+        self.ui.render(f, &self.worker);
+        self.is_dirty = false;
     }
 }
 
@@ -95,6 +142,25 @@ pub struct Options {
     /// Path to scripts to view or default script to load
     #[arg(long)]
     script: Option<std::path::PathBuf>,
+
+    /// MIDI file to record to when pressing `r`. Defaults
+    /// to a new file in ~/.aud/recordings
+    #[arg(long)]
+    record: Option<std::path::PathBuf>,
+
+    /// MIDI file to play, as a port, instead of the MIDI devices
+    #[arg(long)]
+    play: Option<std::path::PathBuf>,
+
+    /// Lua file returning a list of routes, from
+    /// input devices to output devices, see `route`
+    #[arg(long)]
+    routes: Option<std::path::PathBuf>,
+
+    /// Length in bytes above which SysEx dumps are only
+    /// passed to `on_sysex_chunk`, in parts, and not displayed
+    #[arg(long, default_value_t = aud::midi::SysExAssembler::DEFAULT_MAX_LEN)]
+    max_sysex: usize,
 }
 
 pub fn run(
@@ -106,7 +172,28 @@ pub fn run(
         crate::logger::start("midimon", log_file, common_opts.verbose)?;
     }
 
-    let mut app = TerminalApp::default();
+    let routes = match opts.routes {
+        Some(routes) => Some(aud::lua::load_routes(routes)?),
+        None => None,
+    };
+
+    let (play, max_sysex) = (opts.play, opts.max_sysex);
+    let worker = AudioMidiWorker::spawn(DEFAULT_WORKER_INTERVAL, move || {
+        let midi_in: Box<dyn MidiReceiving> = match play {
+            Some(file) => Box::new(SmfPlayer::open(file, PlaybackSpeed::Realtime)?),
+            None => Box::<HostedMidiReceiver>::default(),
+        };
+
+        let mut app = AudioMidiController::with_midi(midi_in, imported::midimon::API);
+        app.midi_mut().set_max_sysex_len(max_sysex);
+        if let Some(routes) = routes {
+            app.midi_mut().set_routes(routes)?;
+        }
+
+        Ok(app)
+    })?;
+
+    let mut app = TerminalApp::new(worker, opts.record);
 
     let scripts = opts
         .script
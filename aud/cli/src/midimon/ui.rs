@@ -1,5 +1,5 @@
 use crate::ui::{components, widgets};
-use aud::{controllers::audio_midi::AudioMidiController, files};
+use aud::{controllers::worker::AudioMidiWorker, files, midi::MidiData};
 use crossterm::event::KeyCode;
 use ratatui::prelude::*;
 use std::path::Path;
@@ -9,13 +9,18 @@ const USAGE: &str = r#"
          a : display API
          s : display script
          d : display docs
+         t : display telemetry
+         m : display MIDI stats
+         r : start / stop recording
    <SPACE> : pause / resume
    <UP>, k : scroll up
  <DOWN>, j : scroll down
  <LEFT>, h : cycle panes left
 <RIGHT>, l : cycle panes right
-     Enter : confirm selection
+     Enter : confirm selection, connect / disconnect port
   <ESC>, q : quit or hide popup
+        F2 : display frame times
+        F3 : log frame times
      <C-c> : force quit
 "#;
 
@@ -41,7 +46,10 @@ pub struct Ui {
     script_dir: Option<std::path::PathBuf>,
     script_names: Vec<String>,
     cached_script: Option<String>,
-    messages: Vec<widgets::midi::MidiMessageString>,
+    messages: widgets::midi::MidiMessageHistory,
+    show_telemetry: bool,
+    show_stats: bool,
+    stats: widgets::midi_stats::MidiStatsView,
 }
 
 impl Default for Ui {
@@ -59,7 +67,10 @@ impl Default for Ui {
             script_dir: None,
             script_names: vec![],
             cached_script: None,
-            messages: vec![],
+            messages: widgets::midi::MidiMessageHistory::default(),
+            show_telemetry: false,
+            show_stats: false,
+            stats: widgets::midi_stats::MidiStatsView::default(),
         }
     }
 }
@@ -68,6 +79,7 @@ pub enum UiEvent {
     Continue,
     ToggleRunningState,
     ClearMessages,
+    ToggleRecording,
     Connect(usize),
     LoadScript(usize),
     Exit,
@@ -86,8 +98,17 @@ impl Ui {
         self.cached_script = None;
     }
 
-    pub fn append_messages(&mut self, messages: &mut Vec<widgets::midi::MidiMessageString>) {
-        self.messages.append(messages);
+    /// Whether a pane showing data that changes without events is visible.
+    pub fn shows_live_data(&self) -> bool {
+        self.show_telemetry || self.show_stats
+    }
+
+    pub fn append_messages(&mut self, messages: Vec<MidiData>) {
+        self.messages.extend(messages);
+    }
+
+    pub fn clear_messages(&mut self) {
+        self.messages.clear();
     }
 
     pub fn update_port_names(&mut self, port_names: &[impl AsRef<str>]) {
@@ -117,6 +138,14 @@ impl Ui {
             KeyCode::Char('a') => self.popups.toggle_visible(Popup::Api),
             KeyCode::Char('s') => self.popups.toggle_visible(Popup::Script),
             KeyCode::Char('d') => self.popups.toggle_visible(Popup::Docs),
+            KeyCode::Char('t') => {
+                self.show_telemetry = !self.show_telemetry;
+                self.show_stats = false;
+            }
+            KeyCode::Char('m') => {
+                self.show_stats = !self.show_stats;
+                self.show_telemetry = false;
+            }
             KeyCode::Char('q') | KeyCode::Esc => {
                 if !self.popups.any_visible() {
                     return Ok(UiEvent::Exit);
@@ -125,6 +154,7 @@ impl Ui {
                 self.popups.hide()
             }
             KeyCode::Char('c') => return Ok(UiEvent::ClearMessages),
+            KeyCode::Char('r') => return Ok(UiEvent::ToggleRecording),
             KeyCode::Char(' ') => return Ok(UiEvent::ToggleRunningState),
             KeyCode::Left | KeyCode::Char('h') => self.selectors.previous_selector(),
             KeyCode::Right | KeyCode::Char('l') => self.selectors.next_selector(),
@@ -147,7 +177,9 @@ impl Ui {
         Ok(UiEvent::Continue)
     }
 
-    pub fn render(&mut self, f: &mut Frame, app: &AudioMidiController) {
+    pub fn render(&mut self, f: &mut Frame, app: &AudioMidiWorker) {
+        let snapshot = app.snapshot();
+
         let sections = Layout::default()
             .direction(Direction::Vertical)
             .margin(1)
@@ -167,12 +199,21 @@ impl Ui {
             sections[0]
         };
 
+        let port_names: Vec<String> = snapshot
+            .port_names
+            .iter()
+            .map(|name| match snapshot.is_connected(name) {
+                true => format!("● {name}"),
+                false => format!("  {name}"),
+            })
+            .collect();
+
         self.selectors.render(
             f,
             port_selector_section,
             Selector::Port,
             crate::title!("ports"),
-            app.midi().port_names(),
+            &port_names,
         );
 
         if has_script_dir {
@@ -185,27 +226,78 @@ impl Ui {
             )
         }
 
-        let selected_port_name = match app.midi().selected_port_name() {
-            Some(name) => crate::title!("port : {}", name),
-            None => "".to_owned(),
+        let selected_port_name = match snapshot.connected_ports.len() {
+            0 => "".to_owned(),
+            1 => crate::title!("port : {}", snapshot.connected_ports[0]),
+            n => crate::title!("ports : {}", n),
         };
 
-        let selected_script_name = match app.selected_script() {
+        let selected_script_name = match &snapshot.selected_script {
             Some(name) => crate::title!("script : {}", name),
             None => "".to_owned(),
         };
 
-        let running_state = if app.midi().is_running() {
+        let running_state = if snapshot.is_running {
             crate::title!("active")
         } else {
             crate::title!("paused")
         };
 
+        let dropped_messages = match snapshot.dropped_messages {
+            0 => "".to_owned(),
+            n => crate::title!("dropped : {}", n),
+        };
+
+        let recording = match snapshot.num_recorded {
+            Some(num_recorded) => crate::title!("recording : {}", num_recorded),
+            None => "".to_owned(),
+        };
+
+        let messages_section = if self.show_telemetry || self.show_stats {
+            let bottom_sections = Layout::default()
+                .direction(Direction::Horizontal)
+                .constraints([Constraint::Percentage(50), Constraint::Percentage(50)])
+                .split(sections[1]);
+
+            match self.show_stats {
+                true => widgets::midi_stats::render(
+                    f,
+                    bottom_sections[1],
+                    crate::title!("stats"),
+                    app.midi_stats(),
+                    &mut self.stats,
+                ),
+                false => widgets::telemetry::render(
+                    f,
+                    bottom_sections[1],
+                    crate::title!("telemetry"),
+                    app.telemetry(),
+                ),
+            }
+
+            bottom_sections[0]
+        } else {
+            sections[1]
+        };
+
+        let title = [
+            running_state,
+            selected_port_name.as_str(),
+            selected_script_name.as_str(),
+            recording.as_str(),
+            dropped_messages.as_str(),
+        ]
+        .into_iter()
+        .filter(|section| !section.is_empty())
+        .collect::<Vec<_>>()
+        .join("─");
+
         widgets::midi::render_messages(
             f,
-            &format!("{running_state}─{selected_port_name}─{selected_script_name}"),
-            &self.messages,
-            sections[1],
+            &title,
+            &mut self.messages,
+            |port| snapshot.port_name(port),
+            messages_section,
         );
 
         self.popups.render(
@@ -240,7 +332,9 @@ impl Ui {
 
         if self.cached_script.is_none() {
             self.cached_script = Some(
-                app.loaded_script_path()
+                snapshot
+                    .script_path
+                    .as_ref()
                     .and_then(|path| std::fs::read_to_string(path).ok())
                     .unwrap_or_else(|| "No script loaded".to_owned()),
             );
@@ -0,0 +1,141 @@
+use aud::{
+    audio::read_wav_file,
+    lua::{
+        imported,
+        traits::api::{ControlFlowApiEvent, LogApiEvent, RoutingApiEvent},
+        CapturedEvent, OfflineInputs, OfflineReport, OfflineScriptRunner, ScriptEvent,
+    },
+    midi::read_midi_file,
+};
+use std::path::PathBuf;
+
+#[derive(Debug, clap::Parser)]
+pub struct Options {
+    /// Scripts to run, one after the other
+    #[arg(required = true)]
+    scripts: Vec<PathBuf>,
+
+    /// Standard MIDI File to feed to the scripts
+    #[arg(long)]
+    midi: Option<PathBuf>,
+
+    /// WAV file to feed to the scripts
+    #[arg(long)]
+    audio: Option<PathBuf>,
+
+    /// Number of audio frames per `on_audio` call
+    #[arg(long, default_value_t = 512)]
+    block_size: usize,
+
+    /// Print every event emitted by the scripts
+    #[arg(long, default_value_t = false)]
+    events: bool,
+
+    /// Path to log file to write to. Defaults
+    /// to system log file at ~/.aud/log/run-script.log
+    #[arg(long)]
+    log: Option<PathBuf>,
+}
+
+pub fn run(opts: Options, common_opts: crate::CommonOptions) -> anyhow::Result<()> {
+    if let Some(log_file) = opts
+        .log
+        .or_else(|| crate::locations::log_file("run-script"))
+    {
+        crate::logger::start("run-script", log_file, common_opts.verbose)?;
+    }
+
+    let midi = match opts.midi {
+        Some(ref path) => read_midi_file(path)?,
+        None => vec![],
+    };
+
+    let audio = match opts.audio {
+        Some(ref path) => Some(read_wav_file(path)?),
+        None => None,
+    };
+
+    let api = match opts.midi {
+        Some(_) => imported::midimon::API,
+        None => imported::auscope::API,
+    };
+
+    let device_name = opts
+        .midi
+        .as_ref()
+        .or(opts.audio.as_ref())
+        .and_then(|path| path.file_name()?.to_str())
+        .unwrap_or("offline")
+        .to_owned();
+
+    for script in &opts.scripts {
+        let mut runner = OfflineScriptRunner::new(api);
+        runner.load_script(script)?;
+
+        let report = runner.run(OfflineInputs {
+            device_name: device_name.clone(),
+            midi: midi.clone(),
+            audio: audio.clone(),
+            block_size: opts.block_size,
+        })?;
+
+        println!("{}", script.display());
+
+        if opts.events {
+            report.events.iter().for_each(print_event);
+        }
+
+        print_report(&report);
+    }
+
+    Ok(())
+}
+
+fn print_event(captured: &CapturedEvent) {
+    let event = match captured.event {
+        ScriptEvent::Midi(ref midi) => format!("midi    : {:?}", midi.bytes),
+        ScriptEvent::Log(LogApiEvent::Log(ref msg)) => format!("log     : {msg}"),
+        ScriptEvent::Log(LogApiEvent::Alert(ref msg)) => format!("alert   : {msg}"),
+        ScriptEvent::Connect(ref conn) => {
+            format!("connect : {} {:?}", conn.device, conn.channels)
+        }
+        ScriptEvent::Control(ControlFlowApiEvent::Pause) => "pause".to_owned(),
+        ScriptEvent::Control(ControlFlowApiEvent::Resume) => "resume".to_owned(),
+        ScriptEvent::Control(ControlFlowApiEvent::Stop) => "stop".to_owned(),
+        ScriptEvent::Route(RoutingApiEvent::Route(ref route)) => format!(
+            "route   : {} -> {}",
+            route.from.as_deref().unwrap_or("*"),
+            route.to
+        ),
+        ScriptEvent::Loaded => "loaded".to_owned(),
+    };
+
+    println!("  [ {:>12} ] : {event}", captured.timestamp);
+}
+
+fn print_report(report: &OfflineReport) {
+    println!(
+        "  {:<12} {:>10} {:>12} {:>12} {:>12} {:>12}",
+        "hook", "calls", "total", "mean", "min", "max"
+    );
+
+    for (hook, timing) in &report.hooks {
+        println!(
+            "  {:<12} {:>10} {:>12} {:>12} {:>12} {:>12}",
+            hook,
+            timing.calls,
+            format!("{:.1?}", timing.total),
+            format!("{:.1?}", timing.mean()),
+            format!("{:.1?}", timing.min),
+            format!("{:.1?}", timing.max),
+        );
+    }
+
+    println!(
+        "  {} events, {:.1?} of input replayed in {:.1?} ({:.0}x realtime)",
+        report.events.len(),
+        report.virtual_duration,
+        report.elapsed,
+        report.speedup(),
+    );
+}
@@ -0,0 +1,165 @@
+use aud::{
+    clock,
+    controllers::sysexio::{SysExIoController, SysExIoEvent},
+    midi::{HostedMidiReceiver, HostedMidiSender, MidiReceiving, SysExPacing},
+};
+use std::{path::PathBuf, time::Duration};
+
+#[derive(Debug, clap::Parser)]
+pub struct Options {
+    /// Script building the commands and parsing the responses
+    script: PathBuf,
+
+    /// MIDI input device the responses are received from
+    #[arg(long)]
+    input: Option<String>,
+
+    /// MIDI output device the commands are sent to, and the
+    /// device name given to the script. Defaults to the input
+    #[arg(long)]
+    output: Option<String>,
+
+    /// Commands to send, in order
+    #[arg(long = "command")]
+    commands: Vec<String>,
+
+    /// Send every command listed by the script
+    #[arg(long, default_value_t = false)]
+    all: bool,
+
+    /// List the commands of the device and the MIDI devices
+    #[arg(long, default_value_t = false)]
+    list: bool,
+
+    /// Number of commands sent before their response is received
+    #[arg(long, default_value_t = SysExPacing::default().max_in_flight)]
+    window: usize,
+
+    /// Bytes sent to the device per second
+    #[arg(long, default_value_t = SysExPacing::default().max_bytes_per_second)]
+    rate: u64,
+
+    /// Time to wait for a response, in milliseconds
+    #[arg(long, default_value_t = SysExPacing::default().timeout.as_millis() as u64)]
+    timeout: u64,
+
+    /// Number of times a command is sent again without response
+    #[arg(long, default_value_t = SysExPacing::default().max_retries)]
+    retries: u32,
+
+    /// Length in bytes of the longest response, longer
+    /// ones are ignored and their command times out
+    #[arg(long, default_value_t = aud::midi::SysExAssembler::DEFAULT_MAX_LEN)]
+    max_sysex: usize,
+
+    /// Path to log file to write to. Defaults
+    /// to system log file at ~/.aud/log/sysexio.log
+    #[arg(long)]
+    log: Option<PathBuf>,
+}
+
+/// Responses are polled for at least this often.
+const POLL_INTERVAL: Duration = Duration::from_millis(1);
+
+pub fn run(opts: Options, common_opts: crate::CommonOptions) -> anyhow::Result<()> {
+    if let Some(log_file) = opts.log.or_else(|| crate::locations::log_file("sysexio")) {
+        crate::logger::start("sysexio", log_file, common_opts.verbose)?;
+    }
+
+    let receiver = HostedMidiReceiver::default();
+    let sender = HostedMidiSender::default();
+
+    if opts.list || opts.input.is_none() {
+        println!("inputs  : {}", receiver.list_midi_devices()?.join(", "));
+        println!("outputs : {}", sender.list_midi_devices()?.join(", "));
+    }
+
+    let pacing = SysExPacing {
+        max_in_flight: opts.window.max(1),
+        max_bytes_per_second: opts.rate,
+        timeout: Duration::from_millis(opts.timeout),
+        max_retries: opts.retries,
+    };
+
+    let mut sysexio = SysExIoController::new(Box::new(receiver), Box::new(sender), pacing)?;
+    sysexio.set_max_sysex_len(opts.max_sysex);
+    sysexio.load_script(&opts.script)?;
+
+    let Some(input) = opts.input else {
+        return Ok(());
+    };
+    let device = opts.output.unwrap_or_else(|| input.clone());
+
+    let commands = match opts.all {
+        true => sysexio.list_commands(&device)?,
+        false => opts.commands,
+    };
+
+    if opts.list {
+        println!("{device}");
+        sysexio
+            .list_commands(&device)?
+            .iter()
+            .for_each(|command| println!("  {command}"));
+        return Ok(());
+    }
+
+    sysexio.connect(&input, &device)?;
+    for command in &commands {
+        sysexio.request(&device, command)?;
+    }
+
+    let mut events = vec![];
+    while !sysexio.is_idle() {
+        sysexio.update(&mut events)?;
+        events.drain(..).for_each(print_event);
+
+        let wait = sysexio
+            .next_deadline()
+            .map(|deadline| Duration::from_micros(deadline.saturating_sub(clock::now())))
+            .map_or(POLL_INTERVAL, |wait| wait.min(POLL_INTERVAL));
+        std::thread::sleep(wait);
+    }
+
+    if let Some(stats) = sysexio.stats(&device) {
+        println!(
+            "{} responses, {} bytes sent, {} bytes received at {:.0} bytes/s, {} retries, {} timeouts",
+            stats.num_responses,
+            stats.bytes_sent,
+            stats.bytes_received,
+            stats.bytes_per_second(),
+            stats.num_retries,
+            stats.num_timeouts,
+        );
+    }
+
+    Ok(())
+}
+
+fn print_event(event: SysExIoEvent) {
+    match event {
+        SysExIoEvent::Response {
+            device,
+            command,
+            bytes,
+            parsed,
+            latency,
+        } => {
+            let response = parsed.unwrap_or_else(|| {
+                bytes
+                    .iter()
+                    .map(|byte| format!("{byte:02X}"))
+                    .collect::<Vec<_>>()
+                    .join(" ")
+            });
+            println!(
+                "[ {device} ] : {command} ({:.1?}) : {response}",
+                Duration::from_micros(latency)
+            );
+        }
+        SysExIoEvent::Sent { device, command } => println!("[ {device} ] : {command} : sent"),
+        SysExIoEvent::TimedOut { device, command } => {
+            println!("[ {device} ] : {command} : no response")
+        }
+    }
+}
@@ -0,0 +1,48 @@
+use crate::frame_stats::{format_value, FrameStats};
+use ratatui::{prelude::*, widgets::*};
+
+const WIDTH: u16 = 51;
+/// A row per measure, a header and the borders.
+const HEIGHT: u16 = 9;
+
+/// Render the times of the latest frames over the top right corner of the terminal.
+pub fn render(f: &mut Frame, title: &str, stats: &FrameStats) {
+    let size = f.size();
+    let area = Rect {
+        x: size.width.saturating_sub(WIDTH + 1),
+        y: 1.min(size.height),
+        width: WIDTH.min(size.width),
+        height: HEIGHT.min(size.height.saturating_sub(1)),
+    };
+
+    let title = format!(
+        "{title}─{}",
+        crate::title!("{:.1} drawn fps", stats.fps().unwrap_or_default())
+    );
+
+    let block = Block::default()
+        .title(title.as_str().dark_gray())
+        .borders(Borders::ALL)
+        .style(Style::default().fg(Color::DarkGray));
+
+    let label = |text: String| Span::styled(text, Style::default().fg(Color::Gray));
+    let value = |text: String| Span::styled(text, Style::default().fg(Color::Yellow));
+
+    let mut lines = vec![Line::from(label(format!(
+        "{:<13}{:>12}{:>12}{:>12}",
+        "", "min", "avg", "p99"
+    )))];
+
+    for (name, series, is_duration) in stats.measures() {
+        let summary = series.summary().unwrap_or_default();
+        lines.push(Line::from(vec![
+            label(format!("{name:<13}")),
+            value(format!("{:>12}", format_value(summary.min, is_duration))),
+            value(format!("{:>12}", format_value(summary.avg, is_duration))),
+            value(format!("{:>12}", format_value(summary.p99, is_duration))),
+        ]));
+    }
+
+    f.render_widget(Clear, area);
+    f.render_widget(Paragraph::new(lines).block(block), area);
+}
@@ -1,3 +1,4 @@
+use aud::midi::{MidiData, MidiPortId};
 use midly::{
     live::{LiveEvent, MtcQuarterFrameMessage, SystemCommon, SystemRealtime},
     MidiMessage,
@@ -6,15 +7,105 @@ use ratatui::{
     prelude::*,
     widgets::{Block, Borders, List, ListItem},
 };
+use std::collections::VecDeque;
 
-pub fn render_messages(f: &mut Frame, title: &str, messages: &[MidiMessageString], area: Rect) {
-    const MAX_NUM_MESSAGES_ON_SCREEN: usize = 128;
+/// The latest messages, kept raw and only formatted once
+/// they are displayed, so that the cost of a frame does not
+/// depend on the rate of the messages.
+pub struct MidiMessageHistory {
+    messages: VecDeque<MidiData>,
+    capacity: usize,
+    /// Number of messages pushed since the start, which
+    /// identifies the messages formatted in `rows`.
+    num_pushed: u64,
+    /// Formatted messages, indexed by their number modulo the length.
+    rows: Vec<Option<(u64, MidiMessageString)>>,
+}
+
+impl Default for MidiMessageHistory {
+    fn default() -> Self {
+        Self::with_capacity(1024)
+    }
+}
+
+impl MidiMessageHistory {
+    pub fn with_capacity(capacity: usize) -> Self {
+        Self {
+            messages: VecDeque::with_capacity(capacity),
+            capacity,
+            num_pushed: 0,
+            rows: vec![],
+        }
+    }
+
+    /// Append messages, dropping the oldest ones past the capacity
+    /// along with the ones that cannot be displayed.
+    pub fn extend(&mut self, messages: impl IntoIterator<Item = MidiData>) {
+        for midi in messages {
+            if LiveEvent::parse(&midi.bytes).is_err() {
+                continue;
+            }
+
+            if self.messages.len() == self.capacity {
+                self.messages.pop_front();
+            }
+
+            self.messages.push_back(midi);
+            self.num_pushed += 1;
+        }
+    }
+
+    pub fn clear(&mut self) {
+        self.messages.clear();
+        self.rows.clear();
+    }
+
+    /// The latest messages, newest first, formatting
+    /// the ones that were not displayed before.
+    pub fn latest_rows(&mut self, num_rows: usize) -> impl Iterator<Item = &MidiMessageString> {
+        let num_rows = num_rows.min(self.messages.len());
+        if self.rows.len() < num_rows {
+            self.rows.resize_with(num_rows, || None);
+        }
+
+        let num_cached = self.rows.len() as u64;
+        let first = self.num_pushed - num_rows as u64;
+
+        for index in first..self.num_pushed {
+            let row = &mut self.rows[(index % num_cached) as usize];
+            if matches!(row, Some((i, _)) if *i == index) {
+                continue;
+            }
+
+            let midi = &self.messages[self.messages.len() - (self.num_pushed - index) as usize];
+            *row = MidiMessageString::new(midi.timestamp, midi.port, &midi.bytes)
+                .map(|string| (index, string));
+        }
+
+        let rows = &self.rows;
+        (first..self.num_pushed).rev().filter_map(move |index| {
+            match &rows[(index % num_cached) as usize] {
+                Some((i, row)) if *i == index => Some(row),
+                _ => None,
+            }
+        })
+    }
+}
+
+/// Only the rows that fit in `area` are formatted, the
+/// ones still on screen from the previous frame are not.
+pub fn render_messages<'a>(
+    f: &mut Frame,
+    title: &str,
+    messages: &mut MidiMessageHistory,
+    port_name: impl Fn(MidiPortId) -> Option<&'a str>,
+    area: Rect,
+) {
+    let num_rows = area.height.saturating_sub(2) as usize;
 
     let message_list: Vec<ListItem> = messages
-        .iter()
-        .rev()
+        .latest_rows(num_rows)
         .enumerate()
-        .take(MAX_NUM_MESSAGES_ON_SCREEN.min(messages.len()))
         .map(|(i, msg)| {
             let style = if i == 0 {
                 Style::default().add_modifier(Modifier::BOLD)
@@ -23,11 +114,13 @@ pub fn render_messages(f: &mut Frame, title: &str, messages: &[MidiMessageString
             };
 
             ListItem::new(vec![Line::from(vec![
-                Span::styled(format!("[ {} ]", msg.timestamp), style.fg(Color::Gray)),
+                Span::styled(msg.timestamp.as_str(), style.fg(Color::Gray)),
+                Span::styled(" : ", style.fg(Color::DarkGray)),
+                Span::styled(port_name(msg.port).unwrap_or("?"), style.fg(Color::Magenta)),
                 Span::styled(" : ", style.fg(Color::DarkGray)),
-                Span::styled(msg.category.clone(), style.fg(Color::Cyan)),
+                Span::styled(msg.category, style.fg(Color::Cyan)),
                 Span::styled(" : ", style.fg(Color::DarkGray)),
-                Span::styled(msg.data.clone(), style.fg(Color::Yellow)),
+                Span::styled(msg.data.as_str(), style.fg(Color::Yellow)),
             ])])
         })
         .collect();
@@ -48,26 +141,30 @@ pub fn render_messages(f: &mut Frame, title: &str, messages: &[MidiMessageString
 }
 
 pub struct MidiMessageString {
-    pub timestamp: u64,
-    pub category: String,
+    pub timestamp: String,
+    pub port: MidiPortId,
+    pub category: &'static str,
     pub data: String,
 }
 
 impl MidiMessageString {
-    pub fn new(timestamp: u64, bytes: &[u8]) -> Option<Self> {
+    pub fn new(timestamp: u64, port: MidiPortId, bytes: &[u8]) -> Option<Self> {
         let Ok(event) = LiveEvent::parse(bytes) else {
             return None;
         };
 
-        let make = |category: &str, data: &str| Self {
-            timestamp,
-            category: category.to_string(),
+        let make = |category: &'static str, data: &str| Self {
+            timestamp: format!("[ {timestamp} ]"),
+            port,
+            category,
             data: data.to_string(),
         };
 
         let str = match event {
             LiveEvent::Midi { channel, message } => {
-                let make = |cat: &str, data: &str| make(cat, &format!("chan = {channel} | {data}"));
+                let make = |cat: &'static str, data: &str| {
+                    make(cat, &format!("chan = {channel} | {data}"))
+                };
 
                 match message {
                     MidiMessage::NoteOn { key, vel } => {
@@ -127,3 +224,48 @@ impl MidiMessageString {
         Some(str)
     }
 }
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn note(timestamp: u64) -> MidiData {
+        MidiData {
+            timestamp,
+            port: 0,
+            bytes: [0x90, 60, 100].into(),
+        }
+    }
+
+    fn timestamps(history: &mut MidiMessageHistory, num_rows: usize) -> Vec<String> {
+        history
+            .latest_rows(num_rows)
+            .map(|row| row.timestamp.clone())
+            .collect()
+    }
+
+    #[test]
+    fn formats_the_latest_messages_newest_first() {
+        let mut history = MidiMessageHistory::with_capacity(8);
+        history.extend((0..5).map(note));
+        assert_eq!(timestamps(&mut history, 3), ["[ 4 ]", "[ 3 ]", "[ 2 ]"]);
+
+        history.extend((5..7).map(note));
+        assert_eq!(timestamps(&mut history, 3), ["[ 6 ]", "[ 5 ]", "[ 4 ]"]);
+        assert_eq!(history.latest_rows(3).next().unwrap().category, "NoteOn");
+    }
+
+    #[test]
+    fn keeps_a_bounded_history_of_valid_messages() {
+        let mut history = MidiMessageHistory::with_capacity(4);
+        history.extend((0..10).map(note));
+        history.extend([MidiData::default()]);
+        assert_eq!(
+            timestamps(&mut history, 100),
+            ["[ 9 ]", "[ 8 ]", "[ 7 ]", "[ 6 ]"]
+        );
+
+        history.clear();
+        assert_eq!(history.latest_rows(4).count(), 0);
+    }
+}
@@ -0,0 +1,165 @@
+use aud::{
+    clock,
+    midi::{MidiMessageKind, MidiPortId, MidiStats, MidiStatsSnapshot, MIDI_INTERVAL_BUCKETS},
+};
+use ratatui::{prelude::*, widgets::*};
+
+/// Rates are averaged over at least this long, in microseconds.
+const RATE_WINDOW: u64 = 1_000_000;
+const NUM_BUSIEST_CONTROLS: usize = 4;
+const BARS: [char; 8] = ['▁', '▂', '▃', '▄', '▅', '▆', '▇', '█'];
+
+/// Snapshots of the stats of every port. Rates are computed
+/// between the last two snapshots of a window, counts are
+/// read from a snapshot taken on every frame.
+#[derive(Default)]
+pub struct MidiStatsView {
+    ports: Vec<MidiPortView>,
+}
+
+struct MidiPortView {
+    port: MidiPortId,
+    device_name: String,
+    earlier: MidiStatsSnapshot,
+    window: MidiStatsSnapshot,
+    latest: MidiStatsSnapshot,
+}
+
+impl MidiStatsView {
+    fn refresh(&mut self, stats: &MidiStats) {
+        let now = clock::now();
+
+        for port in stats.ports() {
+            let latest = port.snapshot(now);
+            match self.ports.iter_mut().find(|view| view.port == port.port) {
+                Some(view) => {
+                    if now.saturating_sub(view.window.timestamp) >= RATE_WINDOW {
+                        view.earlier = std::mem::replace(&mut view.window, latest.clone());
+                    }
+                    view.latest = latest;
+                }
+                None => self.ports.push(MidiPortView {
+                    port: port.port,
+                    device_name: port.device_name.clone(),
+                    earlier: latest.clone(),
+                    window: latest.clone(),
+                    latest,
+                }),
+            }
+        }
+    }
+}
+
+/// The intervals histogram as a line of bars, from short to long.
+fn interval_bars(intervals: &[u64; MIDI_INTERVAL_BUCKETS]) -> String {
+    let max = intervals.iter().copied().max().unwrap_or(0).max(1);
+    intervals
+        .iter()
+        .map(|count| match count {
+            0 => ' ',
+            count => BARS[((count * (BARS.len() as u64 - 1)) / max) as usize],
+        })
+        .collect()
+}
+
+/// Render the statistics of the ports: the rate of each kind of
+/// message and its busiest channel, the intervals between messages,
+/// the SysEx volume, the use of running status and the busiest controls.
+pub fn render(f: &mut Frame, area: Rect, title: &str, stats: &MidiStats, view: &mut MidiStatsView) {
+    let block = Block::default()
+        .title(title.dark_gray())
+        .borders(Borders::ALL)
+        .style(Style::default().fg(Color::DarkGray));
+
+    let inner = block.inner(area);
+    f.render_widget(block, area);
+
+    view.refresh(stats);
+
+    if view.ports.is_empty() {
+        f.render_widget(
+            Paragraph::new("Connect to a port to gather statistics"),
+            inner,
+        );
+        return;
+    }
+
+    let label = |text: String| Span::styled(text, Style::default().fg(Color::Gray));
+    let value = |text: String| Span::styled(text, Style::default().fg(Color::Yellow));
+
+    let mut lines = vec![];
+    for MidiPortView {
+        device_name,
+        earlier,
+        window,
+        latest,
+        ..
+    } in &view.ports
+    {
+        lines.push(Line::from(vec![
+            Span::styled(device_name.clone(), Style::default().fg(Color::Cyan).bold()),
+            label(" : ".to_owned()),
+            value(format!("{}", latest.num_messages)),
+            label(" messages, sysex ".to_owned()),
+            value(format!("{} B", latest.sysex_bytes)),
+            label(", running status ".to_owned()),
+            value(format!(
+                "{}/{}",
+                latest.running_status, latest.repeated_status
+            )),
+        ]));
+
+        for kind in MidiMessageKind::ALL {
+            let count = latest.count(kind, None);
+            if count == 0 {
+                continue;
+            }
+
+            let busiest_channel = (0..16)
+                .max_by_key(|channel| latest.count(kind, Some(*channel)))
+                .unwrap_or(0);
+
+            lines.push(Line::from(vec![
+                label(format!("  {:<16}", kind.name())),
+                value(format!("{:>8.1}/s", window.rate_since(earlier, kind, None))),
+                label(match kind {
+                    MidiMessageKind::System => "       ".to_owned(),
+                    _ => format!("  ch {:<2}", busiest_channel + 1),
+                }),
+                Span::styled(
+                    format!(" {}", interval_bars(latest.intervals(kind))),
+                    Style::default().fg(Color::Magenta),
+                ),
+            ]));
+        }
+
+        let controls = latest.busiest_controls(NUM_BUSIEST_CONTROLS);
+        if !controls.is_empty() {
+            let mut spans = vec![label("  busiest cc      ".to_owned())];
+            for (control, count) in controls {
+                spans.push(value(format!("{control}")));
+                spans.push(label(format!(" ({count})  ")));
+            }
+            lines.push(Line::from(spans));
+        }
+    }
+
+    f.render_widget(Paragraph::new(lines), inner);
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn draws_the_intervals_relative_to_the_largest_bucket() {
+        let mut intervals = [0; MIDI_INTERVAL_BUCKETS];
+        intervals[1] = 1;
+        intervals[3] = 7;
+        intervals[4] = 14;
+
+        let bars = interval_bars(&intervals);
+        assert_eq!(bars.chars().count(), MIDI_INTERVAL_BUCKETS);
+        assert!(bars.starts_with(" ▁ ▄█ "));
+    }
+}
@@ -1,3 +1,7 @@
+pub mod frame_stats;
 pub mod midi;
+pub mod midi_stats;
 pub mod popup;
 pub mod scope;
+pub mod telemetry;
+pub mod waterfall;
@@ -1,5 +1,6 @@
-use aud::{audio::AudioBuffer, dsp};
-use ratatui::{prelude::*, widgets::*};
+use aud::audio::AudioHistory;
+use ratatui::{buffer::Cell, prelude::*, widgets::*};
+use std::ops::Range;
 
 const COLORS: [Color; 8] = [
     Color::Cyan,
@@ -12,78 +13,209 @@ const COLORS: [Color; 8] = [
     Color::LightRed,
 ];
 
-type SamplePoint = (f64, f64);
-type SamplePoints = Vec<SamplePoint>;
+/// Braille cell without any dot, the others add the bits of their dots.
+const BRAILLE_BLANK: u32 = 0x2800;
+/// Bit of each dot of a Braille cell, by row and column of the dot.
+const BRAILLE_DOTS: [[u8; 2]; 4] = [[0x01, 0x08], [0x02, 0x10], [0x04, 0x20], [0x40, 0x80]];
 
-fn prepare_audio_data(
-    audio: &AudioBuffer,
+/// Every channel of an audio history, rasterized straight into the Braille
+/// cells of the buffer, 2 columns and 4 rows of dots per cell.
+///
+/// Each column of dots spans the lowest and the highest of the `downsample`
+/// frames it covers, joined to the last frame of the previous column, so
+/// peaks are never skipped by the decimation and steep edges stay continuous.
+/// The latest frames are drawn on the right edge, channels over each other.
+pub struct Scope<'a> {
+    audio: &'a AudioHistory,
     downsample: usize,
-    num_samples_to_render: usize,
     gain: f32,
-) -> Vec<SamplePoints> {
-    let num_channels = audio.num_channels.min(1) as usize;
-    let audio = dsp::deinterleave(&audio.data, num_channels);
-    let mut channels = Vec::<SamplePoints>::with_capacity(num_channels);
-    for chan in audio {
-        let data = chan
-            .iter()
-            .take(num_samples_to_render * downsample)
-            .rev()
-            .step_by(num_channels)
-            .step_by(downsample)
-            .enumerate()
-            .map(|(i, &sample)| (i as f64, (sample * gain) as f64))
-            .collect();
-        channels.push(data);
+    block: Option<Block<'a>>,
+}
+
+impl<'a> Scope<'a> {
+    pub fn new(audio: &'a AudioHistory) -> Self {
+        Self {
+            audio,
+            downsample: 1,
+            gain: 1.,
+            block: None,
+        }
+    }
+
+    /// Number of frames covered by each column of dots.
+    pub fn downsample(mut self, downsample: usize) -> Self {
+        self.downsample = downsample.max(1);
+        self
+    }
+
+    pub fn gain(mut self, gain: f32) -> Self {
+        self.gain = gain;
+        self
+    }
+
+    pub fn block(mut self, block: Block<'a>) -> Self {
+        self.block = Some(block);
+        self
+    }
+
+    fn render_channel(&self, channel: usize, area: Rect, buf: &mut Buffer) {
+        let num_columns = area.width as usize * 2;
+        let num_rows = area.height as usize * 4;
+        let (older, newer) = self.audio.latest(channel, num_columns * self.downsample);
+        let num_frames = older.len() + newer.len();
+        let color = COLORS[channel % COLORS.len()];
+
+        let first_column = num_columns - num_frames.div_ceil(self.downsample);
+        let mut previous_row = None;
+
+        for column in first_column..num_columns {
+            let end = num_frames - (num_columns - 1 - column) * self.downsample;
+            let frames = end.saturating_sub(self.downsample)..end;
+            let Some((min, max)) = min_max(older, newer, frames) else {
+                continue;
+            };
+
+            let mut top = dot_row(max * self.gain, num_rows);
+            let mut bottom = dot_row(min * self.gain, num_rows);
+            if let Some(row) = previous_row {
+                top = top.min(row);
+                bottom = bottom.max(row);
+            }
+            previous_row = Some(dot_row(sample(older, newer, end - 1) * self.gain, num_rows));
+
+            let x = area.x + (column / 2) as u16;
+            for cell_row in top / 4..=bottom / 4 {
+                let cell_top = cell_row * 4;
+                let rows = top.max(cell_top) - cell_top..=bottom.min(cell_top + 3) - cell_top;
+                let dots = rows.fold(0, |dots, row| dots | BRAILLE_DOTS[row][column % 2]);
+                add_dots(buf.get_mut(x, area.y + cell_row as u16), dots, color);
+            }
+        }
+    }
+}
+
+impl Widget for Scope<'_> {
+    fn render(mut self, area: Rect, buf: &mut Buffer) {
+        let area = match self.block.take() {
+            Some(block) => {
+                let inner = block.inner(area);
+                block.render(area, buf);
+                inner
+            }
+            None => area,
+        };
+
+        if area.is_empty() {
+            return;
+        }
+
+        for channel in 0..self.audio.num_channels() {
+            self.render_channel(channel, area, buf);
+        }
     }
-    channels
 }
 
-fn create_datasets(data: &[SamplePoints]) -> Vec<Dataset> {
-    data.iter()
-        .enumerate()
-        .map(|(i, points)| {
-            Dataset::default()
-                .name(i.to_string())
-                .marker(symbols::Marker::Braille)
-                .style(Style::default().fg(COLORS[i % COLORS.len()]))
-                .data(points)
+/// Add dots to a cell, over the dots it already has if it is a Braille cell.
+fn add_dots(cell: &mut Cell, dots: u8, color: Color) {
+    let existing = cell
+        .symbol()
+        .chars()
+        .next()
+        .map(u32::from)
+        .filter(|c| (BRAILLE_BLANK..BRAILLE_BLANK + 0x100).contains(c))
+        .map_or(0, |c| c - BRAILLE_BLANK);
+
+    let symbol = char::from_u32(BRAILLE_BLANK | existing | dots as u32).unwrap_or(' ');
+    cell.set_char(symbol).set_fg(color);
+}
+
+/// Row of dots of a sample, from the top, with [-1, 1] spanning every row.
+fn dot_row(sample: f32, num_rows: usize) -> usize {
+    let position = (1. - sample.clamp(-1., 1.)) * 0.5;
+    ((position * (num_rows - 1) as f32).round() as usize).min(num_rows - 1)
+}
+
+fn sample(older: &[f32], newer: &[f32], frame: usize) -> f32 {
+    match frame.checked_sub(older.len()) {
+        Some(frame) => newer[frame],
+        None => older[frame],
+    }
+}
+
+/// Lowest and highest samples of a range of frames of the two halves of a history.
+fn min_max(older: &[f32], newer: &[f32], frames: Range<usize>) -> Option<(f32, f32)> {
+    let split = older.len();
+    let older = &older[frames.start.min(split)..frames.end.min(split)];
+    let newer = &newer[frames.start.saturating_sub(split)..frames.end.saturating_sub(split)];
+
+    older.iter().chain(newer).fold(None, |range, &sample| {
+        Some(match range {
+            Some((min, max)) => (sample.min(min), sample.max(max)),
+            None => (sample, sample),
         })
-        .collect()
+    })
 }
 
 pub fn render(
     f: &mut Frame,
     area: Rect,
     title: &str,
-    audio: &AudioBuffer,
+    audio: &AudioHistory,
     downsample: usize,
     gain: f32,
 ) {
-    let width = f.size().width as usize;
-    let num_samples_to_render = (audio.num_frames() / downsample).min(width);
-    let data = prepare_audio_data(audio, downsample, num_samples_to_render, gain);
-
-    let datasets = create_datasets(&data);
-
-    let chart = Chart::new(datasets)
-        .block(
-            Block::default()
-                .title(title.dark_gray())
-                .borders(Borders::ALL)
-                .style(Style::default().fg(Color::DarkGray)),
-        )
-        .x_axis(
-            Axis::default()
-                .style(Style::default().fg(Color::DarkGray))
-                .bounds([0., f.size().width as f64]),
-        )
-        .y_axis(
-            Axis::default()
-                .style(Style::default().fg(Color::DarkGray))
-                .labels(vec!["-1 ".bold(), "――".into(), " 1 ".bold()])
-                .bounds([-1.0, 1.0]),
-        );
-
-    f.render_widget(chart, area);
+    let scope = Scope::new(audio).downsample(downsample).gain(gain).block(
+        Block::default()
+            .title(title.dark_gray())
+            .borders(Borders::ALL)
+            .style(Style::default().fg(Color::DarkGray)),
+    );
+
+    f.render_widget(scope, area);
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use aud::audio::AudioBuffer;
+
+    fn history(samples: &[f32]) -> AudioHistory {
+        let mut history = AudioHistory::new(1, samples.len());
+        history.push(&AudioBuffer {
+            data: samples.to_vec(),
+            num_channels: 1,
+            timestamp: 0,
+        });
+        history
+    }
+
+    fn rasterize(audio: &AudioHistory, downsample: usize, area: Rect) -> Buffer {
+        let mut buf = Buffer::empty(area);
+        Scope::new(audio)
+            .downsample(downsample)
+            .render(area, &mut buf);
+        buf
+    }
+
+    #[test]
+    fn spans_the_lowest_and_highest_frames_of_each_column() {
+        let square: Vec<f32> = (0..64).map(|i| if i % 2 == 0 { 1. } else { -1. }).collect();
+        let buf = rasterize(&history(&square), 4, Rect::new(0, 0, 8, 2));
+
+        for x in 0..8 {
+            assert_eq!(buf.get(x, 0).symbol(), "⣿");
+            assert_eq!(buf.get(x, 1).symbol(), "⣿");
+            assert_eq!(buf.get(x, 0).fg, COLORS[0]);
+        }
+    }
+
+    #[test]
+    fn draws_the_latest_frames_on_the_right_edge() {
+        let buf = rasterize(&history(&[0.; 3]), 1, Rect::new(0, 0, 4, 1));
+
+        assert_eq!(buf.get(0, 0).symbol(), " ");
+        assert_eq!(buf.get(1, 0).symbol(), " ");
+        assert_eq!(buf.get(2, 0).symbol(), "⠠");
+        assert_eq!(buf.get(3, 0).symbol(), "⠤");
+    }
 }
@@ -0,0 +1,136 @@
+use aud::lua::{Histogram, Plot, Telemetry, TelemetryData};
+use ratatui::{prelude::*, widgets::*};
+
+const COLORS: [Color; 4] = [Color::Cyan, Color::Yellow, Color::Magenta, Color::Green];
+
+/// Render the data published by the script through
+/// `scalar`, `plot` and `histogram`, in order of creation.
+///
+/// Scalars are grouped at the top of the pane
+/// and the rest of the area is shared by the graphs.
+pub fn render(f: &mut Frame, area: Rect, title: &str, telemetry: &Telemetry) {
+    let block = Block::default()
+        .title(title.dark_gray())
+        .borders(Borders::ALL)
+        .style(Style::default().fg(Color::DarkGray));
+
+    let inner = block.inner(area);
+    f.render_widget(block, area);
+
+    let channels = telemetry.channels();
+
+    if channels.is_empty() {
+        let hint = Paragraph::new("Use `scalar`, `plot` or `histogram` to publish data");
+        f.render_widget(hint, inner);
+        return;
+    }
+
+    let scalars: Vec<Line> = channels
+        .iter()
+        .filter_map(|channel| match channel.data {
+            TelemetryData::Scalar(ref scalar) => Some(Line::from(vec![
+                Span::styled(channel.name.as_str(), Style::default().fg(Color::Gray)),
+                Span::styled(" : ", Style::default().fg(Color::DarkGray)),
+                Span::styled(
+                    format!("{:.3}", scalar.value()),
+                    Style::default().fg(Color::Yellow),
+                ),
+            ])),
+            _ => None,
+        })
+        .collect();
+
+    let graphs: Vec<_> = channels
+        .iter()
+        .filter(|channel| !matches!(channel.data, TelemetryData::Scalar(_)))
+        .collect();
+
+    let mut constraints = vec![Constraint::Length(scalars.len() as u16)];
+    constraints.extend(
+        graphs
+            .iter()
+            .map(|_| Constraint::Ratio(1, graphs.len() as u32)),
+    );
+
+    let sections = Layout::default()
+        .direction(Direction::Vertical)
+        .constraints(constraints)
+        .split(inner);
+
+    f.render_widget(Paragraph::new(scalars), sections[0]);
+
+    for (i, (channel, area)) in graphs.iter().zip(sections.iter().skip(1)).enumerate() {
+        let color = COLORS[i % COLORS.len()];
+
+        match channel.data {
+            TelemetryData::Plot(ref plot) => render_plot(f, *area, &channel.name, plot, color),
+            TelemetryData::Histogram(ref histogram) => {
+                render_histogram(f, *area, &channel.name, histogram, color)
+            }
+            TelemetryData::Scalar(_) => (),
+        }
+    }
+}
+
+fn render_plot(f: &mut Frame, area: Rect, name: &str, plot: &Plot, color: Color) {
+    let mut values = vec![];
+    plot.read_into(&mut values);
+
+    let (min, max) = values.iter().fold((f64::MAX, f64::MIN), |(min, max), v| {
+        (min.min(*v), max.max(*v))
+    });
+
+    let (min, max) = match (min, max) {
+        (min, max) if min > max => (0., 1.),
+        (min, max) if min == max => (min - 1., max + 1.),
+        range => range,
+    };
+
+    let points: Vec<_> = values
+        .iter()
+        .enumerate()
+        .map(|(i, v)| (i as f64, *v))
+        .collect();
+
+    let last = values
+        .last()
+        .map(|v| format!(" : {v:.3}"))
+        .unwrap_or_default();
+
+    let dataset = Dataset::default()
+        .marker(symbols::Marker::Braille)
+        .graph_type(GraphType::Line)
+        .style(Style::default().fg(color))
+        .data(&points);
+
+    let chart = Chart::new(vec![dataset])
+        .block(Block::default().title(format!("{name}{last}").gray()))
+        .x_axis(Axis::default().bounds([0., Plot::CAPACITY as f64]))
+        .y_axis(
+            Axis::default()
+                .style(Style::default().fg(Color::DarkGray))
+                .labels(vec![format!("{min:.2}").into(), format!("{max:.2}").into()])
+                .bounds([min, max]),
+        );
+
+    f.render_widget(chart, area);
+}
+
+fn render_histogram(f: &mut Frame, area: Rect, name: &str, histogram: &Histogram, color: Color) {
+    let mut counts = vec![];
+    histogram.read_into(&mut counts);
+
+    let title = format!(
+        "{name} : [{}, {}) : {} outliers",
+        histogram.min,
+        histogram.max,
+        histogram.num_outliers()
+    );
+
+    let sparkline = Sparkline::default()
+        .block(Block::default().title(title.gray()))
+        .style(Style::default().fg(color))
+        .data(&counts);
+
+    f.render_widget(sparkline, area);
+}
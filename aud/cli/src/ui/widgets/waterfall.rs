@@ -0,0 +1,366 @@
+use aud::{audio::AudioHistory, dsp::SpectrumAnalyzer};
+use ratatui::{prelude::*, widgets::*};
+use std::ops::Range;
+
+/// Number of samples of each spectrum, by default.
+pub const DEFAULT_FFT_SIZE: usize = 2048;
+/// Lowest frequency shown, in Hz, the rows are spaced logarithmically above it.
+const MIN_FREQUENCY: f32 = 20.;
+/// Each cell shows two rows, the top one in the foreground of a half block.
+const UPPER_HALF_BLOCK: char = '▀';
+/// Spectra overlap by half, a column per half FFT of pushed frames.
+const OVERLAP: usize = 2;
+
+/// Colors of the levels of the spectrum, from the bottom of the dB range to its top.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq, clap::ValueEnum)]
+pub enum ColorMap {
+    #[default]
+    Heat,
+    Ice,
+    Gray,
+}
+
+impl ColorMap {
+    pub fn name(self) -> &'static str {
+        match self {
+            ColorMap::Heat => "heat",
+            ColorMap::Ice => "ice",
+            ColorMap::Gray => "gray",
+        }
+    }
+
+    pub fn next(self) -> Self {
+        match self {
+            ColorMap::Heat => ColorMap::Ice,
+            ColorMap::Ice => ColorMap::Gray,
+            ColorMap::Gray => ColorMap::Heat,
+        }
+    }
+
+    fn stops(self) -> &'static [(u8, u8, u8)] {
+        match self {
+            ColorMap::Heat => &[
+                (0, 0, 0),
+                (80, 0, 110),
+                (200, 30, 40),
+                (255, 160, 0),
+                (255, 255, 220),
+            ],
+            ColorMap::Ice => &[(0, 0, 0), (10, 40, 120), (0, 150, 200), (220, 250, 255)],
+            ColorMap::Gray => &[(0, 0, 0), (255, 255, 255)],
+        }
+    }
+
+    /// Color of a level, from 0 to 1, between the stops of the map.
+    pub fn color(self, level: f32) -> Color {
+        let stops = self.stops();
+        let position = level.clamp(0., 1.) * (stops.len() - 1) as f32;
+        let index = (position as usize).min(stops.len() - 2);
+        let fraction = position - index as f32;
+
+        let (from, to) = (stops[index], stops[index + 1]);
+        let mix = |from: u8, to: u8| (from as f32 + (to as f32 - from as f32) * fraction) as u8;
+        Color::Rgb(mix(from.0, to.0), mix(from.1, to.1), mix(from.2, to.2))
+    }
+}
+
+/// A spectrogram of a channel, scrolling to the left by one column
+/// per hop of frames pushed to the history, so its time axis does
+/// not depend on how often it is drawn.
+///
+/// Only the spectra of the columns added since the last frame are
+/// computed, at most a screen of them, the earlier ones are kept in
+/// a ring of cells allocated when the area changes, so the cost of a
+/// frame does not depend on how much of the session the waterfall shows.
+pub struct Waterfall {
+    analyzer: SpectrumAnalyzer,
+    color_map: ColorMap,
+    db_range: Range<f32>,
+    channel: usize,
+    num_columns: usize,
+    /// Rows of the spectrum, two per cell.
+    num_rows: usize,
+    /// Level of each row in dB, column after column, in a ring.
+    levels: Vec<f32>,
+    /// Colors of the levels, in the same order.
+    colors: Vec<Color>,
+    /// Column of the ring the next spectrum is written to, the oldest one.
+    head: usize,
+    /// Frequency bins spanned by each row, from the top.
+    bins: Vec<Range<usize>>,
+    sample_rate: u32,
+    /// Frames of the history between two columns.
+    hop_size: usize,
+    /// Number of hops of the history when the newest column was computed.
+    num_hops: u64,
+}
+
+impl Default for Waterfall {
+    fn default() -> Self {
+        Self::new(DEFAULT_FFT_SIZE)
+    }
+}
+
+impl Waterfall {
+    pub fn new(fft_size: usize) -> Self {
+        Self {
+            analyzer: SpectrumAnalyzer::new(fft_size),
+            color_map: ColorMap::default(),
+            db_range: -90.0..0.0,
+            channel: 0,
+            num_columns: 0,
+            num_rows: 0,
+            levels: vec![],
+            colors: vec![],
+            head: 0,
+            bins: vec![],
+            sample_rate: 0,
+            hop_size: (fft_size / OVERLAP).max(1),
+            num_hops: 0,
+        }
+    }
+
+    pub fn color_map(&self) -> ColorMap {
+        self.color_map
+    }
+
+    pub fn db_range(&self) -> &Range<f32> {
+        &self.db_range
+    }
+
+    /// Change the colors of the levels, including those already shown.
+    pub fn set_color_map(&mut self, color_map: ColorMap) {
+        self.color_map = color_map;
+        self.recolor();
+    }
+
+    /// Change the levels spanned by the color map, including those already shown.
+    pub fn set_db_range(&mut self, db_range: Range<f32>) {
+        self.db_range = db_range;
+        self.recolor();
+    }
+
+    /// Analyze the hops of the history pushed since the newest
+    /// column, then render the columns of the ring, oldest first.
+    pub fn render(
+        &mut self,
+        f: &mut Frame,
+        area: Rect,
+        title: &str,
+        audio: &AudioHistory,
+        sample_rate: u32,
+    ) {
+        let block = Block::default()
+            .title(title.dark_gray())
+            .borders(Borders::ALL)
+            .style(Style::default().fg(Color::DarkGray));
+
+        let inner = block.inner(area);
+        f.render_widget(block, area);
+
+        self.update(inner, audio, sample_rate);
+        f.render_widget(&*self, inner);
+    }
+
+    fn update(&mut self, area: Rect, audio: &AudioHistory, sample_rate: u32) {
+        let num_columns = area.width as usize;
+        let num_rows = area.height as usize * 2;
+        if num_columns != self.num_columns
+            || num_rows != self.num_rows
+            || sample_rate != self.sample_rate
+        {
+            self.resize(num_columns, num_rows, sample_rate);
+        }
+
+        let num_hops = audio.position() / self.hop_size as u64;
+        // the history was cleared, start over from its new position
+        if num_hops < self.num_hops {
+            self.num_hops = num_hops;
+        }
+
+        if self.num_columns == 0 || self.num_rows == 0 {
+            self.num_hops = num_hops;
+            return;
+        }
+
+        // the older columns would scroll out of the ring before being shown
+        let num_new = (num_hops - self.num_hops).min(self.num_columns as u64);
+        self.num_hops = num_hops;
+
+        let since_last_hop = (audio.position() % self.hop_size as u64) as usize;
+        for hop in (0..num_new as usize).rev() {
+            let skipped = since_last_hop + hop * self.hop_size;
+            self.push_column(audio, skipped);
+        }
+    }
+
+    /// Add the spectrum of the frames before the latest `skipped` ones as the newest column.
+    fn push_column(&mut self, audio: &AudioHistory, skipped: usize) {
+        let size = self.analyzer.size();
+        let (older, newer) = audio.latest(self.channel, size + skipped);
+        let (older, newer) = drop_newest(older, newer, skipped);
+        let spectrum = self.analyzer.analyze(older, newer);
+
+        let column = self.head * self.num_rows..(self.head + 1) * self.num_rows;
+        let levels = self.levels[column.clone()].iter_mut();
+        let colors = self.colors[column].iter_mut();
+        for ((level, color), bins) in levels.zip(colors).zip(&self.bins) {
+            *level = spectrum[bins.clone()]
+                .iter()
+                .fold(SpectrumAnalyzer::FLOOR_DB, |max, &db| max.max(db));
+            *color = level_color(*level, self.color_map, &self.db_range);
+        }
+
+        self.head = (self.head + 1) % self.num_columns;
+    }
+
+    fn resize(&mut self, num_columns: usize, num_rows: usize, sample_rate: u32) {
+        self.num_columns = num_columns;
+        self.num_rows = num_rows;
+        self.sample_rate = sample_rate;
+        self.levels = vec![f32::NEG_INFINITY; num_columns * num_rows];
+        self.colors = vec![Color::Reset; num_columns * num_rows];
+        self.head = 0;
+        self.bins = row_bins(
+            num_rows,
+            self.analyzer.num_bins(),
+            self.analyzer.bin_width(sample_rate),
+        );
+    }
+
+    fn recolor(&mut self) {
+        for (color, &level) in self.colors.iter_mut().zip(&self.levels) {
+            *color = level_color(level, self.color_map, &self.db_range);
+        }
+    }
+}
+
+impl Widget for &Waterfall {
+    fn render(self, area: Rect, buf: &mut Buffer) {
+        let num_columns = self.num_columns.min(area.width as usize);
+        let num_cells = (self.num_rows / 2).min(area.height as usize);
+
+        for x in 0..num_columns {
+            let column = (self.head + x) % self.num_columns * self.num_rows;
+            for y in 0..num_cells {
+                buf.get_mut(area.x + x as u16, area.y + y as u16)
+                    .set_char(UPPER_HALF_BLOCK)
+                    .set_fg(self.colors[column + 2 * y])
+                    .set_bg(self.colors[column + 2 * y + 1]);
+            }
+        }
+    }
+}
+
+/// The frames of a view of the history but its newest `count` ones.
+fn drop_newest<'a>(older: &'a [f32], newer: &'a [f32], count: usize) -> (&'a [f32], &'a [f32]) {
+    match count <= newer.len() {
+        true => (older, &newer[..newer.len() - count]),
+        false => (
+            &older[..older.len().saturating_sub(count - newer.len())],
+            &[],
+        ),
+    }
+}
+
+/// Color of a level in dB, with the terminal's own for the columns not analyzed yet.
+fn level_color(level: f32, color_map: ColorMap, db_range: &Range<f32>) -> Color {
+    if level == f32::NEG_INFINITY {
+        return Color::Reset;
+    }
+
+    let span = (db_range.end - db_range.start).max(f32::EPSILON);
+    color_map.color((level - db_range.start) / span)
+}
+
+/// Frequency bins spanned by each row, from the top, on a logarithmic
+/// scale from `MIN_FREQUENCY`, or the first bin above it, to Nyquist.
+fn row_bins(num_rows: usize, num_bins: usize, bin_width: f32) -> Vec<Range<usize>> {
+    let max_frequency = num_bins as f32 * bin_width;
+    let min_frequency = MIN_FREQUENCY.max(bin_width).min(max_frequency);
+    let ratio = max_frequency / min_frequency;
+    let frequency = |row: usize| min_frequency * ratio.powf(row as f32 / num_rows as f32);
+
+    (0..num_rows)
+        .rev()
+        .map(|row| {
+            let start = ((frequency(row) / bin_width) as usize).min(num_bins - 1);
+            let end = ((frequency(row + 1) / bin_width).ceil() as usize).clamp(start + 1, num_bins);
+            start..end
+        })
+        .collect()
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use aud::audio::AudioBuffer;
+
+    #[test]
+    fn maps_the_rows_from_nyquist_down_to_the_lowest_frequency() {
+        let bins = row_bins(8, 1024, 23.4375);
+
+        assert_eq!(bins.first().unwrap().end, 1024);
+        // The constant bin is not shown, it is below the lowest frequency.
+        assert_eq!(bins.last().unwrap().start, 1);
+        assert!(bins.windows(2).all(|rows| rows[1].start <= rows[0].start));
+        assert!(bins.iter().all(|row| !row.is_empty()));
+    }
+
+    fn push(audio: &mut AudioHistory, num_frames: usize, value: f32) {
+        audio.push(&AudioBuffer {
+            data: vec![value; num_frames],
+            num_channels: 1,
+            timestamp: 0,
+        });
+    }
+
+    #[test]
+    fn scrolls_one_column_per_hop_of_pushed_frames() {
+        let mut waterfall = Waterfall::new(64);
+        let mut audio = AudioHistory::new(1, 256);
+        let area = Rect::new(0, 0, 4, 2);
+
+        // 6 pushes of a half hop, drawn twice each
+        for i in 0..6 {
+            push(&mut audio, 16, i as f32);
+            waterfall.update(area, &audio, 48_000);
+            waterfall.update(area, &audio, 48_000);
+        }
+
+        let mut buf = Buffer::empty(area);
+        (&waterfall).render(area, &mut buf);
+
+        assert_eq!(buf.get(0, 0).fg, Color::Reset);
+        assert_ne!(buf.get(1, 0).fg, Color::Reset);
+        assert_eq!(buf.get(3, 1).symbol(), "▀");
+        assert_eq!(waterfall.head, 3);
+    }
+
+    #[test]
+    fn adds_every_hop_pushed_between_two_frames() {
+        let mut waterfall = Waterfall::new(64);
+        let mut audio = AudioHistory::new(1, 256);
+        let area = Rect::new(0, 0, 4, 2);
+
+        push(&mut audio, 2 * 32 + 8, 1.);
+        waterfall.update(area, &audio, 48_000);
+        assert_eq!(waterfall.head, 2);
+
+        // a stall longer than the screen only fills the screen once
+        push(&mut audio, 10 * 32, 1.);
+        waterfall.update(area, &audio, 48_000);
+        assert_eq!(waterfall.head, 2);
+        assert_eq!(waterfall.num_hops, 12);
+    }
+
+    #[test]
+    fn drops_the_newest_frames_of_a_view() {
+        let (older, newer) = ([1., 2., 3.].as_slice(), [4., 5.].as_slice());
+
+        assert_eq!(drop_newest(older, newer, 0), (older, newer));
+        assert_eq!(drop_newest(older, newer, 1), (older, &newer[..1]));
+        assert_eq!(drop_newest(older, newer, 3), (&older[..2], &[][..]));
+        assert_eq!(drop_newest(older, newer, 9), (&[][..], &[][..]));
+    }
+}
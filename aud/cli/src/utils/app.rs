@@ -1,3 +1,4 @@
+use crate::frame_stats::{FrameStats, Pipeline};
 use crossterm::event::{Event, KeyCode, KeyEvent, KeyEventKind, KeyModifiers};
 use ratatui::prelude::*;
 use std::time::{Duration, Instant};
@@ -19,10 +20,27 @@ pub trait Base {
         Ok(Flow::Continue)
     }
 
+    /// Whether the data shown changed since the last frame was rendered.
+    /// Frames are only drawn when it did, or after a key press or a
+    /// resize, at most at the refresh rate. Always by default.
+    fn is_dirty(&self) -> bool {
+        true
+    }
+
+    /// Time spent pulling data from its source and how much was
+    /// received during the last `update`, for the frame statistics.
+    fn pipeline(&self) -> Pipeline {
+        Pipeline::default()
+    }
+
     /// Render the terminal UI frame
     fn render(&mut self, frame: &mut Frame);
 }
 
+/// Keys handled by every app, before its own.
+const TOGGLE_FRAME_STATS: KeyCode = KeyCode::F(2);
+const LOG_FRAME_STATS: KeyCode = KeyCode::F(3);
+
 pub fn run(
     terminal: &mut Terminal<impl Backend>,
     app: &mut impl Base,
@@ -32,21 +50,52 @@ pub fn run(
 
     let tick_rate = Duration::from_millis((1000. / fps) as u64);
     let mut last_tick = Instant::now();
+    let mut last_draw: Option<Instant> = None;
+    let mut needs_redraw = true;
+    let mut stats = FrameStats::default();
 
     loop {
-        terminal.draw(|f| app.render(f))?;
+        let until_draw = last_draw.map_or(Duration::ZERO, |last| {
+            tick_rate.saturating_sub(last.elapsed())
+        });
+
+        // the statistics are drawn over the frames of the app, they never cause one
+        if until_draw.is_zero() && (needs_redraw || app.is_dirty()) {
+            let started = Instant::now();
+            let mut render = Duration::ZERO;
+            terminal.draw(|f| {
+                app.render(f);
+                render = started.elapsed();
+                if stats.is_visible() {
+                    crate::ui::widgets::frame_stats::render(f, crate::title!("frames"), &stats);
+                }
+            })?;
+
+            stats.record_frame(started, render, started.elapsed());
+            // from the start, like the ticks, so that the next draw is due on the next tick
+            last_draw = Some(started);
+            needs_redraw = false;
+        }
 
-        let timeout = tick_rate
-            .checked_sub(last_tick.elapsed())
-            .unwrap_or_else(|| Duration::from_secs(0));
+        let until_draw = last_draw.map_or(Duration::ZERO, |last| {
+            tick_rate.saturating_sub(last.elapsed())
+        });
+        let until_tick = tick_rate.saturating_sub(last_tick.elapsed());
+        let timeout = match needs_redraw || app.is_dirty() {
+            true => until_tick.min(until_draw),
+            false => until_tick,
+        };
 
         if crossterm::event::poll(timeout)? {
-            if let Event::Key(key) = crossterm::event::read()? {
-                if key.kind == KeyEventKind::Press {
+            match crossterm::event::read()? {
+                Event::Key(key) if key.kind == KeyEventKind::Press => {
+                    needs_redraw = true;
                     match key.code {
                         KeyCode::Char('c') if key.modifiers == KeyModifiers::CONTROL => {
                             return Ok(())
                         }
+                        TOGGLE_FRAME_STATS => stats.toggle_visible(),
+                        LOG_FRAME_STATS => stats.log(),
                         _ => match app.on_keypress(key)? {
                             Flow::Continue => (),
                             Flow::Loop => continue,
@@ -54,12 +103,16 @@ pub fn run(
                         },
                     }
                 }
+                Event::Resize(..) => needs_redraw = true,
+                _ => (),
             }
         }
 
         if last_tick.elapsed() >= tick_rate {
             last_tick = Instant::now();
-            match app.update()? {
+            let flow = app.update()?;
+            stats.record_update(last_tick.elapsed(), app.pipeline());
+            match flow {
                 Flow::Continue => (),
                 Flow::Loop => continue,
                 Flow::Exit => break,
@@ -67,5 +120,6 @@ pub fn run(
         }
     }
 
+    stats.log();
     Ok(())
 }
@@ -0,0 +1,185 @@
+use std::time::{Duration, Instant};
+
+/// Number of frames the statistics are computed over.
+const NUM_FRAMES: usize = 240;
+
+/// What an app did to prepare the data of a frame, during its last `update`.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct Pipeline {
+    /// Time spent pulling the data shown from its source.
+    pub prep: Duration,
+    /// Events or frames of audio received during the update.
+    pub received: usize,
+}
+
+/// Lowest, average and 99th percentile of the values of a series.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct Summary {
+    pub min: u64,
+    pub avg: u64,
+    pub p99: u64,
+}
+
+/// The latest values of a measure, in a ring that never allocates.
+#[derive(Clone)]
+pub struct Series {
+    values: [u64; NUM_FRAMES],
+    len: usize,
+    next: usize,
+}
+
+impl Default for Series {
+    fn default() -> Self {
+        Self {
+            values: [0; NUM_FRAMES],
+            len: 0,
+            next: 0,
+        }
+    }
+}
+
+impl Series {
+    fn push(&mut self, value: u64) {
+        self.values[self.next] = value;
+        self.next = (self.next + 1) % NUM_FRAMES;
+        self.len = (self.len + 1).min(NUM_FRAMES);
+    }
+
+    fn push_duration(&mut self, duration: Duration) {
+        self.push(duration.as_micros() as u64);
+    }
+
+    /// Summary of the values of the window, sorted on a copy of the ring.
+    pub fn summary(&self) -> Option<Summary> {
+        if self.len == 0 {
+            return None;
+        }
+
+        let mut sorted = self.values;
+        let values = &mut sorted[..self.len];
+        values.sort_unstable();
+
+        Some(Summary {
+            min: values[0],
+            avg: values.iter().sum::<u64>() / self.len as u64,
+            p99: values[(self.len * 99).div_ceil(100) - 1],
+        })
+    }
+}
+
+/// Times of the updates and frames of `app::run`, in microseconds,
+/// and the data pipelines of the apps, over the latest frames.
+///
+/// Recording costs a few clock reads per frame, the summaries
+/// are only computed when they are shown or logged.
+#[derive(Default)]
+pub struct FrameStats {
+    pub update: Series,
+    pub prep: Series,
+    pub received: Series,
+    /// Time the app took to render a frame into the buffer.
+    pub render: Series,
+    /// Time to render and flush a frame to the terminal.
+    pub draw: Series,
+    /// Time between the starts of two drawn frames. Apps only draw
+    /// when their data changed, so idle apps show long intervals.
+    pub interval: Series,
+    last_frame: Option<Instant>,
+    is_visible: bool,
+}
+
+impl FrameStats {
+    pub fn is_visible(&self) -> bool {
+        self.is_visible
+    }
+
+    pub fn toggle_visible(&mut self) {
+        self.is_visible = !self.is_visible;
+    }
+
+    pub fn record_update(&mut self, duration: Duration, pipeline: Pipeline) {
+        self.update.push_duration(duration);
+        self.prep.push_duration(pipeline.prep);
+        self.received.push(pipeline.received as u64);
+    }
+
+    pub fn record_frame(&mut self, started: Instant, render: Duration, draw: Duration) {
+        if let Some(last_frame) = self.last_frame.replace(started) {
+            self.interval.push_duration(started - last_frame);
+        }
+        self.render.push_duration(render);
+        self.draw.push_duration(draw);
+    }
+
+    /// Frames drawn per second, on average over the window, below
+    /// the refresh rate whenever the app had nothing new to draw.
+    pub fn fps(&self) -> Option<f64> {
+        self.interval
+            .summary()
+            .filter(|summary| summary.avg > 0)
+            .map(|summary| 1e6 / summary.avg as f64)
+    }
+
+    /// Name of each measure, with whether it is a duration.
+    pub fn measures(&self) -> [(&'static str, &Series, bool); 6] {
+        [
+            ("update", &self.update, true),
+            ("data prep", &self.prep, true),
+            ("received", &self.received, false),
+            ("render", &self.render, true),
+            ("draw", &self.draw, true),
+            ("between draws", &self.interval, true),
+        ]
+    }
+
+    /// Write the summaries to the log, durations in milliseconds.
+    pub fn log(&self) {
+        log::info!(
+            "[ FRAMES ] : {:.1} drawn fps over the latest {NUM_FRAMES} frames, min / avg / p99",
+            self.fps().unwrap_or_default()
+        );
+
+        for (name, series, is_duration) in self.measures() {
+            if let Some(summary) = series.summary() {
+                log::info!(
+                    "[ FRAMES ] : {name:<13} {} / {} / {}",
+                    format_value(summary.min, is_duration),
+                    format_value(summary.avg, is_duration),
+                    format_value(summary.p99, is_duration),
+                );
+            }
+        }
+    }
+}
+
+/// Durations in milliseconds, counts as they are.
+pub fn format_value(value: u64, is_duration: bool) -> String {
+    match is_duration {
+        true => format!("{:.2} ms", value as f64 / 1000.),
+        false => format!("{value}"),
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn summarizes_the_latest_frames() {
+        let mut series = Series::default();
+        assert_eq!(series.summary(), None);
+
+        for value in 0..NUM_FRAMES as u64 + 100 {
+            series.push(value);
+        }
+
+        assert_eq!(
+            series.summary(),
+            Some(Summary {
+                min: 100,
+                avg: 219,
+                p99: 337,
+            })
+        );
+    }
+}
@@ -5,6 +5,8 @@
 /// │  └── aud
 /// ├── log
 /// │  └── aud.log
+/// ├── recordings
+/// │  └── midimon-<timestamp>.mid
 /// └── lua
 ///    ├── api
 ///    │  ├── auscope
@@ -38,6 +40,10 @@ pub fn log_file(name: &str) -> Option<std::path::PathBuf> {
     Some(log()?.join(format!("{name}.log")))
 }
 
+pub fn recordings() -> Option<PathBuf> {
+    Some(aud()?.join("recordings"))
+}
+
 pub mod lua {
     use super::*;
 
@@ -1,4 +1,5 @@
 pub mod app;
+pub mod frame_stats;
 pub mod locations;
 pub mod logger;
 pub mod terminal;
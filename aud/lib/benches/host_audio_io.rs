@@ -14,6 +14,7 @@ fn bench_enqueue(c: &mut Criterion) {
                 sender,
                 input_channels,
                 selected_channels,
+                48_000,
             );
             let audio_buffer: Vec<f32> = repeat_with(|| random::<f32>())
                 .take(buffer_size * input_channels)
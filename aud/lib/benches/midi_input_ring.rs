@@ -0,0 +1,99 @@
+use audlib::midi::*;
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use std::time::{Duration, Instant};
+
+/// The ring capacity used by the hosted receiver for each port.
+const CAPACITY: usize = 4096;
+const MESSAGES_PER_SECOND: u64 = 100_000;
+/// The UI drains the rings once per frame.
+const FRAME: Duration = Duration::from_millis(16);
+
+fn bench_push_and_drain(c: &mut Criterion) {
+    let messages_per_frame = MESSAGES_PER_SECOND / 60;
+    let mut group = c.benchmark_group("MIDI Input Ring");
+    group.throughput(Throughput::Elements(messages_per_frame));
+    group.bench_function("Frame at 100k msg/s", |b| {
+        let (mut callback, mut consumer, _) = test_make_midi_input_callback(0, CAPACITY);
+        let mut messages = Vec::with_capacity(CAPACITY);
+
+        b.iter(|| {
+            for i in 0..messages_per_frame {
+                callback(&[0x90, (i % 128) as u8, 100]);
+            }
+            messages.clear();
+            consumer.drain_into(&mut messages);
+        });
+
+        assert_eq!(consumer.num_dropped(), 0);
+    });
+    group.finish();
+}
+
+/// MIDI threads sharing a rate of 100k messages per second
+/// and a UI thread draining and merging their rings once
+/// per frame, without losing or misordering any message.
+fn bench_sustained_rate(c: &mut Criterion) {
+    const NUM_MESSAGES: u64 = 10_000;
+
+    let mut group = c.benchmark_group("MIDI Input Ring");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(NUM_MESSAGES));
+
+    for num_ports in [1, 8] {
+        let name = format!("Sustained 100k msg/s over {num_ports} ports");
+        group.bench_function(name, |b| {
+            b.iter(|| {
+                let epoch = Instant::now();
+                let messages_per_port = NUM_MESSAGES / num_ports;
+                let interval = Duration::from_secs(1) / (MESSAGES_PER_SECOND / num_ports) as u32;
+
+                let (producers, mut consumers): (Vec<_>, Vec<_>) = (0..num_ports)
+                    .map(|port| {
+                        let (mut callback, consumer, in_flight) =
+                            test_make_midi_input_callback(port as MidiPortId, CAPACITY);
+
+                        let producer = std::thread::spawn(move || {
+                            for i in 0..messages_per_port {
+                                while epoch.elapsed() < interval * i as u32 {
+                                    std::hint::spin_loop();
+                                }
+                                callback(&[0x90, (i % 128) as u8, 100]);
+                            }
+                        });
+
+                        (producer, (consumer, in_flight))
+                    })
+                    .unzip();
+
+                let mut pending = vec![vec![]; consumers.len()];
+                let mut merger = MidiMerger::default();
+                let mut messages = Vec::with_capacity(NUM_MESSAGES as usize);
+                let num_dropped = |consumers: &[(RingConsumer<MidiData>, MidiInFlight)]| -> u64 {
+                    consumers.iter().map(|(c, _)| c.num_dropped()).sum()
+                };
+
+                while messages.len() < (messages_per_port * num_ports) as usize
+                    && num_dropped(&consumers) == 0
+                {
+                    std::thread::sleep(FRAME);
+                    let watermark = midi_watermark(consumers.iter().map(|(_, f)| f));
+                    for ((consumer, _), pending) in consumers.iter_mut().zip(pending.iter_mut()) {
+                        consumer.drain_into(pending);
+                    }
+                    merger.merge(&mut pending, watermark, &mut messages);
+                }
+
+                producers.into_iter().for_each(|p| p.join().unwrap());
+                assert_eq!(num_dropped(&consumers), 0);
+                assert!(messages
+                    .windows(2)
+                    .all(|w| w[0].timestamp <= w[1].timestamp));
+            });
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(midi_input_ring, bench_push_and_drain, bench_sustained_rate);
+criterion_main!(midi_input_ring);
@@ -0,0 +1,81 @@
+use audlib::{clock, comms::*, midi::*};
+use criterion::{black_box, criterion_group, criterion_main, Criterion};
+use std::{
+    net::UdpSocket,
+    time::{Duration, Instant},
+};
+
+/// Sockets bound to ephemeral loopback ports, targeting each other.
+/// The timeout lets the socket threads shut down when dropped.
+fn loopback_sockets() -> (Sockets<UdpSocket>, Sockets<UdpSocket>) {
+    let bind = || {
+        let socket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        socket
+            .set_read_timeout(Some(Duration::from_millis(10)))
+            .unwrap();
+        socket
+    };
+
+    let (a, b) = (bind(), bind());
+    let (a_addr, b_addr) = (a.local_addr().unwrap(), b.local_addr().unwrap());
+
+    (
+        Sockets {
+            socket: a,
+            target: b_addr,
+        },
+        Sockets {
+            socket: b,
+            target: a_addr,
+        },
+    )
+}
+
+/// Time from handing a message to the transmitter to
+/// producing it from the receiver, on another host but
+/// over loopback, which leaves out the network itself.
+fn bench_loopback_latency(c: &mut Criterion) {
+    let mut group = c.benchmark_group("MIDI Network");
+
+    let (tx_sockets, rx_sockets) = loopback_sockets();
+    let mut tx = RemoteMidiTransmitter::new(tx_sockets).unwrap();
+    let mut rx = RemoteMidiReceiver::new(rx_sockets).unwrap();
+    let device = rx.list_midi_devices().unwrap().remove(0);
+    rx.connect_to_midi_device(&device, 0).unwrap();
+
+    for num_messages in [1, 32] {
+        group.bench_function(format!("Loopback latency of {num_messages} notes"), |b| {
+            b.iter_custom(|iters| {
+                let mut elapsed = Duration::ZERO;
+
+                for _ in 0..iters {
+                    let messages: Vec<_> = (0..num_messages)
+                        .map(|i| MidiData {
+                            timestamp: clock::now(),
+                            port: 0,
+                            bytes: [0x90, 60 + i as u8, 100].into(),
+                        })
+                        .collect();
+
+                    let start = Instant::now();
+                    tx.send_midi_messages(&device, &messages).unwrap();
+
+                    let mut num_received = 0;
+                    while num_received < num_messages {
+                        num_received += black_box(rx.produce_midi_messages()).len();
+                    }
+
+                    elapsed += start.elapsed();
+                }
+
+                elapsed
+            });
+        });
+    }
+
+    group.finish();
+    assert_eq!(rx.dropped_midi_messages(), 0);
+}
+
+criterion_group!(midi_network, bench_loopback_latency);
+criterion_main!(midi_network);
@@ -0,0 +1,53 @@
+use audlib::midi::*;
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+
+/// Routes from a keyboard to as many outputs, each
+/// with every transform, on a channel of its own.
+fn make_routes(num_routes: usize) -> Vec<MidiRoute> {
+    (0..num_routes)
+        .map(|i| MidiRoute {
+            from: Some("keys".into()),
+            to: format!("synth {}", i % 8),
+            channels: vec![0],
+            kinds: vec![MidiMessageKind::NoteOn, MidiMessageKind::NoteOff],
+            channel: Some((i % 16) as u8),
+            transpose: (i % 24) as i8 - 12,
+            velocity: VelocityCurve::Power(0.5),
+        })
+        .collect()
+}
+
+/// The thru runs on the MIDI thread of the input, the time to
+/// route a message adds to the latency, which should stay under
+/// 200 µs along with the time to send it to the outputs.
+fn bench_route(c: &mut Criterion) {
+    let mut group = c.benchmark_group("MIDI Routing");
+    group.throughput(Throughput::Elements(1));
+
+    for num_routes in [1, 8, 64] {
+        let router = MidiRouter::new(&make_routes(num_routes)).unwrap();
+        let mut routes = router.routes_from("keys");
+
+        group.bench_function(format!("Note through {num_routes} routes"), |b| {
+            let mut note = 0;
+            b.iter(|| {
+                note = (note + 1) % 128;
+                let mut num_sent = 0;
+                routes.route(black_box(&[0x90, note, 100]), |output, bytes| {
+                    black_box((output, bytes));
+                    num_sent += 1;
+                });
+                num_sent
+            });
+        });
+
+        group.bench_function(format!("Filtered out by {num_routes} routes"), |b| {
+            b.iter(|| routes.route(black_box(&[0xB1, 1, 64]), |_, _| unreachable!()));
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(midi_routing, bench_route);
+criterion_main!(midi_routing);
@@ -34,7 +34,7 @@ fn inject_lua_scripts() {
     let out_dir = Path::new(&env::var("OUT_DIR").unwrap()).join(env!("AUD_IMPORTED_LUA_RS"));
     let mut file = File::create(out_dir).unwrap();
 
-    for cmd in ["auscope", "midimon"] {
+    for cmd in ["auscope", "midimon", "sysexio"] {
         writeln!(file, "pub mod {} {{", cmd).unwrap();
 
         let apis = prj_dir.join(format!("lua/api/{cmd}/api.lua"));
@@ -5,7 +5,7 @@ use std::sync::Arc;
 use std::sync::Mutex;
 use std::thread::sleep;
 use std::thread::JoinHandle;
-use std::time::Duration;
+use std::time::{Duration, Instant};
 
 #[derive(Default, Debug)]
 pub struct AudioInfo {
@@ -94,8 +94,10 @@ fn main() -> anyhow::Result<()> {
     )
     .unwrap();
 
+    let in_a_second = || Instant::now() + Duration::from_millis(1_000);
+
     while rx.list_audio_devices().is_empty() {
-        sleep(Duration::from_millis(1_000));
+        rx.wait_for_events(in_a_second());
         rx.process_audio_events().unwrap();
         log::info!("reattempting to get devices");
     }
@@ -112,7 +114,7 @@ fn main() -> anyhow::Result<()> {
 
     while rx.connected_audio_device().is_none() {
         rx.process_audio_events().unwrap();
-        sleep(Duration::from_millis(1_000));
+        rx.wait_for_events(in_a_second());
         log::info!("waiting for transmitter to connect to device...");
     }
 
@@ -121,13 +123,22 @@ fn main() -> anyhow::Result<()> {
 
     while !rx.is_accessible() {
         rx.process_audio_events().unwrap();
-        sleep(Duration::from_millis(100));
+        rx.wait_for_events(in_a_second());
         log::info!("waiting for transmitter to be accessible...");
     }
 
     while rx.is_accessible() {
         rx.process_audio_events().unwrap();
-        sleep(Duration::from_millis(10));
+        rx.wait_for_events(in_a_second());
+
+        let midi = rx.take_midi_messages();
+        if !midi.is_empty() {
+            log::info!(
+                "received {} midi messages, {} dropped so far",
+                midi.len(),
+                rx.dropped_midi_messages()
+            );
+        }
     }
 
     Ok(())
@@ -1,5 +1,6 @@
 use audlib::audio::*;
 use audlib::comms::*;
+use audlib::midi::{HostedMidiReceiver, MidiReceiving};
 use std::net::UdpSocket;
 use std::thread::sleep;
 use std::time::Duration;
@@ -42,8 +43,22 @@ fn main() -> anyhow::Result<()> {
 
     log::info!("connected to audio device");
 
+    let mut midi = HostedMidiReceiver::default();
+    for (port, device) in midi.list_midi_devices()?.iter().enumerate() {
+        if let Err(e) = midi.connect_to_midi_device(device, port as _) {
+            log::error!("failed to connect to {device} : {e}");
+        }
+    }
+
     while tx.is_accessible() {
         tx.process_audio_events().unwrap();
+
+        let messages = midi.produce_midi_messages();
+        if !messages.is_empty() {
+            if let Err(e) = tx.send_midi(&messages) {
+                log::warn!("failed to send midi : {e}");
+            }
+        }
     }
 
     Ok(())
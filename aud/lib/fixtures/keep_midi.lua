@@ -0,0 +1,6 @@
+local first = nil
+
+function on_midi(device_name, bytes)
+    first = first or bytes
+    alert(table.concat(first, ","))
+end
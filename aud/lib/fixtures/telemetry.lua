@@ -0,0 +1,5 @@
+function on_midi(device_name, bytes)
+    plot("velocity", bytes[3])
+    scalar("note", bytes[2])
+    histogram("notes", bytes[2], 0, 128, 128)
+end
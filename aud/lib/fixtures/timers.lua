@@ -0,0 +1,19 @@
+function on_start()
+    local count = 0
+    every(1000, function()
+        count = count + 1
+        alert("every:" .. count)
+    end)
+
+    local cancelled = after(2000, function() alert("cancelled") end)
+    after(1500, function()
+        alert("after")
+        cancel(cancelled)
+    end)
+
+    spawn(function()
+        alert("spawn")
+        sleep(2500)
+        alert("woke")
+    end)
+end
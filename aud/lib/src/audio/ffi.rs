@@ -1,6 +1,6 @@
 #![allow(non_camel_case_types)]
 
-use crate::comms::Sockets;
+use crate::{clock, comms::Sockets};
 
 use super::*;
 use crossbeam::channel::{Receiver, Sender, TryRecvError};
@@ -69,6 +69,7 @@ impl AudioInterface for CachingAudioProvider {
 
     fn process_audio_events(&mut self) -> anyhow::Result<()> {
         match self.receiver.try_recv() {
+            Ok(audio) if self.audio.data.is_empty() => self.audio = audio,
             Ok(mut audio) => {
                 self.audio.num_channels = audio.num_channels;
                 self.audio.data.append(&mut audio.data)
@@ -313,6 +314,7 @@ unsafe extern "C" fn aud_audio_transmitter_push(
     let data = slice::from_raw_parts(interleaved_buffer, (num_channels * num_frames) as usize);
     let selected_channels = connection.channels.as_vec();
     let mut buffer = AudioBuffer::with_frames(num_frames, selected_channels.len() as u32);
+    buffer.timestamp = clock::now();
 
     for frame in 0..num_frames as usize {
         for (write_chan, &chan) in selected_channels.iter().enumerate() {
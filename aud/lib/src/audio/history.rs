@@ -0,0 +1,171 @@
+use super::AudioBuffer;
+use std::time::Duration;
+
+/// A fixed-capacity history of the latest frames of each channel.
+///
+/// Channels are stored deinterleaved in circular buffers allocated
+/// once, pushing frames overwrites the oldest ones and never moves
+/// the others. Views of the latest frames are a pair of slices,
+/// like `VecDeque::as_slices`, from oldest to newest.
+#[derive(Debug, Clone, PartialEq)]
+pub struct AudioHistory {
+    channels: Vec<Box<[f32]>>,
+    capacity: usize,
+    /// Index of the next frame to write.
+    head: usize,
+    num_frames: usize,
+    /// Number of frames pushed since the history was created or cleared.
+    position: u64,
+}
+
+impl Default for AudioHistory {
+    fn default() -> Self {
+        Self::new(1, 0)
+    }
+}
+
+impl AudioHistory {
+    pub fn new(num_channels: usize, capacity: usize) -> Self {
+        Self {
+            channels: (0..num_channels)
+                .map(|_| vec![0.; capacity].into_boxed_slice())
+                .collect(),
+            capacity,
+            head: 0,
+            num_frames: 0,
+            position: 0,
+        }
+    }
+
+    /// Create a history holding `duration` of audio at `sample_rate`.
+    pub fn with_duration(num_channels: usize, sample_rate: u32, duration: Duration) -> Self {
+        let capacity = (sample_rate as f64 * duration.as_secs_f64()).ceil() as usize;
+        Self::new(num_channels, capacity)
+    }
+
+    pub fn num_channels(&self) -> usize {
+        self.channels.len()
+    }
+
+    /// Number of frames the history holds at most.
+    pub fn capacity(&self) -> usize {
+        self.capacity
+    }
+
+    /// Number of frames currently in the history.
+    pub fn num_frames(&self) -> usize {
+        self.num_frames
+    }
+
+    /// Number of frames pushed since the history was created or cleared,
+    /// including those the history no longer holds. Views of the latest
+    /// frames have not changed as long as the position has not.
+    pub fn position(&self) -> u64 {
+        self.position
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.num_frames == 0
+    }
+
+    pub fn clear(&mut self) {
+        self.head = 0;
+        self.num_frames = 0;
+        self.position = 0;
+    }
+
+    /// Append the frames of an interleaved buffer with as many channels as the
+    /// history. Only the last `capacity` frames of larger buffers are kept.
+    pub fn push(&mut self, audio: &AudioBuffer) {
+        let num_channels = self.channels.len();
+        if self.capacity == 0 || num_channels == 0 {
+            return;
+        }
+
+        debug_assert_eq!(audio.num_channels as usize, num_channels);
+        let num_frames = audio.data.len() / num_channels;
+        let skipped = num_frames.saturating_sub(self.capacity);
+        let frames = audio.data[skipped * num_channels..num_frames * num_channels]
+            .chunks_exact(num_channels);
+
+        for frame in frames {
+            for (channel, sample) in self.channels.iter_mut().zip(frame) {
+                channel[self.head] = *sample;
+            }
+
+            self.head += 1;
+            if self.head == self.capacity {
+                self.head = 0;
+            }
+        }
+
+        self.num_frames = (self.num_frames + num_frames).min(self.capacity);
+        self.position += num_frames as u64;
+    }
+
+    /// The latest `num_frames` frames of a channel, or all
+    /// of them if there are fewer, from oldest to newest.
+    pub fn latest(&self, channel: usize, num_frames: usize) -> (&[f32], &[f32]) {
+        let Some(samples) = self.channels.get(channel) else {
+            return (&[], &[]);
+        };
+
+        let num_frames = num_frames.min(self.num_frames);
+        match num_frames <= self.head {
+            true => (&samples[self.head - num_frames..self.head], &[]),
+            false => (
+                &samples[self.capacity - (num_frames - self.head)..],
+                &samples[..self.head],
+            ),
+        }
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn buffer(data: &[f32], num_channels: u32) -> AudioBuffer {
+        AudioBuffer {
+            data: data.to_vec(),
+            num_channels,
+            timestamp: 0,
+        }
+    }
+
+    fn latest(history: &AudioHistory, channel: usize, num_frames: usize) -> Vec<f32> {
+        let (older, newer) = history.latest(channel, num_frames);
+        older.iter().chain(newer).copied().collect()
+    }
+
+    #[test]
+    fn keeps_the_latest_frames_of_each_channel() {
+        let mut history = AudioHistory::new(2, 4);
+        history.push(&buffer(&[0., 10., 1., 11., 2., 12.], 2));
+        assert_eq!(history.num_frames(), 3);
+        assert_eq!(latest(&history, 0, 8), [0., 1., 2.]);
+        assert_eq!(latest(&history, 1, 2), [11., 12.]);
+
+        history.push(&buffer(&[3., 13., 4., 14.], 2));
+        assert_eq!(history.num_frames(), 4);
+        assert_eq!(latest(&history, 0, 8), [1., 2., 3., 4.]);
+        assert_eq!(latest(&history, 1, 3), [12., 13., 14.]);
+        assert_eq!(latest(&history, 2, 3), []);
+
+        history.clear();
+        assert!(history.is_empty());
+        assert_eq!(latest(&history, 0, 8), []);
+    }
+
+    #[test]
+    fn keeps_the_end_of_buffers_larger_than_the_history() {
+        let mut history = AudioHistory::with_duration(1, 1_000, Duration::from_millis(3));
+        assert_eq!(history.capacity(), 3);
+
+        history.push(&buffer(&[0., 1., 2., 3., 4.], 1));
+        assert_eq!(latest(&history, 0, 3), [2., 3., 4.]);
+        history.push(&buffer(&[5.], 1));
+        assert_eq!(latest(&history, 0, 3), [3., 4., 5.]);
+        assert_eq!(history.position(), 6);
+    }
+}
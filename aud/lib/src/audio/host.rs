@@ -1,6 +1,7 @@
 use std::collections::HashSet;
 
 use super::*;
+use crate::clock;
 use cpal::{traits::*, FromSample, Sample, SizedSample};
 use crossbeam::channel::{Receiver, Sender};
 
@@ -81,7 +82,7 @@ impl AudioInterface for HostAudioInput {
 
     fn process_audio_events(&mut self) -> anyhow::Result<()> {
         for mut buffer in self.receiver.try_iter() {
-            if buffer.num_channels != self.audio.num_channels {
+            if buffer.num_channels != self.audio.num_channels || self.audio.data.is_empty() {
                 self.audio = buffer;
             } else {
                 self.audio.data.append(&mut buffer.data);
@@ -314,6 +315,7 @@ where
         sender,
         config.channels as usize,
         selection.as_vec(),
+        config.sample_rate.0,
     );
 
     let stream = device.build_input_stream(
@@ -356,6 +358,7 @@ fn make_audio_buffer_enqueueing_function<T>(
     sender: Sender<AudioBuffer>,
     num_input_channels: usize,
     selected_channels: Vec<usize>,
+    sample_rate: u32,
 ) -> impl Fn(&[T])
 where
     T: SizedSample + FromSample<f32>,
@@ -369,6 +372,10 @@ where
             num_requested_channels as u32,
         );
 
+        // the callback runs once the last frame was captured
+        let duration = num_frames as u64 * 1_000_000 / sample_rate.max(1) as u64;
+        buffer.timestamp = clock::now().saturating_sub(duration);
+
         for (chan_idx, &read_chan) in selected_channels.iter().enumerate() {
             for frame in 0..num_frames {
                 let read_index = frame * num_input_channels + read_chan;
@@ -444,8 +451,14 @@ pub fn test_make_audio_buffer_enqueueing_function(
     sender: Sender<AudioBuffer>,
     num_input_channels: usize,
     selected_channels: Vec<usize>,
+    sample_rate: u32,
 ) -> impl Fn(&[f32]) {
-    make_audio_buffer_enqueueing_function::<f32>(sender, num_input_channels, selected_channels)
+    make_audio_buffer_enqueueing_function::<f32>(
+        sender,
+        num_input_channels,
+        selected_channels,
+        sample_rate,
+    )
 }
 
 #[cfg(feature = "bench")]
@@ -496,6 +509,7 @@ mod test {
                     sender,
                     num_channels,
                     channels.as_vec(),
+                    48_000,
                 );
                 let mut buffer = AudioBuffer::with_frames(num_frames, num_channels as u32);
                 assign_channel_index_to_each_sample(&mut buffer);
@@ -526,6 +540,7 @@ mod test {
                         sender,
                         num_channels,
                         channels.clone(),
+                        48_000,
                     );
 
                     let mut buffer = AudioBuffer::with_frames(num_frames, num_channels as u32);
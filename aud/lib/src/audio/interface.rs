@@ -51,6 +51,14 @@ pub trait AudioConsuming {
 pub struct AudioBuffer {
     pub data: Vec<f32>,
     pub num_channels: u32,
+    /// Time of the first frame, in microseconds on the shared
+    /// clock, or 0 for buffers that were not captured live.
+    ///
+    /// Clocks are local to a process, so the timestamp is not
+    /// sent, which keeps the wire format of older builds.
+    /// Received buffers are stamped on arrival.
+    #[serde(skip)]
+    pub timestamp: u64,
 }
 
 impl Default for AudioBuffer {
@@ -58,6 +66,7 @@ impl Default for AudioBuffer {
         Self {
             data: vec![],
             num_channels: 1,
+            timestamp: 0,
         }
     }
 }
@@ -86,6 +95,7 @@ impl AudioBuffer {
         Self {
             data: vec![0.; num_frames as usize * num_channels as usize],
             num_channels,
+            timestamp: 0,
         }
     }
 
@@ -112,6 +122,7 @@ impl AudioBuffer {
         Self {
             data: vec![0.; length as usize],
             num_channels,
+            timestamp: 0,
         }
     }
 
@@ -119,6 +130,7 @@ impl AudioBuffer {
     ///
     /// This unsafely assumes all buffers have the same number of channels,
     /// it is up to the caller to guarantee this and pad is necessary.
+    /// The accumulated buffer starts at the time of the first buffer.
     pub fn from_buffers(buffers: impl AsRef<[Self]>) -> Self {
         let buffers = buffers.as_ref();
         let num_channels = buffers.first().map(|b| b.num_channels).unwrap_or(0);
@@ -126,6 +138,7 @@ impl AudioBuffer {
 
         let total_len: usize = buffers.iter().map(|buffer| buffer.data.len()).sum();
         let mut buffer = Self::with_length(total_len as u32, num_channels); // Adjusted the length
+        buffer.timestamp = buffers.first().map_or(0, |b| b.timestamp);
 
         let mut start_idx = 0;
         buffers.iter().for_each(|buf| {
@@ -142,6 +155,7 @@ impl AudioBuffer {
         Self {
             data: crate::dsp::interleave(buffer),
             num_channels: buffer.len() as u32,
+            timestamp: 0,
         }
     }
 
@@ -153,7 +167,7 @@ impl AudioBuffer {
     /// Number of "frames" in this interleaved buffer. This is effectively
     /// the same as "number of samples per channel" for this buffer.
     pub fn num_frames(&self) -> usize {
-        self.data.len() / self.num_channels.min(1) as usize
+        self.data.len() / self.num_channels.max(1) as usize
     }
 }
 
@@ -1,10 +1,14 @@
 #[cfg(feature = "ffi")]
 mod ffi;
 
+mod history;
 mod host;
 mod interface;
 mod net;
+mod wav;
 
+pub use history::*;
 pub use host::*;
 pub use interface::*;
 pub use net::*;
+pub use wav::*;
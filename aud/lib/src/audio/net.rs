@@ -1,6 +1,11 @@
 use super::*;
-use crate::comms::*;
-use crossbeam::channel::{Receiver, Sender};
+use crate::{clock, comms::*, midi::MidiData};
+use crossbeam::channel::{Receiver, Select, Sender, TryRecvError};
+use std::time::Instant;
+
+/// Number of received MIDI messages kept until they are taken,
+/// the oldest ones are dropped when they are not taken in time.
+const MAX_PENDING_MIDI: usize = 4096;
 
 /// `RemoteAudioReceiver` acts as a facade to a remote `AudioProviding` struct,
 /// proxying the audio data to the local `AudioConsumer`.
@@ -12,10 +17,15 @@ pub struct RemoteAudioReceiver<AudioConsumer: AudioConsuming> {
     devices: Vec<AudioDevice>,
     sender: Sender<AudioRequest>,
     receiver: Receiver<AudioResponse>,
+    /// Received while waiting, processed before the next ones.
+    peeked: Option<AudioResponse>,
     is_remote_accessible: bool,
     packets: AudioPacketSequence,
     audio_consumer: AudioConsumer,
     connected_device: Option<AudioDeviceConnection>,
+    midi_reader: MidiPacketReader,
+    midi: Vec<MidiData>,
+    num_dropped_midi: u64,
     _handle: SocketCommunicator,
 }
 
@@ -34,10 +44,14 @@ impl<AudioConsumer: AudioConsuming> RemoteAudioReceiver<AudioConsumer> {
             devices: vec![],
             sender: request_tx,
             receiver: response_rx,
+            peeked: None,
             is_remote_accessible: false,
             audio_consumer,
             packets: AudioPacketSequence::default(),
             connected_device: None,
+            midi_reader: MidiPacketReader::default(),
+            midi: vec![],
+            num_dropped_midi: 0,
             _handle: SocketCommunicator::launch(
                 sockets,
                 Events {
@@ -47,6 +61,44 @@ impl<AudioConsumer: AudioConsuming> RemoteAudioReceiver<AudioConsumer> {
             ),
         })
     }
+
+    /// MIDI messages sent by the transmitter along with the audio,
+    /// received since the last call, stamped with the local `clock`.
+    pub fn take_midi_messages(&mut self) -> Vec<MidiData> {
+        std::mem::take(&mut self.midi)
+    }
+
+    /// Number of MIDI messages lost on the way, or dropped
+    /// because they were not taken before newer ones arrived.
+    pub fn dropped_midi_messages(&self) -> u64 {
+        self.midi_reader.num_lost() + self.num_dropped_midi
+    }
+
+    /// Block until the transmitter has sent something or until `deadline`,
+    /// without processing it. Returns whether something was received,
+    /// which never happens again once the socket tasks have stopped.
+    pub fn wait_for_events(&mut self, deadline: Instant) -> bool {
+        if self.peeked.is_some() {
+            return true;
+        }
+
+        let mut select = Select::new();
+        select.recv(&self.receiver);
+        while select.ready_deadline(deadline).is_ok() {
+            match self.receiver.try_recv() {
+                Ok(response) => {
+                    self.peeked = Some(response);
+                    return true;
+                }
+                Err(TryRecvError::Empty) => (),
+                Err(TryRecvError::Disconnected) => {
+                    std::thread::sleep(deadline.saturating_duration_since(Instant::now()));
+                    return false;
+                }
+            }
+        }
+        false
+    }
 }
 
 impl<AudioConsumer: AudioConsuming> AudioInterface for RemoteAudioReceiver<AudioConsumer> {
@@ -80,7 +132,7 @@ impl<AudioConsumer: AudioConsuming> AudioInterface for RemoteAudioReceiver<Audio
     }
 
     fn process_audio_events(&mut self) -> anyhow::Result<()> {
-        while let Ok(event) = self.receiver.try_recv() {
+        while let Some(event) = self.peeked.take().or_else(|| self.receiver.try_recv().ok()) {
             match event {
                 AudioResponse::Connected(dev) => {
                     self.is_remote_accessible = true;
@@ -94,9 +146,17 @@ impl<AudioConsumer: AudioConsuming> AudioInterface for RemoteAudioReceiver<Audio
                     self.is_remote_accessible = true;
                     self.packets.push(packet);
                 }
+                AudioResponse::Midi(packet) => {
+                    self.midi_reader.read(packet, clock::now(), &mut self.midi);
+                }
             }
         }
 
+        if let Some(num_dropped) = self.midi.len().checked_sub(MAX_PENDING_MIDI) {
+            self.midi.drain(..num_dropped);
+            self.num_dropped_midi += num_dropped as u64;
+        }
+
         if self.packets.num_available_frames() != 0 {
             let buffer = AudioBuffer::from_buffers(self.packets.extract());
             self.audio_consumer.consume_audio_buffer(buffer)?;
@@ -118,6 +178,7 @@ pub struct RemoteAudioTransmitter<AudioProvider> {
     responses: Sender<AudioResponse>,
     sequence: AudioPacketSequenceBuilder,
     connected_device: Option<AudioDeviceConnection>,
+    midi_writer: MidiPacketWriter,
     _handle: SocketCommunicator,
 }
 
@@ -141,6 +202,7 @@ where
             responses: response_tx,
             sequence: AudioPacketSequenceBuilder::default(),
             connected_device: None,
+            midi_writer: MidiPacketWriter::default(),
             _handle: SocketCommunicator::launch(
                 sockets,
                 Events {
@@ -151,6 +213,12 @@ where
         })
     }
 
+    /// Send MIDI messages in the same session as the audio.
+    pub fn send_midi(&mut self, messages: &[MidiData]) -> anyhow::Result<()> {
+        self.midi_writer
+            .send(messages, &self.responses, AudioResponse::Midi)
+    }
+
     fn purge_audio_cache(&mut self) {
         let _ = self.audio_provider.retrieve_audio_buffer();
     }
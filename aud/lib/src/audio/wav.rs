@@ -0,0 +1,183 @@
+use super::AudioBuffer;
+use std::path::Path;
+
+/// An audio recording loaded in memory.
+#[derive(Debug, Clone, PartialEq)]
+pub struct AudioFile {
+    pub buffer: AudioBuffer,
+    pub sample_rate: u32,
+}
+
+/// Read a WAV file into an interleaved `f32` buffer.
+///
+/// Supports 8, 16, 24 and 32-bit integer PCM as well
+/// as 32 and 64-bit floating point files.
+pub fn read_wav_file(path: impl AsRef<Path>) -> anyhow::Result<AudioFile> {
+    parse_wav_file(&std::fs::read(path.as_ref())?)
+}
+
+/// Parse the content of a WAV file, see `read_wav_file`.
+pub fn parse_wav_file(bytes: &[u8]) -> anyhow::Result<AudioFile> {
+    if bytes.len() < 12 || bytes[0..4] != *b"RIFF" || bytes[8..12] != *b"WAVE" {
+        anyhow::bail!("[ WAV ] : missing RIFF/WAVE header");
+    }
+
+    let mut format = None;
+    let mut data = None;
+    let mut chunks = &bytes[12..];
+
+    while chunks.len() >= 8 {
+        let id = &chunks[0..4];
+        let len = u32::from_le_bytes([chunks[4], chunks[5], chunks[6], chunks[7]]) as usize;
+        let body = chunks
+            .get(8..8 + len)
+            .ok_or_else(|| anyhow::anyhow!("[ WAV ] : truncated chunk"))?;
+
+        match id {
+            b"fmt " => format = Some(Format::parse(body)?),
+            b"data" => data = Some(body),
+            _ => (),
+        }
+
+        // chunks are padded to an even number of bytes
+        chunks = chunks.get(8 + len + (len & 1)..).unwrap_or_default();
+    }
+
+    let (Some(format), Some(data)) = (format, data) else {
+        anyhow::bail!("[ WAV ] : missing format or data chunk");
+    };
+
+    Ok(AudioFile {
+        buffer: AudioBuffer {
+            data: format.decode(data)?,
+            num_channels: format.num_channels as u32,
+            timestamp: 0,
+        },
+        sample_rate: format.sample_rate,
+    })
+}
+
+const PCM: u16 = 1;
+const IEEE_FLOAT: u16 = 3;
+const EXTENSIBLE: u16 = 0xFFFE;
+
+struct Format {
+    tag: u16,
+    num_channels: u16,
+    sample_rate: u32,
+    bits_per_sample: u16,
+}
+
+impl Format {
+    fn parse(body: &[u8]) -> anyhow::Result<Self> {
+        if body.len() < 16 {
+            anyhow::bail!("[ WAV ] : invalid format chunk");
+        }
+
+        let u16_at = |i: usize| u16::from_le_bytes([body[i], body[i + 1]]);
+
+        let tag = match u16_at(0) {
+            // the actual format is the start of the sub-format GUID
+            EXTENSIBLE if body.len() >= 26 => u16_at(24),
+            tag => tag,
+        };
+
+        let format = Self {
+            tag,
+            num_channels: u16_at(2),
+            sample_rate: u32::from_le_bytes([body[4], body[5], body[6], body[7]]),
+            bits_per_sample: u16_at(14),
+        };
+
+        if format.num_channels == 0 {
+            anyhow::bail!("[ WAV ] : invalid channel count");
+        }
+
+        Ok(format)
+    }
+
+    fn decode(&self, data: &[u8]) -> anyhow::Result<Vec<f32>> {
+        let sample_size = self.bits_per_sample as usize / 8;
+        let samples = data.chunks_exact(sample_size.max(1));
+
+        let data = match (self.tag, self.bits_per_sample) {
+            (PCM, 8) => samples.map(|s| (s[0] as f32 - 128.) / 128.).collect(),
+            (PCM, 16) => samples
+                .map(|s| i16::from_le_bytes([s[0], s[1]]) as f32 / 32_768.)
+                .collect(),
+            (PCM, 24) => samples
+                .map(|s| (i32::from_le_bytes([0, s[0], s[1], s[2]]) >> 8) as f32 / 8_388_608.)
+                .collect(),
+            (PCM, 32) => samples
+                .map(|s| i32::from_le_bytes([s[0], s[1], s[2], s[3]]) as f32 / 2_147_483_648.)
+                .collect(),
+            (IEEE_FLOAT, 32) => samples
+                .map(|s| f32::from_le_bytes([s[0], s[1], s[2], s[3]]))
+                .collect(),
+            (IEEE_FLOAT, 64) => samples
+                .map(|s| f64::from_le_bytes([s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]]))
+                .map(|s| s as f32)
+                .collect(),
+            (tag, bits) => anyhow::bail!("[ WAV ] : unsupported format {tag} with {bits} bits"),
+        };
+
+        Ok(data)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn wav(tag: u16, num_channels: u16, bits_per_sample: u16, data: &[u8]) -> Vec<u8> {
+        let mut fmt = vec![];
+        fmt.extend(tag.to_le_bytes());
+        fmt.extend(num_channels.to_le_bytes());
+        fmt.extend(48_000u32.to_le_bytes());
+        fmt.extend(0u32.to_le_bytes());
+        fmt.extend(0u16.to_le_bytes());
+        fmt.extend(bits_per_sample.to_le_bytes());
+
+        let mut bytes = b"RIFF".to_vec();
+        bytes.extend(0u32.to_le_bytes());
+        bytes.extend(b"WAVE");
+        bytes.extend(b"fmt ");
+        bytes.extend((fmt.len() as u32).to_le_bytes());
+        bytes.extend(fmt);
+        bytes.extend(b"data");
+        bytes.extend((data.len() as u32).to_le_bytes());
+        bytes.extend(data);
+        bytes
+    }
+
+    #[test]
+    fn can_parse_integer_pcm() {
+        let data: Vec<u8> = [0i16, 16_384, -32_768, 0]
+            .iter()
+            .flat_map(|s| s.to_le_bytes())
+            .collect();
+
+        let file = parse_wav_file(&wav(PCM, 2, 16, &data)).unwrap();
+
+        assert_eq!(file.sample_rate, 48_000);
+        assert_eq!(file.buffer.num_channels, 2);
+        assert_eq!(file.buffer.data, [0., 0.5, -1., 0.]);
+    }
+
+    #[test]
+    fn can_parse_floating_point_pcm() {
+        let data: Vec<u8> = [0.25f32, -0.75]
+            .iter()
+            .flat_map(|s| s.to_le_bytes())
+            .collect();
+        let file = parse_wav_file(&wav(IEEE_FLOAT, 1, 32, &data)).unwrap();
+        assert_eq!(file.buffer.data, [0.25, -0.75]);
+    }
+
+    #[test]
+    fn rejects_invalid_files() {
+        assert!(parse_wav_file(b"RIFF").is_err());
+        assert!(parse_wav_file(&wav(PCM, 0, 16, &[])).is_err());
+        assert!(parse_wav_file(&wav(PCM, 1, 12, &[0, 0])).is_err());
+    }
+}
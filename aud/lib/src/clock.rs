@@ -0,0 +1,97 @@
+//! The monotonic clock shared by every subsystem.
+//!
+//! MIDI messages and audio buffers are stamped with it as soon as
+//! they enter the process, in microseconds since the clock started,
+//! so that events of different sources can be ordered and aligned.
+
+use std::{
+    sync::OnceLock,
+    time::{Duration, Instant},
+};
+
+fn epoch() -> Instant {
+    static EPOCH: OnceLock<Instant> = OnceLock::new();
+    *EPOCH.get_or_init(Instant::now)
+}
+
+/// Current time in microseconds.
+pub fn now() -> u64 {
+    to_micros(Instant::now())
+}
+
+/// Time of an instant in microseconds, instants
+/// from before the clock started are at 0.
+pub fn to_micros(instant: Instant) -> u64 {
+    instant.saturating_duration_since(epoch()).as_micros() as u64
+}
+
+pub fn to_instant(micros: u64) -> Instant {
+    epoch() + Duration::from_micros(micros)
+}
+
+/// Converts between the clock and the clock of an Ableton Link
+/// session, which is also monotonic but has another origin.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct LinkClock {
+    /// Link time minus clock time, in microseconds.
+    offset: i64,
+}
+
+impl LinkClock {
+    /// Measure the offset between both clocks.
+    ///
+    /// The Link clock is read between two reads of the clock,
+    /// the read with the shortest round-trip is kept.
+    pub fn sample(link_micros: impl Fn() -> i64) -> Self {
+        const NUM_SAMPLES: usize = 8;
+
+        let (_, offset) = (0..NUM_SAMPLES)
+            .map(|_| {
+                let before = now();
+                let link = link_micros();
+                let after = now();
+                let midpoint = before + (after - before) / 2;
+                (after - before, link - midpoint as i64)
+            })
+            .min_by_key(|(round_trip, _)| *round_trip)
+            .unwrap_or_default();
+
+        Self { offset }
+    }
+
+    pub fn to_link_micros(&self, micros: u64) -> i64 {
+        micros as i64 + self.offset
+    }
+
+    /// Clock time of a Link time, Link times
+    /// from before the clock started are at 0.
+    pub fn from_link_micros(&self, link_micros: i64) -> u64 {
+        (link_micros - self.offset).max(0) as u64
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn instants_round_trip_through_micros() {
+        let instant = Instant::now();
+        let micros = to_micros(instant);
+        let error = instant.duration_since(to_instant(micros));
+        assert!(error < Duration::from_micros(1));
+        assert!(now() >= micros);
+    }
+
+    #[test]
+    fn converts_to_and_from_link_time() {
+        let link_origin = 1_000_000_000;
+        let clock = LinkClock::sample(|| link_origin + now() as i64);
+
+        let micros = now();
+        let link_micros = clock.to_link_micros(micros);
+        assert!((link_micros - (link_origin + micros as i64)).abs() < 1_000);
+        assert_eq!(clock.from_link_micros(link_micros), micros);
+        assert_eq!(clock.from_link_micros(0), 0);
+    }
+}
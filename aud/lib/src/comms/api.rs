@@ -20,6 +20,8 @@ pub enum AudioResponse {
     Connected(AudioDeviceConnection),
     Devices(Vec<AudioDevice>),
     Audio(AudioPacket),
+    /// MIDI sent along with the audio, in the same session.
+    Midi(MidiPacket),
 }
 
 impl BincodeSerialize for AudioResponse {
@@ -31,6 +31,7 @@ impl AudioPacket {
         let buffer = AudioBuffer {
             data: buffer.as_ref().to_owned(),
             num_channels,
+            timestamp: 0,
         };
 
         Self {
@@ -230,6 +231,7 @@ mod tests {
                 .map(|x| x as f32)
                 .collect(),
             num_channels: num_channels as u32,
+            timestamp: 0,
         };
 
         let packets = AudioPacketSequence::from_buffer(0, &expected_buffer).into_packets();
@@ -0,0 +1,510 @@
+use super::*;
+use crate::midi::{MidiData, MidiPortId};
+use crossbeam::channel::Sender;
+use serde::{Deserialize, Serialize};
+use std::{
+    collections::{hash_map::RandomState, VecDeque},
+    hash::{BuildHasher, Hasher},
+};
+
+#[derive(Serialize, Deserialize, Debug, Clone, PartialEq, Eq)]
+pub struct MidiPacketMessage {
+    /// Microseconds after the timestamp of the batch.
+    pub offset: u32,
+    pub port: MidiPortId,
+    pub bytes: Vec<u8>,
+}
+
+/// Messages sent together, in timestamp order.
+#[derive(Serialize, Deserialize, Default, Debug, Clone, PartialEq, Eq)]
+pub struct MidiBatch {
+    /// Index of the batch in the stream, incremented for every batch.
+    pub sequence: u64,
+    /// Time of the first message, on the clock of the sender.
+    pub timestamp: u64,
+    pub messages: Vec<MidiPacketMessage>,
+}
+
+/// A batch of messages along with a journal of the batches sent
+/// before it, so that the receiver can recover from the loss of a
+/// few packets without asking for retransmission.
+#[derive(Serialize, Deserialize, Default, Debug, Clone, PartialEq, Eq)]
+pub struct MidiPacket {
+    /// Picked at random by the sender when the stream starts, so that
+    /// the receiver notices when it starts again from the first batch.
+    pub session: u64,
+    pub batch: MidiBatch,
+    /// The latest batches sent before `batch`, oldest first.
+    pub journal: Vec<MidiBatch>,
+    /// Number of messages sent since the stream started, `batch` included.
+    pub num_sent: u64,
+}
+
+impl BincodeSerialize for MidiPacket {
+    fn serialize(self) -> Result<Vec<u8>, bincode::Error> {
+        bincode::serialize(&self)
+    }
+}
+
+impl BincodeDeserialize for MidiPacket {
+    fn deserialized(data: &[u8]) -> Result<Self, bincode::Error> {
+        bincode::deserialize(data)
+    }
+}
+
+/// Serialized size of the fields of a message besides its bytes:
+/// the offset, the port and the number of bytes.
+const MESSAGE_OVERHEAD: usize = 4 + 2 + 8;
+/// Serialized size of the sequence, timestamp and number of messages of a batch.
+const BATCH_OVERHEAD: usize = 8 + 8 + 8;
+/// Serialized size of the session, of the number of journaled batches and of
+/// `num_sent`, along with the variant of the `AudioResponse` a packet may be sent in.
+const PACKET_OVERHEAD: usize = 8 + 8 + 8 + 4;
+
+fn message_size(bytes: &[u8]) -> usize {
+    MESSAGE_OVERHEAD + bytes.len()
+}
+
+/// Serialized size of a batch, without going through bincode.
+fn batch_size(batch: &MidiBatch) -> usize {
+    BATCH_OVERHEAD
+        + batch
+            .messages
+            .iter()
+            .map(|m| message_size(&m.bytes))
+            .sum::<usize>()
+}
+
+/// Batches outgoing messages into packets.
+pub struct MidiPacketWriter {
+    session: u64,
+    next_sequence: u64,
+    num_sent: u64,
+    journal: VecDeque<MidiBatch>,
+}
+
+impl Default for MidiPacketWriter {
+    fn default() -> Self {
+        Self {
+            // the keys of every `RandomState` are different
+            session: RandomState::new().build_hasher().finish(),
+            next_sequence: 0,
+            num_sent: 0,
+            journal: VecDeque::with_capacity(Self::JOURNAL_LEN),
+        }
+    }
+}
+
+impl MidiPacketWriter {
+    /// Maximum number of previous batches in a packet.
+    pub const JOURNAL_LEN: usize = 4;
+    /// Longer messages do not fit in the buffer of the receiver.
+    pub const MAX_MESSAGE_LEN: usize = 2048;
+    /// Serialized size above which a batch is split, unless it holds a
+    /// single message, which can be as long as `MAX_MESSAGE_LEN`.
+    const MAX_BATCH_SIZE: usize = 768;
+    /// Serialized size above which older batches are left out of the journal,
+    /// what is left of a datagram once it holds the largest possible batch.
+    const MAX_JOURNAL_SIZE: usize = MAX_DATAGRAM_LEN
+        - PACKET_OVERHEAD
+        - BATCH_OVERHEAD
+        - MESSAGE_OVERHEAD
+        - Self::MAX_MESSAGE_LEN;
+
+    /// Batch messages, in timestamp order, into as few packets as possible.
+    pub fn write(&mut self, messages: &[MidiData]) -> Vec<MidiPacket> {
+        let mut packets = vec![];
+        let mut batch: Option<MidiBatch> = None;
+
+        for midi in messages {
+            if midi.bytes.len() > Self::MAX_MESSAGE_LEN {
+                log::warn!(
+                    "[ MIDI ] : {} bytes message is too long to send",
+                    midi.bytes.len()
+                );
+                continue;
+            }
+
+            let offset = batch
+                .as_ref()
+                .filter(|batch| {
+                    batch_size(batch) + message_size(&midi.bytes) <= Self::MAX_BATCH_SIZE
+                })
+                .and_then(|batch| midi.timestamp.checked_sub(batch.timestamp))
+                .and_then(|offset| u32::try_from(offset).ok());
+
+            let offset = match offset {
+                Some(offset) => offset,
+                None => {
+                    packets.extend(batch.take().map(|batch| self.packet(batch)));
+                    batch = Some(MidiBatch {
+                        sequence: 0,
+                        timestamp: midi.timestamp,
+                        messages: vec![],
+                    });
+                    0
+                }
+            };
+
+            if let Some(ref mut batch) = batch {
+                batch.messages.push(MidiPacketMessage {
+                    offset,
+                    port: midi.port,
+                    bytes: midi.bytes.to_vec(),
+                });
+            }
+        }
+
+        packets.extend(batch.map(|batch| self.packet(batch)));
+        packets
+    }
+
+    /// Write messages and queue their packets to the socket task. When
+    /// it falls behind, the packets that do not fit are taken back, and
+    /// their messages are neither sent nor counted as lost.
+    pub fn send<T>(
+        &mut self,
+        messages: &[MidiData],
+        sender: &Sender<T>,
+        wrap: impl Fn(MidiPacket) -> T,
+    ) -> anyhow::Result<()> {
+        let mut packets = self.write(messages);
+
+        for index in 0..packets.len() {
+            if sender.is_full() {
+                self.cancel(&packets[index..]);
+                anyhow::bail!(
+                    "[ MIDI ] : {} packets could not be sent",
+                    packets.len() - index
+                );
+            }
+
+            // the socket task only has this sender, there is room for the packet
+            sender
+                .try_send(wrap(std::mem::take(&mut packets[index])))
+                .map_err(|_| anyhow::anyhow!("[ MIDI ] : the socket task has stopped"))?;
+        }
+
+        Ok(())
+    }
+
+    /// Take back the latest packets, which could not be sent, so that the
+    /// receiver neither waits for them nor counts their messages as lost.
+    pub fn cancel(&mut self, packets: &[MidiPacket]) {
+        for packet in packets.iter().rev() {
+            debug_assert_eq!(packet.batch.sequence + 1, self.next_sequence);
+
+            if self.journal.back() == Some(&packet.batch) {
+                self.journal.pop_back();
+            }
+
+            self.next_sequence -= 1;
+            self.num_sent -= packet.batch.messages.len() as u64;
+        }
+    }
+
+    fn packet(&mut self, mut batch: MidiBatch) -> MidiPacket {
+        batch.sequence = self.next_sequence;
+        self.next_sequence += 1;
+        self.num_sent += batch.messages.len() as u64;
+
+        let mut journal_size = 0;
+        let num_journaled = self
+            .journal
+            .iter()
+            .rev()
+            .take_while(|batch| {
+                journal_size += batch_size(batch);
+                journal_size <= Self::MAX_JOURNAL_SIZE
+            })
+            .count();
+
+        let packet = MidiPacket {
+            session: self.session,
+            journal: self
+                .journal
+                .range(self.journal.len() - num_journaled..)
+                .cloned()
+                .collect(),
+            batch: batch.clone(),
+            num_sent: self.num_sent,
+        };
+
+        if self.journal.len() == Self::JOURNAL_LEN {
+            self.journal.pop_front();
+        }
+        self.journal.push_back(batch);
+
+        packet
+    }
+}
+
+/// Reads incoming packets, recovering lost batches from the
+/// journals and stamping the messages with the local clock.
+///
+/// Packets are not buffered to be reordered, which would add
+/// latency. A packet arriving after a later one is treated
+/// as lost and its batch is recovered from the journal.
+///
+/// The reader starts over when the session of the packets
+/// changes, i.e. when the sender restarted.
+#[derive(Default)]
+pub struct MidiPacketReader {
+    session: Option<u64>,
+    next_sequence: Option<u64>,
+    /// Local time minus sender time, the smallest seen so far,
+    /// so that the timestamps do not carry the network jitter.
+    clock_offset: Option<i64>,
+    num_received: u64,
+    num_lost: u64,
+    /// Messages lost in the previous sessions.
+    num_lost_before: u64,
+    num_recovered: u64,
+}
+
+impl MidiPacketReader {
+    /// Append the messages of a packet received at `now`, on the
+    /// local clock, along with the ones of the previous batches
+    /// that were lost and are in its journal, in order.
+    pub fn read(&mut self, packet: MidiPacket, now: u64, messages: &mut Vec<MidiData>) {
+        if self.session != Some(packet.session) {
+            if self.session.is_some() {
+                log::info!("[ MIDI ] : the sender started a new stream");
+            }
+
+            *self = Self {
+                session: Some(packet.session),
+                num_lost_before: self.num_lost(),
+                num_recovered: self.num_recovered,
+                ..Default::default()
+            };
+        }
+
+        let sequence = packet.batch.sequence;
+        let next_sequence = *self.next_sequence.get_or_insert(sequence);
+
+        if sequence < next_sequence {
+            return;
+        }
+
+        let offset = now as i64 - packet.batch.timestamp as i64;
+        let clock_offset = *self
+            .clock_offset
+            .insert(self.clock_offset.map_or(offset, |o| o.min(offset)));
+
+        let recovered = packet
+            .journal
+            .into_iter()
+            .filter(|batch| (next_sequence..sequence).contains(&batch.sequence));
+
+        for batch in recovered {
+            self.num_recovered += 1;
+            self.read_batch(batch, clock_offset, messages);
+        }
+
+        self.read_batch(packet.batch, clock_offset, messages);
+        self.next_sequence = Some(sequence + 1);
+        self.num_lost = packet.num_sent.saturating_sub(self.num_received);
+    }
+
+    fn read_batch(&mut self, batch: MidiBatch, clock_offset: i64, messages: &mut Vec<MidiData>) {
+        self.num_received += batch.messages.len() as u64;
+
+        messages.extend(batch.messages.into_iter().map(|message| {
+            let timestamp = (batch.timestamp + message.offset as u64) as i64 + clock_offset;
+            MidiData {
+                timestamp: timestamp.max(0) as u64,
+                port: message.port,
+                bytes: message.bytes.into(),
+            }
+        }));
+    }
+
+    /// Number of messages sent that were never received.
+    pub fn num_lost(&self) -> u64 {
+        self.num_lost_before + self.num_lost
+    }
+
+    /// Number of lost batches recovered from the journals.
+    pub fn num_recovered(&self) -> u64 {
+        self.num_recovered
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn midi(timestamp: u64, note: u8) -> MidiData {
+        MidiData {
+            timestamp,
+            port: 0,
+            bytes: vec![0x90, note, 100].into(),
+        }
+    }
+
+    fn notes(messages: &[MidiData]) -> Vec<u8> {
+        messages.iter().map(|midi| midi.bytes[1]).collect()
+    }
+
+    #[test]
+    fn batches_messages_and_keeps_their_timing() {
+        let mut writer = MidiPacketWriter::default();
+        let packets = writer.write(&[midi(1_000, 60), midi(1_500, 62), midi(3_000, 64)]);
+        assert_eq!(packets.len(), 1);
+        assert_eq!(packets[0].num_sent, 3);
+
+        let mut reader = MidiPacketReader::default();
+        let mut messages = vec![];
+        reader.read(packets[0].clone(), 10_000, &mut messages);
+
+        let timestamps: Vec<_> = messages.iter().map(|m| m.timestamp).collect();
+        assert_eq!(timestamps, [10_000, 10_500, 12_000]);
+        assert_eq!(notes(&messages), [60, 62, 64]);
+    }
+
+    #[test]
+    fn splits_long_batches() {
+        let mut writer = MidiPacketWriter::default();
+        let sysex = MidiData {
+            bytes: vec![0xF0; 400].into(),
+            ..Default::default()
+        };
+
+        let packets = writer.write(&[sysex.clone(), sysex.clone(), midi(0, 60)]);
+        let batches: Vec<_> = packets.iter().map(|p| p.batch.messages.len()).collect();
+        assert_eq!(batches, [1, 2]);
+        assert_eq!(packets[1].journal, [packets[0].batch.clone()]);
+    }
+
+    #[test]
+    fn keeps_dense_bursts_within_a_datagram() {
+        let mut writer = MidiPacketWriter::default();
+        let sysex = |timestamp| MidiData {
+            timestamp,
+            port: 0,
+            bytes: vec![0xF0; MidiPacketWriter::MAX_MESSAGE_LEN].into(),
+        };
+
+        // notes a microsecond apart, with the longest dumps in between
+        let burst: Vec<_> = (0..10_000)
+            .map(|i| match i % 1_000 {
+                999 => sysex(i),
+                _ => midi(i, (i % 128) as u8),
+            })
+            .collect();
+
+        let packets = writer.write(&burst);
+        assert_eq!(packets.last().unwrap().num_sent, 10_000);
+
+        for packet in packets {
+            assert_eq!(
+                bincode::serialized_size(&packet.batch).unwrap() as usize,
+                batch_size(&packet.batch)
+            );
+
+            let size = bincode::serialized_size(&AudioResponse::Midi(packet)).unwrap();
+            assert!(size as usize <= MAX_DATAGRAM_LEN, "{size} bytes packet");
+        }
+    }
+
+    #[test]
+    fn recovers_lost_packets_from_the_journal() {
+        let mut writer = MidiPacketWriter::default();
+        let packets: Vec<_> = (0..10)
+            .flat_map(|i| writer.write(&[midi(i * 1_000, 60 + i as u8)]))
+            .collect();
+
+        let mut reader = MidiPacketReader::default();
+        let mut messages = vec![];
+
+        for i in [0, 1, 3, 2, 4, 9] {
+            reader.read(packets[i].clone(), i as u64 * 1_000, &mut messages);
+        }
+
+        assert_eq!(notes(&messages), [60, 61, 62, 63, 64, 65, 66, 67, 68, 69]);
+        assert!(messages.windows(2).all(|w| w[0].timestamp < w[1].timestamp));
+        assert_eq!(reader.num_recovered(), 5);
+        assert_eq!(reader.num_lost(), 0);
+    }
+
+    #[test]
+    fn counts_messages_lost_beyond_the_journal() {
+        let mut writer = MidiPacketWriter::default();
+        let packets: Vec<_> = (0..10)
+            .flat_map(|i| writer.write(&[midi(i * 1_000, 60 + i as u8)]))
+            .collect();
+
+        let mut reader = MidiPacketReader::default();
+        let mut messages = vec![];
+        reader.read(packets[0].clone(), 0, &mut messages);
+        reader.read(packets[9].clone(), 9_000, &mut messages);
+
+        assert_eq!(notes(&messages), [60, 65, 66, 67, 68, 69]);
+        assert_eq!(reader.num_lost(), 4);
+    }
+
+    #[test]
+    fn starts_over_when_the_sender_restarts() {
+        let mut reader = MidiPacketReader::default();
+        let mut messages = vec![];
+
+        let mut writer = MidiPacketWriter::default();
+        for i in 0..10 {
+            for packet in writer.write(&[midi(i * 1_000, 60)]) {
+                reader.read(packet, 50_000 + i * 1_000, &mut messages);
+            }
+        }
+
+        // the sequence and the clock of the new stream start over
+        let mut writer = MidiPacketWriter::default();
+        for i in 0..3 {
+            for packet in writer.write(&[midi(i * 1_000, 61)]) {
+                reader.read(packet, 100_000 + i * 1_000, &mut messages);
+            }
+        }
+
+        let timestamps: Vec<_> = messages[10..].iter().map(|m| m.timestamp).collect();
+        assert_eq!(timestamps, [100_000, 101_000, 102_000]);
+        assert_eq!(notes(&messages[10..]), [61, 61, 61]);
+        assert_eq!(reader.num_lost(), 0);
+    }
+
+    #[test]
+    fn takes_back_the_packets_that_do_not_fit_in_the_queue() {
+        let mut writer = MidiPacketWriter::default();
+        let (sender, receiver) = crossbeam::channel::bounded(1);
+
+        writer.send(&[midi(0, 60)], &sender, |p| p).unwrap();
+        assert!(writer.send(&[midi(1_000, 61)], &sender, |p| p).is_err());
+        let sent = receiver.try_recv().unwrap();
+
+        writer.send(&[midi(2_000, 62)], &sender, |p| p).unwrap();
+        let next = receiver.try_recv().unwrap();
+        assert_eq!(next.batch.sequence, sent.batch.sequence + 1);
+        assert_eq!(next.num_sent, 2);
+    }
+
+    #[test]
+    fn does_not_count_cancelled_packets_as_lost() {
+        let mut writer = MidiPacketWriter::default();
+        let mut reader = MidiPacketReader::default();
+        let mut messages = vec![];
+
+        for packet in writer.write(&[midi(0, 60)]) {
+            reader.read(packet, 0, &mut messages);
+        }
+
+        let unsent = writer.write(&[midi(1_000, 61), midi(2_000, 62)]);
+        writer.cancel(&unsent);
+
+        for packet in writer.write(&[midi(3_000, 63)]) {
+            assert_eq!(packet.batch.sequence, 1);
+            assert_eq!(packet.journal.len(), 1);
+            reader.read(packet, 3_000, &mut messages);
+        }
+
+        assert_eq!(notes(&messages), [60, 63]);
+        assert_eq!(reader.num_lost(), 0);
+    }
+}
@@ -1,9 +1,11 @@
 mod api;
 mod audio;
 mod interface;
+mod midi;
 mod sockets;
 
 pub use api::*;
 pub use audio::*;
 pub use interface::*;
+pub use midi::*;
 pub use sockets::*;
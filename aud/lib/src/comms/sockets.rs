@@ -2,6 +2,9 @@ use super::{api::*, SocketInterface};
 use crossbeam::channel::{Receiver, Sender};
 use std::net::SocketAddr;
 
+/// Size of the buffer datagrams are received in, longer ones are truncated.
+pub const MAX_DATAGRAM_LEN: usize = 4096;
+
 pub struct Sockets<Socket>
 where
     Socket: SocketInterface,
@@ -68,7 +71,7 @@ impl SocketCommunicator {
         let shutdown_receiver_clone = shutdown_receiver.clone();
         let udp_response_handle = std::thread::spawn(move || {
             let shutdown_receiver = shutdown_receiver_clone.clone();
-            let mut udp_buffer = vec![0u8; 4096];
+            let mut udp_buffer = vec![0u8; MAX_DATAGRAM_LEN];
 
             loop {
                 crossbeam::select! {
@@ -1,15 +1,25 @@
+use crate::{
+    clock::{self, LinkClock},
+    midi::MidiClockTimeline,
+};
+
 pub struct AbletonLink {
     link: rusty_link::AblLink,
     session_state: rusty_link::SessionState,
     quantum: f64,
+    clock: LinkClock,
 }
 
 impl Default for AbletonLink {
     fn default() -> Self {
+        let link = rusty_link::AblLink::new(120.);
+        let clock = LinkClock::sample(|| link.clock_micros());
+
         Self {
-            link: rusty_link::AblLink::new(120.),
+            link,
             session_state: rusty_link::SessionState::new(),
             quantum: 4.,
+            clock,
         }
     }
 }
@@ -51,6 +61,30 @@ impl AbletonLink {
         self.session_state.beat_at_time(self.time(), self.quantum)
     }
 
+    /// Beat of the session at a time of the shared clock,
+    /// e.g. the timestamp of a MIDI message or audio buffer.
+    pub fn beat_at(&self, micros: u64) -> f64 {
+        self.session_state
+            .beat_at_time(self.clock.to_link_micros(micros), self.quantum)
+    }
+
+    /// The session as of the last capture, for a `MidiClockGenerator`.
+    pub fn midi_clock_timeline(&self) -> MidiClockTimeline {
+        let micros = clock::now();
+        MidiClockTimeline {
+            micros,
+            beat: self.beat_at(micros),
+            tempo: self.tempo(),
+            is_playing: self.is_playing(),
+        }
+    }
+
+    /// Time of the shared clock at which the session reaches a beat.
+    pub fn micros_at_beat(&self, beat: f64) -> u64 {
+        self.clock
+            .from_link_micros(self.session_state.time_at_beat(beat, self.quantum))
+    }
+
     pub fn stop(&mut self) {
         self.link.enable(false);
     }
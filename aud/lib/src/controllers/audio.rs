@@ -1,8 +1,20 @@
 use crate::{
-    audio::{AudioBuffer, AudioChannelSelection, AudioDevice, AudioInterface, AudioProviding},
+    audio::{AudioChannelSelection, AudioDevice, AudioHistory, AudioInterface, AudioProviding},
     lua::{HostEvent, ScriptController},
+    timeline::Timeline,
 };
-use std::{cell::RefCell, rc::Rc};
+use std::{
+    cell::RefCell,
+    rc::Rc,
+    sync::{Arc, Mutex},
+    time::Duration,
+};
+
+/// Duration of audio kept for the renderers, by default.
+pub const DEFAULT_AUDIO_HISTORY: Duration = Duration::from_secs(1);
+
+/// Sample rate the history is sized for when the device does not report one.
+const FALLBACK_SAMPLE_RATE: u32 = 48_000;
 
 pub trait AudioProvider: AudioProviding + AudioInterface {}
 
@@ -11,7 +23,9 @@ impl<T> AudioProvider for T where T: AudioProviding + AudioInterface {}
 pub struct AudioProviderController {
     receiver: Box<dyn AudioProvider>,
     script: Rc<RefCell<ScriptController>>,
-    buffer: AudioBuffer,
+    history: AudioHistory,
+    history_duration: Duration,
+    timeline: Arc<Mutex<Timeline>>,
     selected_device: Option<AudioDevice>,
     selected_channels: Option<AudioChannelSelection>,
 }
@@ -19,7 +33,9 @@ pub struct AudioProviderController {
 impl AudioProviderController {
     pub fn new(receiver: Box<dyn AudioProvider>, script: Rc<RefCell<ScriptController>>) -> Self {
         Self {
-            buffer: AudioBuffer::default(),
+            history: AudioHistory::default(),
+            history_duration: DEFAULT_AUDIO_HISTORY,
+            timeline: script.borrow().timeline().clone(),
             receiver,
             script,
             selected_device: None,
@@ -31,12 +47,32 @@ impl AudioProviderController {
         self.receiver.list_audio_devices()
     }
 
-    pub fn buffer(&self) -> &AudioBuffer {
-        &self.buffer
+    /// The latest frames received, up to the history duration.
+    pub fn history(&self) -> &AudioHistory {
+        &self.history
+    }
+
+    /// Change how much audio is kept, which clears the history.
+    pub fn set_history_duration(&mut self, duration: Duration) {
+        self.history_duration = duration;
+        self.reset_history(self.history.num_channels());
+    }
+
+    /// Sample rate of the connected device, or the one assumed without any.
+    pub fn sample_rate(&self) -> u32 {
+        self.receiver
+            .connected_audio_device()
+            .map_or(FALLBACK_SAMPLE_RATE, |connection| connection.sample_rate)
     }
 
-    pub fn buffer_mut(&mut self) -> &mut AudioBuffer {
-        &mut self.buffer
+    fn reset_history(&mut self, num_channels: usize) {
+        let sample_rate = self.sample_rate();
+        self.history =
+            AudioHistory::with_duration(num_channels, sample_rate, self.history_duration);
+        self.timeline
+            .lock()
+            .unwrap()
+            .reset_audio(num_channels, sample_rate);
     }
 
     pub fn selected_device(&self) -> Option<&AudioDevice> {
@@ -47,15 +83,21 @@ impl AudioProviderController {
         self.selected_channels.as_ref()
     }
 
-    pub fn update(&mut self) -> anyhow::Result<()> {
+    /// Move the audio received to the history, returns whether there was any.
+    pub fn update(&mut self) -> anyhow::Result<bool> {
         self.receiver.process_audio_events()?;
-        let mut audio = self.receiver.retrieve_audio_buffer();
-        if self.buffer.num_channels != audio.num_channels {
-            self.buffer = audio;
-        } else {
-            self.buffer.data.append(&mut audio.data);
+        let audio = self.receiver.retrieve_audio_buffer();
+        if audio.data.is_empty() {
+            return Ok(false);
         }
-        Ok(())
+
+        if self.history.num_channels() != audio.num_channels as usize {
+            self.reset_history(audio.num_channels as usize);
+        }
+
+        self.history.push(&audio);
+        self.timeline.lock().unwrap().push_audio(&audio);
+        Ok(true)
     }
 
     pub fn reconnect(&mut self) -> anyhow::Result<()> {
@@ -77,9 +119,9 @@ impl AudioProviderController {
             anyhow::bail!("No audio device selected");
         };
 
-        self.buffer.data.clear();
         self.receiver
             .connect_to_audio_device(audio_device, channel_selection.clone())?;
+        self.reset_history(channel_selection.count());
         self.selected_channels = Some(channel_selection);
 
         if let Err(e) = self
@@ -99,7 +141,6 @@ impl AudioProviderController {
         channel_selection: AudioChannelSelection,
     ) -> anyhow::Result<()> {
         self.selected_device = Some(audio_device.clone());
-        self.buffer.num_channels = channel_selection.count() as u32;
         self.update_channel_selection(channel_selection)
     }
 }
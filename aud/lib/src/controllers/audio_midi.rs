@@ -4,13 +4,17 @@ use super::{
 };
 use crate::{
     audio::{AudioChannelSelection, HostAudioInput},
-    lua::{traits::api::*, HostEvent, LuaEngineEvent, ScriptController, ScriptEvent},
+    lua::{traits::api::*, HostEvent, LuaEngineEvent, ScriptController, ScriptEvent, Telemetry},
     midi::{HostedMidiReceiver, MidiReceiving},
+    timeline::Timeline,
 };
+use crossbeam::channel::Receiver;
 use std::{
     cell::RefCell,
     path::{Path, PathBuf},
     rc::Rc,
+    sync::{Arc, Mutex},
+    time::{Duration, Instant},
 };
 
 #[derive(Debug, PartialEq, Eq)]
@@ -72,6 +76,26 @@ impl AudioMidiController {
         &mut self.midi
     }
 
+    /// Data published by the loaded script.
+    pub fn telemetry(&self) -> Arc<Telemetry> {
+        self.script.borrow().telemetry().clone()
+    }
+
+    /// The audio and MIDI received, in the order of the shared clock.
+    pub fn timeline(&self) -> Arc<Mutex<Timeline>> {
+        self.script.borrow().timeline().clone()
+    }
+
+    /// Change how much audio and MIDI the timeline keeps, which clears its audio.
+    pub fn set_timeline_horizon(&self, horizon: Duration) {
+        self.script
+            .borrow()
+            .timeline()
+            .lock()
+            .unwrap()
+            .set_horizon(horizon);
+    }
+
     pub fn take_alert(&mut self) -> Option<String> {
         self.alert_message.take()
     }
@@ -84,11 +108,17 @@ impl AudioMidiController {
         self.script.borrow().path().map(PathBuf::from)
     }
 
+    /// Whether a MIDI port or an audio device is connected. They have
+    /// to be polled, their messages and frames do not wake anyone up.
+    pub fn has_connected_devices(&self) -> bool {
+        self.midi.has_connections() || self.audio.selected_device().is_some()
+    }
+
     /// Send a script to be loaded by the scripting engine. This function does not block.
     pub fn load_script(&mut self, script_path: impl AsRef<Path>) -> anyhow::Result<AppEvent> {
         self.script.borrow_mut().load(script_path)?;
 
-        if self.midi.selected_port_name().is_some() {
+        if self.midi.has_connections() {
             self.send_midi_port_discovery()?;
             self.midi.reconnect()?;
         }
@@ -105,12 +135,12 @@ impl AudioMidiController {
     pub fn load_script_sync(
         &mut self,
         script_path: impl AsRef<Path>,
-        timeout: std::time::Duration,
+        timeout: Duration,
     ) -> anyhow::Result<()> {
+        let deadline = Instant::now() + timeout;
         self.load_script(script_path)?;
-        let start = std::time::Instant::now();
         while self.process_script_events()? != AppEvent::ScriptLoaded {
-            if start.elapsed() > timeout {
+            if !self.script.borrow().wait_for_script_events(deadline) {
                 anyhow::bail!("Failed to load script in time");
             }
         }
@@ -118,18 +148,30 @@ impl AudioMidiController {
     }
 
     /// Block while waiting for the script to push an alert back to the app.
-    pub fn wait_for_alert(
-        &mut self,
-        timeout: std::time::Duration,
-    ) -> anyhow::Result<Option<String>> {
-        let start = std::time::Instant::now();
-        while start.elapsed() < timeout {
+    pub fn wait_for_alert(&mut self, timeout: Duration) -> anyhow::Result<Option<String>> {
+        let deadline = Instant::now() + timeout;
+        loop {
             let _ = self.process_script_events()?;
-            if self.alert_message.is_some() {
+            if self.alert_message.is_some()
+                || !self.script.borrow().wait_for_script_events(deadline)
+            {
                 return Ok(self.take_alert());
             }
         }
-        Ok(self.take_alert())
+    }
+
+    /// Park the thread until the script, the engine or the file watcher has
+    /// events to process, or until `deadline`. Returns whether any has.
+    pub fn wait_for_events(&self, deadline: Instant) -> bool {
+        self.script
+            .borrow()
+            .wait_for_events::<()>(None, Some(deadline))
+    }
+
+    /// Like `wait_for_events`, also waking up when `other` has a message,
+    /// without a deadline if there is none.
+    pub fn wait_for_events_or<T>(&self, other: &Receiver<T>, deadline: Option<Instant>) -> bool {
+        self.script.borrow().wait_for_events(Some(other), deadline)
     }
 
     /// Process all the available script events without blocking.
@@ -144,18 +186,25 @@ impl AudioMidiController {
                     Err(_) => break,
                 }
             };
-            self.process_script_event(event)?;
+            let app_event = self.process_script_event(event)?;
+            if app_event != AppEvent::Continue {
+                return Ok(app_event);
+            }
         }
         Ok(AppEvent::Continue)
     }
 
     fn process_script_event(&mut self, event: ScriptEvent) -> anyhow::Result<AppEvent> {
         match event {
-            ScriptEvent::Loaded => return Ok(AppEvent::ScriptLoaded),
+            ScriptEvent::Loaded => {
+                self.midi.apply_script_routes()?;
+                return Ok(AppEvent::ScriptLoaded);
+            }
             ScriptEvent::Log(request) => self.handle_lua_log_request(request),
             ScriptEvent::Midi(message) => self.midi.push_message(message),
             ScriptEvent::Connect(request) => self.handle_lua_connect_request(request)?,
             ScriptEvent::Control(request) => return Ok(self.handle_lua_control_request(request)),
+            ScriptEvent::Route(RoutingApiEvent::Route(route)) => self.midi.push_script_route(route),
         }
         Ok(AppEvent::Continue)
     }
@@ -5,19 +5,22 @@ use crate::{
         AudioBuffer, AudioChannelSelection, AudioConsuming, AudioDevice, AudioDeviceConnection,
         AudioInterface, AudioProviding, RemoteAudioReceiver,
     },
+    clock,
     comms::{SocketInterface, Sockets},
 };
 
 // Pipes audio received from the remote into the provider.
 // `RemoteAudioReceiver` receives audio and pushes into a
 // consumer. In our case, we want to grab that audio
-// through the `RemoteAudioProvider`.
+// through the `RemoteAudioProvider`. The remote clock
+// is unknown so buffers are stamped when they are received.
 struct AudioPipe {
     sender: channel::Sender<AudioBuffer>,
 }
 
 impl AudioConsuming for AudioPipe {
-    fn consume_audio_buffer(&mut self, buffer: AudioBuffer) -> anyhow::Result<()> {
+    fn consume_audio_buffer(&mut self, mut buffer: AudioBuffer) -> anyhow::Result<()> {
+        buffer.timestamp = clock::now();
         self.sender.try_send(buffer)?;
         Ok(())
     }
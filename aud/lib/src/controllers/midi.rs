@@ -1,25 +1,59 @@
 use crate::{
     lua::{HostEvent, ScriptController},
-    midi::{MidiData, MidiReceiving},
+    midi::{
+        MidiData, MidiPortId, MidiPortStats, MidiReceiving, MidiRoute, MidiRouter, MidiStats,
+        SmfRecorder, SysExAssembler, SysExEvent,
+    },
+    timeline::Timeline,
+};
+use std::{
+    cell::RefCell,
+    path::Path,
+    rc::Rc,
+    sync::{Arc, Mutex},
 };
-use std::{cell::RefCell, rc::Rc};
 
 pub struct MidiReceiverController {
     receiver: Box<dyn MidiReceiving>,
     script: Rc<RefCell<ScriptController>>,
     port_names: Vec<String>,
-    selected_port_name: Option<String>,
+    /// Names of every port connected so far, indexed by their id.
+    /// Ids are never reused so that queued messages keep their name.
+    port_ids: Vec<String>,
+    /// Indexed like `port_ids`.
+    port_stats: Vec<Arc<MidiPortStats>>,
+    stats: Arc<MidiStats>,
+    timeline: Arc<Mutex<Timeline>>,
+    connected_ports: Vec<MidiPortId>,
     messages: Vec<MidiData>,
+    sysex: SysExAssembler,
+    recorder: Option<SmfRecorder>,
+    routes: Vec<MidiRoute>,
+    script_routes: Vec<MidiRoute>,
+    /// Routes of the script being loaded, applied once it is loaded.
+    pending_script_routes: Vec<MidiRoute>,
 }
 
 impl MidiReceiverController {
     pub fn new(receiver: Box<dyn MidiReceiving>, script: Rc<RefCell<ScriptController>>) -> Self {
+        let stats = script.borrow().midi_stats().clone();
+        let timeline = script.borrow().timeline().clone();
+
         Self {
             port_names: receiver.list_midi_devices().unwrap(),
             receiver,
             script,
-            selected_port_name: None,
+            port_ids: vec![],
+            port_stats: vec![],
+            stats,
+            timeline,
+            connected_ports: vec![],
             messages: vec![],
+            sysex: SysExAssembler::default(),
+            recorder: None,
+            routes: vec![],
+            script_routes: vec![],
+            pending_script_routes: vec![],
         }
     }
 
@@ -31,12 +65,37 @@ impl MidiReceiverController {
         self.receiver.set_midi_stream_active(should_run)
     }
 
+    /// Number of messages the receiver had to drop since it started.
+    pub fn dropped_messages(&self) -> u64 {
+        self.receiver.dropped_midi_messages()
+    }
+
     pub fn port_names(&self) -> &[String] {
         self.port_names.as_slice()
     }
 
-    pub fn selected_port_name(&self) -> Option<&str> {
-        self.selected_port_name.as_deref()
+    /// Name of the port a message was received from.
+    pub fn port_name(&self, port: MidiPortId) -> Option<&str> {
+        self.port_ids.get(port as usize).map(String::as_str)
+    }
+
+    pub fn connected_port_names(&self) -> impl Iterator<Item = &str> {
+        self.connected_ports
+            .iter()
+            .filter_map(|port| self.port_name(*port))
+    }
+
+    pub fn is_connected(&self, port_name: &str) -> bool {
+        self.connected_port_names().any(|name| name == port_name)
+    }
+
+    /// Statistics of every port connected so far.
+    pub fn stats(&self) -> &Arc<MidiStats> {
+        &self.stats
+    }
+
+    pub fn has_connections(&self) -> bool {
+        !self.connected_ports.is_empty()
     }
 
     pub fn push_message(&mut self, message: MidiData) {
@@ -51,19 +110,120 @@ impl MidiReceiverController {
         std::mem::take(&mut self.messages)
     }
 
-    /// Transfer all received MIDI messages to the engine.
+    /// Record every received message to a MIDI file, until `stop_recording`.
+    pub fn start_recording(&mut self, path: impl AsRef<Path>) -> anyhow::Result<()> {
+        self.stop_recording()?;
+        self.recorder = Some(SmfRecorder::create(path)?);
+        Ok(())
+    }
+
+    pub fn stop_recording(&mut self) -> anyhow::Result<()> {
+        match self.recorder.take() {
+            Some(recorder) => recorder.stop(),
+            None => Ok(()),
+        }
+    }
+
+    pub fn recorder(&self) -> Option<&SmfRecorder> {
+        self.recorder.as_ref()
+    }
+
+    /// SysEx dumps longer than this are only passed to the
+    /// script in chunks, and are neither recorded nor displayed.
+    pub fn set_max_sysex_len(&mut self, max_len: usize) {
+        self.sysex.set_max_len(max_len);
+    }
+
+    /// Route MIDI to outputs, in addition to the routes of the loaded script.
+    pub fn set_routes(&mut self, routes: Vec<MidiRoute>) -> anyhow::Result<()> {
+        self.routes = routes;
+        self.update_router()
+    }
+
+    pub fn push_script_route(&mut self, route: MidiRoute) {
+        self.pending_script_routes.push(route);
+    }
+
+    /// Replace the routes of the previous script by the ones of the loaded script.
+    pub fn apply_script_routes(&mut self) -> anyhow::Result<()> {
+        if self.script_routes.is_empty() && self.pending_script_routes.is_empty() {
+            return Ok(());
+        }
+
+        self.script_routes = std::mem::take(&mut self.pending_script_routes);
+        self.update_router()
+    }
+
+    fn update_router(&mut self) -> anyhow::Result<()> {
+        let router = MidiRouter::new(self.routes.iter().chain(&self.script_routes))?;
+        self.receiver.route_midi(router)
+    }
+
+    /// Transfer all received MIDI messages to the engine,
+    /// with the SysEx dumps assembled from their chunks.
+    ///
+    /// Dumps are recorded chunk by chunk, so that the ones too long
+    /// to be assembled are recorded too. The timeline only holds
+    /// whole messages, it does not get the dumps that are too long.
     pub fn update(&mut self) {
-        for msg in self.receiver.produce_midi_messages() {
-            if let Err(e) = self.script.borrow().try_send(HostEvent::Midi(msg)) {
-                log::error!("Failed to send midi to Lua Runtime : {e}");
+        let messages = self.receiver.produce_midi_messages();
+        if messages.is_empty() {
+            return;
+        }
+
+        let max_len = self.sysex.max_len();
+        // locked once for the whole batch, the script reads it from its own thread
+        let mut timeline = self.timeline.lock().unwrap();
+
+        for msg in messages {
+            if let Some(stats) = self.port_stats.get(msg.port as usize) {
+                stats.record(&msg);
             }
+
+            self.sysex.push(msg, |event| {
+                let event = match event {
+                    SysExEvent::Chunk(chunk) => {
+                        if let Some(ref mut recorder) = self.recorder {
+                            recorder.record(&MidiData {
+                                timestamp: chunk.timestamp,
+                                port: chunk.port,
+                                bytes: chunk.bytes.clone(),
+                            });
+                        }
+
+                        let len = chunk.offset + chunk.bytes.len();
+                        if chunk.is_last && len > max_len {
+                            log::warn!(
+                                "[ MIDI ] : {len} bytes SysEx dump is too long for the timeline"
+                            );
+                        }
+
+                        HostEvent::SysExChunk(chunk)
+                    }
+                    SysExEvent::Message(msg) => {
+                        // whole dumps were already recorded by their chunks
+                        if msg.bytes.first() != Some(&0xF0) {
+                            if let Some(ref mut recorder) = self.recorder {
+                                recorder.record(&msg);
+                            }
+                        }
+                        timeline.push_midi(&msg);
+                        HostEvent::Midi(msg)
+                    }
+                };
+
+                if let Err(e) = self.script.borrow().try_send(event) {
+                    log::error!("Failed to send midi to Lua Runtime : {e}");
+                }
+            });
         }
     }
 
     pub fn reconnect(&mut self) -> anyhow::Result<()> {
-        if self.selected_port_name.is_some() {
-            let port = self.selected_port_name.as_ref().unwrap().clone();
-            self.connect_to_input(&port)?;
+        let port_names: Vec<String> = self.connected_port_names().map(str::to_owned).collect();
+
+        for port_name in port_names {
+            self.connect_to_input_unchecked(port_name)?;
         }
 
         Ok(())
@@ -83,19 +243,58 @@ impl MidiReceiverController {
         };
 
         let port_name = port_name.to_owned();
-        self.connect_to_input_unchecked(port_name)?;
-        self.clear_messages();
+        self.connect_to_input_unchecked(port_name)
+    }
+
+    pub fn disconnect_from_input(&mut self, port_name: &str) -> anyhow::Result<()> {
+        self.receiver.disconnect_from_midi_device(port_name)?;
+        self.connected_ports
+            .retain(|port| self.port_ids[*port as usize] != port_name);
         Ok(())
     }
 
+    /// Connect to the port if it is not connected yet, disconnect from it otherwise.
+    pub fn toggle_input_by_index(&mut self, index: usize) -> anyhow::Result<()> {
+        let Some(port_name) = self.port_names.get(index) else {
+            anyhow::bail!("invalid port selection : {index}");
+        };
+
+        let port_name = port_name.to_owned();
+        if self.is_connected(&port_name) {
+            self.disconnect_from_input(&port_name)
+        } else {
+            self.connect_to_input_unchecked(port_name)
+        }
+    }
+
     fn connect_to_input_unchecked(&mut self, port_name: String) -> anyhow::Result<()> {
-        self.receiver.connect_to_midi_device(&port_name)?;
-        self.selected_port_name = Some(port_name.clone());
+        let port = self.port_id(&port_name)?;
+        self.receiver.connect_to_midi_device(&port_name, port)?;
 
-        if let Err(e) = self.script.borrow().try_send(HostEvent::Connect(port_name)) {
+        if !self.connected_ports.contains(&port) {
+            self.connected_ports.push(port);
+        }
+
+        let event = HostEvent::ConnectMidi(port, port_name);
+        if let Err(e) = self.script.borrow().try_send(event) {
             log::error!("Failed to send device connected event to runtime : {e}");
         }
 
         Ok(())
     }
+
+    fn port_id(&mut self, port_name: &str) -> anyhow::Result<MidiPortId> {
+        let index = match self.port_ids.iter().position(|name| name == port_name) {
+            Some(index) => index,
+            None => {
+                let port = MidiPortId::try_from(self.port_ids.len())
+                    .map_err(|_| anyhow::anyhow!("too many MIDI ports"))?;
+                self.port_ids.push(port_name.to_owned());
+                self.port_stats.push(self.stats.register(port, port_name));
+                self.port_ids.len() - 1
+            }
+        };
+
+        MidiPortId::try_from(index).map_err(|_| anyhow::anyhow!("too many MIDI ports"))
+    }
 }
@@ -3,12 +3,17 @@ pub mod audio;
 pub mod audio_midi;
 pub mod audio_remote;
 pub mod midi;
+pub mod sysexio;
+pub mod worker;
 
 #[cfg(test)]
 mod test {
-    use super::audio_midi::{AppEvent, AudioMidiController};
-    use crate::midi::{MidiData, MidiReceiving};
-    use std::time::Duration;
+    use super::{
+        audio_midi::{AppEvent, AudioMidiController},
+        worker::{AudioMidiEvent, AudioMidiWorker, DEFAULT_WORKER_INTERVAL},
+    };
+    use crate::midi::{MidiData, MidiPortId, MidiReceiving};
+    use std::time::{Duration, Instant};
 
     const MIDI_DEVICES: &[&str] = &["dev0", "dev1", "dev2"];
     const MIDI_BYTES: &[u8] = &[1, 2, 3];
@@ -17,6 +22,7 @@ mod test {
     #[derive(Default)]
     struct MockMidiHost {
         is_active: bool,
+        ports: Vec<(String, MidiPortId)>,
     }
 
     impl MidiReceiving for MockMidiHost {
@@ -32,16 +38,31 @@ mod test {
             Ok(MIDI_DEVICES.iter().map(|s| s.to_string()).collect())
         }
 
-        fn connect_to_midi_device(&mut self, device_name: &str) -> anyhow::Result<()> {
+        fn connect_to_midi_device(
+            &mut self,
+            device_name: &str,
+            port: MidiPortId,
+        ) -> anyhow::Result<()> {
             assert!(MIDI_DEVICES.contains(&device_name));
+            self.disconnect_from_midi_device(device_name)?;
+            self.ports.push((device_name.to_owned(), port));
+            Ok(())
+        }
+
+        fn disconnect_from_midi_device(&mut self, device_name: &str) -> anyhow::Result<()> {
+            self.ports.retain(|(name, _)| name != device_name);
             Ok(())
         }
 
         fn produce_midi_messages(&mut self) -> Vec<MidiData> {
-            vec![MidiData {
-                timestamp: 1111,
-                bytes: MIDI_BYTES.into(),
-            }]
+            self.ports
+                .iter()
+                .map(|(_, port)| MidiData {
+                    timestamp: 1111,
+                    port: *port,
+                    bytes: MIDI_BYTES.into(),
+                })
+                .collect()
         }
     }
 
@@ -90,7 +111,7 @@ mod test {
         );
 
         app.midi_mut().connect_to_input_by_index(0).unwrap();
-        assert_eq!(app.midi().selected_port_name().unwrap(), MIDI_DEVICES[0]);
+        assert!(app.midi().is_connected(MIDI_DEVICES[0]));
 
         assert_eq!(
             app.wait_for_alert(TIMEOUT).unwrap().unwrap(),
@@ -123,4 +144,54 @@ mod test {
         app.load_script_sync(valid_script, TIMEOUT).unwrap();
         assert_eq!(app.process_engine_events().unwrap(), AppEvent::Continue);
     }
+
+    #[test]
+    fn parks_until_the_script_has_events() {
+        let mut app = AudioMidiController::with_midi(Box::<MockMidiHost>::default(), "");
+
+        let start = Instant::now();
+        assert!(!app.wait_for_events(start + Duration::from_millis(20)));
+        assert!(start.elapsed() >= Duration::from_millis(20));
+
+        let script = crate::test::fixture("alert_on_load.lua");
+        app.load_script(script).unwrap();
+        assert!(app.wait_for_events(Instant::now() + TIMEOUT));
+    }
+
+    #[test]
+    fn services_the_controller_on_a_worker() {
+        let mut worker = AudioMidiWorker::spawn(DEFAULT_WORKER_INTERVAL, || {
+            Ok(AudioMidiController::with_midi(
+                Box::<MockMidiHost>::default(),
+                "",
+            ))
+        })
+        .unwrap();
+        assert_eq!(worker.snapshot().port_names, MIDI_DEVICES);
+
+        let script = crate::test::fixture("alert_on_load.lua");
+        worker
+            .send(move |app| app.load_script(script).map(|_| ()))
+            .unwrap();
+
+        let alert =
+            std::iter::from_fn(|| worker.events().recv_timeout(TIMEOUT).ok()).find_map(|event| {
+                match event {
+                    AudioMidiEvent::Alert(alert) => Some(alert),
+                    _ => None,
+                }
+            });
+        assert_eq!(alert.unwrap(), "loaded");
+
+        worker
+            .send(|app| app.midi_mut().connect_to_input_by_index(0))
+            .unwrap();
+
+        let start = Instant::now();
+        while !worker.snapshot().is_connected(MIDI_DEVICES[0]) && start.elapsed() < TIMEOUT {
+            worker.update_snapshot();
+            std::thread::sleep(DEFAULT_WORKER_INTERVAL);
+        }
+        assert!(worker.snapshot().is_connected(MIDI_DEVICES[0]));
+    }
 }
@@ -0,0 +1,325 @@
+use crate::{
+    clock,
+    lua::{
+        imported,
+        traits::{
+            api::{LogApiEvent, LogProviding},
+            hooks::SysExHookProviding,
+        },
+        LuaRuntime,
+    },
+    midi::{
+        MidiBytes, MidiData, MidiProducing, MidiReceiving, SysExAssembler, SysExEvent,
+        SysExOutcome, SysExPacing, SysExRequestId, SysExRequests, SysExStats,
+    },
+};
+use crossbeam::channel::Receiver;
+use std::path::Path;
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum SysExIoEvent {
+    Response {
+        device: String,
+        command: String,
+        bytes: MidiBytes,
+        /// Text of the response, from `parse_sysex`.
+        parsed: Option<String>,
+        latency: u64,
+    },
+    /// A command that does not expect a response was sent.
+    Sent {
+        device: String,
+        command: String,
+    },
+    TimedOut {
+        device: String,
+        command: String,
+    },
+}
+
+/// Sends the SysEx commands built by a script to devices,
+/// and passes their responses back through the script.
+///
+/// Requests are pipelined and paced per device by `SysExRequests`.
+/// The script runs on the calling thread, `update` has to be
+/// called until `is_idle`, at the latest by `next_deadline`.
+pub struct SysExIoController {
+    lua: LuaRuntime,
+    logs: Receiver<LogApiEvent>,
+    receiver: Box<dyn MidiReceiving>,
+    sender: Box<dyn MidiProducing>,
+    /// Output device of every connected input, indexed by port.
+    devices: Vec<String>,
+    sysex: SysExAssembler,
+    requests: SysExRequests,
+    /// Commands of the pending requests, by id.
+    commands: Vec<(SysExRequestId, String)>,
+}
+
+impl SysExIoController {
+    pub fn new(
+        receiver: Box<dyn MidiReceiving>,
+        sender: Box<dyn MidiProducing>,
+        pacing: SysExPacing,
+    ) -> anyhow::Result<Self> {
+        let lua = LuaRuntime::default();
+        let (log_tx, log_rx) = crossbeam::channel::unbounded();
+        lua.load_log("sysexio".to_owned(), log_tx.clone())?;
+        lua.load_alert("sysexio".to_owned(), log_tx)?;
+
+        Ok(Self {
+            lua,
+            logs: log_rx,
+            receiver,
+            sender,
+            devices: vec![],
+            sysex: SysExAssembler::default(),
+            requests: SysExRequests::new(pacing),
+            commands: vec![],
+        })
+    }
+
+    pub fn load_script(&mut self, script: impl AsRef<Path>) -> anyhow::Result<()> {
+        let script = script.as_ref();
+        self.lua.load_chunk(imported::sysexio::API)?;
+        self.lua.load_file(script)?;
+        log::trace!("[ SYSEX ] : loaded {}", script.display());
+        Ok(())
+    }
+
+    /// Send the commands of `device` to the `output` device,
+    /// and match them with the responses of the `input` device.
+    pub fn connect(&mut self, input: &str, output: &str) -> anyhow::Result<()> {
+        let port = self.devices.len() as _;
+        self.receiver.connect_to_midi_device(input, port)?;
+        self.devices.push(output.to_owned());
+        Ok(())
+    }
+
+    /// Responses longer than this cannot be matched to their request.
+    pub fn set_max_sysex_len(&mut self, max_len: usize) {
+        self.sysex.set_max_len(max_len);
+    }
+
+    pub fn list_commands(&self, device: &str) -> anyhow::Result<Vec<String>> {
+        self.lua.list_commands(device)
+    }
+
+    /// Queue a command, which is sent once the pacing of the device allows it.
+    pub fn request(&mut self, device: &str, command: &str) -> anyhow::Result<SysExRequestId> {
+        let Some(request) = self.lua.build_command(device, command)? else {
+            anyhow::bail!("[ SYSEX ] : unknown command {command} for {device}");
+        };
+
+        let id = self.requests.push(request);
+        self.commands.push((id, command.to_owned()));
+        Ok(id)
+    }
+
+    pub fn update(&mut self, events: &mut Vec<SysExIoEvent>) -> anyhow::Result<()> {
+        let mut responses = vec![];
+        let max_len = self.sysex.max_len();
+        for midi in self.receiver.produce_midi_messages() {
+            self.sysex.push(midi, |event| match event {
+                SysExEvent::Message(midi) => responses.push(midi),
+                SysExEvent::Chunk(chunk) if chunk.is_last => {
+                    let len = chunk.offset + chunk.bytes.len();
+                    if len > max_len {
+                        log::warn!("[ SYSEX ] : ignored a response of {len} bytes, over {max_len}");
+                    }
+                }
+                SysExEvent::Chunk(_) => (),
+            });
+        }
+
+        let now = clock::now();
+        let mut outcomes = vec![];
+        for midi in responses
+            .into_iter()
+            .filter(|midi| midi.bytes.first() == Some(&0xF0))
+        {
+            let Some(device) = self.devices.get(midi.port as usize) else {
+                continue;
+            };
+
+            match self.requests.receive(device, midi.bytes, now) {
+                Some(outcome) => outcomes.push(outcome),
+                None => log::trace!("[ SYSEX ] : unexpected message from {device}"),
+            }
+        }
+
+        let sender = &mut self.sender;
+        self.requests.poll(
+            now,
+            |device, bytes| {
+                let midi = MidiData {
+                    timestamp: now,
+                    port: 0,
+                    bytes: bytes.clone(),
+                };
+                sender.send_midi_messages(device, std::slice::from_ref(&midi))
+            },
+            &mut outcomes,
+        )?;
+
+        for outcome in outcomes {
+            events.push(self.handle_outcome(outcome)?);
+        }
+
+        for event in self.logs.try_iter() {
+            match event {
+                LogApiEvent::Log(message) => log::info!("[ SYSEX ] : {message}"),
+                LogApiEvent::Alert(message) => log::warn!("[ SYSEX ] : {message}"),
+            }
+        }
+
+        Ok(())
+    }
+
+    fn take_command(&mut self, id: SysExRequestId) -> String {
+        match self.commands.iter().position(|(pending, _)| *pending == id) {
+            Some(index) => self.commands.swap_remove(index).1,
+            None => String::new(),
+        }
+    }
+
+    fn handle_outcome(&mut self, outcome: SysExOutcome) -> anyhow::Result<SysExIoEvent> {
+        Ok(match outcome {
+            SysExOutcome::Response {
+                id,
+                device,
+                bytes,
+                latency,
+            } => SysExIoEvent::Response {
+                command: self.take_command(id),
+                parsed: self.lua.parse_sysex(&device, &bytes)?,
+                device,
+                bytes,
+                latency,
+            },
+            SysExOutcome::Sent { id, device } => SysExIoEvent::Sent {
+                command: self.take_command(id),
+                device,
+            },
+            SysExOutcome::TimedOut { id, device } => SysExIoEvent::TimedOut {
+                command: self.take_command(id),
+                device,
+            },
+        })
+    }
+
+    /// Time at which `update` has to be called, in microseconds on the `clock`.
+    pub fn next_deadline(&self) -> Option<u64> {
+        self.requests.next_deadline()
+    }
+
+    /// Every request has been answered or has timed out.
+    pub fn is_idle(&self) -> bool {
+        self.requests.is_idle()
+    }
+
+    pub fn stats(&self, device: &str) -> Option<&SysExStats> {
+        self.requests.stats(device)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::midi::MidiPortId;
+    use std::{cell::RefCell, rc::Rc, time::Duration};
+
+    const SCRIPT: &str = r#"
+        function list_commands(device)
+            return { ["Id Request"] = { 0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7 } }
+        end
+
+        function parse_sysex(device, bytes)
+            return device .. " : " .. #bytes .. " bytes"
+        end
+    "#;
+
+    /// A device answering every request with an identity reply.
+    #[derive(Default, Clone)]
+    struct MockSysExDevice {
+        port: Rc<RefCell<Option<MidiPortId>>>,
+        pending: Rc<RefCell<Vec<MidiData>>>,
+    }
+
+    impl MidiReceiving for MockSysExDevice {
+        fn is_midi_stream_active(&self) -> bool {
+            true
+        }
+
+        fn set_midi_stream_active(&mut self, _: bool) {}
+
+        fn list_midi_devices(&self) -> anyhow::Result<Vec<String>> {
+            Ok(vec!["synth".to_owned()])
+        }
+
+        fn connect_to_midi_device(&mut self, _: &str, port: MidiPortId) -> anyhow::Result<()> {
+            *self.port.borrow_mut() = Some(port);
+            Ok(())
+        }
+
+        fn disconnect_from_midi_device(&mut self, _: &str) -> anyhow::Result<()> {
+            Ok(())
+        }
+
+        fn produce_midi_messages(&mut self) -> Vec<MidiData> {
+            std::mem::take(&mut *self.pending.borrow_mut())
+        }
+    }
+
+    impl MidiProducing for MockSysExDevice {
+        fn send_midi_messages(&mut self, _: &str, messages: &[MidiData]) -> anyhow::Result<()> {
+            let port = self.port.borrow().unwrap();
+            self.pending
+                .borrow_mut()
+                .extend(messages.iter().map(|_| MidiData {
+                    timestamp: clock::now(),
+                    port,
+                    bytes: [0xF0, 0x7E, 0x00, 0x06, 0x02, 0x42, 0xF7].into(),
+                }));
+            Ok(())
+        }
+    }
+
+    #[test]
+    fn sends_commands_and_parses_their_responses() {
+        let device = MockSysExDevice::default();
+        let mut sysexio = SysExIoController::new(
+            Box::new(device.clone()),
+            Box::new(device),
+            SysExPacing::default(),
+        )
+        .unwrap();
+
+        let script = std::env::temp_dir().join(format!("aud_sysexio_{}.lua", std::process::id()));
+        std::fs::write(&script, SCRIPT).unwrap();
+        sysexio.load_script(&script).unwrap();
+        let _ = std::fs::remove_file(script);
+
+        sysexio.connect("synth", "synth").unwrap();
+        assert_eq!(sysexio.list_commands("synth").unwrap(), ["Id Request"]);
+        assert!(sysexio.request("synth", "Reset").is_err());
+
+        for _ in 0..3 {
+            sysexio.request("synth", "Id Request").unwrap();
+        }
+
+        let mut events = vec![];
+        let start = std::time::Instant::now();
+        while !sysexio.is_idle() && start.elapsed() < Duration::from_secs(1) {
+            sysexio.update(&mut events).unwrap();
+        }
+
+        assert_eq!(events.len(), 3);
+        assert!(events.iter().all(|event| matches!(
+            event,
+            SysExIoEvent::Response { command, parsed: Some(parsed), .. }
+                if command == "Id Request" && parsed == "synth : 7 bytes"
+        )));
+        assert_eq!(sysexio.stats("synth").unwrap().bytes_received, 21);
+    }
+}
@@ -0,0 +1,414 @@
+use super::audio_midi::{AppEvent, AudioMidiController};
+use crate::{
+    lua::Telemetry,
+    midi::{MidiData, MidiPortId, MidiStats},
+    timeline::Timeline,
+};
+use crossbeam::channel::{Receiver, Sender};
+use std::{
+    path::PathBuf,
+    sync::{
+        atomic::{AtomicBool, AtomicU64, Ordering},
+        Arc, Mutex,
+    },
+    time::{Duration, Instant},
+};
+
+/// How often the worker polls the MIDI and audio devices, by default.
+/// It wakes up as soon as a command or a script event is available,
+/// and only waits for them while no device is connected.
+pub const DEFAULT_WORKER_INTERVAL: Duration = Duration::from_millis(1);
+
+/// Counters of the snapshot are published at most this often,
+/// the changes made by commands and scripts right away.
+const PUBLISH_INTERVAL: Duration = Duration::from_millis(20);
+
+/// Number of events waiting for the UI. MIDI batches only take
+/// half of it, so the other events seldom wait for room.
+const EVENT_QUEUE_LEN: usize = 64;
+/// Messages kept while the UI does not keep up, the oldest
+/// ones are dropped past this.
+const MAX_PENDING_MIDI: usize = 4096;
+
+type Command = Box<dyn FnOnce(&mut AudioMidiController) -> anyhow::Result<()> + Send>;
+
+/// State of the controller, as published by its worker.
+#[derive(Debug, Default, Clone, PartialEq, Eq)]
+pub struct AudioMidiSnapshot {
+    pub port_names: Vec<String>,
+    /// Names of every port connected so far, indexed by their id.
+    pub port_ids: Vec<String>,
+    pub connected_ports: Vec<String>,
+    pub is_running: bool,
+    /// Messages lost on the way from the devices,
+    /// or because the UI did not keep up with them.
+    pub dropped_messages: u64,
+    /// Number of messages recorded, while recording.
+    pub num_recorded: Option<u64>,
+    pub selected_script: Option<String>,
+    pub script_path: Option<PathBuf>,
+}
+
+impl AudioMidiSnapshot {
+    fn of(app: &AudioMidiController) -> Self {
+        let midi = app.midi();
+
+        Self {
+            port_names: midi.port_names().to_vec(),
+            port_ids: (0..=MidiPortId::MAX)
+                .map_while(|port| midi.port_name(port).map(str::to_owned))
+                .collect(),
+            connected_ports: midi.connected_port_names().map(str::to_owned).collect(),
+            is_running: midi.is_running(),
+            dropped_messages: midi.dropped_messages(),
+            num_recorded: midi.recorder().map(|recorder| recorder.num_recorded()),
+            selected_script: app.selected_script(),
+            script_path: app.loaded_script_path(),
+        }
+    }
+
+    /// Name of the port a message was received from.
+    pub fn port_name(&self, port: MidiPortId) -> Option<&str> {
+        self.port_ids.get(port as usize).map(String::as_str)
+    }
+
+    pub fn is_connected(&self, port_name: &str) -> bool {
+        self.connected_ports.iter().any(|name| name == port_name)
+    }
+}
+
+pub enum AudioMidiEvent {
+    /// Messages sent by the script.
+    Midi(Vec<MidiData>),
+    Alert(String),
+    ScriptLoaded,
+    ScriptCrash,
+    /// The script stopped the application, the worker has stopped.
+    Stopping,
+    /// A command or an update failed, the worker has stopped.
+    Failed(String),
+}
+
+struct Published {
+    snapshot: Mutex<AudioMidiSnapshot>,
+    version: AtomicU64,
+}
+
+/// Services an `AudioMidiController` on its own thread, at its own
+/// cadence, so that MIDI reaches the script and the script's events
+/// are handled independently of the rate at which the UI renders.
+///
+/// The UI sends commands to run on the controller, receives the
+/// events of the script and reads the snapshots the worker publishes.
+pub struct AudioMidiWorker {
+    commands: Sender<Command>,
+    events: Receiver<AudioMidiEvent>,
+    published: Arc<Published>,
+    snapshot: AudioMidiSnapshot,
+    version: u64,
+    telemetry: Arc<Telemetry>,
+    midi_stats: Arc<MidiStats>,
+    timeline: Arc<Mutex<Timeline>>,
+    is_running: Arc<AtomicBool>,
+    thread: Option<std::thread::JoinHandle<()>>,
+}
+
+impl AudioMidiWorker {
+    /// Build a controller on a new thread and service it every `interval`.
+    ///
+    /// The controller is built on the worker, since some devices,
+    /// like audio streams, cannot be moved to another thread.
+    pub fn spawn(
+        interval: Duration,
+        build: impl FnOnce() -> anyhow::Result<AudioMidiController> + Send + 'static,
+    ) -> anyhow::Result<Self> {
+        let (command_tx, command_rx) = crossbeam::channel::unbounded();
+        let (event_tx, event_rx) = crossbeam::channel::bounded(EVENT_QUEUE_LEN);
+        let (ready_tx, ready_rx) = crossbeam::channel::bounded(1);
+        let is_running = Arc::new(AtomicBool::new(true));
+        let published = Arc::new(Published {
+            snapshot: Mutex::default(),
+            version: AtomicU64::default(),
+        });
+
+        let thread = std::thread::Builder::new()
+            .name("aud-worker".to_owned())
+            .spawn({
+                let is_running = is_running.clone();
+                let published = published.clone();
+                move || {
+                    let app = match build() {
+                        Ok(app) => app,
+                        Err(e) => {
+                            let _ = ready_tx.send(Err(e));
+                            return;
+                        }
+                    };
+
+                    let shared = (app.telemetry(), app.midi().stats().clone(), app.timeline());
+                    let mut worker = Worker {
+                        app,
+                        commands: command_rx,
+                        events: event_tx,
+                        midi: PendingMidi::default(),
+                        published,
+                        has_changed: false,
+                        last_published: Instant::now(),
+                    };
+
+                    worker.publish();
+                    let _ = ready_tx.send(Ok(shared));
+                    worker.run(interval, &is_running);
+                }
+            })?;
+
+        let (telemetry, midi_stats, timeline) = ready_rx
+            .recv()
+            .map_err(|_| anyhow::anyhow!("the worker stopped before building the controller"))??;
+
+        let mut worker = Self {
+            commands: command_tx,
+            events: event_rx,
+            published,
+            snapshot: AudioMidiSnapshot::default(),
+            version: 0,
+            telemetry,
+            midi_stats,
+            timeline,
+            is_running,
+            thread: Some(thread),
+        };
+
+        worker.update_snapshot();
+        Ok(worker)
+    }
+
+    /// Run a command on the controller, on the worker thread.
+    /// Commands run in order, before the controller is serviced.
+    pub fn send(
+        &self,
+        command: impl FnOnce(&mut AudioMidiController) -> anyhow::Result<()> + Send + 'static,
+    ) -> anyhow::Result<()> {
+        self.commands
+            .send(Box::new(command))
+            .map_err(|_| anyhow::anyhow!("the worker has stopped"))
+    }
+
+    /// Events of the script and of the worker, in order. While they
+    /// are not received, MIDI messages are gathered in fewer batches.
+    pub fn events(&self) -> &Receiver<AudioMidiEvent> {
+        &self.events
+    }
+
+    /// Read the latest snapshot published by the worker, if it
+    /// changed since the previous call. Returns whether it changed.
+    pub fn update_snapshot(&mut self) -> bool {
+        let version = self.published.version.load(Ordering::Acquire);
+        if version == self.version {
+            return false;
+        }
+
+        self.version = version;
+        self.snapshot = self.published.snapshot.lock().unwrap().clone();
+        true
+    }
+
+    /// The snapshot read by the last `update_snapshot`.
+    pub fn snapshot(&self) -> &AudioMidiSnapshot {
+        &self.snapshot
+    }
+
+    /// Data published by the loaded script.
+    pub fn telemetry(&self) -> &Arc<Telemetry> {
+        &self.telemetry
+    }
+
+    /// Statistics of every MIDI port connected so far.
+    pub fn midi_stats(&self) -> &Arc<MidiStats> {
+        &self.midi_stats
+    }
+
+    /// The audio and MIDI received, in the order of the shared clock.
+    pub fn timeline(&self) -> &Arc<Mutex<Timeline>> {
+        &self.timeline
+    }
+}
+
+impl Drop for AudioMidiWorker {
+    fn drop(&mut self) {
+        self.is_running.store(false, Ordering::Release);
+        // wakes the worker up, in case it is waiting without a deadline
+        let _ = self.send(|_| Ok(()));
+        // or waiting for room for an event
+        self.events = crossbeam::channel::never();
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+/// MIDI messages on their way to the UI, sent in a single batch
+/// when there is room for it, and gathered until then.
+#[derive(Default)]
+struct PendingMidi {
+    messages: Vec<MidiData>,
+    num_dropped: u64,
+}
+
+impl PendingMidi {
+    fn extend(&mut self, messages: Vec<MidiData>) {
+        self.messages.extend(messages);
+
+        if let Some(num_dropped) = self.messages.len().checked_sub(MAX_PENDING_MIDI) {
+            self.messages.drain(..num_dropped);
+            self.num_dropped += num_dropped as u64;
+        }
+    }
+
+    /// The batch to send, unless the UI is behind on the events.
+    fn batch(&mut self, events: &Sender<AudioMidiEvent>) -> Option<AudioMidiEvent> {
+        let has_room = events.len() < EVENT_QUEUE_LEN / 2;
+        (has_room && !self.messages.is_empty())
+            .then(|| AudioMidiEvent::Midi(std::mem::take(&mut self.messages)))
+    }
+}
+
+struct Worker {
+    app: AudioMidiController,
+    commands: Receiver<Command>,
+    events: Sender<AudioMidiEvent>,
+    midi: PendingMidi,
+    published: Arc<Published>,
+    has_changed: bool,
+    last_published: Instant,
+}
+
+impl Worker {
+    fn run(&mut self, interval: Duration, is_running: &AtomicBool) {
+        while is_running.load(Ordering::Acquire) {
+            let started = Instant::now();
+
+            match self.service() {
+                Ok(true) => (),
+                Ok(false) => return,
+                Err(e) => {
+                    log::error!("[ WORKER ] : {e}");
+                    self.send(AudioMidiEvent::Failed(e.to_string()));
+                    return;
+                }
+            }
+
+            if self.has_changed || self.last_published.elapsed() >= PUBLISH_INTERVAL {
+                self.publish();
+            }
+
+            let deadline = self.app.has_connected_devices().then(|| started + interval);
+            self.app.wait_for_events_or(&self.commands, deadline);
+        }
+    }
+
+    /// Service the controller once, returns whether the worker should keep running.
+    fn service(&mut self) -> anyhow::Result<bool> {
+        for command in self.commands.try_iter() {
+            command(&mut self.app)?;
+            self.has_changed = true;
+        }
+
+        self.app.midi_mut().update();
+        self.app.audio_mut().update()?;
+
+        if self.app.process_engine_events()? == AppEvent::ScriptCrash {
+            self.send(AudioMidiEvent::ScriptCrash);
+            self.has_changed = true;
+        }
+
+        match self.app.process_script_events()? {
+            AppEvent::Stopping => {
+                self.send(AudioMidiEvent::Stopping);
+                return Ok(false);
+            }
+            AppEvent::ScriptLoaded => {
+                self.send(AudioMidiEvent::ScriptLoaded);
+                self.has_changed = true;
+            }
+            _ => (),
+        }
+
+        self.app.process_file_events()?;
+
+        self.midi.extend(self.app.midi_mut().take_messages());
+        if let Some(batch) = self.midi.batch(&self.events) {
+            self.send(batch);
+        }
+
+        if let Some(alert) = self.app.take_alert() {
+            self.send(AudioMidiEvent::Alert(alert));
+        }
+
+        Ok(true)
+    }
+
+    /// Send an event after the messages received before it, waiting
+    /// for room if needed, which only MIDI batches are not worth.
+    fn send(&mut self, event: AudioMidiEvent) {
+        let pending = match event {
+            AudioMidiEvent::Midi(_) => None,
+            _ => Some(std::mem::take(&mut self.midi.messages)).filter(|m| !m.is_empty()),
+        };
+
+        let events = pending.map(AudioMidiEvent::Midi).into_iter().chain([event]);
+        for event in events {
+            if self.events.send(event).is_err() {
+                log::trace!("[ WORKER ] : no receiver for the event");
+            }
+        }
+    }
+
+    fn publish(&mut self) {
+        let mut snapshot = AudioMidiSnapshot::of(&self.app);
+        snapshot.dropped_messages += self.midi.num_dropped;
+        let mut published = self.published.snapshot.lock().unwrap();
+        if *published != snapshot {
+            *published = snapshot;
+            self.published.version.fetch_add(1, Ordering::Release);
+        }
+
+        self.has_changed = false;
+        self.last_published = Instant::now();
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn messages(len: usize) -> Vec<MidiData> {
+        vec![MidiData::default(); len]
+    }
+
+    #[test]
+    fn gathers_the_messages_while_the_ui_is_behind() {
+        let (events_tx, events_rx) = crossbeam::channel::bounded(EVENT_QUEUE_LEN);
+        let mut midi = PendingMidi::default();
+
+        for _ in 0..EVENT_QUEUE_LEN {
+            midi.extend(messages(1));
+            if let Some(batch) = midi.batch(&events_tx) {
+                events_tx.try_send(batch).unwrap();
+            }
+        }
+        assert_eq!(events_rx.len(), EVENT_QUEUE_LEN / 2);
+        assert_eq!(midi.messages.len(), EVENT_QUEUE_LEN / 2);
+
+        midi.extend(messages(MAX_PENDING_MIDI));
+        assert_eq!(midi.messages.len(), MAX_PENDING_MIDI);
+        assert_eq!(midi.num_dropped, EVENT_QUEUE_LEN as u64 / 2);
+
+        events_rx.try_iter().for_each(drop);
+        match midi.batch(&events_tx) {
+            Some(AudioMidiEvent::Midi(batch)) => assert_eq!(batch.len(), MAX_PENDING_MIDI),
+            _ => panic!("no batch"),
+        }
+        assert!(midi.batch(&events_tx).is_none());
+    }
+}
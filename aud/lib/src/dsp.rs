@@ -69,3 +69,160 @@ pub fn interleave(buffer: &[impl AsRef<[f32]>]) -> Vec<f32> {
 
     out
 }
+
+/// Magnitude spectrum of the latest samples of a signal, in dB relative to
+/// a full scale sine, computed by a radix-2 FFT over a Hann window.
+///
+/// Every buffer is allocated when the analyzer is created,
+/// analyzing the signal never allocates.
+#[derive(Debug, Clone)]
+pub struct SpectrumAnalyzer {
+    window: Vec<f32>,
+    /// `e^(-2πik/size)` for each `k` of the first half of the size.
+    twiddles: Vec<(f32, f32)>,
+    real: Vec<f32>,
+    imag: Vec<f32>,
+    magnitudes: Vec<f32>,
+}
+
+impl SpectrumAnalyzer {
+    /// Magnitudes below this are reported at this level, in dB.
+    pub const FLOOR_DB: f32 = -200.;
+
+    /// Create an analyzer of `size` samples, rounded up to a power of two.
+    pub fn new(size: usize) -> Self {
+        let size = size.max(2).next_power_of_two();
+        let phase = |i: usize| std::f32::consts::TAU * i as f32 / size as f32;
+
+        Self {
+            window: (0..size).map(|i| 0.5 - 0.5 * phase(i).cos()).collect(),
+            twiddles: (0..size / 2)
+                .map(|k| (phase(k).cos(), -phase(k).sin()))
+                .collect(),
+            real: vec![0.; size],
+            imag: vec![0.; size],
+            magnitudes: vec![Self::FLOOR_DB; size / 2],
+        }
+    }
+
+    /// Number of samples analyzed at once.
+    pub fn size(&self) -> usize {
+        self.window.len()
+    }
+
+    /// Number of frequency bins of the spectrum, from 0 Hz to below Nyquist.
+    pub fn num_bins(&self) -> usize {
+        self.magnitudes.len()
+    }
+
+    /// Width of each frequency bin, in Hz.
+    pub fn bin_width(&self, sample_rate: u32) -> f32 {
+        sample_rate as f32 / self.size() as f32
+    }
+
+    /// Analyze the latest `size` samples of a signal split in two slices, from
+    /// oldest to newest like the views of an `AudioHistory`. Signals shorter
+    /// than the analyzer are padded with silence before their first sample.
+    pub fn analyze(&mut self, older: &[f32], newer: &[f32]) -> &[f32] {
+        let size = self.size();
+        let num_samples = (older.len() + newer.len()).min(size);
+        let skipped = older.len() + newer.len() - num_samples;
+        let padding = size - num_samples;
+
+        self.real[..padding].fill(0.);
+        let samples = older.iter().chain(newer).skip(skipped);
+        for ((real, sample), window) in self.real[padding..]
+            .iter_mut()
+            .zip(samples)
+            .zip(&self.window[padding..])
+        {
+            *real = sample * window;
+        }
+        self.imag.fill(0.);
+
+        self.transform();
+
+        // A full scale sine peaks at a quarter of the size through the Hann window.
+        let scale = 4. / size as f32;
+        for (bin, magnitude) in self.magnitudes.iter_mut().enumerate() {
+            let power = self.real[bin].powi(2) + self.imag[bin].powi(2);
+            *magnitude = (10. * (power * scale * scale).log10()).max(Self::FLOOR_DB);
+        }
+
+        &self.magnitudes
+    }
+
+    /// In place iterative FFT of the real and imaginary buffers.
+    fn transform(&mut self) {
+        let size = self.size();
+        let bits = size.trailing_zeros();
+
+        for i in 0..size {
+            let j = i.reverse_bits() >> (usize::BITS - bits);
+            if i < j {
+                self.real.swap(i, j);
+                self.imag.swap(i, j);
+            }
+        }
+
+        let mut len = 2;
+        while len <= size {
+            let half = len / 2;
+            let stride = size / len;
+            for start in (0..size).step_by(len) {
+                for k in 0..half {
+                    let (w_real, w_imag) = self.twiddles[k * stride];
+                    let (even, odd) = (start + k, start + k + half);
+                    let t_real = w_real * self.real[odd] - w_imag * self.imag[odd];
+                    let t_imag = w_real * self.imag[odd] + w_imag * self.real[odd];
+                    self.real[odd] = self.real[even] - t_real;
+                    self.imag[odd] = self.imag[even] - t_imag;
+                    self.real[even] += t_real;
+                    self.imag[even] += t_imag;
+                }
+            }
+            len *= 2;
+        }
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn sine(frequency: f32, sample_rate: u32, num_samples: usize) -> Vec<f32> {
+        (0..num_samples)
+            .map(|i| (std::f32::consts::TAU * frequency * i as f32 / sample_rate as f32).sin())
+            .collect()
+    }
+
+    #[test]
+    fn finds_the_frequency_and_level_of_a_sine() {
+        let mut analyzer = SpectrumAnalyzer::new(1000);
+        assert_eq!(analyzer.size(), 1024);
+        assert_eq!(analyzer.bin_width(48_000), 46.875);
+
+        let signal = sine(46.875 * 100., 48_000, 1024 + 512);
+        let (older, newer) = signal.split_at(700);
+        let spectrum = analyzer.analyze(older, newer);
+
+        let peak = (0..spectrum.len())
+            .max_by(|&a, &b| spectrum[a].total_cmp(&spectrum[b]))
+            .unwrap();
+        assert_eq!(peak, 100);
+        assert!(spectrum[100].abs() < 0.1, "{}", spectrum[100]);
+        assert!(spectrum[200] < -80., "{}", spectrum[200]);
+    }
+
+    #[test]
+    fn pads_short_signals_with_silence() {
+        let mut analyzer = SpectrumAnalyzer::new(64);
+        assert!(analyzer
+            .analyze(&[], &[])
+            .iter()
+            .all(|&db| db == SpectrumAnalyzer::FLOOR_DB));
+
+        let spectrum = analyzer.analyze(&[1.], &[]);
+        assert!(spectrum.iter().all(|&db| db > SpectrumAnalyzer::FLOOR_DB));
+    }
+}
@@ -1,10 +1,12 @@
 pub mod audio;
+pub mod clock;
 pub mod comms;
 pub mod controllers;
 pub mod dsp;
 pub mod files;
 pub mod lua;
 pub mod midi;
+pub mod timeline;
 
 #[cfg(test)]
 pub(crate) mod test {
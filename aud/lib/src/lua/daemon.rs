@@ -0,0 +1,241 @@
+use super::route_from_table;
+use crate::midi::{MidiRoute, SysExAssembler};
+use std::{
+    net::SocketAddr,
+    path::{Path, PathBuf},
+    time::Duration,
+};
+
+/// Address the daemon is controlled on when the configuration has none.
+pub const DEFAULT_CONTROL_ADDRESS: &str = "127.0.0.1:4141";
+/// How often the daemon polls its devices when the configuration does not
+/// say. It only delays the messages reaching the script, their timestamps
+/// and the thru do not depend on it, and it waits without polling while
+/// no device is connected.
+pub const DEFAULT_DAEMON_INTERVAL: Duration = Duration::from_millis(10);
+
+/// Audio fetched from a remote `aud` instance rather than a local device.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct RemoteAudioConfig {
+    pub address: String,
+    /// Input and output ports, comma separated.
+    pub ports: String,
+}
+
+/// The pipeline a daemon runs, without rendering.
+#[derive(Debug, Clone, PartialEq)]
+pub struct DaemonConfig {
+    pub script: Option<PathBuf>,
+    /// MIDI inputs to connect to.
+    pub midi: Vec<String>,
+    /// MIDI file played, as a port, instead of the MIDI devices.
+    pub play: Option<PathBuf>,
+    /// Audio input to capture, or remote device to receive from.
+    pub audio: Option<String>,
+    /// Audio channels, from 0.
+    pub channels: Vec<usize>,
+    pub remote: Option<RemoteAudioConfig>,
+    /// MIDI file every message received is recorded to.
+    pub record: Option<PathBuf>,
+    pub routes: Vec<MidiRoute>,
+    pub max_sysex: usize,
+    /// Loopback address the daemon receives its commands on.
+    pub control: String,
+    /// How often metrics are logged, never if `None`.
+    pub metrics: Option<Duration>,
+    /// How often the devices are polled.
+    pub interval: Duration,
+}
+
+impl Default for DaemonConfig {
+    fn default() -> Self {
+        Self {
+            script: None,
+            midi: vec![],
+            play: None,
+            audio: None,
+            channels: vec![],
+            remote: None,
+            record: None,
+            routes: vec![],
+            max_sysex: SysExAssembler::DEFAULT_MAX_LEN,
+            control: DEFAULT_CONTROL_ADDRESS.to_owned(),
+            metrics: None,
+            interval: DEFAULT_DAEMON_INTERVAL,
+        }
+    }
+}
+
+impl DaemonConfig {
+    /// Resolve the relative paths of the configuration from `dir`.
+    pub fn relative_to(mut self, dir: impl AsRef<Path>) -> Self {
+        let dir = dir.as_ref();
+        for path in [&mut self.script, &mut self.play, &mut self.record]
+            .into_iter()
+            .flatten()
+        {
+            *path = dir.join(&*path);
+        }
+        self
+    }
+}
+
+/// Parse a daemon configuration from a Lua chunk returning a table,
+/// in which channels go from 1 and durations are in seconds:
+///
+/// ```lua
+/// return {
+///     script = "monitor.lua",
+///     midi = { "Keystep" },                 -- MIDI inputs to connect to
+///     play = "take.mid",                    -- play a file instead of the inputs
+///     audio = "MacBook Pro Microphone",     -- audio input to capture
+///     channels = { 1, 2 },                  -- the first channel if nil
+///     remote = { address = "127.0.0.1", ports = "8080,8081" },
+///     record = "session.mid",
+///     routes = { { from = "Keystep", to = "IAC Bus 1" } }, -- see `route`
+///     max_sysex = 65536,
+///     control = "127.0.0.1:4141",           -- loopback address of the commands
+///     metrics = 10,                         -- never logged if nil
+///     interval = 0.01,
+/// }
+/// ```
+pub fn parse_daemon_config(chunk: &str) -> anyhow::Result<DaemonConfig> {
+    let lua = mlua::Lua::new();
+    let table: mlua::Table = lua.load(chunk).eval()?;
+    let defaults = DaemonConfig::default();
+
+    let seconds = |key: &str| -> anyhow::Result<Option<Duration>> {
+        match table.get::<_, Option<f64>>(key)? {
+            Some(seconds) if seconds > 0. => Ok(Some(Duration::from_secs_f64(seconds))),
+            Some(seconds) => anyhow::bail!("invalid {key} {seconds}, use a positive duration"),
+            None => Ok(None),
+        }
+    };
+
+    let remote = match table.get::<_, Option<mlua::Table>>("remote")? {
+        Some(remote) => Some(RemoteAudioConfig {
+            address: remote
+                .get::<_, Option<String>>("address")?
+                .unwrap_or_else(|| "127.0.0.1".to_owned()),
+            ports: remote
+                .get::<_, Option<String>>("ports")?
+                .unwrap_or_else(|| "8080,8081".to_owned()),
+        }),
+        None => None,
+    };
+
+    let channels = table
+        .get::<_, Option<Vec<usize>>>("channels")?
+        .unwrap_or_default()
+        .into_iter()
+        .map(|channel| match channel.checked_sub(1) {
+            Some(channel) => Ok(channel),
+            None => anyhow::bail!("invalid channel 0, channels start at 1"),
+        })
+        .collect::<anyhow::Result<_>>()?;
+
+    let routes = table
+        .get::<_, Option<Vec<mlua::Table>>>("routes")?
+        .unwrap_or_default()
+        .into_iter()
+        .map(route_from_table)
+        .collect::<mlua::Result<_>>()?;
+
+    let control = table
+        .get::<_, Option<String>>("control")?
+        .unwrap_or(defaults.control);
+
+    // the commands are not authenticated, they must come from this machine
+    match control.parse::<SocketAddr>() {
+        Ok(address) if address.ip().is_loopback() => (),
+        Ok(_) => anyhow::bail!("invalid control {control}, use a loopback address"),
+        Err(e) => anyhow::bail!("invalid control {control} : {e}"),
+    }
+
+    Ok(DaemonConfig {
+        script: table.get("script")?,
+        midi: table.get::<_, Option<_>>("midi")?.unwrap_or_default(),
+        play: table.get("play")?,
+        audio: table.get("audio")?,
+        channels,
+        remote,
+        record: table.get("record")?,
+        routes,
+        max_sysex: table
+            .get::<_, Option<_>>("max_sysex")?
+            .unwrap_or(defaults.max_sysex),
+        control,
+        metrics: seconds("metrics")?,
+        interval: seconds("interval")?.unwrap_or(defaults.interval),
+    })
+}
+
+/// Configuration of a Lua file, with paths relative to the file.
+pub fn load_daemon_config(path: impl AsRef<Path>) -> anyhow::Result<DaemonConfig> {
+    let path = path.as_ref();
+    let config = parse_daemon_config(&std::fs::read_to_string(path)?)?;
+    Ok(match path.parent() {
+        Some(dir) => config.relative_to(dir),
+        None => config,
+    })
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn parses_the_pipeline_of_the_daemon() {
+        let config = parse_daemon_config(
+            r#"
+            return {
+                script = "monitor.lua",
+                midi = { "keys", "pads" },
+                audio = "mic",
+                channels = { 1, 2 },
+                remote = { ports = "9000,9001" },
+                record = "/tmp/session.mid",
+                routes = { { from = "keys", to = "synth" } },
+                metrics = 10,
+            }
+            "#,
+        )
+        .unwrap()
+        .relative_to("/etc/aud");
+
+        assert_eq!(
+            config,
+            DaemonConfig {
+                script: Some("/etc/aud/monitor.lua".into()),
+                midi: vec!["keys".into(), "pads".into()],
+                audio: Some("mic".into()),
+                channels: vec![0, 1],
+                remote: Some(RemoteAudioConfig {
+                    address: "127.0.0.1".into(),
+                    ports: "9000,9001".into(),
+                }),
+                record: Some("/tmp/session.mid".into()),
+                routes: vec![MidiRoute {
+                    from: Some("keys".into()),
+                    to: "synth".into(),
+                    ..Default::default()
+                }],
+                metrics: Some(Duration::from_secs(10)),
+                ..Default::default()
+            }
+        );
+    }
+
+    #[test]
+    fn rejects_invalid_configurations() {
+        assert!(parse_daemon_config("return { channels = { 0 } }").is_err());
+        assert!(parse_daemon_config("return { metrics = -1 }").is_err());
+        assert!(parse_daemon_config(r#"return { routes = { { channel = 1 } } }"#).is_err());
+        assert!(parse_daemon_config(r#"return { control = "0.0.0.0:4141" }"#).is_err());
+        assert!(parse_daemon_config(r#"return { control = "[::1]:4141" }"#).is_ok());
+        assert_eq!(
+            parse_daemon_config("return {}").unwrap(),
+            DaemonConfig::default()
+        );
+    }
+}
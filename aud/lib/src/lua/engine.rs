@@ -1,17 +1,34 @@
 use super::{
     handle::{start_engine, LuaEngineEvent, LuaEngineHandle, LuaRuntimeControlling},
     traits::{api::*, hooks::*},
-    LuaRuntime,
+    LuaRuntime, Telemetry,
+};
+use crate::{
+    audio::AudioBuffer,
+    clock, files,
+    midi::{MidiData, MidiPortId, MidiStats, SysExChunk},
+    timeline::Timeline,
+};
+use crossbeam::channel::{Receiver, RecvTimeoutError, Select, Sender, TryRecvError};
+use std::{
+    cell::RefCell,
+    path::{Path, PathBuf},
+    sync::{Arc, Mutex},
+    time::Instant,
 };
-use crate::{audio::AudioBuffer, files, midi::MidiData};
-use crossbeam::channel::{Receiver, Sender};
-use std::path::{Path, PathBuf};
 
 pub enum HostEvent {
-    LoadScript { name: String, chunk: String },
+    LoadScript {
+        name: String,
+        chunk: String,
+    },
     Discover(Vec<String>),
     Connect(String),
+    /// A MIDI device was connected, its messages are tagged with the port id.
+    ConnectMidi(MidiPortId, String),
     Midi(MidiData),
+    /// A part of a SysEx dump, the whole dump follows as `Midi` if it is not too long.
+    SysExChunk(SysExChunk),
     Audio(AudioBuffer),
     Stop,
     Terminate,
@@ -22,6 +39,7 @@ pub enum ScriptEvent {
     Log(LogApiEvent),
     Control(ControlFlowApiEvent),
     Connect(ConnectionApiEvent),
+    Route(RoutingApiEvent),
     Loaded,
 }
 
@@ -43,12 +61,25 @@ impl From<ConnectionApiEvent> for ScriptEvent {
     }
 }
 
+impl From<RoutingApiEvent> for ScriptEvent {
+    fn from(event: RoutingApiEvent) -> Self {
+        Self::Route(event)
+    }
+}
+
 #[derive(Clone)]
 pub struct ScriptLoader {
     tx: Sender<ScriptEvent>,
     rx: Receiver<HostEvent>,
     device_name: Option<String>,
+    /// Names of the connected MIDI devices, indexed by port id.
+    midi_ports: Vec<String>,
     chunk_to_preload: &'static str,
+    /// Engine time on the shared clock, script timers are relative to it.
+    now: u64,
+    telemetry: Arc<Telemetry>,
+    midi_stats: Arc<MidiStats>,
+    timeline: Arc<Mutex<Timeline>>,
 }
 
 impl ScriptLoader {
@@ -61,10 +92,30 @@ impl ScriptLoader {
             tx,
             rx,
             device_name: None,
+            midi_ports: vec![],
             chunk_to_preload,
+            now: 0,
+            telemetry: Arc::default(),
+            midi_stats: Arc::default(),
+            timeline: Arc::default(),
         }
     }
 
+    /// Data published by the scripts run by this loader.
+    pub fn telemetry(&self) -> Arc<Telemetry> {
+        self.telemetry.clone()
+    }
+
+    /// Statistics of the MIDI ports, which the host records and scripts query.
+    pub fn midi_stats(&self) -> Arc<MidiStats> {
+        self.midi_stats.clone()
+    }
+
+    /// The audio and MIDI received, which the host records and scripts query.
+    pub fn timeline(&self) -> Arc<Mutex<Timeline>> {
+        self.timeline.clone()
+    }
+
     fn load_script(&mut self, lua: &mut LuaRuntime, name: &str, chunk: &str) -> anyhow::Result<()> {
         self.stop_script(lua)?;
         lua.load_log(name.to_owned(), self.tx.clone())?;
@@ -73,6 +124,11 @@ impl ScriptLoader {
         lua.load_resume(name.to_owned(), self.tx.clone())?;
         lua.load_pause(name.to_owned(), self.tx.clone())?;
         lua.load_stop(name.to_owned(), self.tx.clone())?;
+        lua.load_route(name.to_owned(), self.tx.clone())?;
+        lua.load_timers(self.now)?;
+        lua.load_telemetry(self.telemetry.clone())?;
+        lua.load_midi_stats(self.midi_stats.clone())?;
+        lua.load_timeline(self.timeline.clone())?;
         lua.load_chunk(self.chunk_to_preload)?;
         lua.load_chunk(chunk)?;
         log::trace!("script loaded : {name}");
@@ -81,13 +137,38 @@ impl ScriptLoader {
 
     fn stop_script(&mut self, lua: &mut LuaRuntime) -> anyhow::Result<()> {
         lua.on_stop()?;
+        lua.release_timers();
         let _ = lua.release_script();
         log::trace!("script released");
         Ok(())
     }
 
+    fn connect_midi(
+        &mut self,
+        lua: &LuaRuntime,
+        port: MidiPortId,
+        device_name: String,
+    ) -> anyhow::Result<()> {
+        let port = port as usize;
+        if self.midi_ports.len() <= port {
+            self.midi_ports.resize(port + 1, String::new());
+        }
+        self.midi_ports[port].clone_from(&device_name);
+
+        lua.on_connect(device_name.as_str())?;
+        self.device_name = Some(device_name);
+        Ok(())
+    }
+
+    fn midi_device_name(&self, port: MidiPortId) -> &str {
+        match self.midi_ports.get(port as usize) {
+            Some(name) => name.as_str(),
+            None => self.device_name.as_ref().map_or("", |s| s.as_str()),
+        }
+    }
+
     fn handle_midi(&mut self, lua: &LuaRuntime, midi: MidiData) -> anyhow::Result<()> {
-        let device_name = self.device_name.as_ref().map_or("", |s| s.as_str());
+        let device_name = self.midi_device_name(midi.port);
 
         if lua
             .on_midi(device_name, midi.bytes.as_slice())?
@@ -99,6 +180,10 @@ impl ScriptLoader {
         Ok(())
     }
 
+    fn handle_sysex_chunk(&mut self, lua: &LuaRuntime, chunk: SysExChunk) -> anyhow::Result<()> {
+        lua.on_sysex_chunk(self.midi_device_name(chunk.port), &chunk)
+    }
+
     fn handle_audio(&mut self, lua: &LuaRuntime, audio: AudioBuffer) -> anyhow::Result<()> {
         let device_name = self.device_name.as_ref().map_or("", |s| s.as_str());
         let audio = audio.deinterleave();
@@ -107,30 +192,116 @@ impl ScriptLoader {
     }
 }
 
+impl ScriptLoader {
+    /// Dispatch a single host event to the loaded script.
+    ///
+    /// Returns `false` once the engine has been requested to terminate.
+    pub fn handle_event(&mut self, lua: &mut LuaRuntime, event: HostEvent) -> anyhow::Result<bool> {
+        match event {
+            HostEvent::Stop => self.stop_script(lua)?,
+            HostEvent::LoadScript { name, chunk } => {
+                self.load_script(lua, &name, &chunk)?;
+                self.tx.send(ScriptEvent::Loaded)?
+            }
+            HostEvent::Discover(device_names) => lua.on_discover(&device_names)?,
+            HostEvent::Connect(device_name) => {
+                lua.on_connect(device_name.as_str())?;
+                self.device_name = Some(device_name);
+            }
+            HostEvent::ConnectMidi(port, device_name) => {
+                self.connect_midi(lua, port, device_name)?
+            }
+            HostEvent::Midi(midi) => self.handle_midi(lua, midi)?,
+            HostEvent::SysExChunk(chunk) => self.handle_sysex_chunk(lua, chunk)?,
+            HostEvent::Audio(audio) => self.handle_audio(lua, audio)?,
+            HostEvent::Terminate => {
+                self.stop_script(lua).unwrap();
+                return Ok(false);
+            }
+        }
+
+        Ok(true)
+    }
+}
+
+impl ScriptLoader {
+    /// Move the engine time forward to `now`, in microseconds,
+    /// and fire the script timers that are due.
+    pub fn advance_clock(&mut self, lua: &LuaRuntime, now: u64) -> anyhow::Result<()> {
+        self.now = self.now.max(now);
+        lua.on_timers(self.now)
+    }
+
+    /// Block until the next host event, or until the next
+    /// script timer is due, in which case `None` is returned.
+    fn wait(&self, lua: &LuaRuntime) -> Result<Option<HostEvent>, RecvTimeoutError> {
+        let Some(deadline) = lua.next_timer_deadline() else {
+            return self
+                .rx
+                .recv()
+                .map(Some)
+                .map_err(|_| RecvTimeoutError::Disconnected);
+        };
+
+        match self.rx.recv_deadline(clock::to_instant(deadline)) {
+            Ok(event) => Ok(Some(event)),
+            Err(RecvTimeoutError::Timeout) => Ok(None),
+            Err(e) => Err(e),
+        }
+    }
+}
+
 impl LuaRuntimeControlling for ScriptLoader {
     fn run(&mut self, lua: &mut LuaRuntime) -> anyhow::Result<()> {
-        loop {
-            while let Ok(event) = self.rx.recv() {
-                match event {
-                    HostEvent::Stop => self.stop_script(lua)?,
-                    HostEvent::LoadScript { name, chunk } => {
-                        self.load_script(lua, &name, &chunk)?;
-                        self.tx.send(ScriptEvent::Loaded)?
-                    }
-                    HostEvent::Discover(device_names) => lua.on_discover(&device_names)?,
-                    HostEvent::Connect(device_name) => {
-                        lua.on_connect(device_name.as_str())?;
-                        self.device_name = Some(device_name);
-                    }
-                    HostEvent::Midi(midi) => self.handle_midi(lua, midi)?,
-                    HostEvent::Audio(audio) => self.handle_audio(lua, audio)?,
-                    HostEvent::Terminate => {
-                        self.stop_script(lua).unwrap();
-                        return Ok(());
-                    }
+        while let Ok(event) = self.wait(lua) {
+            self.advance_clock(lua, clock::now())?;
+
+            if let Some(event) = event {
+                if !self.handle_event(lua, event)? {
+                    break;
                 }
             }
         }
+
+        Ok(())
+    }
+}
+
+/// Events received while telling a disconnected channel from a
+/// spurious wake-up, handed out before the next ones.
+#[derive(Default)]
+struct PeekedEvents {
+    script: Option<ScriptEvent>,
+    engine: Option<LuaEngineEvent>,
+    files: Option<notify::Result<notify::Event>>,
+}
+
+impl PeekedEvents {
+    fn is_empty(&self) -> bool {
+        self.script.is_none() && self.engine.is_none() && self.files.is_none()
+    }
+}
+
+enum Readiness {
+    Ready,
+    Spurious,
+    Disconnected,
+}
+
+/// Whether a channel that `Select` found ready has a message, keeping
+/// the one received to find out in `peeked`, or is disconnected.
+fn poll_readiness<T>(rx: &Receiver<T>, peeked: &mut Option<T>) -> Readiness {
+    if !rx.is_empty() {
+        return Readiness::Ready;
+    }
+
+    match rx.try_recv() {
+        Ok(event) => {
+            *peeked = Some(event);
+            Readiness::Ready
+        }
+        Err(TryRecvError::Empty) => Readiness::Spurious,
+        Err(TryRecvError::Disconnected) => Readiness::Disconnected,
     }
 }
 
@@ -140,6 +311,10 @@ pub struct ScriptController {
     lua_handle: LuaEngineHandle,
     script_path: Option<PathBuf>,
     file_watcher: Option<files::FsWatcher>,
+    peeked: RefCell<PeekedEvents>,
+    telemetry: Arc<Telemetry>,
+    midi_stats: Arc<MidiStats>,
+    timeline: Arc<Mutex<Timeline>>,
 }
 
 impl ScriptController {
@@ -147,6 +322,9 @@ impl ScriptController {
         let (host_tx, host_rx) = crossbeam::channel::bounded::<HostEvent>(1_000);
         let (script_tx, script_rx) = crossbeam::channel::bounded::<ScriptEvent>(1_000);
         let loader = ScriptLoader::new(script_tx, host_rx, chunk_to_preload);
+        let telemetry = loader.telemetry();
+        let midi_stats = loader.midi_stats();
+        let timeline = loader.timeline();
 
         Self {
             host_tx,
@@ -154,15 +332,34 @@ impl ScriptController {
             lua_handle: start_engine(loader),
             script_path: None,
             file_watcher: None,
+            peeked: RefCell::default(),
+            telemetry,
+            midi_stats,
+            timeline,
         }
     }
 
+    pub fn telemetry(&self) -> &Arc<Telemetry> {
+        &self.telemetry
+    }
+
+    pub fn midi_stats(&self) -> &Arc<MidiStats> {
+        &self.midi_stats
+    }
+
+    pub fn timeline(&self) -> &Arc<Mutex<Timeline>> {
+        &self.timeline
+    }
+
     pub fn try_send(&self, host_event: HostEvent) -> anyhow::Result<()> {
         Ok(self.host_tx.try_send(host_event)?)
     }
 
     pub fn try_recv(&self) -> anyhow::Result<ScriptEvent> {
-        Ok(self.script_rx.try_recv()?)
+        match self.peeked.borrow_mut().script.take() {
+            Some(event) => Ok(event),
+            None => Ok(self.script_rx.try_recv()?),
+        }
     }
 
     pub fn path(&self) -> Option<&PathBuf> {
@@ -174,7 +371,97 @@ impl ScriptController {
     }
 
     pub fn try_recv_engine_events(&self) -> anyhow::Result<LuaEngineEvent> {
-        Ok(self.lua_handle.events().try_recv()?)
+        match self.peeked.borrow_mut().engine.take() {
+            Some(event) => Ok(event),
+            None => Ok(self.lua_handle.events().try_recv()?),
+        }
+    }
+
+    /// Block until the script, the engine or the file watcher has an event,
+    /// or `other` has a message, or until `deadline` if there is one. Nothing
+    /// is received from `other`, returns whether anything is ready to be.
+    ///
+    /// The channels of the script and of the engine are disconnected once
+    /// the engine terminates, and the one of the file watcher if it fails,
+    /// which makes them always ready. They are left out of the wait then,
+    /// so that the caller does not spin. `other` is the caller's, it is
+    /// ready once disconnected, like with `Select`.
+    pub fn wait_for_events<T>(
+        &self,
+        other: Option<&Receiver<T>>,
+        deadline: Option<Instant>,
+    ) -> bool {
+        let mut peeked = self.peeked.borrow_mut();
+        if !peeked.is_empty() {
+            return true;
+        }
+
+        let engine = self.lua_handle.events();
+        let files = self.file_watcher.as_ref().map(files::FsWatcher::events);
+
+        let mut select = Select::new();
+        let script_index = select.recv(&self.script_rx);
+        let engine_index = select.recv(&engine);
+        let files_index = files.as_ref().map(|files| select.recv(files));
+        let mut num_waited = 2 + files.is_some() as usize;
+        if let Some(other) = other {
+            select.recv(other);
+            num_waited += 1;
+        }
+
+        while num_waited > 0 {
+            let index = match deadline {
+                Some(deadline) => match select.ready_deadline(deadline) {
+                    Ok(index) => index,
+                    Err(_) => return false,
+                },
+                None => select.ready(),
+            };
+
+            let readiness = match (index, &files) {
+                (i, _) if i == script_index => poll_readiness(&self.script_rx, &mut peeked.script),
+                (i, _) if i == engine_index => poll_readiness(&engine, &mut peeked.engine),
+                (i, Some(files)) if Some(i) == files_index => {
+                    poll_readiness(files, &mut peeked.files)
+                }
+                _ => Readiness::Ready,
+            };
+
+            match readiness {
+                Readiness::Ready => return true,
+                Readiness::Spurious => (),
+                Readiness::Disconnected => {
+                    select.remove(index);
+                    num_waited -= 1;
+                }
+            }
+        }
+
+        if let Some(deadline) = deadline {
+            std::thread::sleep(deadline.saturating_duration_since(Instant::now()));
+        }
+        false
+    }
+
+    /// Block until the script has an event or until `deadline`, without
+    /// receiving it. Returns whether the script has an event, which it
+    /// never has again once the engine has terminated.
+    pub fn wait_for_script_events(&self, deadline: Instant) -> bool {
+        let mut peeked = self.peeked.borrow_mut();
+        if peeked.script.is_some() {
+            return true;
+        }
+
+        let mut select = Select::new();
+        select.recv(&self.script_rx);
+        while select.ready_deadline(deadline).is_ok() {
+            match poll_readiness(&self.script_rx, &mut peeked.script) {
+                Readiness::Ready => return true,
+                Readiness::Spurious => (),
+                Readiness::Disconnected => return false,
+            }
+        }
+        false
     }
 
     pub fn load(&mut self, script: impl AsRef<Path>) -> anyhow::Result<()> {
@@ -201,6 +488,7 @@ impl ScriptController {
         };
 
         self.file_watcher = files::FsWatcher::run(script_path).ok();
+        self.peeked.get_mut().files = None;
 
         if let Err(e) = self.host_tx.try_send(event) {
             log::error!("failed to send load script event : {e}");
@@ -214,7 +502,8 @@ impl ScriptController {
             return Ok(false);
         };
 
-        for event in watcher.events().try_iter().collect::<Vec<_>>() {
+        let peeked = self.peeked.borrow_mut().files.take();
+        for event in peeked.into_iter().chain(watcher.events().try_iter()) {
             if self.has_file_changed(event) {
                 if self.script_path.is_some() {
                     log::trace!("Loaded script has changed on filesystem");
@@ -255,3 +544,29 @@ impl Drop for ScriptController {
         }
     }
 }
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn tells_disconnected_channels_from_spurious_wake_ups() {
+        let (tx, rx) = crossbeam::channel::unbounded();
+        let mut peeked = None;
+        assert!(matches!(
+            poll_readiness(&rx, &mut peeked),
+            Readiness::Spurious
+        ));
+
+        tx.send(1).unwrap();
+        drop(tx);
+        assert!(matches!(poll_readiness(&rx, &mut peeked), Readiness::Ready));
+        assert_eq!((rx.len(), peeked), (1, None));
+
+        rx.try_recv().unwrap();
+        assert!(matches!(
+            poll_readiness(&rx, &mut peeked),
+            Readiness::Disconnected
+        ));
+    }
+}
@@ -1,12 +1,22 @@
+mod daemon;
 mod engine;
 mod handle;
+mod offline;
+mod routing;
 mod runtime;
+mod telemetry;
+mod timers;
 
 pub mod traits;
 
+pub use daemon::*;
 pub use engine::*;
 pub use handle::*;
+pub use offline::*;
+pub use routing::*;
 pub use runtime::*;
+pub use telemetry::*;
+pub use timers::{TimerId, TimerQueue};
 
 pub mod imported {
     include!(concat!(env!("OUT_DIR"), "/", env!("AUD_IMPORTED_LUA_RS")));
@@ -0,0 +1,501 @@
+use super::{traits::hooks::TimerHookProviding, HostEvent, LuaRuntime, ScriptEvent, ScriptLoader};
+use crate::{
+    audio::{AudioBuffer, AudioFile},
+    midi::MidiData,
+};
+use crossbeam::channel::{Receiver, Sender};
+use std::{
+    collections::BTreeMap,
+    path::Path,
+    time::{Duration, Instant},
+};
+
+/// Recorded inputs replayed by an `OfflineScriptRunner`.
+pub struct OfflineInputs {
+    /// Device name reported to the script through
+    /// `on_discover` and `on_connect`.
+    pub device_name: String,
+    /// MIDI messages, timestamped in microseconds from the
+    /// start of the recording, all received from `device_name`.
+    pub midi: Vec<MidiData>,
+    /// Audio recording, replayed in blocks of `block_size` frames.
+    pub audio: Option<AudioFile>,
+    pub block_size: usize,
+}
+
+impl Default for OfflineInputs {
+    fn default() -> Self {
+        Self {
+            device_name: "offline".to_owned(),
+            midi: vec![],
+            audio: None,
+            block_size: 512,
+        }
+    }
+}
+
+/// A script event along with the virtual time
+/// of the host event that triggered it.
+pub struct CapturedEvent {
+    pub timestamp: u64,
+    pub event: ScriptEvent,
+}
+
+/// Wall-clock time spent in a script hook.
+#[derive(Debug, Clone, Copy)]
+pub struct HookTiming {
+    pub calls: u64,
+    pub total: Duration,
+    pub min: Duration,
+    pub max: Duration,
+}
+
+impl Default for HookTiming {
+    fn default() -> Self {
+        Self {
+            calls: 0,
+            total: Duration::ZERO,
+            min: Duration::MAX,
+            max: Duration::ZERO,
+        }
+    }
+}
+
+impl HookTiming {
+    fn record(&mut self, duration: Duration) {
+        self.calls += 1;
+        self.total += duration;
+        self.min = self.min.min(duration);
+        self.max = self.max.max(duration);
+    }
+
+    pub fn mean(&self) -> Duration {
+        self.total / self.calls.max(1) as u32
+    }
+}
+
+#[derive(Default)]
+pub struct OfflineReport {
+    /// Every event emitted by the script, in emission order.
+    pub events: Vec<CapturedEvent>,
+    /// Timings keyed by the name of the hook.
+    pub hooks: BTreeMap<&'static str, HookTiming>,
+    /// Duration of the replayed recording.
+    pub virtual_duration: Duration,
+    /// Wall-clock duration of the replay.
+    pub elapsed: Duration,
+}
+
+impl OfflineReport {
+    /// How many times faster than realtime the replay ran.
+    pub fn speedup(&self) -> f64 {
+        self.virtual_duration.as_secs_f64() / self.elapsed.as_secs_f64().max(f64::EPSILON)
+    }
+}
+
+/// Runs a script on the calling thread, feeding it recorded
+/// inputs on a virtual clock as fast as the CPU allows.
+/// Script timers are driven by the same virtual clock.
+///
+/// Contrary to the `ScriptController` nothing is sent to
+/// a background engine, which makes runs deterministic:
+/// the same inputs always produce the same events.
+pub struct OfflineScriptRunner {
+    lua: LuaRuntime,
+    loader: ScriptLoader,
+    script_rx: Receiver<ScriptEvent>,
+    _host_tx: Sender<HostEvent>,
+    now: u64,
+    report: OfflineReport,
+}
+
+impl OfflineScriptRunner {
+    pub fn new(chunk_to_preload: &'static str) -> Self {
+        let (host_tx, host_rx) = crossbeam::channel::unbounded();
+        let (script_tx, script_rx) = crossbeam::channel::unbounded();
+
+        Self {
+            lua: LuaRuntime::default(),
+            loader: ScriptLoader::new(script_tx, host_rx, chunk_to_preload),
+            script_rx,
+            _host_tx: host_tx,
+            now: 0,
+            report: OfflineReport::default(),
+        }
+    }
+
+    pub fn load_script(&mut self, script: impl AsRef<Path>) -> anyhow::Result<()> {
+        let script = script.as_ref();
+        let event = HostEvent::LoadScript {
+            name: script.to_string_lossy().into_owned(),
+            chunk: std::fs::read_to_string(script)?,
+        };
+        self.dispatch("on_start", event)
+    }
+
+    /// Data published by the script, which outlives the run.
+    pub fn telemetry(&self) -> std::sync::Arc<super::Telemetry> {
+        self.loader.telemetry()
+    }
+
+    /// Replay the inputs in timestamp order, then stop the script.
+    /// Inputs are pushed to the timeline before the script handles them.
+    pub fn run(mut self, inputs: OfflineInputs) -> anyhow::Result<OfflineReport> {
+        let start = Instant::now();
+        let device_name = inputs.device_name;
+        let timeline = self.loader.timeline();
+        if let Some(ref file) = inputs.audio {
+            let num_channels = file.buffer.num_channels as usize;
+            timeline
+                .lock()
+                .unwrap()
+                .reset_audio(num_channels, file.sample_rate);
+        }
+        let mut midi = inputs.midi.into_iter().peekable();
+        let mut audio = AudioBlocks::new(inputs.audio, inputs.block_size);
+
+        self.dispatch(
+            "on_discover",
+            HostEvent::Discover(vec![device_name.clone()]),
+        )?;
+        self.dispatch("on_connect", HostEvent::ConnectMidi(0, device_name))?;
+
+        loop {
+            let is_midi_next = match (midi.peek(), audio.next_timestamp()) {
+                (Some(midi), Some(audio)) => midi.timestamp <= audio,
+                (Some(_), None) => true,
+                (None, Some(_)) => false,
+                (None, None) => break,
+            };
+
+            if is_midi_next {
+                let Some(midi) = midi.next() else { break };
+                self.advance_to(midi.timestamp)?;
+                timeline.lock().unwrap().push_midi(&midi);
+                self.dispatch("on_midi", HostEvent::Midi(midi))?;
+            } else {
+                let Some((timestamp, buffer)) = audio.next() else {
+                    break;
+                };
+                self.advance_to(timestamp)?;
+                timeline.lock().unwrap().push_audio(&buffer);
+                self.dispatch("on_audio", HostEvent::Audio(buffer))?;
+            }
+        }
+
+        self.advance_to(audio.duration())?;
+        self.dispatch("on_stop", HostEvent::Terminate)?;
+
+        self.report.virtual_duration = Duration::from_micros(self.now);
+        self.report.elapsed = start.elapsed();
+        Ok(self.report)
+    }
+
+    /// Fire the script timers that are due until `timestamp`,
+    /// each one at its own deadline, then move the clock to `timestamp`.
+    fn advance_to(&mut self, timestamp: u64) -> anyhow::Result<()> {
+        while let Some(deadline) = self
+            .lua
+            .next_timer_deadline()
+            .filter(|deadline| *deadline <= timestamp)
+        {
+            self.now = self.now.max(deadline);
+            self.record("on_timer", |loader, lua, now| {
+                loader.advance_clock(lua, now)
+            })?;
+        }
+
+        self.now = self.now.max(timestamp);
+        self.loader.advance_clock(&self.lua, self.now)
+    }
+
+    fn dispatch(&mut self, hook: &'static str, event: HostEvent) -> anyhow::Result<()> {
+        self.record(hook, |loader, lua, _| {
+            loader.handle_event(lua, event)?;
+            Ok(())
+        })
+    }
+
+    /// Time a call into the script and capture the events it emitted.
+    fn record(
+        &mut self,
+        hook: &'static str,
+        call: impl FnOnce(&mut ScriptLoader, &mut LuaRuntime, u64) -> anyhow::Result<()>,
+    ) -> anyhow::Result<()> {
+        let start = Instant::now();
+        call(&mut self.loader, &mut self.lua, self.now)?;
+        self.report
+            .hooks
+            .entry(hook)
+            .or_default()
+            .record(start.elapsed());
+
+        for event in self.script_rx.try_iter() {
+            self.report.events.push(CapturedEvent {
+                timestamp: self.now,
+                event,
+            });
+        }
+
+        Ok(())
+    }
+}
+
+/// Splits an audio recording in fixed-size blocks,
+/// each timestamped with the time of its first frame.
+struct AudioBlocks {
+    file: Option<AudioFile>,
+    block_size: usize,
+    position: usize,
+}
+
+impl AudioBlocks {
+    fn new(file: Option<AudioFile>, block_size: usize) -> Self {
+        Self {
+            file,
+            block_size: block_size.max(1),
+            position: 0,
+        }
+    }
+
+    fn frames_to_micros(&self, frames: usize) -> u64 {
+        let sample_rate = self.file.as_ref().map_or(1, |f| f.sample_rate.max(1));
+        (frames as u64 * 1_000_000) / sample_rate as u64
+    }
+
+    fn num_frames(&self) -> usize {
+        self.file.as_ref().map_or(0, |f| f.buffer.num_frames())
+    }
+
+    fn duration(&self) -> u64 {
+        self.frames_to_micros(self.num_frames())
+    }
+
+    fn next_timestamp(&self) -> Option<u64> {
+        (self.position < self.num_frames()).then(|| self.frames_to_micros(self.position))
+    }
+
+    fn next(&mut self) -> Option<(u64, AudioBuffer)> {
+        let timestamp = self.next_timestamp()?;
+        let file = self.file.as_ref()?;
+        let num_channels = file.buffer.num_channels as usize;
+        let end = (self.position + self.block_size).min(self.num_frames());
+
+        let buffer = AudioBuffer {
+            data: file.buffer.data[self.position * num_channels..end * num_channels].to_vec(),
+            num_channels: file.buffer.num_channels,
+            timestamp,
+        };
+
+        self.position = end;
+        Some((timestamp, buffer))
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::lua::{traits::api::LogApiEvent, TelemetryData};
+
+    fn alerts(report: &OfflineReport) -> Vec<(u64, String)> {
+        report
+            .events
+            .iter()
+            .filter_map(|captured| match captured.event {
+                ScriptEvent::Log(LogApiEvent::Alert(ref msg)) => {
+                    Some((captured.timestamp, msg.clone()))
+                }
+                _ => None,
+            })
+            .collect()
+    }
+
+    fn run_with_midi() -> OfflineReport {
+        let mut runner = OfflineScriptRunner::new(crate::lua::imported::midimon::API);
+        runner
+            .load_script(crate::test::fixture("alert_in_hooks.lua"))
+            .unwrap();
+
+        runner
+            .run(OfflineInputs {
+                device_name: "recording".to_owned(),
+                midi: (0..3)
+                    .map(|i| MidiData {
+                        timestamp: i * 1_000_000,
+                        port: 0,
+                        bytes: [0x90, 60 + i as u8, 100].into(),
+                    })
+                    .collect(),
+                ..Default::default()
+            })
+            .unwrap()
+    }
+
+    #[test]
+    fn replays_midi_on_a_virtual_clock() {
+        let report = run_with_midi();
+
+        assert_eq!(
+            alerts(&report),
+            [
+                (0, "on_start".to_owned()),
+                (0, "on_discover:recording".to_owned()),
+                (0, "on_connect:recording".to_owned()),
+                (0, "on_midi:recording:144,60,100".to_owned()),
+                (1_000_000, "on_midi:recording:144,61,100".to_owned()),
+                (2_000_000, "on_midi:recording:144,62,100".to_owned()),
+                (2_000_000, "on_stop".to_owned()),
+            ]
+        );
+
+        assert_eq!(report.hooks["on_midi"].calls, 3);
+        assert_eq!(report.virtual_duration, Duration::from_secs(2));
+    }
+
+    #[test]
+    fn runs_are_deterministic() {
+        assert_eq!(alerts(&run_with_midi()), alerts(&run_with_midi()));
+    }
+
+    #[test]
+    fn reports_the_device_of_each_midi_message() {
+        let mut runner = OfflineScriptRunner::new(crate::lua::imported::midimon::API);
+        runner
+            .load_script(crate::test::fixture("alert_in_hooks.lua"))
+            .unwrap();
+
+        let midi = |port| {
+            HostEvent::Midi(MidiData {
+                timestamp: 0,
+                port,
+                bytes: [0xF8].into(),
+            })
+        };
+
+        for (hook, event) in [
+            ("on_connect", HostEvent::ConnectMidi(0, "keys".to_owned())),
+            ("on_connect", HostEvent::ConnectMidi(1, "pads".to_owned())),
+            ("on_midi", midi(1)),
+            ("on_midi", midi(0)),
+        ] {
+            runner.dispatch(hook, event).unwrap();
+        }
+
+        let alerts: Vec<_> = alerts(&runner.report).into_iter().map(|(_, a)| a).collect();
+        assert_eq!(alerts[3..], ["on_midi:pads:248", "on_midi:keys:248"]);
+    }
+
+    #[test]
+    fn scripts_can_keep_the_bytes_of_a_message() {
+        let mut runner = OfflineScriptRunner::new(crate::lua::imported::midimon::API);
+        runner
+            .load_script(crate::test::fixture("keep_midi.lua"))
+            .unwrap();
+
+        for note in [60, 61] {
+            let midi = HostEvent::Midi(MidiData {
+                timestamp: 0,
+                port: 0,
+                bytes: [0x90, note, 100].into(),
+            });
+            runner.dispatch("on_midi", midi).unwrap();
+        }
+
+        let alerts: Vec<_> = alerts(&runner.report).into_iter().map(|(_, a)| a).collect();
+        assert_eq!(alerts, ["144,60,100", "144,60,100"]);
+    }
+
+    #[test]
+    fn fires_timers_on_the_virtual_clock() {
+        let mut runner = OfflineScriptRunner::new(crate::lua::imported::midimon::API);
+        runner
+            .load_script(crate::test::fixture("timers.lua"))
+            .unwrap();
+
+        let report = runner
+            .run(OfflineInputs {
+                midi: vec![MidiData {
+                    timestamp: 3_000_000,
+                    port: 0,
+                    bytes: [0xF8].into(),
+                }],
+                ..Default::default()
+            })
+            .unwrap();
+
+        assert_eq!(
+            alerts(&report),
+            [
+                (0, "spawn".to_owned()),
+                (1_000_000, "every:1".to_owned()),
+                (1_500_000, "after".to_owned()),
+                (2_000_000, "every:2".to_owned()),
+                (2_500_000, "woke".to_owned()),
+                (3_000_000, "every:3".to_owned()),
+            ]
+        );
+    }
+
+    #[test]
+    fn exposes_the_data_published_by_the_script() {
+        let mut runner = OfflineScriptRunner::new(crate::lua::imported::midimon::API);
+        runner
+            .load_script(crate::test::fixture("telemetry.lua"))
+            .unwrap();
+
+        let telemetry = runner.telemetry();
+        runner
+            .run(OfflineInputs {
+                midi: (0..3)
+                    .map(|i| MidiData {
+                        timestamp: i,
+                        port: 0,
+                        bytes: [0x90, 60 + i as u8, 100].into(),
+                    })
+                    .collect(),
+                ..Default::default()
+            })
+            .unwrap();
+
+        let channels = telemetry.channels();
+        let names: Vec<_> = channels.iter().map(|c| c.name.as_str()).collect();
+        assert_eq!(names, ["velocity", "note", "notes"]);
+
+        let TelemetryData::Plot(ref plot) = channels[0].data else {
+            panic!("velocity should be a plot");
+        };
+        let mut values = vec![];
+        plot.read_into(&mut values);
+        assert_eq!(values, [100., 100., 100.]);
+
+        let TelemetryData::Histogram(ref histogram) = channels[2].data else {
+            panic!("notes should be a histogram");
+        };
+        let mut counts = vec![];
+        histogram.read_into(&mut counts);
+        assert_eq!(counts[59..64], [0, 1, 1, 1, 0]);
+    }
+
+    #[test]
+    fn replays_audio_in_blocks() {
+        let mut runner = OfflineScriptRunner::new(crate::lua::imported::auscope::API);
+        runner
+            .load_script(crate::test::fixture("alert_on_load.lua"))
+            .unwrap();
+
+        let report = runner
+            .run(OfflineInputs {
+                audio: Some(AudioFile {
+                    buffer: AudioBuffer::with_frames(1_000, 2),
+                    sample_rate: 1_000,
+                }),
+                block_size: 100,
+                ..Default::default()
+            })
+            .unwrap();
+
+        assert_eq!(report.hooks["on_audio"].calls, 10);
+        assert_eq!(report.virtual_duration, Duration::from_secs(1));
+        assert_eq!(alerts(&report), [(0, "loaded".to_owned())]);
+    }
+}
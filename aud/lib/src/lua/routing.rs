@@ -0,0 +1,132 @@
+use crate::midi::{MidiMessageKind, MidiRoute, VelocityCurve};
+use std::path::Path;
+
+/// Parse a route from a Lua table, in which channels go from 1 to 16:
+///
+/// ```lua
+/// {
+///     from = "Keystep",        -- every input if nil
+///     to = "IAC Bus 1",
+///     channels = { 1, 2 },     -- every channel if nil
+///     messages = { "note_on", "note_off" }, -- every kind if nil
+///     channel = 10,            -- keep the channel if nil
+///     transpose = -12,
+///     curve = 0.5,             -- velocity exponent
+///     velocity = 100,          -- fixed velocity, overrides `curve`
+/// }
+/// ```
+pub fn route_from_table(table: mlua::Table) -> mlua::Result<MidiRoute> {
+    let channel = |channel: u8| {
+        channel
+            .checked_sub(1)
+            .filter(|channel| *channel < 16)
+            .ok_or_else(|| {
+                mlua::Error::RuntimeError(format!("invalid channel {channel}, use 1 to 16"))
+            })
+    };
+
+    let kind = |name: String| {
+        MidiMessageKind::from_name(&name)
+            .ok_or_else(|| mlua::Error::RuntimeError(format!("invalid message kind {name}")))
+    };
+
+    let velocity = match (
+        table.get::<_, Option<u8>>("velocity")?,
+        table.get::<_, Option<f32>>("curve")?,
+    ) {
+        (Some(velocity), _) => VelocityCurve::Fixed(velocity),
+        (None, Some(exponent)) => VelocityCurve::Power(exponent),
+        (None, None) => VelocityCurve::Linear,
+    };
+
+    Ok(MidiRoute {
+        from: table.get("from")?,
+        to: table.get("to")?,
+        channels: table
+            .get::<_, Option<Vec<u8>>>("channels")?
+            .unwrap_or_default()
+            .into_iter()
+            .map(channel)
+            .collect::<mlua::Result<_>>()?,
+        kinds: table
+            .get::<_, Option<Vec<String>>>("messages")?
+            .unwrap_or_default()
+            .into_iter()
+            .map(kind)
+            .collect::<mlua::Result<_>>()?,
+        channel: table
+            .get::<_, Option<u8>>("channel")?
+            .map(channel)
+            .transpose()?,
+        transpose: table.get::<_, Option<i8>>("transpose")?.unwrap_or(0),
+        velocity,
+    })
+}
+
+/// Routes of a Lua chunk returning a list of route tables.
+pub fn parse_routes(chunk: &str) -> anyhow::Result<Vec<MidiRoute>> {
+    let lua = mlua::Lua::new();
+    let tables: Vec<mlua::Table> = lua.load(chunk).eval()?;
+
+    Ok(tables
+        .into_iter()
+        .map(route_from_table)
+        .collect::<mlua::Result<_>>()?)
+}
+
+/// Routes of a Lua file returning a list of route tables.
+pub fn load_routes(path: impl AsRef<Path>) -> anyhow::Result<Vec<MidiRoute>> {
+    parse_routes(&std::fs::read_to_string(path)?)
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn parses_routes_with_one_based_channels() {
+        let routes = parse_routes(
+            r#"
+            return {
+                { to = "synth" },
+                {
+                    from = "keys",
+                    to = "drums",
+                    channels = { 1, 16 },
+                    messages = { "note_on", "controller" },
+                    channel = 10,
+                    transpose = -12,
+                    curve = 0.5,
+                },
+            }
+            "#,
+        )
+        .unwrap();
+
+        assert_eq!(
+            routes,
+            [
+                MidiRoute {
+                    to: "synth".into(),
+                    ..Default::default()
+                },
+                MidiRoute {
+                    from: Some("keys".into()),
+                    to: "drums".into(),
+                    channels: vec![0, 15],
+                    kinds: vec![MidiMessageKind::NoteOn, MidiMessageKind::ControlChange],
+                    channel: Some(9),
+                    transpose: -12,
+                    velocity: VelocityCurve::Power(0.5),
+                }
+            ]
+        );
+    }
+
+    #[test]
+    fn rejects_invalid_routes() {
+        assert!(parse_routes("return { { channel = 1 } }").is_err());
+        assert!(parse_routes(r#"return { { to = "synth", channel = 0 } }"#).is_err());
+        assert!(parse_routes(r#"return { { to = "synth", messages = { "notes" } } }"#).is_err());
+    }
+}
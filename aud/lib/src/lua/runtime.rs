@@ -1,4 +1,4 @@
-use std::path::Path;
+use std::{cell::RefCell, path::Path};
 
 /// `LuaRuntime` is the type that
 /// actually runs a script. It
@@ -7,6 +7,7 @@ use std::path::Path;
 pub struct LuaRuntime {
     ctx: mlua::Lua,
     script: Option<String>,
+    midi_hook_args: RefCell<MidiHookArgs>,
 }
 
 impl Default for LuaRuntime {
@@ -14,15 +15,55 @@ impl Default for LuaRuntime {
         Self {
             ctx: mlua::Lua::new(),
             script: None,
+            midi_hook_args: RefCell::default(),
         }
     }
 }
 
+/// Device names passed to `on_midi`, kept in the Lua registry
+/// so that every message does not allocate a new string.
+#[derive(Default)]
+struct MidiHookArgs {
+    /// One string per device, messages of several devices are interleaved.
+    device_names: Vec<(String, mlua::RegistryKey)>,
+}
+
 impl LuaRuntime {
     pub fn release_script(&mut self) -> Option<String> {
         self.script.take()
     }
 
+    pub(super) fn ctx(&self) -> &mlua::Lua {
+        &self.ctx
+    }
+
+    /// Lua values of the `on_midi` arguments. The table of bytes
+    /// is created for every call, so scripts are free to keep it.
+    pub(super) fn midi_hook_args<'lua>(
+        &'lua self,
+        device_name: &str,
+        bytes: &[u8],
+    ) -> mlua::Result<(mlua::String<'lua>, mlua::Table<'lua>)> {
+        let mut args = self.midi_hook_args.borrow_mut();
+        let table = self.ctx.create_sequence_from(bytes.iter().copied())?;
+
+        let name = match args
+            .device_names
+            .iter()
+            .find(|(name, _)| name == device_name)
+        {
+            Some((_, key)) => self.ctx.registry_value(key)?,
+            None => {
+                let name = self.ctx.create_string(device_name)?;
+                let key = self.ctx.create_registry_value(name.clone())?;
+                args.device_names.push((device_name.to_owned(), key));
+                name
+            }
+        };
+
+        Ok((name, table))
+    }
+
     pub fn has_script(&self) -> bool {
         self.script.is_some()
     }
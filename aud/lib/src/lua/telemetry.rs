@@ -0,0 +1,387 @@
+use std::{
+    collections::HashMap,
+    sync::{
+        atomic::{fence, AtomicU64, Ordering},
+        Arc, Mutex,
+    },
+};
+
+/// Typed data published by scripts, for the UI to render.
+///
+/// Channels are created by the engine thread the first time a script
+/// publishes to them, which is the only time the registry is locked.
+/// Each channel then has a single writer, the engine thread, and
+/// any number of readers. Reads and writes are lock-free.
+#[derive(Default)]
+pub struct Telemetry {
+    channels: Mutex<Vec<Arc<TelemetryChannel>>>,
+}
+
+impl Telemetry {
+    /// All the channels, in order of creation.
+    pub fn channels(&self) -> Vec<Arc<TelemetryChannel>> {
+        self.channels
+            .lock()
+            .map(|channels| channels.to_vec())
+            .unwrap_or_default()
+    }
+
+    pub fn clear(&self) {
+        if let Ok(mut channels) = self.channels.lock() {
+            channels.clear();
+        }
+    }
+
+    fn register(&self, channel: TelemetryChannel) -> Arc<TelemetryChannel> {
+        let channel = Arc::new(channel);
+        if let Ok(mut channels) = self.channels.lock() {
+            channels.push(channel.clone());
+        }
+        channel
+    }
+}
+
+pub struct TelemetryChannel {
+    pub name: String,
+    pub data: TelemetryData,
+}
+
+pub enum TelemetryData {
+    Scalar(Scalar),
+    Plot(Plot),
+    Histogram(Histogram),
+}
+
+impl TelemetryData {
+    fn kind(&self) -> &'static str {
+        match self {
+            Self::Scalar(_) => "scalar",
+            Self::Plot(_) => "plot",
+            Self::Histogram(_) => "histogram",
+        }
+    }
+}
+
+/// The latest value of a series.
+#[derive(Default)]
+pub struct Scalar {
+    value: AtomicU64,
+    num_updates: AtomicU64,
+}
+
+impl Scalar {
+    fn publish(&self, value: f64) {
+        self.value.store(value.to_bits(), Ordering::Relaxed);
+        self.num_updates.fetch_add(1, Ordering::Release);
+    }
+
+    pub fn value(&self) -> f64 {
+        f64::from_bits(self.value.load(Ordering::Relaxed))
+    }
+
+    pub fn num_updates(&self) -> u64 {
+        self.num_updates.load(Ordering::Acquire)
+    }
+}
+
+/// The latest values of a series, in a fixed-size ring.
+pub struct Plot {
+    values: Box<[AtomicU64]>,
+    num_written: AtomicU64,
+}
+
+impl Plot {
+    pub const CAPACITY: usize = 512;
+
+    fn with_capacity(capacity: usize) -> Self {
+        Self {
+            values: (0..capacity.max(1)).map(|_| AtomicU64::default()).collect(),
+            num_written: AtomicU64::default(),
+        }
+    }
+
+    fn publish(&self, value: f64) {
+        let index = self.num_written.load(Ordering::Relaxed);
+        let slot = &self.values[(index % self.values.len() as u64) as usize];
+        slot.store(value.to_bits(), Ordering::Relaxed);
+        self.num_written.store(index + 1, Ordering::Release);
+    }
+
+    /// Copy the values in the ring, oldest first, into `values`.
+    ///
+    /// Values that the writer overwrote during the copy, or may have been
+    /// overwriting, are left out of the output. The writer stores a value
+    /// before counting it, so the slot of the next value to count may
+    /// already hold it.
+    pub fn read_into(&self, values: &mut Vec<f64>) {
+        let capacity = self.values.len() as u64;
+        let end = self.num_written.load(Ordering::Acquire);
+        let start = end.saturating_sub(capacity);
+
+        values.clear();
+        values.extend((start..end).map(|i| {
+            let slot = &self.values[(i % capacity) as usize];
+            f64::from_bits(slot.load(Ordering::Relaxed))
+        }));
+
+        // Orders the loads of the slots before the count read after them.
+        fence(Ordering::Acquire);
+        let overwritten = (self.num_written.load(Ordering::Relaxed) + 1)
+            .saturating_sub(capacity)
+            .saturating_sub(start);
+
+        values.drain(..(overwritten as usize).min(values.len()));
+    }
+}
+
+/// Counts of values in evenly-sized bins over `[min, max)`.
+pub struct Histogram {
+    pub min: f64,
+    pub max: f64,
+    bins: Box<[AtomicU64]>,
+    num_outliers: AtomicU64,
+}
+
+impl Histogram {
+    pub const NUM_BINS: usize = 32;
+    /// Bounds the memory a script can make the host allocate.
+    pub const MAX_NUM_BINS: usize = 4096;
+
+    fn new(min: f64, max: f64, num_bins: usize) -> Self {
+        Self {
+            min,
+            max,
+            bins: (0..num_bins).map(|_| AtomicU64::default()).collect(),
+            num_outliers: AtomicU64::default(),
+        }
+    }
+
+    fn publish(&self, value: f64) {
+        let position = (value - self.min) / (self.max - self.min);
+
+        if !(0. ..1.).contains(&position) {
+            self.num_outliers.fetch_add(1, Ordering::Relaxed);
+            return;
+        }
+
+        let bin = (position * self.bins.len() as f64) as usize;
+        self.bins[bin.min(self.bins.len() - 1)].fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub fn read_into(&self, counts: &mut Vec<u64>) {
+        counts.clear();
+        counts.extend(self.bins.iter().map(|bin| bin.load(Ordering::Relaxed)));
+    }
+
+    /// Number of values that fell outside of the histogram range.
+    pub fn num_outliers(&self) -> u64 {
+        self.num_outliers.load(Ordering::Relaxed)
+    }
+}
+
+/// Engine-side handle to the telemetry channels,
+/// caching them by name so publishing never locks.
+pub struct TelemetryWriter {
+    telemetry: Arc<Telemetry>,
+    channels: HashMap<String, Arc<TelemetryChannel>>,
+}
+
+impl TelemetryWriter {
+    pub fn new(telemetry: Arc<Telemetry>) -> Self {
+        telemetry.clear();
+
+        Self {
+            telemetry,
+            channels: HashMap::new(),
+        }
+    }
+
+    pub fn scalar(&mut self, name: &str, value: f64) -> anyhow::Result<()> {
+        let create = || TelemetryData::Scalar(Scalar::default());
+        match &self.channel(name, create)?.data {
+            TelemetryData::Scalar(scalar) => scalar.publish(value),
+            data => anyhow::bail!("{name} is a {}, not a scalar", data.kind()),
+        }
+        Ok(())
+    }
+
+    pub fn plot(&mut self, name: &str, value: f64) -> anyhow::Result<()> {
+        let create = || TelemetryData::Plot(Plot::with_capacity(Plot::CAPACITY));
+        match &self.channel(name, create)?.data {
+            TelemetryData::Plot(plot) => plot.publish(value),
+            data => anyhow::bail!("{name} is a {}, not a plot", data.kind()),
+        }
+        Ok(())
+    }
+
+    /// The range and the number of bins are only used when
+    /// the histogram is created by its first value.
+    pub fn histogram(
+        &mut self,
+        name: &str,
+        value: f64,
+        range: (f64, f64),
+        num_bins: usize,
+    ) -> anyhow::Result<()> {
+        if range.0 >= range.1 {
+            anyhow::bail!("{name} has an empty range");
+        }
+
+        if !(1..=Histogram::MAX_NUM_BINS).contains(&num_bins) {
+            anyhow::bail!(
+                "{name} needs between 1 and {} bins, not {num_bins}",
+                Histogram::MAX_NUM_BINS
+            );
+        }
+
+        let create = || TelemetryData::Histogram(Histogram::new(range.0, range.1, num_bins));
+        match &self.channel(name, create)?.data {
+            TelemetryData::Histogram(histogram) => histogram.publish(value),
+            data => anyhow::bail!("{name} is a {}, not a histogram", data.kind()),
+        }
+        Ok(())
+    }
+
+    fn channel(
+        &mut self,
+        name: &str,
+        create: impl FnOnce() -> TelemetryData,
+    ) -> anyhow::Result<&TelemetryChannel> {
+        if !self.channels.contains_key(name) {
+            let channel = self.telemetry.register(TelemetryChannel {
+                name: name.to_owned(),
+                data: create(),
+            });
+            self.channels.insert(name.to_owned(), channel);
+        }
+
+        self.channels
+            .get(name)
+            .map(|channel| channel.as_ref())
+            .ok_or_else(|| anyhow::anyhow!("{name} could not be created"))
+    }
+}
+
+impl TelemetryWriter {
+    pub(super) fn load(lua: &mlua::Lua, telemetry: Arc<Telemetry>) -> mlua::Result<()> {
+        lua.set_app_data(Self::new(telemetry));
+
+        let globals = lua.globals();
+        globals.set("scalar", lua.create_function(scalar)?)?;
+        globals.set("plot", lua.create_function(plot)?)?;
+        globals.set("histogram", lua.create_function(histogram)?)
+    }
+}
+
+fn with_writer(
+    lua: &mlua::Lua,
+    publish: impl FnOnce(&mut TelemetryWriter) -> anyhow::Result<()>,
+) -> mlua::Result<()> {
+    let mut writer = lua
+        .app_data_mut::<TelemetryWriter>()
+        .ok_or_else(|| mlua::Error::RuntimeError("telemetry is not loaded".into()))?;
+
+    publish(&mut writer).map_err(mlua::Error::external)
+}
+
+// names are borrowed from the Lua strings, publishing does not allocate
+
+fn scalar<'lua>(
+    lua: &'lua mlua::Lua,
+    (name, value): (mlua::String<'lua>, f64),
+) -> mlua::Result<()> {
+    let name = name.to_str()?;
+    with_writer(lua, |writer| writer.scalar(name, value))
+}
+
+fn plot<'lua>(lua: &'lua mlua::Lua, (name, value): (mlua::String<'lua>, f64)) -> mlua::Result<()> {
+    let name = name.to_str()?;
+    with_writer(lua, |writer| writer.plot(name, value))
+}
+
+fn histogram<'lua>(
+    lua: &'lua mlua::Lua,
+    (name, value, min, max, num_bins): (mlua::String<'lua>, f64, f64, f64, Option<usize>),
+) -> mlua::Result<()> {
+    let name = name.to_str()?;
+    let num_bins = num_bins.unwrap_or(Histogram::NUM_BINS);
+    with_writer(lua, |writer| {
+        writer.histogram(name, value, (min, max), num_bins)
+    })
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn plots_keep_the_latest_values_in_order() {
+        let plot = Plot::with_capacity(4);
+        let mut values = vec![];
+
+        plot.read_into(&mut values);
+        assert!(values.is_empty());
+
+        (0..3).for_each(|i| plot.publish(i as f64));
+        plot.read_into(&mut values);
+        assert_eq!(values, [0., 1., 2.]);
+
+        // The slot of the oldest value is the next one written, and is left out.
+        (3..6).for_each(|i| plot.publish(i as f64));
+        plot.read_into(&mut values);
+        assert_eq!(values, [3., 4., 5.]);
+    }
+
+    #[test]
+    fn histograms_count_values_per_bin() {
+        let histogram = Histogram::new(0., 4., 4);
+        [0., 0.5, 1., 3.9, 4., -1.]
+            .iter()
+            .for_each(|v| histogram.publish(*v));
+
+        let mut counts = vec![];
+        histogram.read_into(&mut counts);
+        assert_eq!(counts, [2, 1, 0, 1]);
+        assert_eq!(histogram.num_outliers(), 2);
+    }
+
+    #[test]
+    fn channels_are_registered_once_with_a_single_type() {
+        let telemetry = Arc::new(Telemetry::default());
+        let mut writer = TelemetryWriter::new(telemetry.clone());
+
+        writer.scalar("velocity", 1.).unwrap();
+        writer.scalar("velocity", 2.).unwrap();
+        writer.plot("notes", 60.).unwrap();
+        assert!(writer.plot("velocity", 3.).is_err());
+
+        let channels = telemetry.channels();
+        assert_eq!(channels.len(), 2);
+        assert_eq!(channels[0].name, "velocity");
+
+        let TelemetryData::Scalar(ref scalar) = channels[0].data else {
+            panic!("velocity should be a scalar");
+        };
+        assert_eq!(scalar.value(), 2.);
+        assert_eq!(scalar.num_updates(), 2);
+
+        TelemetryWriter::new(telemetry.clone());
+        assert!(telemetry.channels().is_empty());
+    }
+
+    #[test]
+    fn histograms_are_limited_in_size() {
+        let telemetry = Arc::new(Telemetry::default());
+        let mut writer = TelemetryWriter::new(telemetry.clone());
+
+        let range = (0., 1.);
+        assert!(writer.histogram("empty", 0., range, 0).is_err());
+        assert!(writer
+            .histogram("huge", 0., range, Histogram::MAX_NUM_BINS + 1)
+            .is_err());
+        assert!(writer
+            .histogram("large", 0., range, Histogram::MAX_NUM_BINS)
+            .is_ok());
+        assert_eq!(telemetry.channels().len(), 1);
+    }
+}
@@ -0,0 +1,293 @@
+use std::{
+    cmp::Reverse,
+    collections::{BinaryHeap, HashMap},
+    rc::Rc,
+};
+
+pub type TimerId = u64;
+
+struct Timer<T> {
+    deadline: u64,
+    period: Option<u64>,
+    payload: T,
+}
+
+/// Timers ordered by deadline.
+///
+/// Time is expressed in microseconds and is provided by the
+/// caller, which lets the same queue run on a wall clock
+/// or on the virtual clock of an offline run.
+///
+/// Cancelled and rescheduled timers are removed
+/// lazily, when their stale deadline is popped.
+pub struct TimerQueue<T> {
+    deadlines: BinaryHeap<Reverse<(u64, TimerId)>>,
+    timers: HashMap<TimerId, Timer<T>>,
+    next_id: TimerId,
+}
+
+impl<T> Default for TimerQueue<T> {
+    fn default() -> Self {
+        Self {
+            deadlines: BinaryHeap::new(),
+            timers: HashMap::new(),
+            next_id: 1,
+        }
+    }
+}
+
+impl<T: Clone> TimerQueue<T> {
+    /// Schedule a timer to fire at `deadline`, and then
+    /// every `period` if it is a periodic timer.
+    pub fn schedule(&mut self, deadline: u64, period: Option<u64>, payload: T) -> TimerId {
+        let id = self.next_id;
+        self.next_id += 1;
+
+        self.deadlines.push(Reverse((deadline, id)));
+        self.timers.insert(
+            id,
+            Timer {
+                deadline,
+                // a null period would fire forever without letting time advance
+                period: period.map(|period| period.max(1)),
+                payload,
+            },
+        );
+
+        id
+    }
+
+    pub fn cancel(&mut self, id: TimerId) -> Option<T> {
+        self.timers.remove(&id).map(|timer| timer.payload)
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.timers.is_empty()
+    }
+
+    pub fn next_deadline(&mut self) -> Option<u64> {
+        self.discard_stale_deadlines();
+        self.deadlines
+            .peek()
+            .map(|Reverse((deadline, _))| *deadline)
+    }
+
+    /// Pop the earliest timer that is due at `now`, along with its deadline.
+    ///
+    /// Periodic timers are rescheduled on their original phase. If they
+    /// fell behind by more than one period the missed ticks are skipped.
+    pub fn pop_expired(&mut self, now: u64) -> Option<(u64, T)> {
+        let deadline = self.next_deadline().filter(|deadline| *deadline <= now)?;
+        let Reverse((_, id)) = self.deadlines.pop()?;
+
+        let timer = self.timers.get_mut(&id)?;
+
+        let Some(period) = timer.period else {
+            return self
+                .timers
+                .remove(&id)
+                .map(|timer| (deadline, timer.payload));
+        };
+
+        timer.deadline = match deadline + period {
+            next if next > now => next,
+            _ => now + period - (now - deadline) % period,
+        };
+
+        self.deadlines.push(Reverse((timer.deadline, id)));
+        Some((deadline, timer.payload.clone()))
+    }
+
+    fn discard_stale_deadlines(&mut self) {
+        while let Some(Reverse((deadline, id))) = self.deadlines.peek() {
+            match self.timers.get(id) {
+                Some(timer) if timer.deadline == *deadline => break,
+                _ => self.deadlines.pop(),
+            };
+        }
+    }
+}
+
+/// Timers of the loaded script, stored in the app data of the Lua context.
+///
+/// Timer callbacks run as coroutines, `sleep(ms)` yields the
+/// coroutine, which is then resumed by a one-shot timer.
+pub(super) struct ScriptTimers {
+    queue: TimerQueue<Rc<mlua::RegistryKey>>,
+    /// Time of the engine in microseconds, timers
+    /// scheduled by the script are relative to it.
+    now: u64,
+}
+
+impl ScriptTimers {
+    pub(super) fn load(lua: &mlua::Lua, now: u64) -> mlua::Result<()> {
+        lua.set_app_data(Self {
+            queue: TimerQueue::default(),
+            now,
+        });
+
+        let globals = lua.globals();
+        globals.set("after", lua.create_function(after)?)?;
+        globals.set("every", lua.create_function(every)?)?;
+        globals.set("cancel", lua.create_function(cancel)?)?;
+        globals.set("spawn", lua.create_function(spawn)?)?;
+        globals.set("now", lua.create_function(engine_time)?)?;
+
+        let coroutine: mlua::Table = globals.get("coroutine")?;
+        globals.set("sleep", coroutine.get::<_, mlua::Function>("yield")?)
+    }
+
+    pub(super) fn release(lua: &mlua::Lua) {
+        lua.remove_app_data::<Self>();
+        lua.expire_registry_values();
+    }
+
+    pub(super) fn next_deadline(lua: &mlua::Lua) -> Option<u64> {
+        lua.app_data_mut::<Self>()?.queue.next_deadline()
+    }
+
+    /// Run every task due at `now`, including the ones they schedule,
+    /// then move the script time forward to `now`.
+    pub(super) fn fire(lua: &mlua::Lua, now: u64) -> mlua::Result<()> {
+        loop {
+            let task = {
+                let Some(mut timers) = lua.app_data_mut::<Self>() else {
+                    return Ok(());
+                };
+
+                let Some((deadline, task)) = timers.queue.pop_expired(now) else {
+                    timers.now = timers.now.max(now);
+                    return Ok(());
+                };
+
+                timers.now = timers.now.max(deadline);
+                task
+            };
+
+            match lua.registry_value::<mlua::Value>(&task)? {
+                mlua::Value::Function(func) => resume(lua, lua.create_thread(func)?)?,
+                mlua::Value::Thread(thread) => resume(lua, thread)?,
+                _ => (),
+            }
+        }
+    }
+
+    fn schedule<'lua>(
+        lua: &'lua mlua::Lua,
+        delay_ms: f64,
+        period_ms: Option<f64>,
+        task: impl mlua::IntoLua<'lua>,
+    ) -> mlua::Result<TimerId> {
+        let task = Rc::new(lua.create_registry_value(task)?);
+        let mut timers = lua
+            .app_data_mut::<Self>()
+            .ok_or_else(|| mlua::Error::RuntimeError("timers are not loaded".into()))?;
+
+        let deadline = timers.now + millis_to_micros(delay_ms);
+        let period = period_ms.map(millis_to_micros);
+        Ok(timers.queue.schedule(deadline, period, task))
+    }
+}
+
+pub(super) fn millis_to_micros(ms: f64) -> u64 {
+    (ms.max(0.) * 1_000.) as u64
+}
+
+fn after<'lua>(
+    lua: &'lua mlua::Lua,
+    (ms, func): (f64, mlua::Function<'lua>),
+) -> mlua::Result<TimerId> {
+    ScriptTimers::schedule(lua, ms, None, func)
+}
+
+fn every<'lua>(
+    lua: &'lua mlua::Lua,
+    (ms, func): (f64, mlua::Function<'lua>),
+) -> mlua::Result<TimerId> {
+    ScriptTimers::schedule(lua, ms, Some(ms), func)
+}
+
+fn cancel(lua: &mlua::Lua, id: TimerId) -> mlua::Result<()> {
+    if let Some(mut timers) = lua.app_data_mut::<ScriptTimers>() {
+        timers.queue.cancel(id);
+    }
+    Ok(())
+}
+
+/// Time of the engine, in milliseconds.
+fn engine_time(lua: &mlua::Lua, (): ()) -> mlua::Result<f64> {
+    Ok(lua
+        .app_data_ref::<ScriptTimers>()
+        .map_or(0., |timers| timers.now as f64 / 1_000.))
+}
+
+fn spawn<'lua>(lua: &'lua mlua::Lua, func: mlua::Function<'lua>) -> mlua::Result<()> {
+    resume(lua, lua.create_thread(func)?)
+}
+
+/// Resume a coroutine until it either returns or
+/// yields the number of milliseconds to sleep for.
+fn resume<'lua>(lua: &'lua mlua::Lua, thread: mlua::Thread<'lua>) -> mlua::Result<()> {
+    let yielded: mlua::Value = thread.resume(())?;
+
+    if thread.status() != mlua::ThreadStatus::Resumable {
+        return Ok(());
+    }
+
+    let sleep_ms = match yielded {
+        mlua::Value::Integer(ms) => ms as f64,
+        mlua::Value::Number(ms) => ms,
+        _ => {
+            log::warn!("[ LUA ] : coroutine yielded without a sleep duration, dropping it");
+            return Ok(());
+        }
+    };
+
+    ScriptTimers::schedule(lua, sleep_ms, None, thread)?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn fires_timers_in_deadline_order() {
+        let mut queue = TimerQueue::default();
+        queue.schedule(300, None, "c");
+        queue.schedule(100, None, "a");
+        queue.schedule(200, None, "b");
+
+        assert_eq!(queue.next_deadline(), Some(100));
+        assert_eq!(queue.pop_expired(50), None);
+        assert_eq!(queue.pop_expired(250), Some((100, "a")));
+        assert_eq!(queue.pop_expired(250), Some((200, "b")));
+        assert_eq!(queue.pop_expired(250), None);
+        assert_eq!(queue.pop_expired(300), Some((300, "c")));
+        assert!(queue.is_empty());
+    }
+
+    #[test]
+    fn reschedules_periodic_timers_without_drifting() {
+        let mut queue = TimerQueue::default();
+        queue.schedule(100, Some(100), ());
+
+        assert_eq!(queue.pop_expired(130), Some((100, ())));
+        assert_eq!(queue.next_deadline(), Some(200));
+
+        // late by more than a period, the missed ticks are skipped
+        assert_eq!(queue.pop_expired(450), Some((200, ())));
+        assert_eq!(queue.next_deadline(), Some(500));
+    }
+
+    #[test]
+    fn cancelled_timers_never_fire() {
+        let mut queue = TimerQueue::default();
+        let id = queue.schedule(100, Some(10), ());
+        queue.schedule(200, None, ());
+
+        assert_eq!(queue.cancel(id), Some(()));
+        assert_eq!(queue.next_deadline(), Some(200));
+        assert_eq!(queue.pop_expired(150), None);
+    }
+}
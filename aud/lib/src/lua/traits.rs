@@ -2,7 +2,20 @@
 //!
 //! Access it by including the traits you need.
 
-use super::LuaRuntime;
+use super::{
+    timers::{millis_to_micros, ScriptTimers},
+    LuaRuntime, Telemetry, TelemetryWriter,
+};
+use crate::{
+    clock,
+    midi::{MidiMessageKind, MidiRoute, MidiStats, MidiStatsSnapshot, SysExChunk, SysExRequest},
+    timeline::Timeline,
+};
+use std::{
+    cell::RefCell,
+    sync::{Arc, Mutex},
+    time::Duration,
+};
 
 pub mod hooks {
     use super::*;
@@ -19,12 +32,35 @@ pub mod hooks {
 
     pub trait MidiHookProviding {
         fn on_midi(&self, device_name: &str, bytes: &[u8]) -> anyhow::Result<Option<bool>>;
+        /// Called for every part of a SysEx dump, before `on_midi`
+        /// is called with the whole dump if it is not too long.
+        fn on_sysex_chunk(&self, device_name: &str, chunk: &SysExChunk) -> anyhow::Result<()>;
+    }
+
+    pub trait SysExHookProviding {
+        /// Names of the commands the script can build for a device.
+        fn list_commands(&self, device_name: &str) -> anyhow::Result<Vec<String>>;
+        /// The request of a command, built by `build_command` or else
+        /// taken from `list_commands`, `None` if the command is unknown.
+        fn build_command(
+            &self,
+            device_name: &str,
+            command: &str,
+        ) -> anyhow::Result<Option<SysExRequest>>;
+        fn parse_sysex(&self, device_name: &str, bytes: &[u8]) -> anyhow::Result<Option<String>>;
     }
 
     pub trait AudioHookProviding {
         fn on_audio(&self, device_name: &str, data: &[Vec<f32>]) -> anyhow::Result<()>;
     }
 
+    pub trait TimerHookProviding {
+        /// Earliest deadline of the script timers, in microseconds.
+        fn next_timer_deadline(&self) -> Option<u64>;
+        /// Fire the script timers that are due at `now`, in microseconds.
+        fn on_timers(&self, now: u64) -> anyhow::Result<()>;
+    }
+
     impl TraceHookProviding for LuaRuntime {
         fn on_start(&self) -> anyhow::Result<()> {
             match self.has_script() {
@@ -60,7 +96,84 @@ pub mod hooks {
     impl MidiHookProviding for LuaRuntime {
         fn on_midi(&self, device_name: &str, bytes: &[u8]) -> anyhow::Result<Option<bool>> {
             match self.has_script() {
-                true => self.call("on_midi", (device_name, bytes)),
+                true => self.call("on_midi", self.midi_hook_args(device_name, bytes)?),
+                false => Ok(None),
+            }
+        }
+
+        fn on_sysex_chunk(&self, device_name: &str, chunk: &SysExChunk) -> anyhow::Result<()> {
+            if !self.has_script() {
+                return Ok(());
+            }
+
+            let (device_name, bytes) = self.midi_hook_args(device_name, &chunk.bytes)?;
+            self.call(
+                "on_sysex_chunk",
+                (device_name, bytes, chunk.offset, chunk.is_last),
+            )
+        }
+    }
+
+    impl SysExHookProviding for LuaRuntime {
+        fn list_commands(&self, device_name: &str) -> anyhow::Result<Vec<String>> {
+            if !self.has_script() {
+                return Ok(vec![]);
+            }
+
+            let commands: Option<mlua::Table> = self.call("list_commands", device_name)?;
+            let mut names: Vec<String> = commands
+                .into_iter()
+                .flat_map(|commands| commands.pairs::<mlua::Value, mlua::Value>())
+                .filter_map(|pair| match pair {
+                    Ok((mlua::Value::String(name), _)) => name.to_str().ok().map(str::to_owned),
+                    _ => None,
+                })
+                .collect();
+
+            names.sort();
+            Ok(names)
+        }
+
+        fn build_command(
+            &self,
+            device_name: &str,
+            command: &str,
+        ) -> anyhow::Result<Option<SysExRequest>> {
+            if !self.has_script() {
+                return Ok(None);
+            }
+
+            let args = self.ctx().create_table()?;
+            let (bytes, response): (Option<Vec<u8>>, mlua::Value) =
+                self.call("build_command", (device_name, command, args))?;
+
+            let bytes = match bytes {
+                Some(bytes) => bytes,
+                None => {
+                    let commands: Option<mlua::Table> = self.call("list_commands", device_name)?;
+                    match commands {
+                        Some(commands) => match commands.get::<_, Option<Vec<u8>>>(command)? {
+                            Some(bytes) => bytes,
+                            None => return Ok(None),
+                        },
+                        None => return Ok(None),
+                    }
+                }
+            };
+
+            let request = SysExRequest::new(device_name, bytes);
+            Ok(Some(match response {
+                mlua::Value::Nil => request,
+                mlua::Value::Boolean(false) => request.with_response(None),
+                response => {
+                    request.with_response(Some(mlua::FromLua::from_lua(response, self.ctx())?))
+                }
+            }))
+        }
+
+        fn parse_sysex(&self, device_name: &str, bytes: &[u8]) -> anyhow::Result<Option<String>> {
+            match self.has_script() {
+                true => self.call("parse_sysex", self.midi_hook_args(device_name, bytes)?),
                 false => Ok(None),
             }
         }
@@ -74,6 +187,16 @@ pub mod hooks {
             }
         }
     }
+
+    impl TimerHookProviding for LuaRuntime {
+        fn next_timer_deadline(&self) -> Option<u64> {
+            ScriptTimers::next_deadline(self.ctx())
+        }
+
+        fn on_timers(&self, now: u64) -> anyhow::Result<()> {
+            Ok(ScriptTimers::fire(self.ctx(), now)?)
+        }
+    }
 }
 
 pub mod api {
@@ -120,6 +243,43 @@ pub mod api {
         fn load_stop(&self, name: String, tx: Sender<E>) -> anyhow::Result<()>;
     }
 
+    pub enum RoutingApiEvent {
+        Route(MidiRoute),
+    }
+
+    pub trait RoutingProviding<E>
+    where
+        E: From<RoutingApiEvent>,
+    {
+        /// Provide `route`, to be called when the script is loaded.
+        fn load_route(&self, name: String, tx: Sender<E>) -> anyhow::Result<()>;
+    }
+
+    pub trait TimerProviding {
+        /// Provide `after`, `every`, `cancel`, `spawn`, `sleep` and `now`,
+        /// with `now` being the current engine time in microseconds.
+        fn load_timers(&self, now: u64) -> anyhow::Result<()>;
+        /// Drop all the timers and sleeping coroutines.
+        fn release_timers(&self);
+    }
+
+    pub trait TelemetryProviding {
+        /// Provide `scalar`, `plot` and `histogram`,
+        /// publishing to freshly cleared `telemetry`.
+        fn load_telemetry(&self, telemetry: Arc<Telemetry>) -> anyhow::Result<()>;
+    }
+
+    pub trait MidiStatsProviding {
+        /// Provide `midi_stats`, reading the statistics of a port.
+        fn load_midi_stats(&self, stats: Arc<MidiStats>) -> anyhow::Result<()>;
+    }
+
+    pub trait TimelineProviding {
+        /// Provide `midi_between`, `audio_around` and `latency`,
+        /// reading the audio and MIDI received by the host.
+        fn load_timeline(&self, timeline: Arc<Mutex<Timeline>>) -> anyhow::Result<()>;
+    }
+
     impl<E> LogProviding<E> for LuaRuntime
     where
         E: From<LogApiEvent> + 'static,
@@ -204,4 +364,159 @@ pub mod api {
             })
         }
     }
+
+    impl<E> RoutingProviding<E> for LuaRuntime
+    where
+        E: From<RoutingApiEvent> + 'static,
+    {
+        fn load_route(&self, name: String, tx: Sender<E>) -> anyhow::Result<()> {
+            self.set_fn("route", {
+                move |_, table: mlua::Table| {
+                    let route = crate::lua::route_from_table(table)?;
+                    if let Err(e) = tx.try_send(RoutingApiEvent::Route(route).into()) {
+                        log::error!("{name} ! failed to send route event : {}", e);
+                    }
+                    Ok(())
+                }
+            })
+        }
+    }
+
+    impl TimerProviding for LuaRuntime {
+        fn load_timers(&self, now: u64) -> anyhow::Result<()> {
+            Ok(ScriptTimers::load(self.ctx(), now)?)
+        }
+
+        fn release_timers(&self) {
+            ScriptTimers::release(self.ctx())
+        }
+    }
+
+    impl TelemetryProviding for LuaRuntime {
+        fn load_telemetry(&self, telemetry: Arc<Telemetry>) -> anyhow::Result<()> {
+            Ok(TelemetryWriter::load(self.ctx(), telemetry)?)
+        }
+    }
+
+    /// Number of controllers listed in `busiest_controls`.
+    const NUM_BUSIEST_CONTROLS: usize = 8;
+
+    impl MidiStatsProviding for LuaRuntime {
+        fn load_midi_stats(&self, stats: Arc<MidiStats>) -> anyhow::Result<()> {
+            // rates are computed since the previous query of each device
+            let earlier: RefCell<Vec<(String, MidiStatsSnapshot)>> = RefCell::default();
+
+            self.set_fn("midi_stats", move |lua, device_name: String| {
+                let Some(port) = stats.port(&device_name) else {
+                    return Ok(mlua::Value::Nil);
+                };
+
+                let snapshot = port.snapshot(clock::now());
+                let mut earlier = earlier.borrow_mut();
+                let index = match earlier.iter().position(|(name, _)| *name == device_name) {
+                    Some(index) => index,
+                    None => {
+                        earlier.push((device_name, MidiStatsSnapshot::default()));
+                        earlier.len() - 1
+                    }
+                };
+                let earlier = std::mem::replace(&mut earlier[index].1, snapshot.clone());
+
+                let table = lua.create_table()?;
+                table.set("messages", snapshot.num_messages)?;
+                table.set("sysex_bytes", snapshot.sysex_bytes)?;
+                table.set("running_status", snapshot.running_status)?;
+                table.set("repeated_status", snapshot.repeated_status)?;
+
+                for kind in MidiMessageKind::ALL {
+                    let counts = lua.create_table()?;
+                    counts.set("count", snapshot.count(kind, None))?;
+                    counts.set("rate", snapshot.rate_since(&earlier, kind, None))?;
+                    counts.set(
+                        "channels",
+                        (0..16)
+                            .map(|channel| snapshot.count(kind, Some(channel)))
+                            .collect::<Vec<_>>(),
+                    )?;
+                    counts.set("intervals", snapshot.intervals(kind).to_vec())?;
+                    table.set(kind.name(), counts)?;
+                }
+
+                let controls = lua.create_table()?;
+                for (control, count) in snapshot.busiest_controls(NUM_BUSIEST_CONTROLS) {
+                    let entry = lua.create_table()?;
+                    entry.set("control", control)?;
+                    entry.set("count", count)?;
+                    controls.push(entry)?;
+                }
+                table.set("busiest_controls", controls)?;
+
+                Ok(mlua::Value::Table(table))
+            })
+        }
+    }
+
+    fn lock_timeline(
+        timeline: &Mutex<Timeline>,
+    ) -> mlua::Result<std::sync::MutexGuard<'_, Timeline>> {
+        timeline
+            .lock()
+            .map_err(|_| mlua::Error::RuntimeError("the timeline is poisoned".into()))
+    }
+
+    fn micros_to_millis(micros: u64) -> f64 {
+        micros as f64 / 1_000.
+    }
+
+    impl TimelineProviding for LuaRuntime {
+        fn load_timeline(&self, timeline: Arc<Mutex<Timeline>>) -> anyhow::Result<()> {
+            self.set_fn("midi_between", {
+                let timeline = timeline.clone();
+                move |lua, (from, to): (f64, f64)| {
+                    let timeline = lock_timeline(&timeline)?;
+                    let messages = lua.create_table()?;
+                    for midi in timeline.midi_between(millis_to_micros(from), millis_to_micros(to))
+                    {
+                        let message = lua.create_table()?;
+                        message.set("time", micros_to_millis(midi.timestamp))?;
+                        message.set("bytes", midi.bytes.to_vec())?;
+                        messages.push(message)?;
+                    }
+                    Ok(messages)
+                }
+            })?;
+
+            self.set_fn("audio_around", {
+                let timeline = timeline.clone();
+                move |lua, (time, before, after): (f64, f64, f64)| {
+                    let audio = lock_timeline(&timeline)?.audio_around(
+                        millis_to_micros(time),
+                        Duration::from_micros(millis_to_micros(before)),
+                        Duration::from_micros(millis_to_micros(after)),
+                    );
+
+                    if audio.data.is_empty() {
+                        return Ok(mlua::Value::Nil);
+                    }
+
+                    let table = lua.create_table()?;
+                    table.set("time", micros_to_millis(audio.timestamp))?;
+                    table.set("channels", audio.deinterleave())?;
+                    Ok(mlua::Value::Table(table))
+                }
+            })?;
+
+            self.set_fn(
+                "latency",
+                move |_, (time, threshold, within): (f64, f32, f64)| {
+                    let latency = lock_timeline(&timeline)?.latency_after(
+                        millis_to_micros(time),
+                        threshold,
+                        Duration::from_micros(millis_to_micros(within)),
+                    );
+                    Ok(latency.map(|latency| latency.as_secs_f64() * 1_000.))
+                },
+            )
+        }
+    }
 }
@@ -0,0 +1,147 @@
+use std::{fmt, ops::Deref, sync::Arc};
+
+/// The bytes of a single MIDI message.
+///
+/// Channel and system common messages, which are at most
+/// 3 bytes long, are stored inline so they never allocate.
+/// Longer messages, i.e. SysEx, are stored in a shared buffer
+/// which makes them cheap to copy between threads.
+#[derive(Clone)]
+pub enum MidiBytes {
+    Short { len: u8, data: [u8; 3] },
+    Long(Arc<[u8]>),
+}
+
+impl MidiBytes {
+    pub const MAX_SHORT_LEN: usize = 3;
+
+    pub fn as_slice(&self) -> &[u8] {
+        match self {
+            Self::Short { len, data } => &data[..*len as usize],
+            Self::Long(bytes) => bytes,
+        }
+    }
+
+    pub fn is_short(&self) -> bool {
+        matches!(self, Self::Short { .. })
+    }
+}
+
+impl Default for MidiBytes {
+    fn default() -> Self {
+        Self::Short {
+            len: 0,
+            data: [0; 3],
+        }
+    }
+}
+
+impl Deref for MidiBytes {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        self.as_slice()
+    }
+}
+
+impl From<&[u8]> for MidiBytes {
+    fn from(bytes: &[u8]) -> Self {
+        if bytes.len() > Self::MAX_SHORT_LEN {
+            return Self::Long(bytes.into());
+        }
+
+        let mut data = [0; 3];
+        data[..bytes.len()].copy_from_slice(bytes);
+
+        Self::Short {
+            len: bytes.len() as u8,
+            data,
+        }
+    }
+}
+
+impl<const N: usize> From<[u8; N]> for MidiBytes {
+    fn from(bytes: [u8; N]) -> Self {
+        bytes.as_slice().into()
+    }
+}
+
+impl From<Vec<u8>> for MidiBytes {
+    fn from(bytes: Vec<u8>) -> Self {
+        if bytes.len() > Self::MAX_SHORT_LEN {
+            return Self::Long(bytes.into());
+        }
+
+        bytes.as_slice().into()
+    }
+}
+
+impl From<Arc<[u8]>> for MidiBytes {
+    fn from(bytes: Arc<[u8]>) -> Self {
+        if bytes.len() > Self::MAX_SHORT_LEN {
+            return Self::Long(bytes);
+        }
+
+        bytes.as_ref().into()
+    }
+}
+
+impl PartialEq for MidiBytes {
+    fn eq(&self, other: &Self) -> bool {
+        self.as_slice() == other.as_slice()
+    }
+}
+
+impl Eq for MidiBytes {}
+
+impl PartialEq<[u8]> for MidiBytes {
+    fn eq(&self, other: &[u8]) -> bool {
+        self.as_slice() == other
+    }
+}
+
+impl<const N: usize> PartialEq<[u8; N]> for MidiBytes {
+    fn eq(&self, other: &[u8; N]) -> bool {
+        self.as_slice() == other
+    }
+}
+
+impl fmt::Debug for MidiBytes {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        self.as_slice().fmt(f)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn stores_channel_messages_inline() {
+        let bytes = MidiBytes::from([0x90, 60, 100]);
+        assert!(bytes.is_short());
+        assert_eq!(bytes, [0x90, 60, 100]);
+        assert_eq!(bytes.len(), 3);
+
+        let bytes = MidiBytes::from(vec![0xF8]);
+        assert!(bytes.is_short());
+        assert_eq!(bytes, [0xF8]);
+    }
+
+    #[test]
+    fn shares_sysex_messages() {
+        let bytes = MidiBytes::from(vec![0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7]);
+        assert!(!bytes.is_short());
+
+        let copy = bytes.clone();
+        assert_eq!(copy.as_ptr(), bytes.as_ptr());
+        assert_eq!(copy, [0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7]);
+    }
+
+    #[test]
+    fn compares_by_content() {
+        let arc: Arc<[u8]> = vec![0xC0, 0x05].into();
+        assert_eq!(MidiBytes::from(arc), MidiBytes::from([0xC0, 0x05]));
+        assert_ne!(MidiBytes::from([0xC0, 0x05]), MidiBytes::from([0xC0]));
+    }
+}
@@ -1,6 +1,30 @@
+mod bytes;
+mod merge;
+mod net;
+mod player;
+mod recorder;
+mod requests;
+mod ring;
+mod router;
+mod smf;
+mod stats;
 mod stream;
+mod sync;
+mod sysex;
 
+pub use bytes::*;
+pub use merge::*;
+pub use net::*;
+pub use player::*;
+pub use recorder::*;
+pub use requests::*;
+pub use ring::*;
+pub use router::*;
+pub use smf::*;
+pub use stats::*;
 pub use stream::*;
+pub use sync::*;
+pub use sysex::*;
 
 pub trait MidiReceiving {
     ///
@@ -9,10 +33,29 @@ pub trait MidiReceiving {
     fn set_midi_stream_active(&mut self, should_be_active: bool);
     ///
     fn list_midi_devices(&self) -> anyhow::Result<Vec<String>>;
+    /// Connect to a device, in addition to the already connected ones.
+    /// Its messages are tagged with `port`, which is chosen by the caller.
+    fn connect_to_midi_device(&mut self, device_name: &str, port: MidiPortId)
+        -> anyhow::Result<()>;
     ///
-    fn connect_to_midi_device(&mut self, device_name: &str) -> anyhow::Result<()>;
-    ///
+    fn disconnect_from_midi_device(&mut self, device_name: &str) -> anyhow::Result<()>;
+    /// Messages received from all the connected devices, in timestamp order.
+    /// Messages may be held back until a later call, so that none is older
+    /// than a message already produced.
     fn produce_midi_messages(&mut self) -> Vec<MidiData>;
+    /// Number of messages lost because they were received
+    /// faster than they were produced, since the receiver started.
+    fn dropped_midi_messages(&self) -> u64 {
+        0
+    }
+    /// Route the received messages to output devices,
+    /// replacing the previous routes.
+    fn route_midi(&mut self, router: MidiRouter) -> anyhow::Result<()> {
+        if !router.is_empty() {
+            anyhow::bail!("[ MIDI ] : this receiver cannot route MIDI");
+        }
+        Ok(())
+    }
 }
 
 pub trait MidiProducing {
@@ -20,8 +63,12 @@ pub trait MidiProducing {
     fn send_midi_messages(&mut self, device: &str, messages: &[MidiData]) -> anyhow::Result<()>;
 }
 
-#[derive(Default, Debug, PartialEq, Eq)]
+/// Compact identifier of the port a message was received from.
+pub type MidiPortId = u16;
+
+#[derive(Default, Debug, Clone, PartialEq, Eq)]
 pub struct MidiData {
     pub timestamp: u64,
-    pub bytes: Vec<u8>,
+    pub port: MidiPortId,
+    pub bytes: MidiBytes,
 }
@@ -0,0 +1,146 @@
+use super::*;
+use crate::{clock, comms::*};
+use crossbeam::channel::{Receiver, Sender};
+
+/// `RemoteMidiTransmitter` sends MIDI messages to a remote `RemoteMidiReceiver`.
+///
+/// Messages are batched into sequence-numbered packets, each carrying a
+/// journal of the previous batches, so that a few lost packets are
+/// recovered by the receiver without retransmission.
+pub struct RemoteMidiTransmitter {
+    writer: MidiPacketWriter,
+    packets: Sender<MidiPacket>,
+    _responses: Receiver<MidiPacket>,
+    _handle: SocketCommunicator,
+}
+
+impl RemoteMidiTransmitter {
+    pub fn new<Socket>(sockets: Sockets<Socket>) -> anyhow::Result<Self>
+    where
+        Socket: SocketInterface + 'static,
+    {
+        let (packet_tx, packet_rx) = crossbeam::channel::bounded(128);
+        let (response_tx, response_rx) = crossbeam::channel::bounded(1);
+
+        Ok(Self {
+            writer: MidiPacketWriter::default(),
+            packets: packet_tx,
+            _responses: response_rx,
+            _handle: SocketCommunicator::launch(
+                sockets,
+                Events {
+                    inputs: packet_rx,
+                    outputs: response_tx,
+                },
+            ),
+        })
+    }
+}
+
+impl MidiProducing for RemoteMidiTransmitter {
+    /// Every message is sent to the target of the sockets, `device` is ignored.
+    fn send_midi_messages(&mut self, _: &str, messages: &[MidiData]) -> anyhow::Result<()> {
+        self.writer.send(messages, &self.packets, |packet| packet)
+    }
+}
+
+/// `RemoteMidiReceiver` receives the MIDI messages of a remote
+/// `RemoteMidiTransmitter`, which it lists as a single device.
+///
+/// Messages are stamped with the local `clock`, at the time they were
+/// sent plus the smallest delay seen so far, so that they keep their
+/// timing and can be ordered with the local devices.
+pub struct RemoteMidiReceiver {
+    device_name: String,
+    port: Option<MidiPortId>,
+    is_running: bool,
+    reader: MidiPacketReader,
+    packets: Receiver<MidiPacket>,
+    _requests: Sender<MidiPacket>,
+    _handle: SocketCommunicator,
+}
+
+impl RemoteMidiReceiver {
+    pub fn new<Socket>(sockets: Sockets<Socket>) -> anyhow::Result<Self>
+    where
+        Socket: SocketInterface + 'static,
+    {
+        let (packet_tx, packet_rx) = crossbeam::channel::bounded(1_024);
+        let (request_tx, request_rx) = crossbeam::channel::bounded(1);
+
+        Ok(Self {
+            device_name: format!("remote {}", sockets.target),
+            port: None,
+            is_running: true,
+            reader: MidiPacketReader::default(),
+            packets: packet_rx,
+            _requests: request_tx,
+            _handle: SocketCommunicator::launch(
+                sockets,
+                Events {
+                    inputs: request_rx,
+                    outputs: packet_tx,
+                },
+            ),
+        })
+    }
+
+    /// Number of lost packets recovered from the journals.
+    pub fn recovered_midi_packets(&self) -> u64 {
+        self.reader.num_recovered()
+    }
+}
+
+impl MidiReceiving for RemoteMidiReceiver {
+    fn is_midi_stream_active(&self) -> bool {
+        self.is_running
+    }
+
+    fn set_midi_stream_active(&mut self, should_be_active: bool) {
+        self.is_running = should_be_active;
+    }
+
+    fn list_midi_devices(&self) -> anyhow::Result<Vec<String>> {
+        Ok(vec![self.device_name.clone()])
+    }
+
+    fn connect_to_midi_device(
+        &mut self,
+        device_name: &str,
+        port: MidiPortId,
+    ) -> anyhow::Result<()> {
+        if device_name != self.device_name {
+            anyhow::bail!("[ MIDI ] : unknown remote device : {device_name}");
+        }
+
+        self.port = Some(port);
+        Ok(())
+    }
+
+    fn disconnect_from_midi_device(&mut self, device_name: &str) -> anyhow::Result<()> {
+        if device_name == self.device_name {
+            self.port = None;
+        }
+        Ok(())
+    }
+
+    fn produce_midi_messages(&mut self) -> Vec<MidiData> {
+        let mut messages = vec![];
+
+        while let Ok(packet) = self.packets.try_recv() {
+            self.reader.read(packet, clock::now(), &mut messages);
+        }
+
+        match self.port {
+            Some(port) if self.is_running => {
+                messages.iter_mut().for_each(|midi| midi.port = port);
+                messages
+            }
+            _ => vec![],
+        }
+    }
+
+    fn dropped_midi_messages(&self) -> u64 {
+        self.reader.num_lost()
+    }
+}
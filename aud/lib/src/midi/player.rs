@@ -0,0 +1,343 @@
+use super::{
+    read_midi_file, ring, MidiData, MidiPortId, MidiReceiving, RingConsumer, RingProducer,
+};
+use crate::clock;
+use std::{
+    path::Path,
+    sync::{
+        atomic::{AtomicBool, Ordering},
+        Arc,
+    },
+    thread::JoinHandle,
+    time::{Duration, Instant},
+};
+
+const RING_CAPACITY: usize = 4096;
+/// Below this delay the playback thread spins instead of sleeping,
+/// sleeps are not precise enough for sub-millisecond timing.
+const SPIN_THRESHOLD: Duration = Duration::from_millis(2);
+/// Longest sleep of the playback thread, which bounds
+/// how long it takes to notice a pause or a stop.
+const MAX_SLEEP: Duration = Duration::from_millis(10);
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum PlaybackSpeed {
+    /// Messages are produced when they are due, on a dedicated thread.
+    Realtime,
+    /// All the messages are produced at once, for tests and offline runs.
+    AsFastAsPossible,
+}
+
+enum Playback {
+    Realtime {
+        consumer: RingConsumer<MidiData>,
+        is_stopped: Arc<AtomicBool>,
+        thread: Option<JoinHandle<()>>,
+    },
+    AsFastAsPossible {
+        port: MidiPortId,
+        is_finished: bool,
+    },
+}
+
+/// Replays the messages of a MIDI file as a single device, named after the file.
+///
+/// The playback starts on connection. In realtime, messages are stamped
+/// with the `clock` when they are produced, like the messages of a device.
+/// Otherwise they keep the timestamps of the file, from its start.
+pub struct SmfPlayer {
+    device_name: String,
+    messages: Arc<[MidiData]>,
+    speed: PlaybackSpeed,
+    is_running: Arc<AtomicBool>,
+    playback: Option<Playback>,
+}
+
+impl SmfPlayer {
+    pub fn open(path: impl AsRef<Path>, speed: PlaybackSpeed) -> anyhow::Result<Self> {
+        let path = path.as_ref();
+        let device_name = path
+            .file_stem()
+            .map(|name| name.to_string_lossy().into_owned())
+            .unwrap_or_else(|| "smf".to_owned());
+
+        Ok(Self::new(device_name, read_midi_file(path)?, speed))
+    }
+
+    pub fn new(device_name: String, messages: Vec<MidiData>, speed: PlaybackSpeed) -> Self {
+        Self {
+            device_name,
+            messages: messages.into(),
+            speed,
+            is_running: Arc::new(AtomicBool::new(true)),
+            playback: None,
+        }
+    }
+
+    /// Whether every message of the file has been produced.
+    pub fn is_finished(&self) -> bool {
+        match self.playback {
+            Some(Playback::Realtime {
+                ref consumer,
+                ref thread,
+                ..
+            }) => thread.as_ref().is_none_or(|t| t.is_finished()) && consumer.is_empty(),
+            Some(Playback::AsFastAsPossible { is_finished, .. }) => is_finished,
+            None => false,
+        }
+    }
+
+    fn start(&mut self, port: MidiPortId) -> anyhow::Result<()> {
+        self.stop();
+
+        self.playback = Some(match self.speed {
+            PlaybackSpeed::AsFastAsPossible => Playback::AsFastAsPossible {
+                port,
+                is_finished: false,
+            },
+            PlaybackSpeed::Realtime => {
+                let (producer, consumer) = ring(RING_CAPACITY);
+                let is_stopped = Arc::new(AtomicBool::new(false));
+                let thread = std::thread::Builder::new()
+                    .name("aud-smf-player".to_owned())
+                    .spawn({
+                        let messages = self.messages.clone();
+                        let is_running = self.is_running.clone();
+                        let is_stopped = is_stopped.clone();
+                        move || play(&messages, port, producer, &is_running, &is_stopped)
+                    })?;
+
+                Playback::Realtime {
+                    consumer,
+                    is_stopped,
+                    thread: Some(thread),
+                }
+            }
+        });
+
+        Ok(())
+    }
+
+    fn stop(&mut self) {
+        let Some(Playback::Realtime {
+            is_stopped,
+            mut thread,
+            ..
+        }) = self.playback.take()
+        else {
+            return;
+        };
+
+        is_stopped.store(true, Ordering::Relaxed);
+        if thread
+            .take()
+            .map(JoinHandle::join)
+            .is_some_and(|r| r.is_err())
+        {
+            log::error!("[ SMF ] : playback thread panicked");
+        }
+    }
+}
+
+impl Drop for SmfPlayer {
+    fn drop(&mut self) {
+        self.stop();
+    }
+}
+
+impl MidiReceiving for SmfPlayer {
+    fn is_midi_stream_active(&self) -> bool {
+        self.is_running.load(Ordering::Relaxed)
+    }
+
+    fn set_midi_stream_active(&mut self, should_be_active: bool) {
+        self.is_running.store(should_be_active, Ordering::Relaxed)
+    }
+
+    fn list_midi_devices(&self) -> anyhow::Result<Vec<String>> {
+        Ok(vec![self.device_name.clone()])
+    }
+
+    fn connect_to_midi_device(
+        &mut self,
+        device_name: &str,
+        port: MidiPortId,
+    ) -> anyhow::Result<()> {
+        if device_name != self.device_name {
+            anyhow::bail!("[ SMF ] : Cannot find device {device_name}");
+        }
+
+        self.start(port)
+    }
+
+    fn disconnect_from_midi_device(&mut self, device_name: &str) -> anyhow::Result<()> {
+        if device_name == self.device_name {
+            self.stop();
+        }
+        Ok(())
+    }
+
+    fn produce_midi_messages(&mut self) -> Vec<MidiData> {
+        let is_running = self.is_midi_stream_active();
+
+        match self.playback {
+            Some(Playback::Realtime {
+                ref mut consumer, ..
+            }) => {
+                let mut messages = vec![];
+                consumer.drain_into(&mut messages);
+                messages
+            }
+            Some(Playback::AsFastAsPossible {
+                port,
+                ref mut is_finished,
+            }) if is_running && !*is_finished => {
+                *is_finished = true;
+                self.messages
+                    .iter()
+                    .map(|midi| MidiData {
+                        port,
+                        ..midi.clone()
+                    })
+                    .collect()
+            }
+            _ => vec![],
+        }
+    }
+}
+
+/// Push the messages to the ring when they are due. Time
+/// stands still while the stream is paused. The ring is
+/// never overrun, playback waits for the ring to be read.
+fn play(
+    messages: &[MidiData],
+    port: MidiPortId,
+    mut producer: RingProducer<MidiData>,
+    is_running: &AtomicBool,
+    is_stopped: &AtomicBool,
+) {
+    let mut origin = Instant::now();
+
+    for midi in messages {
+        loop {
+            if is_stopped.load(Ordering::Relaxed) {
+                return;
+            }
+
+            if !is_running.load(Ordering::Relaxed) {
+                let paused_at = Instant::now();
+                std::thread::sleep(MAX_SLEEP);
+                origin += paused_at.elapsed();
+                continue;
+            }
+
+            let due = origin + Duration::from_micros(midi.timestamp);
+            let Some(remaining) = due.checked_duration_since(Instant::now()) else {
+                break;
+            };
+
+            if remaining > SPIN_THRESHOLD {
+                std::thread::sleep((remaining - SPIN_THRESHOLD).min(MAX_SLEEP));
+            } else {
+                std::hint::spin_loop();
+            }
+        }
+
+        let mut midi = MidiData {
+            timestamp: clock::now(),
+            port,
+            bytes: midi.bytes.clone(),
+        };
+
+        while let Err(unsent) = producer.push(midi) {
+            if is_stopped.load(Ordering::Relaxed) {
+                return;
+            }
+
+            midi = unsent;
+            std::thread::sleep(MAX_SLEEP);
+        }
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn messages(timestamps: &[u64]) -> Vec<MidiData> {
+        timestamps
+            .iter()
+            .map(|timestamp| MidiData {
+                timestamp: *timestamp,
+                port: 0,
+                bytes: [0xF8].into(),
+            })
+            .collect()
+    }
+
+    #[test]
+    fn produces_every_message_at_once_as_fast_as_possible() {
+        let mut player = SmfPlayer::new(
+            "file".to_owned(),
+            messages(&[0, 1_000_000, 3_600_000_000]),
+            PlaybackSpeed::AsFastAsPossible,
+        );
+
+        assert!(player.produce_midi_messages().is_empty());
+        assert!(player.connect_to_midi_device("other", 0).is_err());
+
+        player.connect_to_midi_device("file", 3).unwrap();
+        let produced = player.produce_midi_messages();
+        assert_eq!(produced.len(), 3);
+        assert!(produced.iter().all(|midi| midi.port == 3));
+        assert!(player.is_finished());
+        assert!(player.produce_midi_messages().is_empty());
+    }
+
+    const TIMESTAMPS: [u64; 5] = [0, 2_000, 5_000, 5_500, 20_000];
+
+    /// Times at which the messages were played, from the connection.
+    fn play_in_realtime() -> Vec<u64> {
+        let mut player = SmfPlayer::new(
+            "file".to_owned(),
+            messages(&TIMESTAMPS),
+            PlaybackSpeed::Realtime,
+        );
+
+        let start = clock::now();
+        player.connect_to_midi_device("file", 0).unwrap();
+
+        let mut produced = vec![];
+        while !player.is_finished() {
+            produced.extend(player.produce_midi_messages());
+            // messages are stamped by the playback thread, leave it the CPU
+            std::thread::sleep(Duration::from_millis(1));
+        }
+
+        produced.iter().map(|midi| midi.timestamp - start).collect()
+    }
+
+    #[test]
+    fn never_produces_messages_before_they_are_due_in_realtime() {
+        let played_at = play_in_realtime();
+        assert_eq!(played_at.len(), TIMESTAMPS.len());
+
+        for (timestamp, played_at) in TIMESTAMPS.iter().zip(played_at) {
+            assert!(
+                played_at >= *timestamp,
+                "{timestamp} played early at {played_at}"
+            );
+        }
+    }
+
+    #[test]
+    #[ignore = "depends on the scheduling of the machine"]
+    fn produces_messages_when_they_are_due_in_realtime() {
+        for (timestamp, played_at) in TIMESTAMPS.iter().zip(play_in_realtime()) {
+            assert!(
+                played_at - timestamp < 1_000,
+                "{timestamp} played late at {played_at}"
+            );
+        }
+    }
+}
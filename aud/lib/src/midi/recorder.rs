@@ -0,0 +1,200 @@
+use super::{ring, MidiData, RingConsumer, RingProducer, SmfWriter};
+use std::{
+    io::{Seek, Write},
+    path::Path,
+    sync::{
+        atomic::{AtomicBool, Ordering},
+        Arc,
+    },
+    thread::JoinHandle,
+    time::{Duration, Instant},
+};
+
+/// Number of messages buffered between the caller and the writer thread.
+const RING_CAPACITY: usize = 16_384;
+/// How often the writer thread wakes up to write the buffered messages.
+const POLL_INTERVAL: Duration = Duration::from_millis(10);
+/// How often the file is made valid, which bounds what a crash can lose.
+const FLUSH_INTERVAL: Duration = Duration::from_secs(1);
+
+/// Records messages to a Standard MIDI File on a background thread.
+///
+/// Messages are handed over through a ring and streamed to the
+/// file as they come, so memory does not grow with the length of
+/// the recording. The recording starts at its first message,
+/// and the port of every message is kept.
+pub struct SmfRecorder {
+    producer: RingProducer<MidiData>,
+    is_running: Arc<AtomicBool>,
+    thread: Option<JoinHandle<anyhow::Result<()>>>,
+    num_recorded: u64,
+}
+
+impl SmfRecorder {
+    pub fn create(path: impl AsRef<Path>) -> anyhow::Result<Self> {
+        Self::start(SmfWriter::create(path)?)
+    }
+
+    pub fn start<W: Write + Seek + Send + 'static>(writer: SmfWriter<W>) -> anyhow::Result<Self> {
+        let (producer, consumer) = ring(RING_CAPACITY);
+        let is_running = Arc::new(AtomicBool::new(true));
+
+        let thread = std::thread::Builder::new()
+            .name("aud-smf-recorder".to_owned())
+            .spawn({
+                let is_running = is_running.clone();
+                move || write_messages(writer, consumer, is_running)
+            })?;
+
+        Ok(Self {
+            producer,
+            is_running,
+            thread: Some(thread),
+            num_recorded: 0,
+        })
+    }
+
+    /// Queue a message to be written, without blocking.
+    pub fn record(&mut self, midi: &MidiData) {
+        if self.producer.push(midi.clone()).is_ok() {
+            self.num_recorded += 1;
+        }
+    }
+
+    pub fn num_recorded(&self) -> u64 {
+        self.num_recorded
+    }
+
+    /// Number of messages that could not be queued
+    /// because the writer thread fell behind.
+    pub fn num_dropped(&self) -> u64 {
+        self.producer.num_dropped()
+    }
+
+    /// Write the queued messages, terminate the file and wait for the writer thread.
+    pub fn stop(mut self) -> anyhow::Result<()> {
+        self.join()
+    }
+
+    fn join(&mut self) -> anyhow::Result<()> {
+        self.is_running.store(false, Ordering::Release);
+
+        match self.thread.take().map(JoinHandle::join) {
+            Some(Ok(result)) => result,
+            Some(Err(_)) => anyhow::bail!("[ SMF ] : recorder thread panicked"),
+            None => Ok(()),
+        }
+    }
+}
+
+impl Drop for SmfRecorder {
+    fn drop(&mut self) {
+        if let Err(e) = self.join() {
+            log::error!("[ SMF ] : failed to finish recording : {e}");
+        }
+    }
+}
+
+fn write_messages<W: Write + Seek>(
+    mut writer: SmfWriter<W>,
+    mut consumer: RingConsumer<MidiData>,
+    is_running: Arc<AtomicBool>,
+) -> anyhow::Result<()> {
+    let mut origin = None;
+    let mut last_flush = Instant::now();
+
+    loop {
+        // read the flag first, messages queued before a stop are still written
+        let is_stopping = !is_running.load(Ordering::Acquire);
+
+        while let Some(mut midi) = consumer.pop() {
+            let origin = *origin.get_or_insert(midi.timestamp);
+            midi.timestamp = midi.timestamp.saturating_sub(origin);
+
+            // a full track is terminated, the messages written so far are kept
+            if let Err(e) = writer.write(&midi) {
+                writer.finish()?;
+                return Err(e);
+            }
+        }
+
+        if is_stopping {
+            break;
+        }
+
+        if last_flush.elapsed() >= FLUSH_INTERVAL {
+            writer.flush()?;
+            last_flush = Instant::now();
+        }
+
+        std::thread::sleep(POLL_INTERVAL);
+    }
+
+    writer.finish()?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::midi::{parse_midi_file, MidiPortId};
+    use std::{
+        io::Cursor,
+        sync::{Mutex, MutexGuard},
+    };
+
+    /// In-memory file which can be inspected while the recorder writes to it.
+    #[derive(Clone, Default)]
+    struct SharedFile(Arc<Mutex<Cursor<Vec<u8>>>>);
+
+    impl SharedFile {
+        fn lock(&self) -> MutexGuard<Cursor<Vec<u8>>> {
+            self.0.lock().unwrap()
+        }
+    }
+
+    impl Write for SharedFile {
+        fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+            self.lock().write(buf)
+        }
+
+        fn flush(&mut self) -> std::io::Result<()> {
+            Ok(())
+        }
+    }
+
+    impl Seek for SharedFile {
+        fn seek(&mut self, pos: std::io::SeekFrom) -> std::io::Result<u64> {
+            self.lock().seek(pos)
+        }
+    }
+
+    #[test]
+    fn records_messages_relative_to_the_first_one() {
+        let file = SharedFile::default();
+        let mut recorder = SmfRecorder::start(SmfWriter::new(file.clone()).unwrap()).unwrap();
+
+        for i in 0..1_000 {
+            recorder.record(&MidiData {
+                timestamp: 5_000 + i * 1_000,
+                port: (i % 2) as MidiPortId,
+                bytes: [0x90, (i % 128) as u8, 100].into(),
+            });
+        }
+
+        assert_eq!(recorder.num_recorded(), 1_000);
+        recorder.stop().unwrap();
+
+        let messages = parse_midi_file(file.lock().get_ref()).unwrap();
+        assert_eq!(messages.len(), 1_000);
+        assert_eq!(messages[0].timestamp, 0);
+        assert_eq!(messages[999].timestamp, 999_000);
+        assert_eq!(messages[999].bytes, [0x90, (999 % 128) as u8, 100]);
+        assert!(messages.iter().step_by(2).all(|midi| midi.port == 0));
+        assert!(messages
+            .iter()
+            .skip(1)
+            .step_by(2)
+            .all(|midi| midi.port == 1));
+    }
+}
@@ -0,0 +1,531 @@
+use super::*;
+use std::{collections::VecDeque, time::Duration};
+
+/// Pacing of the requests sent to a device, so that its buffers do not overflow.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SysExPacing {
+    /// Requests sent to a device before their response is received.
+    pub max_in_flight: usize,
+    /// Bytes sent to a device per second, DIN MIDI runs at 3125.
+    pub max_bytes_per_second: u64,
+    /// Time to wait for a response before sending the request again.
+    pub timeout: Duration,
+    /// Number of times a request is sent again before giving up.
+    pub max_retries: u32,
+}
+
+impl Default for SysExPacing {
+    fn default() -> Self {
+        Self {
+            max_in_flight: 4,
+            max_bytes_per_second: 3125,
+            timeout: Duration::from_secs(1),
+            max_retries: 2,
+        }
+    }
+}
+
+pub struct SysExRequest {
+    pub device: String,
+    pub bytes: MidiBytes,
+    /// Prefix of the response, or `None` if the device does not respond.
+    pub response: Option<Vec<u8>>,
+}
+
+impl SysExRequest {
+    /// A request expecting a response from the same manufacturer,
+    /// or a universal non-realtime message for universal requests.
+    pub fn new(device: impl Into<String>, bytes: impl Into<MidiBytes>) -> Self {
+        let bytes = bytes.into();
+        let response = match bytes.get(1) {
+            Some(0x00) => bytes.get(..4).map(<[u8]>::to_vec),
+            Some(0x7E | 0x7F) => Some(vec![0xF0, 0x7E]),
+            Some(&id) => Some(vec![0xF0, id]),
+            None => Some(vec![0xF0]),
+        };
+
+        Self {
+            device: device.into(),
+            bytes,
+            response,
+        }
+    }
+
+    pub fn with_response(mut self, response: Option<Vec<u8>>) -> Self {
+        self.response = response;
+        self
+    }
+}
+
+pub type SysExRequestId = u64;
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum SysExOutcome {
+    Response {
+        id: SysExRequestId,
+        device: String,
+        bytes: MidiBytes,
+        /// Microseconds from the last time the request was sent.
+        latency: u64,
+    },
+    /// A request that does not expect a response was sent.
+    Sent { id: SysExRequestId, device: String },
+    /// No response was received after every retry.
+    TimedOut { id: SysExRequestId, device: String },
+}
+
+#[derive(Debug, Default, Clone, Copy, PartialEq)]
+pub struct SysExStats {
+    pub bytes_sent: u64,
+    pub bytes_received: u64,
+    pub num_responses: u64,
+    pub num_retries: u64,
+    pub num_timeouts: u64,
+    /// Time the first request was sent and the last response received.
+    first_sent: Option<u64>,
+    last_received: u64,
+}
+
+impl SysExStats {
+    /// Rate of the responses, from the first request sent to the last response.
+    pub fn bytes_per_second(&self) -> f64 {
+        let Some(first_sent) = self.first_sent else {
+            return 0.;
+        };
+
+        let elapsed = self.last_received.saturating_sub(first_sent) as f64 / 1e6;
+        match elapsed > 0. {
+            true => self.bytes_received as f64 / elapsed,
+            false => 0.,
+        }
+    }
+}
+
+struct PendingRequest {
+    id: SysExRequestId,
+    request: SysExRequest,
+    num_sent: u32,
+    sent_at: u64,
+}
+
+#[derive(Default)]
+struct DeviceRequests {
+    device: String,
+    queued: VecDeque<PendingRequest>,
+    /// In the order they were sent, which is the order of the responses.
+    in_flight: VecDeque<PendingRequest>,
+    /// Bytes that can be sent without exceeding the rate, negative
+    /// while the bytes of the last requests are still on the wire.
+    budget: f64,
+    last_refill: u64,
+    /// Sending one request at a time, since a request timed out.
+    is_recovering: bool,
+    /// Time before which nothing is sent, while the late responses arrive.
+    quiet_until: u64,
+    stats: SysExStats,
+}
+
+impl DeviceRequests {
+    fn refill(&mut self, now: u64, bytes_per_second: u64) {
+        let elapsed = now.saturating_sub(self.last_refill) as f64 / 1e6;
+        self.budget = (self.budget + elapsed * bytes_per_second as f64).min(0.);
+        self.last_refill = now;
+    }
+
+    /// Time at which the next queued request can be sent.
+    fn next_send(&self, pacing: &SysExPacing) -> Option<u64> {
+        let max_in_flight = match self.is_recovering {
+            true => 1,
+            false => pacing.max_in_flight,
+        };
+
+        if self.queued.is_empty() || self.in_flight.len() >= max_in_flight {
+            return None;
+        }
+
+        let wait = -self.budget / pacing.max_bytes_per_second.max(1) as f64;
+        let at = self.last_refill + (wait * 1e6).ceil() as u64;
+        Some(at.max(self.quiet_until))
+    }
+
+    fn is_idle(&self) -> bool {
+        self.queued.is_empty() && self.in_flight.is_empty()
+    }
+
+    /// Pipelining resumes once every request sent before a timeout is done.
+    fn end_recovery_if_idle(&mut self) {
+        if self.is_idle() {
+            self.is_recovering = false;
+        }
+    }
+}
+
+/// Sends SysEx requests to several devices and matches their responses.
+///
+/// Several requests are in flight at once for each device, which is
+/// what makes pulling a bank of patches fast, while the rate of the
+/// bytes sent is limited to what the device can take. Responses are
+/// matched to the oldest request in flight with the same prefix, since
+/// devices respond in order. Requests left without a response are sent
+/// again, then reported as timed out.
+///
+/// A late response to a request that was sent again cannot be told
+/// apart from the response to its retry, nor from the responses to the
+/// requests sent after it. So when a request times out, every request
+/// in flight is sent again, one at a time, after waiting for another
+/// timeout if there were others, during which the responses received
+/// match nothing and are discarded. Only the requests that timed out
+/// are charged a retry.
+///
+/// Time is passed in microseconds, on the `clock`.
+pub struct SysExRequests {
+    pacing: SysExPacing,
+    devices: Vec<DeviceRequests>,
+    next_id: SysExRequestId,
+}
+
+impl SysExRequests {
+    pub fn new(pacing: SysExPacing) -> Self {
+        Self {
+            pacing,
+            devices: vec![],
+            next_id: 0,
+        }
+    }
+
+    pub fn pacing(&self) -> &SysExPacing {
+        &self.pacing
+    }
+
+    pub fn push(&mut self, request: SysExRequest) -> SysExRequestId {
+        let id = self.next_id;
+        self.next_id += 1;
+
+        let index = match self.devices.iter().position(|d| d.device == request.device) {
+            Some(index) => index,
+            None => {
+                self.devices.push(DeviceRequests {
+                    device: request.device.clone(),
+                    ..Default::default()
+                });
+                self.devices.len() - 1
+            }
+        };
+
+        self.devices[index].queued.push_back(PendingRequest {
+            id,
+            request,
+            num_sent: 0,
+            sent_at: 0,
+        });
+        id
+    }
+
+    /// Match a message received from a device to the request it answers.
+    pub fn receive(&mut self, device: &str, bytes: MidiBytes, now: u64) -> Option<SysExOutcome> {
+        let requests = self.devices.iter_mut().find(|d| d.device == device)?;
+
+        let index = requests.in_flight.iter().position(|pending| {
+            let response = pending.request.response.as_deref().unwrap_or_default();
+            bytes.starts_with(response)
+        })?;
+
+        let pending = requests.in_flight.remove(index)?;
+        requests.stats.bytes_received += bytes.len() as u64;
+        requests.stats.num_responses += 1;
+        requests.stats.last_received = now;
+        requests.end_recovery_if_idle();
+
+        Some(SysExOutcome::Response {
+            id: pending.id,
+            device: requests.device.clone(),
+            bytes,
+            latency: now.saturating_sub(pending.sent_at),
+        })
+    }
+
+    /// Send the requests that the pacing allows, and retry
+    /// or give up on the ones that are left without a response.
+    pub fn poll(
+        &mut self,
+        now: u64,
+        mut send: impl FnMut(&str, &MidiBytes) -> anyhow::Result<()>,
+        outcomes: &mut Vec<SysExOutcome>,
+    ) -> anyhow::Result<()> {
+        let pacing = self.pacing;
+        let timeout = pacing.timeout.as_micros() as u64;
+
+        for requests in self.devices.iter_mut() {
+            let is_timed_out = |pending: &PendingRequest| pending.sent_at + timeout <= now;
+
+            if requests.in_flight.iter().any(is_timed_out) {
+                if requests.in_flight.len() > 1 {
+                    requests.quiet_until = now + timeout;
+                }
+                requests.is_recovering = true;
+
+                while let Some(mut pending) = requests.in_flight.pop_back() {
+                    if !is_timed_out(&pending) {
+                        // sent again because of another request
+                        pending.num_sent -= 1;
+                    } else if pending.num_sent > pacing.max_retries {
+                        requests.stats.num_timeouts += 1;
+                        outcomes.push(SysExOutcome::TimedOut {
+                            id: pending.id,
+                            device: requests.device.clone(),
+                        });
+                        continue;
+                    } else {
+                        requests.stats.num_retries += 1;
+                    }
+
+                    requests.queued.push_front(pending);
+                }
+
+                requests.end_recovery_if_idle();
+            }
+
+            requests.refill(now, pacing.max_bytes_per_second);
+
+            while requests.next_send(&pacing).is_some_and(|at| at <= now) {
+                let Some(mut pending) = requests.queued.pop_front() else {
+                    break;
+                };
+
+                send(&requests.device, &pending.request.bytes)?;
+
+                let len = pending.request.bytes.len() as u64;
+                requests.budget -= len as f64;
+                requests.stats.bytes_sent += len;
+                requests.stats.first_sent.get_or_insert(now);
+                pending.num_sent += 1;
+                pending.sent_at = now;
+
+                match pending.request.response {
+                    Some(_) => requests.in_flight.push_back(pending),
+                    None => outcomes.push(SysExOutcome::Sent {
+                        id: pending.id,
+                        device: requests.device.clone(),
+                    }),
+                }
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Time at which `poll` has something to do, if anything is pending.
+    pub fn next_deadline(&self) -> Option<u64> {
+        let timeout = self.pacing.timeout.as_micros() as u64;
+
+        self.devices
+            .iter()
+            .flat_map(|requests| {
+                let next_timeout = requests
+                    .in_flight
+                    .iter()
+                    .map(|pending| pending.sent_at + timeout)
+                    .min();
+
+                next_timeout
+                    .into_iter()
+                    .chain(requests.next_send(&self.pacing))
+            })
+            .min()
+    }
+
+    /// Nothing is queued or waiting for a response.
+    pub fn is_idle(&self) -> bool {
+        self.devices.iter().all(DeviceRequests::is_idle)
+    }
+
+    pub fn stats(&self, device: &str) -> Option<&SysExStats> {
+        self.devices
+            .iter()
+            .find(|requests| requests.device == device)
+            .map(|requests| &requests.stats)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    const ID_REQUEST: [u8; 6] = [0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7];
+    const ID_RESPONSE: [u8; 7] = [0xF0, 0x7E, 0x00, 0x06, 0x02, 0x42, 0xF7];
+
+    fn pacing() -> SysExPacing {
+        SysExPacing {
+            max_in_flight: 2,
+            max_bytes_per_second: 1_000_000,
+            timeout: Duration::from_millis(10),
+            max_retries: 1,
+        }
+    }
+
+    fn poll(requests: &mut SysExRequests, now: u64, sent: &mut Vec<u8>) -> Vec<SysExOutcome> {
+        let mut outcomes = vec![];
+        requests
+            .poll(
+                now,
+                |_, bytes| {
+                    sent.push(bytes[1]);
+                    Ok(())
+                },
+                &mut outcomes,
+            )
+            .unwrap();
+        outcomes
+    }
+
+    #[test]
+    fn pipelines_requests_and_matches_responses_in_order() {
+        let mut requests = SysExRequests::new(pacing());
+        let ids: Vec<_> = (0..3)
+            .map(|_| requests.push(SysExRequest::new("synth", ID_REQUEST)))
+            .collect();
+
+        let mut sent = vec![];
+        for now in [0, 10] {
+            assert!(poll(&mut requests, now, &mut sent).is_empty());
+        }
+        assert_eq!(sent.len(), 2);
+
+        let response = requests.receive("synth", ID_RESPONSE.into(), 100);
+        assert!(
+            matches!(response, Some(SysExOutcome::Response { id, latency: 100, .. }) if id == ids[0])
+        );
+        assert!(requests
+            .receive("synth", [0xF0, 0x41, 0xF7].into(), 100)
+            .is_none());
+
+        poll(&mut requests, 100, &mut sent);
+        assert_eq!(sent.len(), 3);
+
+        for now in [200, 300] {
+            requests.receive("synth", ID_RESPONSE.into(), now).unwrap();
+        }
+        assert!(requests.is_idle());
+
+        let stats = requests.stats("synth").unwrap();
+        assert_eq!(stats.bytes_sent, 18);
+        assert_eq!(stats.bytes_received, 21);
+        assert_eq!(stats.bytes_per_second(), 21. / 300e-6);
+    }
+
+    #[test]
+    fn paces_the_bytes_sent_to_a_device() {
+        let mut requests = SysExRequests::new(SysExPacing {
+            max_in_flight: 8,
+            max_bytes_per_second: 6_000,
+            ..pacing()
+        });
+
+        for _ in 0..3 {
+            requests.push(SysExRequest::new("synth", ID_REQUEST).with_response(None));
+        }
+
+        let mut sent = vec![];
+        assert_eq!(poll(&mut requests, 0, &mut sent).len(), 1);
+        assert_eq!(requests.next_deadline(), Some(1_000));
+        assert!(poll(&mut requests, 999, &mut sent).is_empty());
+        assert_eq!(poll(&mut requests, 1_000, &mut sent).len(), 1);
+        assert_eq!(poll(&mut requests, 5_000, &mut sent).len(), 1);
+        assert!(requests.is_idle());
+    }
+
+    #[test]
+    fn retries_then_gives_up_on_requests_without_response() {
+        let mut requests = SysExRequests::new(pacing());
+        let id = requests.push(SysExRequest::new("synth", ID_REQUEST));
+
+        let mut sent = vec![];
+        poll(&mut requests, 0, &mut sent);
+        assert_eq!(requests.next_deadline(), Some(10_000));
+
+        assert!(poll(&mut requests, 10_000, &mut sent).is_empty());
+        assert_eq!(sent.len(), 2);
+
+        let outcomes = poll(&mut requests, 20_000, &mut sent);
+        assert_eq!(
+            outcomes,
+            [SysExOutcome::TimedOut {
+                id,
+                device: "synth".into()
+            }]
+        );
+        assert_eq!(requests.stats("synth").unwrap().num_retries, 1);
+        assert!(requests.is_idle());
+    }
+
+    #[test]
+    fn discards_late_responses_to_requests_sent_again() {
+        let mut requests = SysExRequests::new(pacing());
+        let ids: Vec<_> = (0..2)
+            .map(|_| requests.push(SysExRequest::new("synth", ID_REQUEST)))
+            .collect();
+
+        let mut sent = vec![];
+        for now in [0, 10, 10_000] {
+            assert!(poll(&mut requests, now, &mut sent).is_empty());
+        }
+        assert_eq!(sent.len(), 2);
+        assert_eq!(requests.next_deadline(), Some(20_000));
+
+        // the late response to the first request
+        assert!(requests
+            .receive("synth", ID_RESPONSE.into(), 15_000)
+            .is_none());
+
+        for (now, id) in [(20_000, ids[0]), (20_100, ids[1])] {
+            poll(&mut requests, now, &mut sent);
+            let response = requests.receive("synth", ID_RESPONSE.into(), now + 50);
+            assert!(
+                matches!(response, Some(SysExOutcome::Response { id: i, latency: 50, .. }) if i == id)
+            );
+        }
+
+        assert_eq!(sent.len(), 4);
+        assert_eq!(requests.stats("synth").unwrap().num_retries, 1);
+        assert!(requests.is_idle());
+    }
+
+    #[test]
+    fn only_charges_a_retry_to_the_request_that_timed_out() {
+        let mut requests = SysExRequests::new(pacing());
+        let ids: Vec<_> = (0..2)
+            .map(|_| requests.push(SysExRequest::new("synth", ID_REQUEST)))
+            .collect();
+
+        let mut sent = vec![];
+        for now in [0, 10, 10_000, 20_000] {
+            assert!(poll(&mut requests, now, &mut sent).is_empty());
+        }
+        requests
+            .receive("synth", ID_RESPONSE.into(), 20_050)
+            .unwrap();
+
+        // the second request did not time out, it has a retry left
+        for now in [20_100, 30_100] {
+            assert!(poll(&mut requests, now, &mut sent).is_empty());
+        }
+        let response = requests.receive("synth", ID_RESPONSE.into(), 30_150);
+        assert!(matches!(response, Some(SysExOutcome::Response { id, .. }) if id == ids[1]));
+
+        let stats = requests.stats("synth").unwrap();
+        assert_eq!((stats.num_retries, stats.num_timeouts), (2, 0));
+        assert!(requests.is_idle());
+    }
+
+    #[test]
+    fn matches_responses_by_manufacturer() {
+        let korg = SysExRequest::new("synth", [0xF0, 0x42, 0x30, 0xF7]);
+        assert_eq!(korg.response.as_deref(), Some(&[0xF0, 0x42][..]));
+
+        let extended = SysExRequest::new("synth", [0xF0, 0x00, 0x20, 0x29, 0x01, 0xF7]);
+        assert_eq!(
+            extended.response.as_deref(),
+            Some(&[0xF0, 0x00, 0x20, 0x29][..])
+        );
+    }
+}
@@ -0,0 +1,206 @@
+use std::{
+    cell::UnsafeCell,
+    mem::MaybeUninit,
+    sync::{
+        atomic::{AtomicU64, AtomicUsize, Ordering},
+        Arc,
+    },
+};
+
+/// Keeps the producer and consumer indices on separate cache lines.
+#[repr(align(64))]
+#[derive(Default)]
+struct CachePadded<T>(T);
+
+struct Ring<T> {
+    slots: Box<[UnsafeCell<MaybeUninit<T>>]>,
+    mask: usize,
+    /// Index of the next slot to read, only written by the consumer.
+    head: CachePadded<AtomicUsize>,
+    /// Index of the next slot to write, only written by the producer.
+    tail: CachePadded<AtomicUsize>,
+    num_dropped: AtomicU64,
+}
+
+// SAFETY: a slot is only ever accessed by one side at a time, the producer
+// between `head` and `head + capacity`, the consumer between `head` and `tail`.
+unsafe impl<T: Send> Sync for Ring<T> {}
+
+impl<T> Drop for Ring<T> {
+    fn drop(&mut self) {
+        let head = *self.head.0.get_mut();
+        let tail = *self.tail.0.get_mut();
+
+        for i in head..tail {
+            // SAFETY: the slots between head and tail were written and never read
+            unsafe { self.slots[i & self.mask].get_mut().assume_init_drop() }
+        }
+    }
+}
+
+/// Create a wait-free, single producer, single consumer ring.
+///
+/// The capacity is rounded up to the next power of two. When the ring
+/// is full new values are dropped and counted, the producer never waits.
+pub fn ring<T: Send>(capacity: usize) -> (RingProducer<T>, RingConsumer<T>) {
+    let capacity = capacity.max(1).next_power_of_two();
+    let ring = Arc::new(Ring {
+        slots: (0..capacity)
+            .map(|_| UnsafeCell::new(MaybeUninit::uninit()))
+            .collect(),
+        mask: capacity - 1,
+        head: CachePadded::default(),
+        tail: CachePadded::default(),
+        num_dropped: AtomicU64::default(),
+    });
+
+    (
+        RingProducer {
+            ring: ring.clone(),
+            cached_head: 0,
+        },
+        RingConsumer { ring },
+    )
+}
+
+pub struct RingProducer<T> {
+    ring: Arc<Ring<T>>,
+    /// Last known read index, to only load the shared one when the ring looks full.
+    cached_head: usize,
+}
+
+impl<T> RingProducer<T> {
+    /// Push a value without blocking, or give it back if the ring is full.
+    pub fn push(&mut self, value: T) -> Result<(), T> {
+        let ring = &*self.ring;
+        let tail = ring.tail.0.load(Ordering::Relaxed);
+
+        if tail.wrapping_sub(self.cached_head) == ring.slots.len() {
+            self.cached_head = ring.head.0.load(Ordering::Acquire);
+
+            if tail.wrapping_sub(self.cached_head) == ring.slots.len() {
+                ring.num_dropped.fetch_add(1, Ordering::Relaxed);
+                return Err(value);
+            }
+        }
+
+        // SAFETY: the slot is free, the consumer has moved past it
+        unsafe { (*ring.slots[tail & ring.mask].get()).write(value) };
+        ring.tail.0.store(tail.wrapping_add(1), Ordering::Release);
+        Ok(())
+    }
+
+    /// Number of values dropped because the ring was full.
+    pub fn num_dropped(&self) -> u64 {
+        self.ring.num_dropped.load(Ordering::Relaxed)
+    }
+}
+
+pub struct RingConsumer<T> {
+    ring: Arc<Ring<T>>,
+}
+
+impl<T> RingConsumer<T> {
+    pub fn pop(&mut self) -> Option<T> {
+        let ring = &*self.ring;
+        let head = ring.head.0.load(Ordering::Relaxed);
+
+        if head == ring.tail.0.load(Ordering::Acquire) {
+            return None;
+        }
+
+        // SAFETY: the slot was written by the producer before it published the tail
+        let value = unsafe { (*ring.slots[head & ring.mask].get()).assume_init_read() };
+        ring.head.0.store(head.wrapping_add(1), Ordering::Release);
+        Some(value)
+    }
+
+    /// Move every value currently in the ring to the end of `values`.
+    pub fn drain_into(&mut self, values: &mut Vec<T>) {
+        values.extend(std::iter::from_fn(|| self.pop()));
+    }
+
+    pub fn len(&self) -> usize {
+        let tail = self.ring.tail.0.load(Ordering::Acquire);
+        tail.wrapping_sub(self.ring.head.0.load(Ordering::Relaxed))
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.ring.slots.len()
+    }
+
+    /// Number of values the producer dropped because the ring was full.
+    pub fn num_dropped(&self) -> u64 {
+        self.ring.num_dropped.load(Ordering::Relaxed)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn drops_and_counts_values_pushed_to_a_full_ring() {
+        let (mut producer, mut consumer) = ring(3);
+        assert_eq!(consumer.capacity(), 4);
+
+        (0..6).for_each(|i| {
+            let _ = producer.push(i);
+        });
+        assert_eq!(consumer.len(), 4);
+        assert_eq!(consumer.num_dropped(), 2);
+
+        let mut values = vec![];
+        consumer.drain_into(&mut values);
+        assert_eq!(values, [0, 1, 2, 3]);
+
+        assert!(producer.push(6).is_ok());
+        assert_eq!(consumer.pop(), Some(6));
+        assert_eq!(consumer.pop(), None);
+    }
+
+    #[test]
+    fn transfers_values_across_threads_in_order() {
+        let (mut producer, mut consumer) = ring(64);
+        const NUM_VALUES: u64 = 100_000;
+
+        let thread = std::thread::spawn(move || {
+            for i in 0..NUM_VALUES {
+                let mut value = i;
+                while let Err(v) = producer.push(value) {
+                    value = v;
+                    std::thread::yield_now();
+                }
+            }
+        });
+
+        let mut expected = 0;
+        while expected < NUM_VALUES {
+            match consumer.pop() {
+                Some(value) => {
+                    assert_eq!(value, expected);
+                    expected += 1;
+                }
+                None => std::thread::yield_now(),
+            }
+        }
+
+        thread.join().unwrap();
+    }
+
+    #[test]
+    fn releases_values_left_in_the_ring() {
+        let value = Arc::new(());
+        let (mut producer, consumer) = ring(4);
+        producer.push(value.clone()).unwrap();
+        producer.push(value.clone()).unwrap();
+        assert_eq!(Arc::strong_count(&value), 3);
+
+        drop((producer, consumer));
+        assert_eq!(Arc::strong_count(&value), 1);
+    }
+}
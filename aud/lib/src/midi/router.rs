@@ -0,0 +1,471 @@
+/// Kinds of MIDI messages a route can be restricted to.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum MidiMessageKind {
+    NoteOff,
+    NoteOn,
+    PolyPressure,
+    ControlChange,
+    ProgramChange,
+    ChannelPressure,
+    PitchBend,
+    /// System common, realtime and exclusive messages, which have no channel.
+    System,
+}
+
+impl MidiMessageKind {
+    pub const ALL: [Self; 8] = [
+        Self::NoteOff,
+        Self::NoteOn,
+        Self::PolyPressure,
+        Self::ControlChange,
+        Self::ProgramChange,
+        Self::ChannelPressure,
+        Self::PitchBend,
+        Self::System,
+    ];
+
+    /// Kind of the message starting with `status`, or `None` for a data byte.
+    pub fn of(status: u8) -> Option<Self> {
+        Some(match status & 0xF0 {
+            0x80 => Self::NoteOff,
+            0x90 => Self::NoteOn,
+            0xA0 => Self::PolyPressure,
+            0xB0 => Self::ControlChange,
+            0xC0 => Self::ProgramChange,
+            0xD0 => Self::ChannelPressure,
+            0xE0 => Self::PitchBend,
+            0xF0 => Self::System,
+            _ => return None,
+        })
+    }
+
+    /// Name of the kind, as used by the `aud.midi` Lua module.
+    pub fn name(self) -> &'static str {
+        match self {
+            Self::NoteOff => "note_off",
+            Self::NoteOn => "note_on",
+            Self::PolyPressure => "poly_pressure",
+            Self::ControlChange => "controller",
+            Self::ProgramChange => "program_change",
+            Self::ChannelPressure => "channel_pressure",
+            Self::PitchBend => "pitch_bend",
+            Self::System => "system",
+        }
+    }
+
+    pub fn from_name(name: &str) -> Option<Self> {
+        Self::ALL.into_iter().find(|kind| kind.name() == name)
+    }
+
+    fn mask(self) -> u8 {
+        1 << self as u8
+    }
+}
+
+/// Mapping of the velocity of note-on messages.
+///
+/// A velocity of 0 is a note-off and is never mapped.
+#[derive(Debug, Default, Clone, Copy, PartialEq)]
+pub enum VelocityCurve {
+    #[default]
+    Linear,
+    /// Velocities are normalized and raised to this exponent,
+    /// below 1 makes soft notes louder, above 1 quieter.
+    Power(f32),
+    /// Every note is played at this velocity.
+    Fixed(u8),
+}
+
+impl VelocityCurve {
+    fn table(self) -> [u8; 128] {
+        std::array::from_fn(|velocity| match self {
+            _ if velocity == 0 => 0,
+            Self::Linear => velocity as u8,
+            Self::Power(exponent) => {
+                let mapped = (velocity as f32 / 127.).powf(exponent) * 127.;
+                mapped.round().clamp(1., 127.) as u8
+            }
+            Self::Fixed(velocity) => velocity.clamp(1, 127),
+        })
+    }
+}
+
+/// Routes the messages of an input device to an output device.
+#[derive(Debug, Default, Clone, PartialEq)]
+pub struct MidiRoute {
+    /// Input device, every input when `None`.
+    pub from: Option<String>,
+    /// Output device.
+    pub to: String,
+    /// Channels to route, from 0 to 15, every channel when empty.
+    pub channels: Vec<u8>,
+    /// Kinds of messages to route, every kind when empty.
+    pub kinds: Vec<MidiMessageKind>,
+    /// Channel to send the messages on, instead of their own.
+    pub channel: Option<u8>,
+    /// Semitones added to the notes, notes out of range are not routed.
+    pub transpose: i8,
+    pub velocity: VelocityCurve,
+}
+
+/// A route compiled to masks and lookup tables,
+/// so that routing a message is a handful of branches.
+#[derive(Debug, Clone)]
+struct CompiledRoute {
+    /// Index of the output in `MidiRouter::outputs`.
+    output: usize,
+    channels: u16,
+    kinds: u8,
+    channel: Option<u8>,
+    transpose: i8,
+    velocities: [u8; 128],
+}
+
+/// The routing matrix, from input devices to output devices.
+#[derive(Debug, Clone, Default)]
+pub struct MidiRouter {
+    outputs: Vec<String>,
+    routes: Vec<(Option<String>, CompiledRoute)>,
+}
+
+impl MidiRouter {
+    pub fn new<'a>(routes: impl IntoIterator<Item = &'a MidiRoute>) -> anyhow::Result<Self> {
+        let mut router = Self::default();
+
+        for route in routes {
+            router.add(route)?;
+        }
+
+        Ok(router)
+    }
+
+    fn add(&mut self, route: &MidiRoute) -> anyhow::Result<()> {
+        if route.to.is_empty() {
+            anyhow::bail!("[ MIDI ] : route has no output");
+        }
+
+        if let Some(channel) = route
+            .channels
+            .iter()
+            .chain(&route.channel)
+            .find(|c| **c > 15)
+        {
+            anyhow::bail!(
+                "[ MIDI ] : invalid channel {channel} in route to {}",
+                route.to
+            );
+        }
+
+        match route.velocity {
+            VelocityCurve::Power(exponent) if !(exponent > 0. && exponent.is_finite()) => {
+                anyhow::bail!(
+                    "[ MIDI ] : invalid velocity curve {exponent} in route to {}",
+                    route.to
+                )
+            }
+            VelocityCurve::Fixed(velocity) if velocity > 127 => {
+                anyhow::bail!(
+                    "[ MIDI ] : invalid velocity {velocity} in route to {}",
+                    route.to
+                )
+            }
+            _ => (),
+        }
+
+        let output = match self.outputs.iter().position(|output| *output == route.to) {
+            Some(output) => output,
+            None => {
+                self.outputs.push(route.to.clone());
+                self.outputs.len() - 1
+            }
+        };
+
+        let compiled = CompiledRoute {
+            output,
+            channels: match route.channels.is_empty() {
+                true => u16::MAX,
+                false => route.channels.iter().fold(0, |mask, c| mask | 1 << c),
+            },
+            kinds: match route.kinds.is_empty() {
+                true => u8::MAX,
+                false => route.kinds.iter().fold(0, |mask, kind| mask | kind.mask()),
+            },
+            channel: route.channel,
+            transpose: route.transpose,
+            velocities: route.velocity.table(),
+        };
+
+        self.routes.push((route.from.clone(), compiled));
+        Ok(())
+    }
+
+    /// Output devices, indexed by the routes.
+    pub fn outputs(&self) -> &[String] {
+        self.outputs.as_slice()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.routes.is_empty()
+    }
+
+    /// The routes of the messages received from `device_name`.
+    pub fn routes_from(&self, device_name: &str) -> PortRoutes {
+        PortRoutes {
+            routes: self
+                .routes
+                .iter()
+                .filter(|(from, _)| from.as_deref().is_none_or(|from| from == device_name))
+                .map(|(_, route)| route.clone())
+                .collect(),
+            is_in_sysex: false,
+        }
+    }
+}
+
+/// The routes of a single input device.
+#[derive(Debug, Clone, Default)]
+pub struct PortRoutes {
+    routes: Vec<CompiledRoute>,
+    /// Whether a SysEx message has started and not ended, the
+    /// bytes that continue it are routed like system messages.
+    is_in_sysex: bool,
+}
+
+impl PortRoutes {
+    pub fn is_empty(&self) -> bool {
+        self.routes.is_empty()
+    }
+
+    /// Send a transformed copy of a message for every route it matches,
+    /// along with the index of the output in `MidiRouter::outputs`.
+    ///
+    /// Runs on the MIDI thread of the host, it does not allocate.
+    /// Messages without a status byte are routed to the outputs of
+    /// the SysEx message they continue, for backends that deliver
+    /// long messages in parts. Other messages without a status byte,
+    /// i.e. using running status, are not routed.
+    pub fn route(&mut self, bytes: &[u8], mut send: impl FnMut(usize, &[u8])) {
+        let Some(&status) = bytes.first() else {
+            return;
+        };
+
+        let kind = match MidiMessageKind::of(status) {
+            Some(kind) => kind,
+            None if self.is_in_sysex => MidiMessageKind::System,
+            None => return,
+        };
+
+        // real-time messages can be sent in the middle of a SysEx message
+        if status < 0xF8 {
+            let is_sysex = status == 0xF0 || status < 0x80;
+            self.is_in_sysex = is_sysex && bytes.last() != Some(&0xF7);
+        }
+
+        for route in self.routes.iter().filter(|r| r.kinds & kind.mask() != 0) {
+            if kind == MidiMessageKind::System {
+                send(route.output, bytes);
+                continue;
+            }
+
+            if let Some(message) = route.transform(kind, bytes) {
+                send(route.output, message.as_slice());
+            }
+        }
+    }
+}
+
+impl CompiledRoute {
+    fn transform(&self, kind: MidiMessageKind, bytes: &[u8]) -> Option<ChannelMessage> {
+        let status = bytes[0];
+        let channel = status & 0x0F;
+
+        if self.channels & 1 << channel == 0 {
+            return None;
+        }
+
+        let mut message = ChannelMessage::new(bytes);
+        message.bytes[0] = status & 0xF0 | self.channel.unwrap_or(channel);
+
+        let has_note = matches!(
+            kind,
+            MidiMessageKind::NoteOn | MidiMessageKind::NoteOff | MidiMessageKind::PolyPressure
+        );
+
+        if has_note && message.len >= 2 {
+            message.bytes[1] = message.bytes[1]
+                .checked_add_signed(self.transpose)
+                .filter(|note| *note < 128)?;
+        }
+
+        if kind == MidiMessageKind::NoteOn && message.len == 3 {
+            message.bytes[2] = self.velocities[(message.bytes[2] & 0x7F) as usize];
+        }
+
+        Some(message)
+    }
+}
+
+struct ChannelMessage {
+    bytes: [u8; 3],
+    len: usize,
+}
+
+impl ChannelMessage {
+    fn new(bytes: &[u8]) -> Self {
+        let len = bytes.len().min(3);
+        let mut message = Self { bytes: [0; 3], len };
+        message.bytes[..len].copy_from_slice(&bytes[..len]);
+        message
+    }
+
+    fn as_slice(&self) -> &[u8] {
+        &self.bytes[..self.len]
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn route_all(routes: &mut PortRoutes, bytes: &[u8]) -> Vec<(usize, Vec<u8>)> {
+        let mut sent = vec![];
+        routes.route(bytes, |output, bytes| sent.push((output, bytes.to_vec())));
+        sent
+    }
+
+    #[test]
+    fn routes_messages_by_input_channel_and_kind() {
+        let router = MidiRouter::new(&[
+            MidiRoute {
+                from: Some("keys".into()),
+                to: "synth".into(),
+                channels: vec![0],
+                kinds: vec![MidiMessageKind::NoteOn, MidiMessageKind::NoteOff],
+                ..Default::default()
+            },
+            MidiRoute {
+                to: "drums".into(),
+                channels: vec![9],
+                ..Default::default()
+            },
+        ])
+        .unwrap();
+
+        assert_eq!(router.outputs(), ["synth", "drums"]);
+
+        let mut keys = router.routes_from("keys");
+        assert_eq!(
+            route_all(&mut keys, &[0x90, 60, 100]),
+            [(0, vec![0x90, 60, 100])]
+        );
+        assert_eq!(
+            route_all(&mut keys, &[0x99, 36, 100]),
+            [(1, vec![0x99, 36, 100])]
+        );
+        assert!(route_all(&mut keys, &[0xB0, 1, 64]).is_empty());
+        assert!(route_all(&mut keys, &[0x91, 60, 100]).is_empty());
+
+        let mut pads = router.routes_from("pads");
+        assert!(route_all(&mut pads, &[0x90, 60, 100]).is_empty());
+        assert_eq!(route_all(&mut pads, &[0x99, 36, 100]).len(), 1);
+
+        let clock = route_all(&mut pads, &[0xF8]);
+        assert_eq!(clock, [(1, vec![0xF8])]);
+    }
+
+    #[test]
+    fn transforms_channel_notes_and_velocities() {
+        let router = MidiRouter::new(&[MidiRoute {
+            to: "synth".into(),
+            channel: Some(3),
+            transpose: 12,
+            velocity: VelocityCurve::Fixed(64),
+            ..Default::default()
+        }])
+        .unwrap();
+        let mut routes = router.routes_from("keys");
+
+        assert_eq!(
+            route_all(&mut routes, &[0x90, 60, 100])[0].1,
+            [0x93, 72, 64]
+        );
+        assert_eq!(route_all(&mut routes, &[0x90, 60, 0])[0].1, [0x93, 72, 0]);
+        assert_eq!(
+            route_all(&mut routes, &[0x80, 60, 100])[0].1,
+            [0x83, 72, 100]
+        );
+        assert_eq!(route_all(&mut routes, &[0xC5, 7])[0].1, [0xC3, 7]);
+        assert!(route_all(&mut routes, &[0x90, 120, 100]).is_empty());
+    }
+
+    #[test]
+    fn routes_sysex_continuations_like_their_start() {
+        let router = MidiRouter::new(&[
+            MidiRoute {
+                to: "synth".into(),
+                kinds: vec![MidiMessageKind::System],
+                ..Default::default()
+            },
+            MidiRoute {
+                to: "drums".into(),
+                kinds: vec![MidiMessageKind::NoteOn],
+                ..Default::default()
+            },
+        ])
+        .unwrap();
+        let mut routes = router.routes_from("keys");
+
+        assert_eq!(route_all(&mut routes, &[0xF0, 0x7E, 0x01]).len(), 1);
+        assert_eq!(
+            route_all(&mut routes, &[0x02, 0x03]),
+            [(0, vec![0x02, 0x03])]
+        );
+        assert_eq!(route_all(&mut routes, &[0xF8]), [(0, vec![0xF8])]);
+        assert_eq!(
+            route_all(&mut routes, &[0x04, 0xF7]),
+            [(0, vec![0x04, 0xF7])]
+        );
+
+        // running status, after the end of the dump
+        assert!(route_all(&mut routes, &[0x05, 0x06]).is_empty());
+
+        // a dump interrupted by another message
+        route_all(&mut routes, &[0xF0, 0x7E]);
+        assert_eq!(route_all(&mut routes, &[0x90, 60, 100]).len(), 1);
+        assert!(route_all(&mut routes, &[0x01, 0xF7]).is_empty());
+    }
+
+    #[test]
+    fn velocity_curves_keep_the_range() {
+        let soft = VelocityCurve::Power(0.5).table();
+        let hard = VelocityCurve::Power(2.).table();
+
+        assert_eq!((soft[0], soft[1], soft[127]), (0, 11, 127));
+        assert_eq!((hard[0], hard[1], hard[127]), (0, 1, 127));
+        assert!(soft[64] > 64 && hard[64] < 64);
+        assert!(VelocityCurve::Linear
+            .table()
+            .iter()
+            .enumerate()
+            .all(|(i, v)| i == *v as usize));
+    }
+
+    #[test]
+    fn rejects_invalid_routes() {
+        let route = |route: MidiRoute| MidiRouter::new(&[route]);
+
+        assert!(route(MidiRoute::default()).is_err());
+        assert!(route(MidiRoute {
+            to: "synth".into(),
+            channels: vec![16],
+            ..Default::default()
+        })
+        .is_err());
+        assert!(route(MidiRoute {
+            to: "synth".into(),
+            velocity: VelocityCurve::Power(0.),
+            ..Default::default()
+        })
+        .is_err());
+    }
+}
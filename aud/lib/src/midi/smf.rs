@@ -0,0 +1,618 @@
+use super::{MidiData, MidiPortId};
+use std::{
+    fs::File,
+    io::{BufWriter, Seek, SeekFrom, Write},
+    path::Path,
+};
+
+/// Read a Standard MIDI File and flatten all of its tracks
+/// into a single time-ordered list of messages.
+///
+/// Timestamps are in microseconds from the start of the file,
+/// and take into account the tempo map of the file. Ports are
+/// taken from the MIDI port meta events, and are 0 by default.
+pub fn read_midi_file(path: impl AsRef<Path>) -> anyhow::Result<Vec<MidiData>> {
+    parse_midi_file(&std::fs::read(path.as_ref())?)
+}
+
+/// Parse the content of a Standard MIDI File, see `read_midi_file`.
+pub fn parse_midi_file(bytes: &[u8]) -> anyhow::Result<Vec<MidiData>> {
+    let mut reader = ByteReader::new(bytes);
+
+    if reader.take(4)? != b"MThd" {
+        anyhow::bail!("[ SMF ] : missing file header");
+    }
+
+    let header = ByteReader::new(reader.chunk()?).header()?;
+    let mut events = vec![];
+
+    while !reader.is_empty() {
+        let chunk_type = reader.take(4)?;
+        let chunk = reader.chunk()?;
+
+        if chunk_type == b"MTrk" {
+            ByteReader::new(chunk).track(&mut events)?;
+        }
+    }
+
+    // a stable sort keeps the file order of simultaneous events
+    events.sort_by_key(|event| event.tick);
+
+    let mut tempo = DEFAULT_TEMPO;
+    let mut last_tick = 0;
+    let mut micros = 0;
+    let mut messages = Vec::with_capacity(events.len());
+
+    for event in events {
+        micros += header.ticks_to_micros(event.tick - last_tick, tempo);
+        last_tick = event.tick;
+
+        match event.kind {
+            TrackEventKind::Tempo(new_tempo) => tempo = new_tempo,
+            TrackEventKind::Message(port, bytes) => messages.push(MidiData {
+                timestamp: micros,
+                port,
+                bytes: bytes.into(),
+            }),
+        }
+    }
+
+    Ok(messages)
+}
+
+/// Microseconds per quarter note, i.e. 120 BPM.
+const DEFAULT_TEMPO: u64 = 500_000;
+
+/// Resolution of the files written by `SmfWriter`,
+/// which is 20 microseconds per tick at 120 BPM.
+const TICKS_PER_QUARTER_NOTE: u16 = 25_000;
+const MICROS_PER_TICK: u64 = DEFAULT_TEMPO / TICKS_PER_QUARTER_NOTE as u64;
+
+const END_OF_TRACK: [u8; 4] = [0x00, 0xFF, 0x2F, 0x00];
+/// Empty text event, used to fill gaps too long for a single delta time.
+const EMPTY_TEXT: [u8; 3] = [0xFF, 0x01, 0x00];
+const MAX_VLQ: u64 = 0x0FFF_FFFF;
+const VLQ_MAX_LEN: u64 = 4;
+/// MIDI port meta event, its data is the port of the next messages of the track.
+const MIDI_PORT: [u8; 2] = [0xFF, 0x21];
+/// Longest MIDI port meta event, with its delta time.
+const MIDI_PORT_MAX_LEN: u64 = 1 + MIDI_PORT.len() as u64 + 1 + 2;
+
+/// Streams messages to a single-track Standard MIDI File.
+///
+/// Messages are written as they come, nothing is kept in memory. The
+/// end of the track and the length of the track are only written on
+/// `flush`, after which the file is valid until the next message.
+///
+/// The port of the messages is written as a MIDI port meta event
+/// every time it changes. Ports above 255, which do not fit the
+/// single byte of the standard event, are written on two bytes.
+pub struct SmfWriter<W: Write + Seek> {
+    writer: W,
+    /// Offset of the length of the track chunk.
+    track_len_offset: u64,
+    track_len: u64,
+    last_tick: u64,
+    port: Option<MidiPortId>,
+    is_flushed: bool,
+}
+
+impl SmfWriter<BufWriter<File>> {
+    pub fn create(path: impl AsRef<Path>) -> anyhow::Result<Self> {
+        Self::new(BufWriter::new(File::create(path.as_ref())?))
+    }
+}
+
+impl<W: Write + Seek> SmfWriter<W> {
+    pub fn new(mut writer: W) -> anyhow::Result<Self> {
+        writer.write_all(b"MThd")?;
+        writer.write_all(&6u32.to_be_bytes())?;
+        writer.write_all(&0u16.to_be_bytes())?;
+        writer.write_all(&1u16.to_be_bytes())?;
+        writer.write_all(&TICKS_PER_QUARTER_NOTE.to_be_bytes())?;
+        writer.write_all(b"MTrk")?;
+        let track_len_offset = writer.stream_position()?;
+        writer.write_all(&0u32.to_be_bytes())?;
+
+        let mut smf = Self {
+            writer,
+            track_len_offset,
+            track_len: 0,
+            last_tick: 0,
+            port: None,
+            is_flushed: false,
+        };
+
+        let tempo = (DEFAULT_TEMPO as u32).to_be_bytes();
+        smf.write_event(0, &[0xFF, 0x51, 0x03, tempo[1], tempo[2], tempo[3]])?;
+        smf.flush()?;
+        Ok(smf)
+    }
+
+    /// Write a message, its timestamp is in microseconds from the start
+    /// of the file and it must not be earlier than the previous one.
+    ///
+    /// System real-time and common messages are escaped, and so
+    /// are messages without a status byte, which continue a SysEx
+    /// dump written in chunks. Empty messages are ignored.
+    ///
+    /// Fails without writing anything once the track is too long for
+    /// the length of its chunk, about 4 GiB, the file can be finished.
+    pub fn write(&mut self, midi: &MidiData) -> anyhow::Result<()> {
+        let tick = (midi.timestamp / MICROS_PER_TICK).max(self.last_tick);
+        let mut delta = tick - self.last_tick;
+        let bytes = midi.bytes.as_slice();
+
+        if bytes.is_empty() {
+            return Ok(());
+        }
+
+        // gaps, port, delta time, status and length of the data, and the data
+        let max_len = (delta / MAX_VLQ) * (VLQ_MAX_LEN + EMPTY_TEXT.len() as u64)
+            + MIDI_PORT_MAX_LEN
+            + VLQ_MAX_LEN
+            + 1
+            + VLQ_MAX_LEN
+            + bytes.len() as u64;
+
+        if self.track_len + max_len + END_OF_TRACK.len() as u64 > u32::MAX as u64 {
+            anyhow::bail!("[ SMF ] : the track is full");
+        }
+
+        while delta > MAX_VLQ {
+            self.write_event(MAX_VLQ, &EMPTY_TEXT)?;
+            delta -= MAX_VLQ;
+        }
+
+        if self.port != Some(midi.port) {
+            match u8::try_from(midi.port) {
+                Ok(port) => self.write_event(delta, &[MIDI_PORT[0], MIDI_PORT[1], 1, port])?,
+                Err(_) => {
+                    let [high, low] = midi.port.to_be_bytes();
+                    self.write_event(delta, &[MIDI_PORT[0], MIDI_PORT[1], 2, high, low])?
+                }
+            }
+
+            self.port = Some(midi.port);
+            delta = 0;
+        }
+
+        match bytes.first() {
+            Some(0x80..=0xEF) => self.write_event(delta, bytes)?,
+            Some(0xF0) => {
+                self.write_event(delta, &[0xF0])?;
+                self.write_data(&bytes[1..])?;
+            }
+            _ => {
+                self.write_event(delta, &[0xF7])?;
+                self.write_data(bytes)?;
+            }
+        }
+
+        self.last_tick = tick;
+        Ok(())
+    }
+
+    /// Terminate the track and update its length, the file is
+    /// then valid. The next message overwrites the end of track.
+    pub fn flush(&mut self) -> anyhow::Result<()> {
+        if self.is_flushed {
+            return Ok(());
+        }
+
+        let end = self.writer.stream_position()?;
+        self.writer.write_all(&END_OF_TRACK)?;
+
+        let track_len = u32::try_from(self.track_len + END_OF_TRACK.len() as u64)?;
+        self.writer.seek(SeekFrom::Start(self.track_len_offset))?;
+        self.writer.write_all(&track_len.to_be_bytes())?;
+        self.writer.seek(SeekFrom::Start(end))?;
+        self.writer.flush()?;
+
+        self.is_flushed = true;
+        Ok(())
+    }
+
+    pub fn finish(mut self) -> anyhow::Result<W> {
+        self.flush()?;
+        Ok(self.writer)
+    }
+
+    fn write_event(&mut self, delta: u64, bytes: &[u8]) -> anyhow::Result<()> {
+        self.write_vlq(delta)?;
+        self.write_bytes(bytes)
+    }
+
+    fn write_data(&mut self, bytes: &[u8]) -> anyhow::Result<()> {
+        self.write_vlq(bytes.len() as u64)?;
+        self.write_bytes(bytes)
+    }
+
+    fn write_vlq(&mut self, value: u64) -> anyhow::Result<()> {
+        if value > MAX_VLQ {
+            anyhow::bail!("[ SMF ] : {value} does not fit in a variable-length quantity");
+        }
+
+        let mut bytes = [0u8; 4];
+        let mut len = 0;
+        let mut value = value;
+
+        loop {
+            bytes[3 - len] = (value & 0x7F) as u8 | if len == 0 { 0 } else { 0x80 };
+            len += 1;
+            value >>= 7;
+
+            if value == 0 {
+                break;
+            }
+        }
+
+        self.write_bytes(&bytes[4 - len..])
+    }
+
+    fn write_bytes(&mut self, bytes: &[u8]) -> anyhow::Result<()> {
+        self.writer.write_all(bytes)?;
+        self.track_len += bytes.len() as u64;
+        self.is_flushed = false;
+        Ok(())
+    }
+}
+
+enum Division {
+    Metrical { ticks_per_quarter_note: u64 },
+    Timecode { ticks_per_second: f64 },
+}
+
+struct Header {
+    division: Division,
+}
+
+impl Header {
+    fn ticks_to_micros(&self, ticks: u64, tempo: u64) -> u64 {
+        match self.division {
+            Division::Metrical {
+                ticks_per_quarter_note,
+            } => ticks * tempo / ticks_per_quarter_note,
+            Division::Timecode { ticks_per_second } => {
+                (ticks as f64 * 1e6 / ticks_per_second) as u64
+            }
+        }
+    }
+}
+
+enum TrackEventKind {
+    Tempo(u64),
+    Message(MidiPortId, Vec<u8>),
+}
+
+struct TrackEvent {
+    tick: u64,
+    kind: TrackEventKind,
+}
+
+struct ByteReader<'a> {
+    bytes: &'a [u8],
+}
+
+impl<'a> ByteReader<'a> {
+    fn new(bytes: &'a [u8]) -> Self {
+        Self { bytes }
+    }
+
+    fn is_empty(&self) -> bool {
+        self.bytes.is_empty()
+    }
+
+    fn take(&mut self, len: usize) -> anyhow::Result<&'a [u8]> {
+        if len > self.bytes.len() {
+            anyhow::bail!("[ SMF ] : unexpected end of file");
+        }
+
+        let (head, tail) = self.bytes.split_at(len);
+        self.bytes = tail;
+        Ok(head)
+    }
+
+    fn u8(&mut self) -> anyhow::Result<u8> {
+        Ok(self.take(1)?[0])
+    }
+
+    fn u16(&mut self) -> anyhow::Result<u16> {
+        let bytes = self.take(2)?;
+        Ok(u16::from_be_bytes([bytes[0], bytes[1]]))
+    }
+
+    fn u32(&mut self) -> anyhow::Result<u32> {
+        let bytes = self.take(4)?;
+        Ok(u32::from_be_bytes([bytes[0], bytes[1], bytes[2], bytes[3]]))
+    }
+
+    fn peek(&self) -> anyhow::Result<u8> {
+        self.bytes
+            .first()
+            .copied()
+            .ok_or_else(|| anyhow::anyhow!("[ SMF ] : unexpected end of track"))
+    }
+
+    /// Variable-length quantity, at most 4 bytes long.
+    fn vlq(&mut self) -> anyhow::Result<u64> {
+        let mut value = 0;
+
+        for _ in 0..4 {
+            let byte = self.u8()?;
+            value = (value << 7) | (byte & 0x7F) as u64;
+
+            if byte & 0x80 == 0 {
+                return Ok(value);
+            }
+        }
+
+        anyhow::bail!("[ SMF ] : invalid variable-length quantity")
+    }
+
+    fn chunk(&mut self) -> anyhow::Result<&'a [u8]> {
+        let len = self.u32()?;
+        self.take(len as usize)
+    }
+
+    fn vlq_data(&mut self) -> anyhow::Result<&'a [u8]> {
+        let len = self.vlq()?;
+        self.take(len as usize)
+    }
+
+    fn header(&mut self) -> anyhow::Result<Header> {
+        let _format = self.u16()?;
+        let _num_tracks = self.u16()?;
+        let division = self.u16()?;
+
+        let division = if division & 0x8000 == 0 {
+            if division == 0 {
+                anyhow::bail!("[ SMF ] : invalid time division");
+            }
+
+            Division::Metrical {
+                ticks_per_quarter_note: division as u64,
+            }
+        } else {
+            let fps = match ((division >> 8) as i8).wrapping_neg() {
+                29 => 29.97,
+                fps => fps as f64,
+            };
+
+            Division::Timecode {
+                ticks_per_second: fps * (division & 0xFF).max(1) as f64,
+            }
+        };
+
+        Ok(Header { division })
+    }
+
+    fn track(&mut self, events: &mut Vec<TrackEvent>) -> anyhow::Result<()> {
+        let mut tick = 0;
+        let mut running_status = None;
+        let mut port = 0;
+
+        while !self.is_empty() {
+            tick += self.vlq()?;
+
+            let status = match self.peek()? {
+                byte if byte & 0x80 != 0 => self.u8()?,
+                _ => running_status
+                    .ok_or_else(|| anyhow::anyhow!("[ SMF ] : data byte without status"))?,
+            };
+
+            let kind = match status {
+                0xFF => {
+                    let meta_type = self.u8()?;
+                    let data = self.vlq_data()?;
+
+                    match (meta_type, data) {
+                        (0x2F, _) => break,
+                        (0x51, &[a, b, c]) => {
+                            TrackEventKind::Tempo(u32::from_be_bytes([0, a, b, c]) as u64)
+                        }
+                        (0x21, &[new_port]) => {
+                            port = new_port as MidiPortId;
+                            continue;
+                        }
+                        (0x21, &[high, low]) => {
+                            port = MidiPortId::from_be_bytes([high, low]);
+                            continue;
+                        }
+                        _ => continue,
+                    }
+                }
+                0xF0 => {
+                    let data = self.vlq_data()?;
+                    TrackEventKind::Message(port, [&[0xF0], data].concat())
+                }
+                0xF7 => TrackEventKind::Message(port, self.vlq_data()?.to_vec()),
+                0x80..=0xEF => {
+                    running_status = Some(status);
+                    let num_data_bytes = match status & 0xF0 {
+                        0xC0 | 0xD0 => 1,
+                        _ => 2,
+                    };
+                    let data = self.take(num_data_bytes)?;
+                    TrackEventKind::Message(port, [&[status], data].concat())
+                }
+                _ => anyhow::bail!("[ SMF ] : unexpected status byte {status:#04X}"),
+            };
+
+            events.push(TrackEvent { tick, kind });
+        }
+
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn smf(division: u16, tracks: &[&[u8]]) -> Vec<u8> {
+        let mut bytes = b"MThd".to_vec();
+        bytes.extend(6u32.to_be_bytes());
+        bytes.extend(1u16.to_be_bytes());
+        bytes.extend((tracks.len() as u16).to_be_bytes());
+        bytes.extend(division.to_be_bytes());
+
+        for track in tracks {
+            bytes.extend(b"MTrk");
+            bytes.extend((track.len() as u32).to_be_bytes());
+            bytes.extend(*track);
+        }
+
+        bytes
+    }
+
+    #[test]
+    fn can_parse_messages_with_running_status() {
+        let track: &[u8] = &[
+            0x00, 0x90, 60, 100, // note on
+            0x60, 62, 100, // running status note on, 96 ticks later
+            0x00, 0xFF, 0x2F, 0x00, // end of track
+        ];
+
+        let messages = parse_midi_file(&smf(96, &[track])).unwrap();
+
+        assert_eq!(messages.len(), 2);
+        assert_eq!(messages[0].timestamp, 0);
+        assert_eq!(messages[0].bytes, [0x90, 60, 100]);
+        assert_eq!(messages[1].timestamp, DEFAULT_TEMPO);
+        assert_eq!(messages[1].bytes, [0x90, 62, 100]);
+    }
+
+    #[test]
+    fn applies_the_tempo_map_across_tracks() {
+        let tempo_track: &[u8] = &[
+            0x60, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40, // 1s per beat after 1 beat
+            0x00, 0xFF, 0x2F, 0x00,
+        ];
+
+        let note_track: &[u8] = &[
+            0x81, 0x40, 0xC0, 0x05, // program change after 192 ticks
+            0x00, 0xF0, 0x03, 0x7E, 0x01, 0xF7, // sysex
+            0x00, 0xFF, 0x2F, 0x00,
+        ];
+
+        let messages = parse_midi_file(&smf(96, &[tempo_track, note_track])).unwrap();
+
+        assert_eq!(messages.len(), 2);
+        assert_eq!(messages[0].timestamp, DEFAULT_TEMPO + 1_000_000);
+        assert_eq!(messages[0].bytes, [0xC0, 0x05]);
+        assert_eq!(messages[1].timestamp, DEFAULT_TEMPO + 1_000_000);
+        assert_eq!(messages[1].bytes, [0xF0, 0x7E, 0x01, 0xF7]);
+    }
+
+    fn write(messages: &[MidiData]) -> anyhow::Result<Vec<u8>> {
+        let mut smf = SmfWriter::new(std::io::Cursor::new(vec![]))?;
+        for midi in messages {
+            smf.write(midi)?;
+        }
+        Ok(smf.finish()?.into_inner())
+    }
+
+    fn midi(timestamp: u64, bytes: &[u8]) -> MidiData {
+        MidiData {
+            timestamp,
+            port: 0,
+            bytes: bytes.into(),
+        }
+    }
+
+    fn midi_from(port: MidiPortId, timestamp: u64, bytes: &[u8]) -> MidiData {
+        MidiData {
+            port,
+            ..midi(timestamp, bytes)
+        }
+    }
+
+    #[test]
+    fn written_files_can_be_read_back() {
+        let messages = [
+            midi(0, &[0x90, 60, 100]),
+            midi(40, &[0xF8]),
+            midi(1_000_000, &[0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7]),
+            // ten hours later
+            midi(36_000_000_000, &[0x80, 60, 0]),
+        ];
+
+        assert_eq!(
+            parse_midi_file(&write(&messages).unwrap()).unwrap(),
+            messages
+        );
+    }
+
+    #[test]
+    fn keeps_the_port_of_every_message() {
+        let messages = [
+            midi_from(1, 0, &[0x90, 60, 100]),
+            midi_from(1, 20, &[0x80, 60, 0]),
+            midi_from(0, 20, &[0xF8]),
+            midi_from(300, 40, &[0xF0, 0x7E, 0xF7]),
+            midi_from(1, 60, &[0xC0, 0x05]),
+        ];
+
+        assert_eq!(
+            parse_midi_file(&write(&messages).unwrap()).unwrap(),
+            messages
+        );
+    }
+
+    #[test]
+    fn stops_writing_when_the_track_is_full() {
+        let mut smf = SmfWriter::new(std::io::Cursor::new(vec![])).unwrap();
+        smf.write(&midi(0, &[0x90, 60, 100])).unwrap();
+
+        // pretend the track is almost 4 GiB long
+        let track_len = std::mem::replace(&mut smf.track_len, u32::MAX as u64 - 16);
+        assert!(smf.write(&midi(20, &[0x80, 60, 0])).is_err());
+        smf.track_len = track_len;
+
+        let bytes = smf.finish().unwrap().into_inner();
+        assert_eq!(
+            parse_midi_file(&bytes).unwrap(),
+            [midi(0, &[0x90, 60, 100])]
+        );
+    }
+
+    #[test]
+    fn writes_dumps_chunk_by_chunk() {
+        let chunks = [
+            midi(0, &[0xF0, 0x01, 0x02]),
+            midi(0, &[0x03, 0x04]),
+            midi(0, &[0x05, 0xF7]),
+        ];
+
+        assert_eq!(parse_midi_file(&write(&chunks).unwrap()).unwrap(), chunks);
+    }
+
+    #[test]
+    fn files_are_valid_after_every_flush() {
+        let mut smf = SmfWriter::new(std::io::Cursor::new(vec![])).unwrap();
+        smf.write(&midi(0, &[0x90, 60, 100])).unwrap();
+        smf.flush().unwrap();
+
+        let bytes = smf.writer.get_ref().clone();
+        assert!(bytes.ends_with(&END_OF_TRACK));
+        assert_eq!(parse_midi_file(&bytes).unwrap().len(), 1);
+
+        smf.write(&midi(20, &[0x80, 60, 0])).unwrap();
+        smf.flush().unwrap();
+
+        let messages = parse_midi_file(smf.writer.get_ref()).unwrap();
+        assert_eq!(
+            messages,
+            [midi(0, &[0x90, 60, 100]), midi(20, &[0x80, 60, 0])]
+        );
+    }
+
+    #[test]
+    fn rejects_truncated_files() {
+        let track: &[u8] = &[0x00, 0x90, 60];
+        assert!(parse_midi_file(&smf(96, &[track])).is_err());
+        assert!(parse_midi_file(b"MThd").is_err());
+        assert!(parse_midi_file(b"RIFF").is_err());
+    }
+}
@@ -0,0 +1,350 @@
+use super::*;
+use std::sync::{
+    atomic::{AtomicU64, AtomicU8, Ordering},
+    Arc, Mutex,
+};
+
+/// Number of buckets of the inter-arrival histograms. Bucket `i` counts
+/// the intervals from `2^(i-1)` up to `2^i` microseconds, bucket 0 the
+/// intervals of 0, and the last one every interval from `2^22` microseconds,
+/// about 4 seconds, and above.
+pub const MIDI_INTERVAL_BUCKETS: usize = 24;
+
+const NUM_KINDS: usize = MidiMessageKind::ALL.len();
+const NUM_CHANNELS: usize = 16;
+
+fn counters<const N: usize>() -> [AtomicU64; N] {
+    std::array::from_fn(|_| AtomicU64::default())
+}
+
+fn interval_bucket(interval: u64) -> usize {
+    ((u64::BITS - interval.leading_zeros()) as usize).min(MIDI_INTERVAL_BUCKETS - 1)
+}
+
+/// Counters of the messages received from a port.
+///
+/// There is a single writer, the thread receiving the messages, which
+/// updates a few counters per message without allocating. Any number
+/// of readers take `MidiStatsSnapshot`s, which are not synchronized
+/// with each other: a snapshot can miss the latest message.
+pub struct MidiPortStats {
+    pub port: MidiPortId,
+    pub device_name: String,
+    num_messages: AtomicU64,
+    /// Indexed by kind then channel, system messages are on channel 0.
+    counts: [[AtomicU64; NUM_CHANNELS]; NUM_KINDS],
+    /// Indexed by kind then bucket, between messages of the same kind.
+    intervals: [[AtomicU64; MIDI_INTERVAL_BUCKETS]; NUM_KINDS],
+    /// Indexed by controller number, on every channel.
+    control_changes: [AtomicU64; 128],
+    sysex_bytes: AtomicU64,
+    /// Messages received without their status byte.
+    running_status: AtomicU64,
+    /// Messages with the status of the previous channel message, which
+    /// a sender can leave out with running status, whether it did or not.
+    repeated_status: AtomicU64,
+    /// Time of the previous message of each kind, plus one, 0 if none.
+    previous_times: [AtomicU64; NUM_KINDS],
+    /// Status that data bytes without a status byte continue.
+    previous_status: AtomicU8,
+}
+
+impl MidiPortStats {
+    pub fn new(port: MidiPortId, device_name: String) -> Self {
+        Self {
+            port,
+            device_name,
+            num_messages: AtomicU64::default(),
+            counts: std::array::from_fn(|_| counters()),
+            intervals: std::array::from_fn(|_| counters()),
+            control_changes: counters(),
+            sysex_bytes: AtomicU64::default(),
+            running_status: AtomicU64::default(),
+            repeated_status: AtomicU64::default(),
+            previous_times: counters(),
+            previous_status: AtomicU8::default(),
+        }
+    }
+
+    pub fn record(&self, midi: &MidiData) {
+        let Some(&first) = midi.bytes.first() else {
+            return;
+        };
+
+        self.num_messages.fetch_add(1, Ordering::Relaxed);
+        let previous_status = self.previous_status.load(Ordering::Relaxed);
+
+        let status = match first {
+            0x00..=0x7F | 0xF7 if previous_status == 0xF0 => {
+                self.sysex_bytes
+                    .fetch_add(midi.bytes.len() as u64, Ordering::Relaxed);
+                if midi.bytes.last() == Some(&0xF7) {
+                    self.previous_status.store(0, Ordering::Relaxed);
+                }
+                return;
+            }
+            0x00..=0x7F if previous_status >= 0x80 => {
+                self.running_status.fetch_add(1, Ordering::Relaxed);
+                previous_status
+            }
+            0x00..=0x7F => return,
+            status => status,
+        };
+
+        let Some(kind) = MidiMessageKind::of(status) else {
+            return;
+        };
+        let channel = match kind {
+            MidiMessageKind::System => 0,
+            _ => (status & 0x0F) as usize,
+        };
+        self.counts[kind as usize][channel].fetch_add(1, Ordering::Relaxed);
+
+        let previous_time =
+            self.previous_times[kind as usize].swap(midi.timestamp + 1, Ordering::Relaxed);
+        if let Some(previous_time) = previous_time.checked_sub(1) {
+            let bucket = interval_bucket(midi.timestamp.saturating_sub(previous_time));
+            self.intervals[kind as usize][bucket].fetch_add(1, Ordering::Relaxed);
+        }
+
+        let data = match first {
+            0x00..=0x7F => &midi.bytes[..],
+            _ => &midi.bytes[1..],
+        };
+
+        if kind == MidiMessageKind::ControlChange {
+            if let Some(&controller) = data.first() {
+                self.control_changes[(controller & 0x7F) as usize].fetch_add(1, Ordering::Relaxed);
+            }
+        }
+
+        match status {
+            0x80..=0xEF => {
+                if status == previous_status {
+                    self.repeated_status.fetch_add(1, Ordering::Relaxed);
+                }
+                self.previous_status.store(status, Ordering::Relaxed);
+            }
+            0xF0 => {
+                self.sysex_bytes
+                    .fetch_add(midi.bytes.len() as u64, Ordering::Relaxed);
+                let is_last = midi.bytes.last() == Some(&0xF7);
+                self.previous_status
+                    .store(if is_last { 0 } else { 0xF0 }, Ordering::Relaxed);
+            }
+            // system common messages cancel running status, realtime ones do not
+            0xF1..=0xF7 => self.previous_status.store(0, Ordering::Relaxed),
+            _ => (),
+        }
+    }
+
+    /// Copy of the counters, at `timestamp`, to compute rates between snapshots.
+    pub fn snapshot(&self, timestamp: u64) -> MidiStatsSnapshot {
+        let load = |counter: &AtomicU64| counter.load(Ordering::Relaxed);
+
+        MidiStatsSnapshot {
+            timestamp,
+            num_messages: load(&self.num_messages),
+            counts: self
+                .counts
+                .each_ref()
+                .map(|counts| counts.each_ref().map(load)),
+            intervals: self
+                .intervals
+                .each_ref()
+                .map(|buckets| buckets.each_ref().map(load)),
+            control_changes: self.control_changes.each_ref().map(load),
+            sysex_bytes: load(&self.sysex_bytes),
+            running_status: load(&self.running_status),
+            repeated_status: load(&self.repeated_status),
+        }
+    }
+}
+
+/// The counters of a `MidiPortStats` at a point in time.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct MidiStatsSnapshot {
+    pub timestamp: u64,
+    pub num_messages: u64,
+    counts: [[u64; NUM_CHANNELS]; NUM_KINDS],
+    intervals: [[u64; MIDI_INTERVAL_BUCKETS]; NUM_KINDS],
+    control_changes: [u64; 128],
+    pub sysex_bytes: u64,
+    pub running_status: u64,
+    pub repeated_status: u64,
+}
+
+impl Default for MidiStatsSnapshot {
+    fn default() -> Self {
+        Self {
+            timestamp: 0,
+            num_messages: 0,
+            counts: [[0; NUM_CHANNELS]; NUM_KINDS],
+            intervals: [[0; MIDI_INTERVAL_BUCKETS]; NUM_KINDS],
+            control_changes: [0; 128],
+            sysex_bytes: 0,
+            running_status: 0,
+            repeated_status: 0,
+        }
+    }
+}
+
+impl MidiStatsSnapshot {
+    /// Messages of a kind on a channel, or on every channel if `None`.
+    pub fn count(&self, kind: MidiMessageKind, channel: Option<u8>) -> u64 {
+        let counts = &self.counts[kind as usize];
+        match channel {
+            Some(channel) => counts[channel as usize % NUM_CHANNELS],
+            None => counts.iter().sum(),
+        }
+    }
+
+    /// Messages per second of a kind on a channel, or
+    /// on every channel, since an earlier snapshot.
+    pub fn rate_since(
+        &self,
+        earlier: &MidiStatsSnapshot,
+        kind: MidiMessageKind,
+        channel: Option<u8>,
+    ) -> f64 {
+        let elapsed = self.timestamp.saturating_sub(earlier.timestamp) as f64 / 1e6;
+        let count = self
+            .count(kind, channel)
+            .saturating_sub(earlier.count(kind, channel));
+
+        match elapsed > 0. {
+            true => count as f64 / elapsed,
+            false => 0.,
+        }
+    }
+
+    /// Histogram of the intervals between messages of a kind, see `MIDI_INTERVAL_BUCKETS`.
+    pub fn intervals(&self, kind: MidiMessageKind) -> &[u64; MIDI_INTERVAL_BUCKETS] {
+        &self.intervals[kind as usize]
+    }
+
+    /// The controllers that changed the most, with their number of changes.
+    pub fn busiest_controls(&self, len: usize) -> Vec<(u8, u64)> {
+        let mut controls: Vec<(u8, u64)> = (0..128u8)
+            .map(|controller| (controller, self.control_changes[controller as usize]))
+            .filter(|(_, count)| *count > 0)
+            .collect();
+
+        controls.sort_by(|a, b| b.1.cmp(&a.1).then(a.0.cmp(&b.0)));
+        controls.truncate(len);
+        controls
+    }
+}
+
+/// Statistics of every port connected so far.
+///
+/// Ports are registered the first time they connect, which is
+/// the only time the registry is locked, their stats are kept
+/// when they disconnect and reused when they reconnect.
+#[derive(Default)]
+pub struct MidiStats {
+    ports: Mutex<Vec<Arc<MidiPortStats>>>,
+}
+
+impl MidiStats {
+    /// All the ports, in order of registration.
+    pub fn ports(&self) -> Vec<Arc<MidiPortStats>> {
+        self.ports
+            .lock()
+            .map(|ports| ports.to_vec())
+            .unwrap_or_default()
+    }
+
+    pub fn port(&self, device_name: &str) -> Option<Arc<MidiPortStats>> {
+        self.ports
+            .lock()
+            .ok()?
+            .iter()
+            .find(|stats| stats.device_name == device_name)
+            .cloned()
+    }
+
+    pub fn register(&self, port: MidiPortId, device_name: &str) -> Arc<MidiPortStats> {
+        let mut ports = match self.ports.lock() {
+            Ok(ports) => ports,
+            Err(poisoned) => poisoned.into_inner(),
+        };
+
+        if let Some(stats) = ports.iter().find(|stats| stats.port == port) {
+            return stats.clone();
+        }
+
+        let stats = Arc::new(MidiPortStats::new(port, device_name.to_owned()));
+        ports.push(stats.clone());
+        stats
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn midi(timestamp: u64, bytes: &[u8]) -> MidiData {
+        MidiData {
+            timestamp,
+            port: 0,
+            bytes: bytes.into(),
+        }
+    }
+
+    #[test]
+    fn counts_messages_by_kind_and_channel() {
+        let stats = MidiPortStats::new(0, "keys".to_owned());
+        stats.record(&midi(0, &[0x90, 60, 100]));
+        stats.record(&midi(1_000, &[0x91, 62, 100]));
+        stats.record(&midi(2_000, &[0x91, 62, 0]));
+        stats.record(&midi(2_000, &[0xF8]));
+        stats.record(&midi(2_500, &[0xB0, 74, 10]));
+        stats.record(&midi(2_600, &[0xB3, 74, 11]));
+        stats.record(&midi(2_700, &[0xB0, 1, 11]));
+
+        let earlier = MidiStatsSnapshot::default();
+        let snapshot = stats.snapshot(500_000);
+        assert_eq!(snapshot.num_messages, 7);
+        assert_eq!(snapshot.count(MidiMessageKind::NoteOn, None), 3);
+        assert_eq!(snapshot.count(MidiMessageKind::NoteOn, Some(1)), 2);
+        assert_eq!(snapshot.count(MidiMessageKind::System, None), 1);
+        assert_eq!(
+            snapshot.rate_since(&earlier, MidiMessageKind::NoteOn, None),
+            6.
+        );
+        assert_eq!(snapshot.busiest_controls(1), [(74, 2)]);
+        assert_eq!(snapshot.busiest_controls(8), [(74, 2), (1, 1)]);
+
+        let intervals = snapshot.intervals(MidiMessageKind::NoteOn);
+        assert_eq!(intervals[interval_bucket(1_000)], 2);
+        assert_eq!(intervals.iter().sum::<u64>(), 2);
+    }
+
+    #[test]
+    fn counts_running_status_and_sysex_bytes() {
+        let stats = MidiPortStats::new(0, "keys".to_owned());
+        stats.record(&midi(0, &[0x90, 60, 100]));
+        stats.record(&midi(0, &[62, 100]));
+        stats.record(&midi(0, &[0x90, 64, 100]));
+        stats.record(&midi(0, &[0xF0, 0x43, 0x10]));
+        stats.record(&midi(0, &[0x01, 0x02, 0xF7]));
+        stats.record(&midi(0, &[64, 0]));
+
+        let snapshot = stats.snapshot(0);
+        assert_eq!(snapshot.running_status, 1);
+        assert_eq!(snapshot.repeated_status, 2);
+        assert_eq!(snapshot.sysex_bytes, 6);
+        assert_eq!(snapshot.count(MidiMessageKind::NoteOn, None), 3);
+        assert_eq!(snapshot.count(MidiMessageKind::System, None), 1);
+    }
+
+    #[test]
+    fn buckets_intervals_by_power_of_two() {
+        assert_eq!(interval_bucket(0), 0);
+        assert_eq!(interval_bucket(1), 1);
+        assert_eq!(interval_bucket(3), 2);
+        assert_eq!(interval_bucket(1_000), 10);
+        assert_eq!(interval_bucket(u64::MAX), MIDI_INTERVAL_BUCKETS - 1);
+    }
+}
@@ -1,54 +1,324 @@
 use super::*;
-use crossbeam::channel::{Receiver, Sender};
+use crate::clock;
+use crossbeam::{
+    channel::{Receiver, Sender},
+    queue::ArrayQueue,
+};
 use midir::*;
-use std::sync::{
-    atomic::{AtomicBool, Ordering},
-    Arc,
+use std::{
+    sync::{
+        atomic::{AtomicBool, AtomicU64, Ordering},
+        Arc,
+    },
+    thread::Thread,
 };
 
+/// Number of messages a port can buffer between two updates.
+const PORT_RING_CAPACITY: usize = 4096;
+/// Number of messages an output can queue before its thread sends them.
+const THRU_QUEUE_CAPACITY: usize = 1024;
+
+/// Output connections are shared by the thru of every input.
+type SharedMidiOutput = Arc<MidiThruOutput>;
+
+/// Queue of messages routed to an output, sent by a thread of its own so
+/// that the MIDI threads of the inputs never wait for an output, nor for
+/// each other. The thread sends what is left and ends once it is dropped.
+struct MidiThruOutput {
+    queue: Arc<ArrayQueue<MidiBytes>>,
+    is_open: Arc<AtomicBool>,
+    thread: Thread,
+}
+
+impl MidiThruOutput {
+    fn spawn(mut connection: MidiOutputConnection) -> anyhow::Result<Self> {
+        let queue = Arc::new(ArrayQueue::<MidiBytes>::new(THRU_QUEUE_CAPACITY));
+        let is_open = Arc::new(AtomicBool::new(true));
+
+        let thread = std::thread::Builder::new()
+            .name("aud-midi-thru".to_owned())
+            .spawn({
+                let queue = queue.clone();
+                let is_open = is_open.clone();
+                move || loop {
+                    while let Some(bytes) = queue.pop() {
+                        let _ = connection.send(&bytes);
+                    }
+
+                    if !is_open.load(Ordering::Acquire) {
+                        break;
+                    }
+
+                    std::thread::park();
+                }
+            })?;
+
+        Ok(Self {
+            queue,
+            is_open,
+            thread: thread.thread().clone(),
+        })
+    }
+
+    /// Lock-free, messages that do not fit in the queue are dropped.
+    fn send(&self, bytes: &[u8]) {
+        if self.queue.push(bytes.into()).is_ok() {
+            self.thread.unpark();
+        }
+    }
+}
+
+impl Drop for MidiThruOutput {
+    fn drop(&mut self) {
+        self.is_open.store(false, Ordering::Release);
+        self.thread.unpark();
+    }
+}
+
+/// The routes of a port, along with the outputs they send to.
+#[derive(Default)]
+struct MidiThru {
+    routes: PortRoutes,
+    /// Indexed like `MidiRouter::outputs`.
+    outputs: Vec<SharedMidiOutput>,
+}
+
+impl MidiThru {
+    fn send(&mut self, bytes: &[u8]) {
+        let outputs = &self.outputs;
+        self.routes
+            .route(bytes, |output, bytes| outputs[output].send(bytes));
+    }
+}
+
+/// Stamp of the message the callback of a port is pushing to its ring, shared
+/// with the receiver so that it only merges the messages every port is done with.
+#[derive(Clone)]
+pub struct MidiInFlight(Arc<AtomicU64>);
+
+impl MidiInFlight {
+    const IDLE: u64 = u64::MAX;
+    /// Set before reading the clock, a message may be pushed with any stamp.
+    const STAMPING: u64 = 0;
+
+    fn new() -> Self {
+        Self(Arc::new(AtomicU64::new(Self::IDLE)))
+    }
+
+    /// Stamp a message, which is in flight until `land` is called.
+    fn stamp(&self) -> u64 {
+        self.0.store(Self::STAMPING, Ordering::SeqCst);
+        let timestamp = clock::now();
+        self.0.store(timestamp, Ordering::SeqCst);
+        timestamp
+    }
+
+    fn land(&self) {
+        self.0.store(Self::IDLE, Ordering::Release);
+    }
+}
+
+/// Time before which every message of the ports has been pushed to their
+/// ring: the oldest stamp still in flight, or now if none is. The clock is
+/// read first, a message stamped after it may land at any time.
+pub fn midi_watermark<'a>(in_flight: impl IntoIterator<Item = &'a MidiInFlight>) -> u64 {
+    let now = clock::now();
+    in_flight.into_iter().fold(now, |watermark, port| {
+        watermark.min(port.0.load(Ordering::SeqCst))
+    })
+}
+
+/// State moved into the callback of a connected port.
+struct MidiPortInput {
+    port: MidiPortId,
+    producer: RingProducer<MidiData>,
+    in_flight: MidiInFlight,
+    is_running: Arc<AtomicBool>,
+    thru: MidiThru,
+    /// Replaces `thru` when the routes change.
+    thru_updates: Receiver<MidiThru>,
+    /// Takes the replaced `thru` back, to be freed off the MIDI thread.
+    old_thru: Sender<MidiThru>,
+}
+
+struct MidiPortConnection {
+    device_name: String,
+    _connection: MidiInputConnection<MidiPortInput>,
+    consumer: RingConsumer<MidiData>,
+    in_flight: MidiInFlight,
+    thru_updates: Sender<MidiThru>,
+    /// The same channel as the input, to drop the updates it has not taken yet.
+    stale_thru: Receiver<MidiThru>,
+    old_thru: Receiver<MidiThru>,
+}
+
+impl MidiPortConnection {
+    /// Replace the thru of the input. The replaced ones are freed first, then
+    /// the update it has not taken yet, so that at most one update and two
+    /// replaced thru are ever queued and the bounded channels never fill up.
+    fn update_thru(&self, thru: MidiThru) {
+        self.free_old_thru();
+        self.stale_thru.try_iter().for_each(drop);
+        let _ = self.thru_updates.try_send(thru);
+    }
+
+    fn free_old_thru(&self) {
+        self.old_thru.try_iter().for_each(drop);
+    }
+}
+
+/// Receives from any number of devices at once, each on
+/// its own connection, thread and ring. The messages are
+/// stamped with the `clock` on reception, which orders
+/// them across devices and with the other subsystems.
+///
+/// A message may land in its ring after a later message of
+/// another device was drained, so the messages stamped after
+/// the `midi_watermark` are held back until the next poll.
+///
+/// Messages are routed to the outputs of the `MidiRouter`
+/// directly from the MIDI thread of their input, before
+/// being buffered, so that thru does not wait for the app.
+/// Each output sends them from a thread of its own.
 pub struct HostedMidiReceiver {
     host: MidiInput,
-    sender: Sender<MidiData>,
-    receiver: Receiver<MidiData>,
-    connection: Option<MidiInputConnection<Sender<MidiData>>>,
+    connections: Vec<MidiPortConnection>,
+    /// Messages drained from each connection, before they are merged,
+    /// followed by those left by the closed connections.
+    pending: Vec<Vec<MidiData>>,
+    merger: MidiMerger,
+    /// Messages dropped by the rings of closed connections.
+    num_dropped_before: u64,
     is_running: Arc<AtomicBool>,
+    router: MidiRouter,
+    /// Indexed like `MidiRouter::outputs`.
+    outputs: Vec<SharedMidiOutput>,
 }
 
 impl Default for HostedMidiReceiver {
     fn default() -> Self {
-        let (sender, receiver) = crossbeam::channel::bounded(1_000);
-
         Self {
             host: MidiInput::new("aud-midi-in").unwrap(),
-            connection: None,
-            sender,
-            receiver,
+            connections: vec![],
+            pending: vec![vec![]],
+            merger: MidiMerger::default(),
+            num_dropped_before: 0,
             is_running: Arc::new(AtomicBool::new(true)),
+            router: MidiRouter::default(),
+            outputs: vec![],
+        }
+    }
+}
+
+impl HostedMidiReceiver {
+    fn thru_from(&self, device_name: &str) -> MidiThru {
+        MidiThru {
+            routes: self.router.routes_from(device_name),
+            outputs: self.outputs.clone(),
         }
     }
+
+    fn connect_to_output(&self, device_name: &str) -> anyhow::Result<SharedMidiOutput> {
+        if let Some(index) = self.router.outputs().iter().position(|o| o == device_name) {
+            return Ok(self.outputs[index].clone());
+        }
+
+        let connection = connect_to_midi_output(device_name, "aud-midi-thru")?;
+        Ok(Arc::new(MidiThruOutput::spawn(connection)?))
+    }
 }
 
 impl MidiReceiving for HostedMidiReceiver {
     fn is_midi_stream_active(&self) -> bool {
-        self.is_running.load(Ordering::SeqCst)
+        self.is_running.load(Ordering::Relaxed)
     }
 
     fn set_midi_stream_active(&mut self, should_be_active: bool) {
-        self.is_running.store(should_be_active, Ordering::SeqCst)
+        self.is_running.store(should_be_active, Ordering::Relaxed)
     }
 
-    fn connect_to_midi_device(&mut self, device_name: &str) -> anyhow::Result<()> {
+    fn connect_to_midi_device(
+        &mut self,
+        device_name: &str,
+        port: MidiPortId,
+    ) -> anyhow::Result<()> {
         let ports = self.host.ports();
-        let port = ports
+        let midi_port = ports
             .iter()
             .find(|&port| self.host.port_name(port).as_deref() == Ok(device_name))
             .ok_or_else(|| anyhow::anyhow!("[ MIDI ] : Cannot find device {device_name}"))?;
 
-        self.connection = Some(self.connect_to_input_device(port)?);
+        self.disconnect_from_midi_device(device_name)?;
+
+        let (producer, consumer) = ring(PORT_RING_CAPACITY);
+        let (thru_updates, thru_receiver) = crossbeam::channel::bounded(1);
+        let (old_thru_sender, old_thru) = crossbeam::channel::bounded(2);
+        let in_flight = MidiInFlight::new();
+        let input = MidiPortInput {
+            port,
+            producer,
+            in_flight: in_flight.clone(),
+            is_running: self.is_running.clone(),
+            thru: self.thru_from(device_name),
+            thru_updates: thru_receiver.clone(),
+            old_thru: old_thru_sender,
+        };
+
+        let connection = MidiInput::new("aud-midi-in")?
+            .connect(midi_port, "aud-midi-in", on_midi_input, input)
+            .map_err(|e| anyhow::anyhow!(e.to_string()))?;
+
+        self.connections.push(MidiPortConnection {
+            device_name: device_name.to_owned(),
+            _connection: connection,
+            consumer,
+            in_flight,
+            thru_updates,
+            stale_thru: thru_receiver,
+            old_thru,
+        });
+        self.pending.insert(
+            self.connections.len() - 1,
+            Vec::with_capacity(PORT_RING_CAPACITY),
+        );
+
         log::trace!("[ MIDI ] : connected to {device_name}");
         Ok(())
     }
 
+    fn disconnect_from_midi_device(&mut self, device_name: &str) -> anyhow::Result<()> {
+        let Some(index) = self
+            .connections
+            .iter()
+            .position(|connection| connection.device_name == device_name)
+        else {
+            return Ok(());
+        };
+
+        let MidiPortConnection {
+            _connection,
+            mut consumer,
+            old_thru,
+            ..
+        } = self.connections.remove(index);
+        // closed before the ring is drained, so that no message lands after,
+        // and while the channel taking back the replaced thru is still open
+        drop(_connection);
+        drop(old_thru);
+
+        let mut left = self.pending.remove(index);
+        consumer.drain_into(&mut left);
+
+        // held back with those of the other closed ports, until the watermark passes them
+        let closed = self.pending.last_mut().unwrap();
+        let mut streams = [std::mem::take(closed), left];
+        self.merger.merge(&mut streams, u64::MAX, closed);
+
+        self.num_dropped_before += consumer.num_dropped();
+        log::trace!("[ MIDI ] : disconnected from {device_name}");
+        Ok(())
+    }
+
     fn list_midi_devices(&self) -> anyhow::Result<Vec<String>> {
         Ok(self
             .host
@@ -59,36 +329,168 @@ impl MidiReceiving for HostedMidiReceiver {
     }
 
     fn produce_midi_messages(&mut self) -> Vec<MidiData> {
-        self.receiver.try_iter().collect()
+        let watermark = midi_watermark(self.connections.iter().map(|c| &c.in_flight));
+        for (connection, pending) in self.connections.iter_mut().zip(self.pending.iter_mut()) {
+            connection.consumer.drain_into(pending);
+            connection.free_old_thru();
+        }
+
+        let mut messages = vec![];
+        self.merger
+            .merge(&mut self.pending, watermark, &mut messages);
+        messages
+    }
+
+    fn dropped_midi_messages(&self) -> u64 {
+        let num_dropped: u64 = self
+            .connections
+            .iter()
+            .map(|connection| connection.consumer.num_dropped())
+            .sum();
+
+        self.num_dropped_before + num_dropped
+    }
+
+    fn route_midi(&mut self, router: MidiRouter) -> anyhow::Result<()> {
+        let outputs = router
+            .outputs()
+            .iter()
+            .map(|device_name| self.connect_to_output(device_name))
+            .collect::<anyhow::Result<Vec<_>>>()?;
+
+        self.router = router;
+        self.outputs = outputs;
+
+        for connection in self.connections.iter() {
+            connection.update_thru(self.thru_from(&connection.device_name));
+        }
+
+        Ok(())
     }
 }
 
-impl HostedMidiReceiver {
-    fn connect_to_input_device(
-        &mut self,
-        port: &MidiInputPort,
-    ) -> anyhow::Result<MidiInputConnection<Sender<MidiData>>> {
-        let callback = {
-            let is_running = self.is_running.clone();
-
-            move |timestamp: u64, bytes: &[u8], sender: &mut Sender<MidiData>| {
-                if !is_running.load(Ordering::SeqCst) {
-                    return;
-                }
+fn connect_to_midi_output(
+    device_name: &str,
+    connection_name: &str,
+) -> anyhow::Result<MidiOutputConnection> {
+    let host = MidiOutput::new("aud-midi-out")?;
+    let port = host
+        .ports()
+        .into_iter()
+        .find(|port| host.port_name(port).as_deref() == Ok(device_name))
+        .ok_or_else(|| anyhow::anyhow!("[ MIDI ] : Cannot find output device {device_name}"))?;
 
-                let midi = MidiData {
-                    timestamp,
-                    bytes: bytes.into(),
-                };
+    let connection = host
+        .connect(&port, connection_name)
+        .map_err(|e| anyhow::anyhow!(e.to_string()))?;
 
-                if let Err(e) = sender.try_send(midi) {
-                    log::error!("Failed to push midi message event to runtime : {e}");
-                }
+    log::trace!("[ MIDI ] : connected to output {device_name}");
+    Ok(connection)
+}
+
+/// Sends to any number of output devices, connecting
+/// to each of them the first time it is sent to.
+#[derive(Default)]
+pub struct HostedMidiSender {
+    connections: Vec<(String, MidiOutputConnection)>,
+}
+
+impl HostedMidiSender {
+    pub fn list_midi_devices(&self) -> anyhow::Result<Vec<String>> {
+        let host = MidiOutput::new("aud-midi-out")?;
+        Ok(host
+            .ports()
+            .iter()
+            .map(|port| host.port_name(port))
+            .collect::<Result<Vec<_>, _>>()?)
+    }
+}
+
+impl MidiProducing for HostedMidiSender {
+    fn send_midi_messages(&mut self, device: &str, messages: &[MidiData]) -> anyhow::Result<()> {
+        let index = match self.connections.iter().position(|(name, _)| name == device) {
+            Some(index) => index,
+            None => {
+                let connection = connect_to_midi_output(device, "aud-midi-send")?;
+                self.connections.push((device.to_owned(), connection));
+                self.connections.len() - 1
             }
         };
 
-        MidiInput::new("aud-midi-in")?
-            .connect(port, "aud-midi-in", callback, self.sender.clone())
-            .map_err(|e| anyhow::anyhow!(e.to_string()))
+        let connection = &mut self.connections[index].1;
+        for midi in messages {
+            connection
+                .send(&midi.bytes)
+                .map_err(|e| anyhow::anyhow!("[ MIDI ] : Cannot send to {device} : {e}"))?;
+        }
+
+        Ok(())
+    }
+}
+
+/// Runs on the MIDI thread of the host, it must not block, log
+/// or allocate for channel messages. Messages that do not fit
+/// in the ring are counted as dropped by the ring itself.
+///
+/// Long SysEx messages are split into chunks, like some backends
+/// deliver them, so that a dump is never copied whole. The chunks
+/// are assembled, up to a maximum length, by a `SysExAssembler`.
+///
+/// Messages are routed even when the stream is paused,
+/// which only stops them from reaching the app.
+///
+/// The backend timestamp is ignored because its origin depends
+/// on the backend and on the connection, which makes it useless
+/// to order messages received from different devices. The clock
+/// is read first thing instead, so that routing the message does
+/// not delay its stamp.
+fn on_midi_input(_: u64, bytes: &[u8], input: &mut MidiPortInput) {
+    let timestamp = input.in_flight.stamp();
+
+    // only this thread sends the replaced thru, there is room for it unless the
+    // app has not freed the previous ones yet, then the update waits for it
+    if !input.old_thru.is_full() {
+        if let Ok(thru) = input.thru_updates.try_recv() {
+            let old_thru = std::mem::replace(&mut input.thru, thru);
+            let _ = input.old_thru.try_send(old_thru);
+        }
+    }
+
+    input.thru.send(bytes);
+
+    if input.is_running.load(Ordering::Relaxed) {
+        for bytes in split_sysex(bytes) {
+            let _ = input.producer.push(MidiData {
+                timestamp,
+                port: input.port,
+                bytes: bytes.into(),
+            });
+        }
     }
+
+    input.in_flight.land();
+}
+
+#[cfg(feature = "bench")]
+pub fn test_make_midi_input_callback(
+    port: MidiPortId,
+    capacity: usize,
+) -> (impl FnMut(&[u8]), RingConsumer<MidiData>, MidiInFlight) {
+    let (producer, consumer) = ring(capacity);
+    let in_flight = MidiInFlight::new();
+    let mut input = MidiPortInput {
+        port,
+        producer,
+        in_flight: in_flight.clone(),
+        is_running: Arc::new(AtomicBool::new(true)),
+        thru: MidiThru::default(),
+        thru_updates: crossbeam::channel::never(),
+        old_thru: crossbeam::channel::bounded(1).0,
+    };
+
+    (
+        move |bytes| on_midi_input(0, bytes, &mut input),
+        consumer,
+        in_flight,
+    )
 }
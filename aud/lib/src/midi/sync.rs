@@ -0,0 +1,488 @@
+use super::*;
+use crate::clock;
+use crossbeam::channel::{Receiver, Sender};
+use std::{
+    sync::{
+        atomic::{AtomicBool, AtomicU64, Ordering},
+        Arc,
+    },
+    thread::JoinHandle,
+    time::Duration,
+};
+
+/// Pulses per quarter note of the MIDI clock.
+pub const MIDI_CLOCK_PPQN: i64 = 24;
+/// Pulses per sixteenth note, the unit of the song position pointer.
+const TICKS_PER_POSITION: i64 = MIDI_CLOCK_PPQN / 4;
+
+/// Below this delay the clock thread spins instead of sleeping,
+/// sleeps are not precise enough for sub-millisecond timing.
+const SPIN_THRESHOLD: Duration = Duration::from_millis(2);
+/// Longest sleep of the clock thread, which bounds how
+/// long it takes to follow a change of the timeline.
+const MAX_SLEEP: Duration = Duration::from_millis(5);
+/// Late ticks are sent at most this much faster than the tempo until
+/// they catch up, devices follow a small change of tempo better than
+/// a burst of ticks.
+const MAX_CATCH_UP_SPEED: f64 = 1.25;
+/// Number of late ticks above which they are dropped
+/// instead, catching up on them would take too long.
+const MAX_LATE_TICKS: i64 = MIDI_CLOCK_PPQN;
+
+const TICK: u8 = 0xF8;
+const START: u8 = 0xFA;
+const CONTINUE: u8 = 0xFB;
+const STOP: u8 = 0xFC;
+const SONG_POSITION: u8 = 0xF2;
+
+/// Tempo and position of a session, e.g. of Ableton Link,
+/// which the beats follow in a line from a point in time.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct MidiClockTimeline {
+    /// Time on the `clock` at which the session is at `beat`.
+    pub micros: u64,
+    pub beat: f64,
+    pub tempo: f64,
+    pub is_playing: bool,
+}
+
+impl MidiClockTimeline {
+    pub fn beat_at(&self, micros: u64) -> f64 {
+        self.beat + (micros as f64 - self.micros as f64) * self.tempo / 60e6
+    }
+
+    pub fn micros_at_beat(&self, beat: f64) -> u64 {
+        let micros = self.micros as f64 + (beat - self.beat) * 60e6 / self.tempo;
+        micros.max(0.).round() as u64
+    }
+
+    fn micros_at_tick(&self, tick: i64) -> u64 {
+        self.micros_at_beat(tick as f64 / MIDI_CLOCK_PPQN as f64)
+    }
+
+    fn micros_per_tick(&self) -> f64 {
+        60e6 / (self.tempo * MIDI_CLOCK_PPQN as f64)
+    }
+
+    /// Time at which `tick` is sent, no sooner after the previous
+    /// tick than `MAX_CATCH_UP_SPEED` allows, so late ticks are
+    /// spread over the next ones instead of being sent at once.
+    fn send_time(&self, tick: i64, previous: Option<u64>) -> u64 {
+        let min_interval = (self.micros_per_tick() / MAX_CATCH_UP_SPEED) as u64;
+        let due = self.micros_at_tick(tick);
+        previous.map_or(due, |previous| due.max(previous + min_interval))
+    }
+
+    /// The first tick at or after `micros`.
+    fn tick_at(&self, micros: u64) -> i64 {
+        (self.beat_at(micros) * MIDI_CLOCK_PPQN as f64 - 1e-6).ceil() as i64
+    }
+
+    /// Both timelines put the beats at the same times, within a tick.
+    fn is_in_sync_with(&self, other: &Self) -> bool {
+        let drift = (self.beat_at(other.micros) - other.beat) * MIDI_CLOCK_PPQN as f64;
+        self.tempo == other.tempo && self.is_playing == other.is_playing && drift.abs() < 0.01
+    }
+}
+
+/// How late the ticks were sent, in microseconds.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct MidiClockStats {
+    pub num_ticks: u64,
+    pub last_lateness: u64,
+    pub max_lateness: u64,
+    /// Ticks too late to be caught up on.
+    pub num_dropped: u64,
+}
+
+#[derive(Default)]
+struct SharedMidiClockStats {
+    num_ticks: AtomicU64,
+    last_lateness: AtomicU64,
+    max_lateness: AtomicU64,
+    num_dropped: AtomicU64,
+}
+
+/// Sends the MIDI clock of a timeline to a device, from its own thread.
+///
+/// Ticks are scheduled at absolute deadlines computed from the timeline,
+/// so that their error does not accumulate and tempo changes apply from
+/// the next tick. The thread sleeps until shortly before a deadline then
+/// spins, which keeps the ticks within tens of microseconds of their
+/// deadline on an idle machine. Ticks that are late anyway are caught up
+/// on at a slightly faster tempo, or dropped past a beat.
+///
+/// Ticks are sent whether the timeline is playing or not, so that devices
+/// follow the tempo. Starting sends the song position and a continue, or
+/// a start from the first beat, on the next sixteenth note.
+pub struct MidiClockGenerator {
+    timeline: MidiClockTimeline,
+    timelines: Sender<MidiClockTimeline>,
+    stats: Arc<SharedMidiClockStats>,
+    is_stopped: Arc<AtomicBool>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl MidiClockGenerator {
+    pub fn start(
+        mut sender: Box<dyn MidiProducing + Send>,
+        device: String,
+        timeline: MidiClockTimeline,
+    ) -> anyhow::Result<Self> {
+        let (timeline_tx, timeline_rx) = crossbeam::channel::bounded(64);
+        let stats = Arc::new(SharedMidiClockStats::default());
+        let is_stopped = Arc::new(AtomicBool::new(false));
+
+        let thread = std::thread::Builder::new()
+            .name("aud-midi-clock".to_owned())
+            .spawn({
+                let stats = stats.clone();
+                let is_stopped = is_stopped.clone();
+                move || {
+                    let mut send =
+                        |messages: &[MidiData]| sender.send_midi_messages(&device, messages);
+                    run_clock(timeline, timeline_rx, &mut send, &stats, &is_stopped)
+                }
+            })?;
+
+        Ok(Self {
+            timeline,
+            timelines: timeline_tx,
+            stats,
+            is_stopped,
+            thread: Some(thread),
+        })
+    }
+
+    /// Follow a new timeline, which is only passed on
+    /// to the clock thread if it moves the beats.
+    pub fn update(&mut self, timeline: MidiClockTimeline) {
+        if self.timeline.is_in_sync_with(&timeline) {
+            return;
+        }
+
+        if self.timelines.try_send(timeline).is_ok() {
+            self.timeline = timeline;
+        }
+    }
+
+    pub fn stats(&self) -> MidiClockStats {
+        MidiClockStats {
+            num_ticks: self.stats.num_ticks.load(Ordering::Relaxed),
+            last_lateness: self.stats.last_lateness.load(Ordering::Relaxed),
+            max_lateness: self.stats.max_lateness.load(Ordering::Relaxed),
+            num_dropped: self.stats.num_dropped.load(Ordering::Relaxed),
+        }
+    }
+}
+
+impl Drop for MidiClockGenerator {
+    fn drop(&mut self) {
+        self.is_stopped.store(true, Ordering::Relaxed);
+        if self
+            .thread
+            .take()
+            .map(JoinHandle::join)
+            .is_some_and(|r| r.is_err())
+        {
+            log::error!("[ MIDI ] : clock thread panicked");
+        }
+    }
+}
+
+enum Transport {
+    Stopped,
+    Starting,
+    Playing,
+}
+
+fn message(bytes: &[u8]) -> MidiData {
+    MidiData {
+        timestamp: clock::now(),
+        port: 0,
+        bytes: bytes.into(),
+    }
+}
+
+/// Messages due at a tick, the transport ones before the tick itself.
+fn tick_messages(
+    tick: i64,
+    timeline: &MidiClockTimeline,
+    transport: &mut Transport,
+    messages: &mut Vec<MidiData>,
+) {
+    match (timeline.is_playing, &transport) {
+        (false, Transport::Starting | Transport::Playing) => {
+            messages.push(message(&[STOP]));
+            *transport = Transport::Stopped;
+        }
+        (true, Transport::Stopped) => *transport = Transport::Starting,
+        _ => (),
+    }
+
+    if matches!(transport, Transport::Starting) && tick >= 0 && tick % TICKS_PER_POSITION == 0 {
+        let position = tick / TICKS_PER_POSITION;
+        if position == 0 {
+            messages.push(message(&[START]));
+        } else {
+            let position = position.min(0x3FFF) as u16;
+            messages.push(message(&[
+                SONG_POSITION,
+                (position & 0x7F) as u8,
+                (position >> 7) as u8,
+            ]));
+            messages.push(message(&[CONTINUE]));
+        }
+        *transport = Transport::Playing;
+    }
+
+    messages.push(message(&[TICK]));
+}
+
+fn run_clock(
+    mut timeline: MidiClockTimeline,
+    timelines: Receiver<MidiClockTimeline>,
+    send: &mut dyn FnMut(&[MidiData]) -> anyhow::Result<()>,
+    stats: &SharedMidiClockStats,
+    is_stopped: &AtomicBool,
+) {
+    let mut tick = timeline.tick_at(clock::now());
+    let mut transport = Transport::Stopped;
+    let mut messages = Vec::with_capacity(4);
+    let mut has_failed = false;
+    let mut last_sent = None;
+
+    loop {
+        let num_late = timeline.tick_at(clock::now()) - tick;
+        if num_late > MAX_LATE_TICKS {
+            stats
+                .num_dropped
+                .fetch_add(num_late as u64, Ordering::Relaxed);
+            tick += num_late;
+            last_sent = None;
+        }
+
+        loop {
+            if is_stopped.load(Ordering::Relaxed) {
+                return;
+            }
+
+            if let Some(update) = timelines.try_iter().last() {
+                timeline = update;
+                tick = timeline.tick_at(clock::now());
+                last_sent = None;
+            }
+
+            let deadline = timeline.send_time(tick, last_sent);
+            let remaining = Duration::from_micros(deadline.saturating_sub(clock::now()));
+
+            if remaining.is_zero() {
+                break;
+            } else if remaining > SPIN_THRESHOLD {
+                std::thread::sleep((remaining - SPIN_THRESHOLD).min(MAX_SLEEP));
+            } else {
+                std::hint::spin_loop();
+            }
+        }
+
+        messages.clear();
+        tick_messages(tick, &timeline, &mut transport, &mut messages);
+
+        if let Err(e) = send(&messages) {
+            if !has_failed {
+                log::error!("[ MIDI ] : cannot send the clock : {e}");
+            }
+            has_failed = true;
+        }
+
+        let now = clock::now();
+        let lateness = now.saturating_sub(timeline.micros_at_tick(tick));
+        last_sent = Some(now);
+        stats.num_ticks.fetch_add(1, Ordering::Relaxed);
+        stats.last_lateness.store(lateness, Ordering::Relaxed);
+        stats.max_lateness.fetch_max(lateness, Ordering::Relaxed);
+        tick += 1;
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use std::sync::Mutex;
+
+    type SentMessages = Arc<Mutex<Vec<(u64, Vec<u8>)>>>;
+
+    /// Records the time each message was sent, like a MIDI loopback would.
+    #[derive(Default)]
+    struct LoopbackMidiDevice {
+        sent: SentMessages,
+    }
+
+    impl MidiProducing for LoopbackMidiDevice {
+        fn send_midi_messages(&mut self, _: &str, messages: &[MidiData]) -> anyhow::Result<()> {
+            let now = clock::now();
+            let mut sent = self.sent.lock().unwrap();
+            sent.extend(messages.iter().map(|midi| (now, midi.bytes.to_vec())));
+            Ok(())
+        }
+    }
+
+    fn start_clock(timeline: MidiClockTimeline) -> (MidiClockGenerator, SentMessages) {
+        let device = LoopbackMidiDevice::default();
+        let sent = device.sent.clone();
+        let generator =
+            MidiClockGenerator::start(Box::new(device), "loopback".to_owned(), timeline).unwrap();
+        (generator, sent)
+    }
+
+    fn tick_times(sent: &SentMessages) -> Vec<u64> {
+        sent.lock()
+            .unwrap()
+            .iter()
+            .filter(|(_, bytes)| bytes[0] == TICK)
+            .map(|(time, _)| *time)
+            .collect()
+    }
+
+    #[test]
+    fn converts_between_beats_and_time() {
+        let timeline = MidiClockTimeline {
+            micros: 1_000_000,
+            beat: 4.,
+            tempo: 120.,
+            is_playing: true,
+        };
+
+        assert_eq!(timeline.beat_at(1_500_000), 5.);
+        assert_eq!(timeline.micros_at_beat(3.), 500_000);
+        assert_eq!(timeline.tick_at(1_000_000), 4 * MIDI_CLOCK_PPQN);
+        assert_eq!(timeline.tick_at(1_000_001), 4 * MIDI_CLOCK_PPQN + 1);
+        assert!(timeline.is_in_sync_with(&MidiClockTimeline {
+            micros: 1_500_000,
+            beat: 5.,
+            ..timeline
+        }));
+    }
+
+    #[test]
+    fn starts_on_the_first_beat_and_stops() {
+        let mut transport = Transport::Stopped;
+        let mut timeline = MidiClockTimeline {
+            micros: 0,
+            beat: 0.,
+            tempo: 120.,
+            is_playing: true,
+        };
+
+        let mut messages = vec![];
+        let mut sent = |tick, timeline: &MidiClockTimeline, transport: &mut Transport| {
+            messages.clear();
+            tick_messages(tick, timeline, transport, &mut messages);
+            messages
+                .iter()
+                .map(|midi| midi.bytes.to_vec())
+                .collect::<Vec<_>>()
+        };
+
+        assert_eq!(sent(-1, &timeline, &mut transport), [vec![TICK]]);
+        assert_eq!(
+            sent(0, &timeline, &mut transport),
+            [vec![START], vec![TICK]]
+        );
+        assert_eq!(sent(1, &timeline, &mut transport), [vec![TICK]]);
+
+        timeline.is_playing = false;
+        assert_eq!(sent(2, &timeline, &mut transport), [vec![STOP], vec![TICK]]);
+
+        timeline.is_playing = true;
+        assert_eq!(sent(3, &timeline, &mut transport), [vec![TICK]]);
+        assert_eq!(
+            sent(1_206, &timeline, &mut transport),
+            [vec![SONG_POSITION, 73, 1], vec![CONTINUE], vec![TICK]]
+        );
+    }
+
+    #[test]
+    fn spreads_late_ticks_over_the_next_ones() {
+        let timeline = MidiClockTimeline {
+            micros: 0,
+            beat: 0.,
+            tempo: 125.,
+            is_playing: true,
+        };
+        // 20ms per tick, sent at least 16ms apart
+        assert_eq!(timeline.send_time(3, None), 60_000);
+        assert_eq!(timeline.send_time(3, Some(40_000)), 60_000);
+
+        // the first tick was sent 30ms late
+        let sent: Vec<_> = (1..=8)
+            .scan(30_000, |previous, tick| {
+                *previous = timeline.send_time(tick, Some(*previous));
+                Some(*previous / 1_000)
+            })
+            .collect();
+        assert_eq!(sent, [46, 62, 78, 94, 110, 126, 142, 160]);
+    }
+
+    /// Loopback timing of the ticks at 300 bpm, where they are 8.3ms apart.
+    /// It sleeps on the wall clock, run it with `--ignored` on an idle machine.
+    #[test]
+    #[ignore = "depends on the scheduling of the machine"]
+    fn sends_ticks_on_time_and_follows_the_tempo() {
+        let start = clock::now() + 10_000;
+        let timeline = MidiClockTimeline {
+            micros: start,
+            beat: 0.,
+            tempo: 300.,
+            is_playing: true,
+        };
+
+        let (mut generator, sent) = start_clock(timeline);
+        std::thread::sleep(Duration::from_millis(260));
+
+        let ticks = tick_times(&sent);
+        assert!(ticks.len() >= 24, "{} ticks", ticks.len());
+
+        let (started_at, _) = *sent
+            .lock()
+            .unwrap()
+            .iter()
+            .find(|(_, bytes)| bytes[0] == START)
+            .unwrap();
+        assert!(started_at >= start);
+
+        // ticks are late, never early, the deadline of a tick is the last one before it
+        let mut lateness: Vec<u64> = ticks
+            .iter()
+            .map(|time| {
+                let tick = (timeline.beat_at(*time) * MIDI_CLOCK_PPQN as f64).floor() as i64;
+                time - timeline.micros_at_tick(tick)
+            })
+            .collect();
+        lateness.sort_unstable();
+        let p50 = lateness[lateness.len() / 2];
+        assert!(p50 < 100, "median lateness of {p50} µs");
+
+        let now = clock::now();
+        generator.update(MidiClockTimeline {
+            micros: now,
+            beat: timeline.beat_at(now),
+            tempo: 600.,
+            is_playing: true,
+        });
+        std::thread::sleep(Duration::from_millis(100));
+        drop(generator);
+
+        // 240 ticks per second, late ticks are caught up on
+        let ticks: Vec<_> = tick_times(&sent)
+            .into_iter()
+            .filter(|time| *time > now)
+            .collect();
+        let expected = (ticks.last().unwrap() - now) as f64 * 240. / 1e6;
+        assert!(
+            (ticks.len() as f64 - expected).abs() <= 2.,
+            "{} ticks instead of {expected}",
+            ticks.len()
+        );
+    }
+}
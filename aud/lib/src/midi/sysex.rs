@@ -0,0 +1,325 @@
+use super::*;
+use std::sync::Arc;
+
+/// Length above which a SysEx message is split into chunks as soon as
+/// it is received, so that no buffer holds a whole dump unless asked to.
+/// Chunks also fit in the packets of a `MidiPacketWriter`.
+pub const SYSEX_CHUNK_LEN: usize = 1024;
+
+/// A part of a SysEx dump, in order, sharing the bytes received.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct SysExChunk {
+    /// Time the dump started.
+    pub timestamp: u64,
+    pub port: MidiPortId,
+    /// Number of bytes of the dump before this chunk.
+    pub offset: usize,
+    pub bytes: MidiBytes,
+    pub is_last: bool,
+}
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum SysExEvent {
+    /// A message that is not part of a dump, or a whole
+    /// dump that is no longer than the maximum length.
+    Message(MidiData),
+    Chunk(SysExChunk),
+}
+
+/// The dump being received on a port.
+#[derive(Default)]
+struct SysExDump {
+    timestamp: u64,
+    len: usize,
+    /// Parts of the dump, shared with their chunks, until it is longer than the maximum.
+    parts: Vec<MidiBytes>,
+    is_too_long: bool,
+}
+
+impl SysExDump {
+    /// The whole dump, copied from its parts into a single allocation.
+    fn concat(&self) -> MidiBytes {
+        let mut bytes: Arc<[u8]> = std::iter::repeat_n(0, self.len).collect();
+        let whole = Arc::get_mut(&mut bytes).expect("the dump was just allocated");
+
+        let mut offset = 0;
+        for part in &self.parts {
+            whole[offset..offset + part.len()].copy_from_slice(part);
+            offset += part.len();
+        }
+
+        bytes.into()
+    }
+}
+
+/// Assembles the SysEx dumps that backends deliver as several
+/// messages, and that large dumps are split into on reception.
+///
+/// Every part of a dump is passed on as a chunk, without copying
+/// it. Dumps no longer than `max_len` are also passed on whole,
+/// once, after their last chunk. Longer ones are only streamed,
+/// which bounds the memory used to `max_len` per port.
+pub struct SysExAssembler {
+    max_len: usize,
+    /// Indexed by port id.
+    dumps: Vec<Option<SysExDump>>,
+    num_truncated: u64,
+}
+
+impl Default for SysExAssembler {
+    fn default() -> Self {
+        Self::new(Self::DEFAULT_MAX_LEN)
+    }
+}
+
+impl SysExAssembler {
+    pub const DEFAULT_MAX_LEN: usize = 64 * 1024;
+
+    pub fn new(max_len: usize) -> Self {
+        Self {
+            max_len,
+            dumps: vec![],
+            num_truncated: 0,
+        }
+    }
+
+    pub fn max_len(&self) -> usize {
+        self.max_len
+    }
+
+    pub fn set_max_len(&mut self, max_len: usize) {
+        self.max_len = max_len;
+    }
+
+    /// Number of dumps interrupted before their end.
+    pub fn num_truncated(&self) -> u64 {
+        self.num_truncated
+    }
+
+    pub fn push(&mut self, midi: MidiData, mut on_event: impl FnMut(SysExEvent)) {
+        let Some(&status) = midi.bytes.first() else {
+            return on_event(SysExEvent::Message(midi));
+        };
+
+        let port = midi.port as usize;
+        if self.dumps.len() <= port {
+            self.dumps.resize_with(port + 1, || None);
+        }
+
+        let is_start = status == 0xF0;
+        let is_continuation = status < 0x80 || status == 0xF7;
+        let is_realtime = status >= 0xF8;
+
+        if is_realtime || !(is_start || is_continuation) {
+            if !is_realtime && self.dumps[port].take().is_some() {
+                self.num_truncated += 1;
+            }
+            return on_event(SysExEvent::Message(midi));
+        }
+
+        if is_start && self.dumps[port].is_some() {
+            self.num_truncated += 1;
+            self.dumps[port] = None;
+        }
+
+        let is_last = midi.bytes.last() == Some(&0xF7);
+        let max_len = self.max_len;
+
+        if is_start && is_last {
+            on_event(SysExEvent::Chunk(SysExChunk {
+                timestamp: midi.timestamp,
+                port: midi.port,
+                offset: 0,
+                bytes: midi.bytes.clone(),
+                is_last,
+            }));
+
+            if midi.bytes.len() <= max_len {
+                on_event(SysExEvent::Message(midi));
+            }
+            return;
+        }
+
+        let dump = match (is_start, &mut self.dumps[port]) {
+            (true, dump) => dump.insert(SysExDump {
+                timestamp: midi.timestamp,
+                ..Default::default()
+            }),
+            (false, Some(dump)) => dump,
+            (false, None) => return on_event(SysExEvent::Message(midi)),
+        };
+
+        on_event(SysExEvent::Chunk(SysExChunk {
+            timestamp: dump.timestamp,
+            port: midi.port,
+            offset: dump.len,
+            bytes: midi.bytes.clone(),
+            is_last,
+        }));
+
+        dump.len += midi.bytes.len();
+
+        if dump.len > max_len {
+            dump.is_too_long = true;
+            dump.parts.clear();
+        } else {
+            dump.parts.push(midi.bytes);
+        }
+
+        if !is_last {
+            return;
+        }
+
+        if let Some(dump) = self.dumps[port].take().filter(|dump| !dump.is_too_long) {
+            on_event(SysExEvent::Message(MidiData {
+                timestamp: dump.timestamp,
+                port: midi.port,
+                bytes: dump.concat(),
+            }));
+        }
+    }
+}
+
+/// Split a long SysEx message into chunks of at most `SYSEX_CHUNK_LEN`
+/// bytes, the way backends deliver them, leaving other messages whole.
+pub fn split_sysex(bytes: &[u8]) -> impl Iterator<Item = &[u8]> {
+    let chunk_len = match bytes.first() {
+        Some(0xF0) => SYSEX_CHUNK_LEN,
+        _ => bytes.len().max(1),
+    };
+
+    bytes.chunks(chunk_len)
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn sysex(port: MidiPortId, bytes: &[u8]) -> MidiData {
+        MidiData {
+            timestamp: 100,
+            port,
+            bytes: bytes.into(),
+        }
+    }
+
+    fn assemble(assembler: &mut SysExAssembler, messages: &[MidiData]) -> Vec<SysExEvent> {
+        let mut events = vec![];
+        for midi in messages {
+            assembler.push(midi.clone(), |event| events.push(event));
+        }
+        events
+    }
+
+    fn dumps(events: &[SysExEvent]) -> Vec<&[u8]> {
+        events
+            .iter()
+            .filter_map(|event| match event {
+                SysExEvent::Message(midi) => Some(midi.bytes.as_slice()),
+                SysExEvent::Chunk(_) => None,
+            })
+            .collect()
+    }
+
+    fn chunks(events: &[SysExEvent]) -> Vec<(usize, usize, bool)> {
+        events
+            .iter()
+            .filter_map(|event| match event {
+                SysExEvent::Chunk(chunk) => Some((chunk.offset, chunk.bytes.len(), chunk.is_last)),
+                SysExEvent::Message(_) => None,
+            })
+            .collect()
+    }
+
+    #[test]
+    fn passes_whole_dumps_without_copying_them() {
+        let mut assembler = SysExAssembler::default();
+        let dump = sysex(0, &[0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7]);
+        let events = assemble(&mut assembler, &[dump.clone(), sysex(0, &[0x90, 60, 100])]);
+
+        assert_eq!(chunks(&events), [(0, 6, true)]);
+        assert_eq!(dumps(&events), [dump.bytes.as_slice(), &[0x90, 60, 100]]);
+
+        let SysExEvent::Message(ref whole) = events[1] else {
+            panic!("expected the whole dump");
+        };
+        assert!(matches!(
+            (&whole.bytes, &dump.bytes),
+            (MidiBytes::Long(a), MidiBytes::Long(b)) if std::sync::Arc::ptr_eq(a, b)
+        ));
+    }
+
+    #[test]
+    fn assembles_fragments_and_lets_realtime_messages_through() {
+        let mut assembler = SysExAssembler::default();
+        let events = assemble(
+            &mut assembler,
+            &[
+                sysex(1, &[0xF0, 0x43, 0x10]),
+                sysex(0, &[0xF8]),
+                sysex(1, &[0x01, 0x02, 0x03, 0x04]),
+                sysex(1, &[0x05, 0xF7]),
+            ],
+        );
+
+        assert_eq!(
+            chunks(&events),
+            [(0, 3, false), (3, 4, false), (7, 2, true)]
+        );
+        assert_eq!(
+            dumps(&events),
+            [
+                &[0xF8][..],
+                &[0xF0, 0x43, 0x10, 0x01, 0x02, 0x03, 0x04, 0x05, 0xF7]
+            ]
+        );
+    }
+
+    #[test]
+    fn only_streams_dumps_longer_than_the_maximum() {
+        let mut assembler = SysExAssembler::new(8);
+        let long_dump = [&[0xF0][..], &[0x01; 10], &[0xF7]].concat();
+        let messages: Vec<_> = long_dump.chunks(4).map(|bytes| sysex(0, bytes)).collect();
+        let events = assemble(&mut assembler, &messages);
+
+        assert_eq!(chunks(&events).len(), 3);
+        assert!(dumps(&events).is_empty());
+
+        let events = assemble(&mut assembler, &[sysex(0, &long_dump)]);
+        assert_eq!(chunks(&events), [(0, 12, true)]);
+        assert!(dumps(&events).is_empty());
+    }
+
+    /// Data bytes outside of a dump cannot be told apart
+    /// from running status, they are passed on as they are.
+    #[test]
+    fn drops_interrupted_dumps() {
+        let mut assembler = SysExAssembler::default();
+        let events = assemble(
+            &mut assembler,
+            &[
+                sysex(0, &[0xF0, 0x01]),
+                sysex(0, &[0x90, 60, 100]),
+                sysex(0, &[0x02, 0xF7]),
+                sysex(0, &[0xF0, 0x03]),
+                sysex(0, &[0xF0, 0x04, 0xF7]),
+            ],
+        );
+
+        assert_eq!(
+            dumps(&events),
+            [&[0x90, 60, 100][..], &[0x02, 0xF7], &[0xF0, 0x04, 0xF7]]
+        );
+        assert_eq!(assembler.num_truncated(), 2);
+    }
+
+    #[test]
+    fn splits_long_sysex_messages_only() {
+        let dump = [&[0xF0][..], &[0x01; SYSEX_CHUNK_LEN], &[0xF7]].concat();
+        let lens: Vec<_> = split_sysex(&dump).map(<[u8]>::len).collect();
+        assert_eq!(lens, [SYSEX_CHUNK_LEN, 2]);
+
+        assert_eq!(split_sysex(&[0x90, 60, 100]).count(), 1);
+        assert_eq!(split_sysex(&[]).count(), 0);
+    }
+}
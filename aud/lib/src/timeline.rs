@@ -0,0 +1,424 @@
+//! The audio and MIDI received, merged in the order of the shared `clock`.
+//!
+//! Audio is kept in blocks, as it was received, indexed by the time
+//! and the position of their first frame, so that the frames around
+//! a MIDI message can be found without scanning the audio.
+
+use crate::{
+    audio::{AudioBuffer, AudioHistory},
+    midi::MidiData,
+};
+use std::{collections::VecDeque, time::Duration};
+
+/// How much audio and MIDI a timeline keeps, by default.
+pub const DEFAULT_TIMELINE_HORIZON: Duration = Duration::from_secs(5);
+
+/// Frames of audio received at once.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct AudioBlock {
+    /// Time of the first frame, in microseconds.
+    pub timestamp: u64,
+    /// Position of the first frame since the audio was reset.
+    pub first_frame: u64,
+    pub num_frames: u64,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum TimelineEvent<'a> {
+    Audio(AudioBlock),
+    Midi(&'a MidiData),
+}
+
+impl TimelineEvent<'_> {
+    pub fn timestamp(&self) -> u64 {
+        match self {
+            Self::Audio(block) => block.timestamp,
+            Self::Midi(midi) => midi.timestamp,
+        }
+    }
+}
+
+/// Audio blocks and MIDI messages of the last `horizon`, in timestamp order.
+///
+/// Memory is bounded by the horizon: the audio is stored in a circular
+/// history sized for it, and older messages are dropped as newer ones
+/// are pushed. Lookups of a time window are binary searches.
+#[derive(Debug, Clone)]
+pub struct Timeline {
+    horizon: Duration,
+    sample_rate: u32,
+    audio: AudioHistory,
+    blocks: VecDeque<AudioBlock>,
+    /// Number of frames pushed since the audio was reset.
+    num_frames: u64,
+    midi: VecDeque<MidiData>,
+}
+
+impl Default for Timeline {
+    fn default() -> Self {
+        Self::new(DEFAULT_TIMELINE_HORIZON)
+    }
+}
+
+impl Timeline {
+    pub fn new(horizon: Duration) -> Self {
+        Self {
+            horizon,
+            sample_rate: 0,
+            audio: AudioHistory::new(0, 0),
+            blocks: VecDeque::new(),
+            num_frames: 0,
+            midi: VecDeque::new(),
+        }
+    }
+
+    pub fn horizon(&self) -> Duration {
+        self.horizon
+    }
+
+    /// Change how much is kept, which clears the audio.
+    pub fn set_horizon(&mut self, horizon: Duration) {
+        self.horizon = horizon;
+        self.reset_audio(self.audio.num_channels(), self.sample_rate);
+        self.evict();
+    }
+
+    pub fn sample_rate(&self) -> u32 {
+        self.sample_rate
+    }
+
+    /// Clear the audio, to push audio of another format.
+    pub fn reset_audio(&mut self, num_channels: usize, sample_rate: u32) {
+        self.sample_rate = sample_rate;
+        self.audio = AudioHistory::with_duration(num_channels, sample_rate, self.horizon);
+        self.blocks.clear();
+        self.num_frames = 0;
+    }
+
+    pub fn clear(&mut self) {
+        self.audio.clear();
+        self.blocks.clear();
+        self.num_frames = 0;
+        self.midi.clear();
+    }
+
+    /// Append a buffer with as many channels as the audio was reset with.
+    pub fn push_audio(&mut self, audio: &AudioBuffer) {
+        let num_channels = self.audio.num_channels();
+        if num_channels == 0 || audio.num_channels as usize != num_channels {
+            return;
+        }
+
+        let num_frames = (audio.data.len() / num_channels) as u64;
+        if num_frames == 0 {
+            return;
+        }
+
+        self.blocks.push_back(AudioBlock {
+            timestamp: audio.timestamp,
+            first_frame: self.num_frames,
+            num_frames,
+        });
+        self.audio.push(audio);
+        self.num_frames += num_frames;
+        self.evict();
+    }
+
+    /// Insert a message in timestamp order, messages
+    /// are usually pushed in order and simply appended.
+    pub fn push_midi(&mut self, midi: &MidiData) {
+        match self.midi.back() {
+            Some(last) if last.timestamp > midi.timestamp => {
+                let index = self
+                    .midi
+                    .partition_point(|other| other.timestamp <= midi.timestamp);
+                self.midi.insert(index, midi.clone());
+            }
+            _ => self.midi.push_back(midi.clone()),
+        }
+        self.evict();
+    }
+
+    /// Time of the latest audio frame or message, in microseconds.
+    pub fn latest_timestamp(&self) -> Option<u64> {
+        let audio = self
+            .blocks
+            .back()
+            .map(|block| block.timestamp + self.frames_to_micros(block.num_frames));
+        let midi = self.midi.back().map(|midi| midi.timestamp);
+        audio.max(midi)
+    }
+
+    fn evict(&mut self) {
+        let Some(latest) = self.latest_timestamp() else {
+            return;
+        };
+
+        let oldest = latest.saturating_sub(self.horizon.as_micros() as u64);
+        while self
+            .midi
+            .front()
+            .is_some_and(|midi| midi.timestamp < oldest)
+        {
+            self.midi.pop_front();
+        }
+
+        let first_frame = self.first_frame();
+        while self
+            .blocks
+            .front()
+            .is_some_and(|block| block.first_frame + block.num_frames <= first_frame)
+        {
+            self.blocks.pop_front();
+        }
+    }
+
+    /// Position of the oldest frame still in the history.
+    fn first_frame(&self) -> u64 {
+        self.num_frames - self.audio.num_frames() as u64
+    }
+
+    fn frames_to_micros(&self, num_frames: u64) -> u64 {
+        match self.sample_rate {
+            0 => 0,
+            sample_rate => num_frames * 1_000_000 / sample_rate as u64,
+        }
+    }
+
+    fn micros_to_frames(&self, micros: u64) -> u64 {
+        micros * self.sample_rate as u64 / 1_000_000
+    }
+
+    /// Position of the frame captured at `timestamp`, the first frame
+    /// of the next block if it falls between blocks, clamped to the history.
+    fn frame_at(&self, timestamp: u64) -> u64 {
+        let index = self
+            .blocks
+            .partition_point(|block| block.timestamp <= timestamp);
+
+        let frame = match index.checked_sub(1).and_then(|i| self.blocks.get(i)) {
+            Some(block) => {
+                let offset = self.micros_to_frames(timestamp - block.timestamp);
+                block.first_frame + offset.min(block.num_frames)
+            }
+            None => 0,
+        };
+
+        frame.clamp(self.first_frame(), self.num_frames)
+    }
+
+    /// Time of the frame at a position, in microseconds.
+    fn time_of_frame(&self, frame: u64) -> Option<u64> {
+        let index = self
+            .blocks
+            .partition_point(|block| block.first_frame <= frame);
+        let block = self.blocks.get(index.checked_sub(1)?)?;
+        Some(block.timestamp + self.frames_to_micros(frame - block.first_frame))
+    }
+
+    /// Messages with a timestamp from `from` and before `to`.
+    pub fn midi_between(&self, from: u64, to: u64) -> impl Iterator<Item = &MidiData> {
+        let start = self.midi.partition_point(|midi| midi.timestamp < from);
+        let end = self
+            .midi
+            .partition_point(|midi| midi.timestamp < to)
+            .max(start);
+        self.midi.range(start..end)
+    }
+
+    /// Blocks with frames from `from` and before `to`.
+    pub fn audio_blocks_between(&self, from: u64, to: u64) -> impl Iterator<Item = &AudioBlock> {
+        let start = self.blocks.partition_point(|block| {
+            block.timestamp + self.frames_to_micros(block.num_frames) <= from
+        });
+        let end = self
+            .blocks
+            .partition_point(|block| block.timestamp < to)
+            .max(start);
+        self.blocks.range(start..end)
+    }
+
+    /// Audio blocks and messages between `from` and `to`, in timestamp order.
+    /// Messages come first when they have the timestamp of a block.
+    pub fn events_between(&self, from: u64, to: u64) -> impl Iterator<Item = TimelineEvent<'_>> {
+        let mut midi = self.midi_between(from, to).peekable();
+        let mut audio = self.audio_blocks_between(from, to).peekable();
+
+        std::iter::from_fn(move || match (midi.peek(), audio.peek()) {
+            (Some(message), Some(block)) if message.timestamp <= block.timestamp => {
+                midi.next().map(TimelineEvent::Midi)
+            }
+            (_, Some(_)) => audio.next().copied().map(TimelineEvent::Audio),
+            (Some(_), None) => midi.next().map(TimelineEvent::Midi),
+            (None, None) => None,
+        })
+    }
+
+    /// Interleaved frames captured from `from` and before `to`, stamped with
+    /// the time of the first one, or an empty buffer if there are none.
+    pub fn audio_between(&self, from: u64, to: u64) -> AudioBuffer {
+        let (start, end) = (self.frame_at(from), self.frame_at(to));
+        let num_channels = self.audio.num_channels();
+        let mut buffer = AudioBuffer {
+            data: Vec::with_capacity((end - start) as usize * num_channels),
+            num_channels: num_channels as u32,
+            timestamp: 0,
+        };
+
+        let Some(timestamp) = self.time_of_frame(start).filter(|_| start < end) else {
+            return buffer;
+        };
+
+        buffer.timestamp = timestamp;
+        buffer
+            .data
+            .resize((end - start) as usize * num_channels, 0.);
+        for channel in 0..num_channels {
+            let (older, newer) = self
+                .audio
+                .latest(channel, (self.num_frames - start) as usize);
+            let frames = older.iter().chain(newer).take((end - start) as usize);
+            for (frame, sample) in frames.enumerate() {
+                buffer.data[frame * num_channels + channel] = *sample;
+            }
+        }
+
+        buffer
+    }
+
+    /// Audio captured from `before` until `after` a time,
+    /// e.g. the sound played by a synthesizer around a note on.
+    pub fn audio_around(&self, timestamp: u64, before: Duration, after: Duration) -> AudioBuffer {
+        self.audio_between(
+            timestamp.saturating_sub(before.as_micros() as u64),
+            timestamp + after.as_micros() as u64,
+        )
+    }
+
+    /// Time of the first frame at or after `timestamp`, and within
+    /// `within` of it, of which a channel reaches `threshold`.
+    pub fn onset_after(&self, timestamp: u64, threshold: f32, within: Duration) -> Option<u64> {
+        let start = self.frame_at(timestamp);
+        let end = self.frame_at(timestamp + within.as_micros() as u64);
+
+        let onset = (0..self.audio.num_channels())
+            .filter_map(|channel| {
+                let (older, newer) = self
+                    .audio
+                    .latest(channel, (self.num_frames - start) as usize);
+                older
+                    .iter()
+                    .chain(newer)
+                    .take((end - start) as usize)
+                    .position(|sample| sample.abs() >= threshold)
+            })
+            .min()?;
+
+        self.time_of_frame(start + onset as u64)
+    }
+
+    /// Delay from `timestamp` until the audio reaches `threshold`,
+    /// e.g. from a note on sent to a synthesizer to its sound.
+    pub fn latency_after(
+        &self,
+        timestamp: u64,
+        threshold: f32,
+        within: Duration,
+    ) -> Option<Duration> {
+        self.onset_after(timestamp, threshold, within)
+            .map(|onset| Duration::from_micros(onset.saturating_sub(timestamp)))
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn note_on(timestamp: u64) -> MidiData {
+        MidiData {
+            timestamp,
+            port: 0,
+            bytes: [0x90, 60, 100].into(),
+        }
+    }
+
+    /// Blocks of 10 frames at 1kHz, so 10ms long, of which
+    /// the samples are the position of their frame.
+    fn push_blocks(timeline: &mut Timeline, blocks: std::ops::Range<u64>) {
+        for block in blocks {
+            timeline.push_audio(&AudioBuffer {
+                data: (block * 10..block * 10 + 10)
+                    .map(|frame| frame as f32)
+                    .collect(),
+                num_channels: 1,
+                timestamp: block * 10_000,
+            });
+        }
+    }
+
+    #[test]
+    fn looks_up_the_audio_and_midi_of_a_window() {
+        let mut timeline = Timeline::new(Duration::from_millis(100));
+        timeline.reset_audio(1, 1_000);
+        push_blocks(&mut timeline, 0..5);
+        timeline.push_midi(&note_on(25_000));
+        timeline.push_midi(&note_on(5_000));
+
+        let events: Vec<_> = timeline
+            .events_between(0, 20_000)
+            .map(|event| event.timestamp())
+            .collect();
+        assert_eq!(events, [0, 5_000, 10_000]);
+
+        let audio =
+            timeline.audio_around(25_000, Duration::from_millis(2), Duration::from_millis(3));
+        assert_eq!(audio.timestamp, 23_000);
+        assert_eq!(audio.data, [23., 24., 25., 26., 27.]);
+
+        // only the last 100ms are kept
+        push_blocks(&mut timeline, 5..15);
+        assert_eq!(timeline.midi_between(0, u64::MAX).count(), 0);
+        assert_eq!(
+            timeline.audio_between(0, 60_000).data,
+            (50..60).map(|f| f as f32).collect::<Vec<_>>()
+        );
+        assert_eq!(timeline.audio_blocks_between(0, u64::MAX).count(), 10);
+    }
+
+    #[test]
+    fn measures_the_delay_until_the_audio_reaches_a_threshold() {
+        let mut timeline = Timeline::default();
+        timeline.reset_audio(2, 1_000);
+        timeline.push_midi(&note_on(12_000));
+
+        for block in 0..4u64 {
+            let mut data = vec![0.; 20];
+            if block == 2 {
+                // frame 27 on the second channel, 15ms after the note
+                data[7 * 2 + 1] = -0.8;
+            }
+            timeline.push_audio(&AudioBuffer {
+                data,
+                num_channels: 2,
+                timestamp: block * 10_000,
+            });
+        }
+
+        assert_eq!(
+            timeline.onset_after(12_000, 0.5, Duration::from_millis(50)),
+            Some(27_000)
+        );
+        assert_eq!(
+            timeline.latency_after(12_000, 0.5, Duration::from_millis(50)),
+            Some(Duration::from_millis(15))
+        );
+        assert_eq!(
+            timeline.latency_after(12_000, 0.5, Duration::from_millis(10)),
+            None
+        );
+        assert_eq!(
+            timeline.latency_after(12_000, 0.9, Duration::from_millis(50)),
+            None
+        );
+    }
+}
@@ -19,3 +19,60 @@ function resume() end
 
 -- Request to stop the application
 function stop() end
+
+-- Call `callback` once, after `ms` milliseconds
+--
+-- @return number: Timer id, see `cancel`
+function after(ms, callback) end
+
+-- Call `callback` every `ms` milliseconds
+--
+-- @return number: Timer id, see `cancel`
+function every(ms, callback) end
+
+-- Cancel a timer created with `after` or `every`
+function cancel(timer_id) end
+
+-- Run `func` as a coroutine, in which `sleep` can be used
+function spawn(func) end
+
+-- Suspend the current coroutine for `ms` milliseconds.
+-- Only available in `spawn`, `after` and `every` callbacks
+function sleep(ms) end
+
+-- Time of the engine, in milliseconds on the clock the
+-- MIDI messages and audio received are stamped with
+function now() end
+
+-- Publish the latest value of a series, shown in the telemetry pane
+function scalar(name, value) end
+
+-- Append a value to a series plotted in the telemetry pane
+function plot(name, value) end
+
+-- Count a value in a histogram shown in the telemetry pane.
+-- The range and number of bins are set by the first value.
+--
+-- @param min number: Lower bound of the histogram, inclusive
+-- @param max number: Upper bound of the histogram, exclusive
+-- @param num_bins number: Number of bins, 32 if nil, at most 4096
+function histogram(name, value, min, max, num_bins) end
+
+-- MIDI messages received from `from` and before `to`, in milliseconds
+-- as returned by `now`, among the last seconds kept by the host
+--
+-- @return table: A list of `{ time, bytes }`, in time order
+function midi_between(from, to) end
+
+-- Audio received from `before` until `after` milliseconds around a time,
+-- e.g. the sound of a synthesizer around the note on it was sent, or nil
+-- if no audio was received then
+--
+-- @return table: `{ time, channels }`, `time` being the time of the
+--                first frame and `channels` a list of sample lists
+function audio_around(time, before, after) end
+
+-- Milliseconds from a time until a channel of the audio reaches
+-- `threshold`, in absolute value, or nil if it does not within
+-- `within` milliseconds, e.g. the delay of a synthesizer
+function latency(time, threshold, within) end
@@ -10,7 +10,8 @@ function on_start() end
 -- @param device_names string list: Names of the discovered MIDI devices
 function on_discover(device_names) end
 
--- Called when a MIDI connection is made
+-- Called when a MIDI connection is made, once for every
+-- device since several devices can be connected at once
 --
 -- @param device_name string: Name of the MIDI device we've just connected to
 function on_connect(device_name) end
@@ -22,5 +23,15 @@ function on_connect(device_name) end
 -- @return bool: Should this message be displayed?
 function on_midi(device_name, bytes) end
 
+-- Called for every part of a SysEx dump, in order, as it is received.
+-- Dumps no longer than the maximum SysEx length are then passed whole
+-- to `on_midi`, longer ones are only passed in parts.
+--
+-- @param device_name string: Name of the MIDI device sending this dump
+-- @param bytes table: The bytes of this part of the dump.
+-- @param offset number: Number of bytes of the dump before this part
+-- @param is_last bool: Is this the last part of the dump?
+function on_sysex_chunk(device_name, bytes, offset, is_last) end
+
 -- Called when `aud` is stopping
 function on_stop() end
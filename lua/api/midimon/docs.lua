@@ -11,6 +11,23 @@ function connect(device_name) end
 -- @return string: Alert message
 function alert(message) end
 
+-- Route MIDI from an input device to an output device, directly
+-- from the MIDI thread. Call it when the script is loaded, the
+-- routes replace the ones of the previously loaded script.
+--
+-- @param route table: {
+--     from = "Keystep",        -- input device, every input if nil
+--     to = "IAC Bus 1",        -- output device
+--     channels = { 1, 2 },     -- input channels, every channel if nil
+--     messages = { "note_on", "note_off" }, -- kinds of messages, every kind if nil,
+--                              -- among those of `aud.midi` headers and "system"
+--     channel = 10,            -- output channel, the input channel if nil
+--     transpose = -12,         -- semitones added to the notes
+--     curve = 0.5,             -- velocity exponent, below 1 is louder
+--     velocity = 100,          -- fixed velocity, overrides `curve`
+-- }
+function route(route) end
+
 -- Pause the stream
 function pause() end
 
@@ -19,3 +36,78 @@ function resume() end
 
 -- Request to stop the application
 function stop() end
+
+-- Call `callback` once, after `ms` milliseconds
+--
+-- @return number: Timer id, see `cancel`
+function after(ms, callback) end
+
+-- Call `callback` every `ms` milliseconds
+--
+-- @return number: Timer id, see `cancel`
+function every(ms, callback) end
+
+-- Cancel a timer created with `after` or `every`
+function cancel(timer_id) end
+
+-- Run `func` as a coroutine, in which `sleep` can be used
+function spawn(func) end
+
+-- Suspend the current coroutine for `ms` milliseconds.
+-- Only available in `spawn`, `after` and `every` callbacks
+function sleep(ms) end
+
+-- Time of the engine, in milliseconds on the clock the
+-- MIDI messages and audio received are stamped with
+function now() end
+
+-- Publish the latest value of a series, shown in the telemetry pane
+function scalar(name, value) end
+
+-- Append a value to a series plotted in the telemetry pane
+function plot(name, value) end
+
+-- Count a value in a histogram shown in the telemetry pane.
+-- The range and number of bins are set by the first value.
+--
+-- @param min number: Lower bound of the histogram, inclusive
+-- @param max number: Upper bound of the histogram, exclusive
+-- @param num_bins number: Number of bins, 32 if nil, at most 4096
+function histogram(name, value, min, max, num_bins) end
+
+-- Statistics of the messages received from a MIDI device since it
+-- first connected, or nil if it never connected. For every kind of
+-- message (`note_off`, `note_on`, `poly_pressure`, `controller`,
+-- `program_change`, `channel_pressure`, `pitch_bend` and `system`):
+--
+--   count     : number of messages
+--   rate      : messages per second since the previous call for this device
+--   channels  : number of messages on each channel, 1 to 16
+--   intervals : histogram of the time between messages, entry `i` counting
+--               the intervals from 2^(i-2) up to 2^(i-1) microseconds
+--
+-- Along with `messages`, `sysex_bytes`, `running_status` (messages received
+-- without a status byte), `repeated_status` (messages that could have used
+-- running status) and `busiest_controls` (a list of `{ control, count }`).
+--
+-- @return table: The statistics of the device
+function midi_stats(device_name) end
+
+-- MIDI messages received from `from` and before `to`, in milliseconds
+-- as returned by `now`, among the last seconds kept by the host
+--
+-- @return table: A list of `{ time, bytes }`, in time order
+function midi_between(from, to) end
+
+-- Audio received from `before` until `after` milliseconds around a time,
+-- e.g. the sound of a synthesizer around the note on it was sent, or nil
+-- if no audio was received then
+--
+-- @return table: `{ time, channels }`, `time` being the time of the
+--                first frame and `channels` a list of sample lists
+function audio_around(time, before, after) end
+
+-- Milliseconds from a time until a channel of the audio reaches
+-- `threshold`, in absolute value, or nil if it does not within
+-- `within` milliseconds, e.g. the delay of a synthesizer
+function latency(time, threshold, within) end
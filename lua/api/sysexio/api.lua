@@ -9,6 +9,9 @@ function list_commands(device) end
 -- @param device string: The name of the MIDI device for which the SysEx commands are intended.
 -- @param command string: The name of the SysEx command to build
 -- @param args table: A table of named arguments that will be encoded in the SysEx command
+-- @return table: The bytes of the command, or nil to send the bytes listed by `list_commands`
+-- @return table: The first bytes of the response, which defaults to the manufacturer id
+--                of the command, or false if the device does not respond to it
 function build_command(device, command, args) end
 
 -- Parse a SysEx response